@@ -74,6 +74,17 @@
 #define CORK_CONFIG_HAVE_GCC_STATEMENT_EXPRS  0
 #endif
 
+/* Function-specific target options, which let us compile SIMD code paths that
+ * we choose between at runtime using __builtin_cpu_supports, are available
+ * on x86 as of GCC 4.9. */
+
+#if (CORK_CONFIG_ARCH_X86 || CORK_CONFIG_ARCH_X64) && \
+    (CORK_CONFIG_GCC_VERSION >= 40900 || defined(__clang__))
+#define CORK_CONFIG_HAVE_GCC_TARGET_ATTRIBUTE  1
+#else
+#define CORK_CONFIG_HAVE_GCC_TARGET_ATTRIBUTE  0
+#endif
+
 /* Thread-local storage has been available since GCC 3.3, but not on Mac
  * OS X. */
 
@@ -29,6 +29,9 @@
 
 #define CORK_HAVE_REALLOCF  0
 #define CORK_HAVE_PTHREADS  1
+#define CORK_HAVE_FALLOCATE  1
+#define CORK_HAVE_FDATASYNC  1
+#define CORK_HAVE_MREMAP  1
 
 
 #endif /* LIBCORK_CONFIG_LINUX_H */
@@ -29,6 +29,9 @@
 
 #define CORK_HAVE_REALLOCF  1
 #define CORK_HAVE_PTHREADS  1
+#define CORK_HAVE_FALLOCATE  0
+#define CORK_HAVE_FDATASYNC  0
+#define CORK_HAVE_MREMAP  0
 
 
 #endif /* LIBCORK_CONFIG_MACOSX_H */
@@ -21,7 +21,38 @@
 #define CORK_MEMPOOL_DEFAULT_BLOCK_SIZE  4096
 
 
-struct cork_mempool;
+struct cork_mempool_block;
+
+/* These fields are private; they're only visible here so that the object
+ * allocation fast paths can be inlined. */
+struct cork_mempool {
+    size_t  element_size;
+    size_t  block_size;
+    /* The size of each object's header.  This is zero for compact pools,
+     * which store the free list link in the object itself. */
+    size_t  header_size;
+    /* The distance between consecutive objects in a block */
+    size_t  object_size;
+    /* Every object's address is a multiple of this */
+    size_t  alignment;
+    struct cork_mempool_object  *free_list;
+    /* The number of objects that have been given out by
+     * cork_mempool_new but not returned via cork_mempool_free. */
+    size_t  allocated_count;
+    struct cork_mempool_block  *blocks;
+
+    void  *user_data;
+    cork_free_f  free_user_data;
+    cork_init_f  init_object;
+    cork_done_f  done_object;
+};
+
+struct cork_mempool_object {
+    /* When this object is unclaimed, it will be in the cork_mempool
+     * object's free_list using this pointer.  In a compact pool, this
+     * overlaps the start of the object's contents. */
+    struct cork_mempool_object  *next_free;
+};
 
 
 CORK_API struct cork_mempool *
@@ -37,6 +68,41 @@ cork_mempool_new_size_ex(size_t element_size, size_t block_size);
 #define cork_mempool_new(type) \
     (cork_mempool_new_size(sizeof(type)))
 
+/* Every object's address will be a multiple of alignment, which must be a
+ * power of 2. */
+CORK_API struct cork_mempool *
+cork_mempool_new_aligned_size_ex(size_t element_size, size_t block_size,
+                                 size_t alignment);
+
+#define cork_mempool_new_aligned(type, alignment) \
+    (cork_mempool_new_aligned_size_ex \
+     (sizeof(type), CORK_MEMPOOL_DEFAULT_BLOCK_SIZE, (alignment)))
+
+
+/* A compact pool doesn't give each object a header; instead, it stores the
+ * free list link inside of each object while it's unclaimed.  You can't use
+ * init_object or done_object callbacks with a compact pool. */
+CORK_API struct cork_mempool *
+cork_mempool_new_compact_size_ex(size_t element_size, size_t block_size);
+
+#define cork_mempool_new_compact_size(element_size) \
+    (cork_mempool_new_compact_size_ex \
+     ((element_size), CORK_MEMPOOL_DEFAULT_BLOCK_SIZE))
+
+#define cork_mempool_new_compact_ex(type, block_size) \
+    (cork_mempool_new_compact_size_ex(sizeof(type), (block_size)))
+
+#define cork_mempool_new_compact(type) \
+    (cork_mempool_new_compact_size(sizeof(type)))
+
+CORK_API struct cork_mempool *
+cork_mempool_new_compact_aligned_size_ex(size_t element_size,
+                                         size_t block_size, size_t alignment);
+
+#define cork_mempool_new_compact_aligned(type, alignment) \
+    (cork_mempool_new_compact_aligned_size_ex \
+     (sizeof(type), CORK_MEMPOOL_DEFAULT_BLOCK_SIZE, (alignment)))
+
 CORK_API void
 cork_mempool_free(struct cork_mempool *mp);
 
@@ -56,4 +122,32 @@ CORK_API void
 cork_mempool_free_object(struct cork_mempool *mp, void *ptr);
 
 
+/* Inline versions of cork_mempool_new_object and cork_mempool_free_object,
+ * which only call into the library when a new block is needed. */
+
+CORK_ATTR_UNUSED
+static inline void *
+cork_mempool_new_object_fast(struct cork_mempool *mp)
+{
+    struct cork_mempool_object  *obj = mp->free_list;
+    if (CORK_LIKELY(obj != NULL)) {
+        mp->free_list = obj->next_free;
+        mp->allocated_count++;
+        return ((char *) obj) + mp->header_size;
+    }
+    return cork_mempool_new_object(mp);
+}
+
+CORK_ATTR_UNUSED
+static inline void
+cork_mempool_free_object_fast(struct cork_mempool *mp, void *ptr)
+{
+    struct cork_mempool_object  *obj =
+        (struct cork_mempool_object *) (((char *) ptr) - mp->header_size);
+    obj->next_free = mp->free_list;
+    mp->free_list = obj;
+    mp->allocated_count--;
+}
+
+
 #endif /* LIBCORK_CORK_MEMPOOL_H */
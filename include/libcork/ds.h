@@ -15,12 +15,28 @@
 
 #include <libcork/ds/array.h>
 #include <libcork/ds/bitset.h>
+#include <libcork/ds/bloom-filter.h>
 #include <libcork/ds/buffer.h>
+#include <libcork/ds/buffer-pool.h>
+#include <libcork/ds/cache.h>
+#include <libcork/ds/compression.h>
+#include <libcork/ds/csv.h>
+#include <libcork/ds/cuckoo-filter.h>
+#include <libcork/ds/deque.h>
 #include <libcork/ds/dllist.h>
+#include <libcork/ds/encoding.h>
+#include <libcork/ds/framing.h>
 #include <libcork/ds/hash-table.h>
+#include <libcork/ds/json-writer.h>
 #include <libcork/ds/managed-buffer.h>
+#include <libcork/ds/number.h>
 #include <libcork/ds/ring-buffer.h>
+#include <libcork/ds/serializer.h>
+#include <libcork/ds/sketch.h>
+#include <libcork/ds/skip-list.h>
 #include <libcork/ds/slice.h>
+#include <libcork/ds/slist.h>
+#include <libcork/ds/slot-map.h>
 #include <libcork/ds/stream.h>
 
 #endif /* LIBCORK_DS_H */
@@ -12,6 +12,7 @@
 
 
 #include <libcork/core/api.h>
+#include <libcork/core/attributes.h>
 #include <libcork/core/callbacks.h>
 #include <libcork/core/types.h>
 
@@ -20,7 +21,24 @@
  * Resizable arrays
  */
 
-struct cork_array_priv;
+/* These fields are private; they're only visible here so that the append
+ * fast path can be inlined. */
+struct cork_array_priv {
+    size_t  allocated_count;
+    size_t  allocated_size;
+    size_t  element_size;
+    /* Not maintained while the array is in POD mode. */
+    size_t  initialized_count;
+    /* Whether the array has no callbacks, so that its elements can be copied
+     * and discarded with plain memory operations. */
+    bool  pod;
+    void  *user_data;
+    cork_free_f  free_user_data;
+    cork_init_f  init;
+    cork_done_f  done;
+    cork_init_f  reuse;
+    cork_done_f  remove;
+};
 
 struct cork_raw_array {
     void  *items;
@@ -74,6 +92,30 @@ cork_raw_array_ensure_size(struct cork_raw_array *array, size_t count);
 CORK_API void *
 cork_raw_array_append(struct cork_raw_array *array);
 
+/* Appends count elements, copied from src. */
+CORK_API void *
+cork_raw_array_append_n(struct cork_raw_array *array,
+                        const void *src, size_t count);
+
+CORK_API bool
+cork_raw_array_is_pod(const struct cork_raw_array *array);
+
+#define cork_raw_array_has_room_pod(array) \
+    ((array)->priv->pod && (array)->size < (array)->priv->allocated_count)
+
+/* If the array is in POD mode and has room for another element, we don't have
+ * to call out to cork_raw_array_append. */
+CORK_ATTR_UNUSED
+static inline void *
+cork_raw_array_append_fast(struct cork_raw_array *array)
+{
+    if (CORK_LIKELY(cork_raw_array_has_room_pod(array))) {
+        return ((char *) array->items) +
+               (array->priv->element_size * array->size++);
+    }
+    return cork_raw_array_append(array);
+}
+
 CORK_API int
 cork_raw_array_copy(struct cork_raw_array *dest,
                     const struct cork_raw_array *src,
@@ -122,13 +164,23 @@ cork_raw_array_copy(struct cork_raw_array *dest,
 #define cork_array_ensure_size(arr, count) \
     (cork_raw_array_ensure_size(cork_array_to_raw(arr), (count)))
 
+#define cork_array_is_pod(arr) \
+    (cork_raw_array_is_pod(cork_array_to_raw(arr)))
+
 #define cork_array_append(arr, element) \
-    (cork_raw_array_append(cork_array_to_raw(arr)), \
-     ((arr)->items[(arr)->size - 1] = (element), (void) 0))
+    (CORK_LIKELY(cork_raw_array_has_room_pod(arr))? \
+     ((arr)->size++, (arr)->items[(arr)->size - 1] = (element), (void) 0): \
+     (cork_raw_array_append(cork_array_to_raw(arr)), \
+      (arr)->items[(arr)->size - 1] = (element), (void) 0))
 
 #define cork_array_append_get(arr) \
-    (cork_raw_array_append(cork_array_to_raw(arr)), \
-     &(arr)->items[(arr)->size - 1])
+    (CORK_LIKELY(cork_raw_array_has_room_pod(arr))? \
+     &(arr)->items[(arr)->size++]: \
+     (cork_raw_array_append(cork_array_to_raw(arr)), \
+      &(arr)->items[(arr)->size - 1]))
+
+#define cork_array_append_n(arr, src, count) \
+    (cork_raw_array_append_n(cork_array_to_raw(arr), (src), (count)))
 
 
 /*-----------------------------------------------------------------------
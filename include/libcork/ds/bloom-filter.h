@@ -0,0 +1,86 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_BLOOM_FILTER_H
+#define LIBCORK_DS_BLOOM_FILTER_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/hash.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/bloom-filter.h" */
+#define CORK_BLOOM_FILTER_ERROR  0xd9695640
+
+enum cork_bloom_filter_error {
+    /* A serialized filter is corrupt or was created on an incompatible
+     * platform */
+    CORK_BLOOM_FILTER_INVALID
+};
+
+
+/*-----------------------------------------------------------------------
+ * Blocked Bloom filters
+ */
+
+struct cork_bloom_filter;
+
+CORK_API struct cork_bloom_filter *
+cork_bloom_filter_new(size_t expected_count, double false_positive_rate);
+
+CORK_API void
+cork_bloom_filter_free(struct cork_bloom_filter *filter);
+
+CORK_API void
+cork_bloom_filter_clear(struct cork_bloom_filter *filter);
+
+/* The number of hash bits set for each element, and the total size of the
+ * filter's bit array. */
+CORK_API unsigned int
+cork_bloom_filter_hash_count(const struct cork_bloom_filter *filter);
+
+CORK_API size_t
+cork_bloom_filter_byte_size(const struct cork_bloom_filter *filter);
+
+
+CORK_API void
+cork_bloom_filter_add_hash(struct cork_bloom_filter *filter,
+                           cork_big_hash hash);
+
+CORK_API bool
+cork_bloom_filter_contains_hash(const struct cork_bloom_filter *filter,
+                                cork_big_hash hash);
+
+CORK_API void
+cork_bloom_filter_add(struct cork_bloom_filter *filter,
+                      const void *src, size_t len);
+
+CORK_API bool
+cork_bloom_filter_contains(const struct cork_bloom_filter *filter,
+                           const void *src, size_t len);
+
+
+/* Appends a serialized copy of the filter to dest. */
+CORK_API void
+cork_bloom_filter_save(const struct cork_bloom_filter *filter,
+                       struct cork_buffer *dest);
+
+/* Creates a filter that uses a serialized copy in place, without copying it.
+ * src must be 8-byte aligned, and must outlive the filter. */
+CORK_API struct cork_bloom_filter *
+cork_bloom_filter_new_from_bytes(void *src, size_t size);
+
+
+#endif /* LIBCORK_DS_BLOOM_FILTER_H */
@@ -0,0 +1,60 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_BUFFER_POOL_H
+#define LIBCORK_DS_BUFFER_POOL_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+#include <libcork/ds/managed-buffer.h>
+
+
+/*-----------------------------------------------------------------------
+ * Buffer pools
+ */
+
+/* Buffers whose capacity is larger than this are freed when they're
+ * released, rather than being kept in the pool. */
+#define CORK_BUFFER_POOL_MAX_SIZE  (1024 * 1024)
+
+struct cork_buffer_pool;
+
+/* The pool keeps at most max_retained bytes of buffers in its shared free
+ * lists.  Each thread can also cache a few buffers of each size. */
+CORK_API struct cork_buffer_pool *
+cork_buffer_pool_new(size_t max_retained);
+
+CORK_API void
+cork_buffer_pool_free(struct cork_buffer_pool *pool);
+
+/* Returns an empty buffer that can hold at least size bytes (plus a NUL
+ * terminator) without growing. */
+CORK_API struct cork_buffer *
+cork_buffer_pool_acquire(struct cork_buffer_pool *pool, size_t size);
+
+/* buffer must have come from cork_buffer_pool_acquire on some pool. */
+CORK_API void
+cork_buffer_pool_release(struct cork_buffer_pool *pool,
+                         struct cork_buffer *buffer);
+
+/* Wraps a buffer from cork_buffer_pool_acquire in a managed buffer, which
+ * takes over the caller's ownership of it.  The buffer is released back into
+ * pool when the last reference to the managed buffer is dropped. */
+CORK_API struct cork_managed_buffer *
+cork_buffer_pool_to_managed_buffer(struct cork_buffer_pool *pool,
+                                   struct cork_buffer *buffer);
+
+/* The number of bytes of buffers in the pool's shared free lists. */
+CORK_API size_t
+cork_buffer_pool_retained(struct cork_buffer_pool *pool);
+
+
+#endif /* LIBCORK_DS_BUFFER_POOL_H */
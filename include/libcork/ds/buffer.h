@@ -13,6 +13,7 @@
 
 
 #include <stdarg.h>
+#include <string.h>
 
 #include <libcork/core/api.h>
 #include <libcork/core/attributes.h>
@@ -49,6 +50,10 @@ cork_buffer_equal(const struct cork_buffer *buffer1,
                   const struct cork_buffer *buffer2);
 
 
+/* On platforms with mremap, buffers at least this large are allocated
+ * directly with mmap, so that they can grow without copying. */
+#define CORK_BUFFER_LARGE_SIZE  (16 * 1024 * 1024)
+
 CORK_API void
 cork_buffer_ensure_size(struct cork_buffer *buffer, size_t desired_size);
 
@@ -79,6 +84,22 @@ cork_buffer_set(struct cork_buffer *buffer, const void *src, size_t length);
 CORK_API void
 cork_buffer_append(struct cork_buffer *buffer, const void *src, size_t length);
 
+/* An inline version of cork_buffer_append, which only calls into the library
+ * when the buffer needs to grow. */
+CORK_ATTR_UNUSED
+static inline void
+cork_buffer_append_fast(struct cork_buffer *buffer,
+                        const void *src, size_t length)
+{
+    if (CORK_LIKELY(buffer->size + length < buffer->allocated_size)) {
+        memcpy(((char *) buffer->buf) + buffer->size, src, length);
+        buffer->size += length;
+        ((char *) buffer->buf)[buffer->size] = '\0';
+    } else {
+        cork_buffer_append(buffer, src, length);
+    }
+}
+
 
 CORK_API void
 cork_buffer_set_string(struct cork_buffer *buffer, const char *str);
@@ -0,0 +1,96 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_CACHE_H
+#define LIBCORK_DS_CACHE_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/callbacks.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/hash-table.h>
+
+
+/*-----------------------------------------------------------------------
+ * Bounded caches
+ */
+
+enum cork_cache_policy {
+    /* Evict the least recently used entry. */
+    CORK_CACHE_LRU,
+    /* Approximate LRU with a reference bit per entry ("second chance"). */
+    CORK_CACHE_CLOCK,
+    /* Scan-resistant S3-FIFO: a small probationary FIFO, a main FIFO, and a
+     * ghost FIFO of recently evicted hashes. */
+    CORK_CACHE_S3FIFO
+};
+
+/* Called whenever the cache gives up ownership of an entry that the caller
+ * didn't ask to get back. */
+typedef void
+(*cork_cache_evict_f)(void *user_data, void *key, void *value);
+
+struct cork_cache;
+
+
+CORK_API struct cork_cache *
+cork_cache_new(enum cork_cache_policy policy,
+               size_t max_count, size_t max_bytes,
+               cork_hash_table_hasher hasher,
+               cork_hash_table_comparator comparator);
+
+CORK_API struct cork_cache *
+cork_cache_new_sharded(size_t shard_count, enum cork_cache_policy policy,
+                       size_t max_count, size_t max_bytes,
+                       cork_hash_table_hasher hasher,
+                       cork_hash_table_comparator comparator);
+
+CORK_API void
+cork_cache_free(struct cork_cache *cache);
+
+CORK_API void
+cork_cache_set_callbacks(struct cork_cache *cache,
+                         void *user_data, cork_free_f free_user_data,
+                         cork_cache_evict_f evict);
+
+
+CORK_API void
+cork_cache_clear(struct cork_cache *cache);
+
+CORK_API size_t
+cork_cache_size(const struct cork_cache *cache);
+
+CORK_API size_t
+cork_cache_bytes(const struct cork_cache *cache);
+
+
+/* In a sharded cache, the result is only valid until another thread puts an
+ * entry into the same shard, since that can evict it.  Use
+ * cork_cache_visit to look at the value while the cache still owns it. */
+CORK_API void *
+cork_cache_get(struct cork_cache *cache, const void *key);
+
+/* Called with the key and value while the entry's shard is locked. */
+typedef void
+(*cork_cache_visit_f)(void *user_data, void *key, void *value);
+
+CORK_API bool
+cork_cache_visit(struct cork_cache *cache, const void *key,
+                 void *user_data, cork_cache_visit_f visit);
+
+CORK_API void
+cork_cache_put(struct cork_cache *cache, void *key, void *value, size_t size,
+               bool *is_new, void **old_key, void **old_value);
+
+CORK_API bool
+cork_cache_delete(struct cork_cache *cache, const void *key,
+                  void **deleted_key, void **deleted_value);
+
+
+#endif /* LIBCORK_DS_CACHE_H */
@@ -0,0 +1,76 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_COMPRESSION_H
+#define LIBCORK_DS_COMPRESSION_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/stream.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/compression.h" */
+#define CORK_COMPRESSION_ERROR  0x80ce278c
+
+enum cork_compression_error {
+    /* The compressed data is malformed or truncated */
+    CORK_COMPRESSION_INVALID,
+    /* A block's contents don't match its checksum */
+    CORK_COMPRESSION_CHECKSUM
+};
+
+
+/*-----------------------------------------------------------------------
+ * Blocks
+ */
+
+/* The largest block that the stream compressor will create.  Matches can
+ * only refer back this far. */
+#define CORK_LZ_MAX_BLOCK_SIZE  65536
+
+/* The most space needed to compress size bytes. */
+#define cork_lz_compress_bound(size) \
+    ((size) + ((size) / 255) + 16)
+
+/* Compresses src into dest, which must have room for at least
+ * cork_lz_compress_bound(src_size) bytes.  Returns the size of the
+ * compressed data. */
+CORK_API size_t
+cork_lz_compress_block(const void *src, size_t src_size, void *dest);
+
+/* Decompresses src into dest, which can hold at most dest_size bytes.
+ * Returns the size of the decompressed data, or -1 if src is malformed or
+ * doesn't fit into dest. */
+CORK_API ssize_t
+cork_lz_decompress_block(const void *src, size_t src_size,
+                         void *dest, size_t dest_size);
+
+
+/*-----------------------------------------------------------------------
+ * Stream consumers
+ */
+
+/* Compresses everything it receives, and passes the compressed frame along
+ * to dest.  If checksum is true, each block includes a checksum of its
+ * uncompressed contents.  Takes control of dest. */
+CORK_API struct cork_stream_consumer *
+cork_lz_compressor_new(struct cork_stream_consumer *dest, bool checksum);
+
+/* Decompresses everything it receives, and passes the uncompressed data
+ * along to dest.  Takes control of dest. */
+CORK_API struct cork_stream_consumer *
+cork_lz_decompressor_new(struct cork_stream_consumer *dest);
+
+
+#endif /* LIBCORK_DS_COMPRESSION_H */
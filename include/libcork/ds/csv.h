@@ -0,0 +1,63 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_CSV_H
+#define LIBCORK_DS_CSV_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/callbacks.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/slice.h>
+#include <libcork/ds/stream.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/csv.h" */
+#define CORK_CSV_ERROR  0xc158c91f
+
+enum cork_csv_error {
+    /* The input isn't validly quoted */
+    CORK_CSV_INVALID
+};
+
+
+/*-----------------------------------------------------------------------
+ * CSV and TSV tokenizers
+ */
+
+/* The most rows that we'll pass to the callback at once. */
+#define CORK_CSV_BATCH_SIZE  256
+
+struct cork_csv_row {
+    struct cork_slice  *fields;
+    size_t  field_count;
+};
+
+/* Called with each batch of complete rows.  The rows and their fields are
+ * only valid until the callback returns. */
+typedef int
+(*cork_csv_rows_f)(void *user_data,
+                   const struct cork_csv_row *rows, size_t row_count);
+
+/* Returns a stream consumer that splits its input into rows and fields.
+ * Fields are separated by delimiter, and rows by newlines.  If quote isn't
+ * '\0', fields can be quoted, and a doubled quote within a quoted field
+ * stands for a single quote character.  delimiter and quote must be
+ * different, and neither can be a newline. */
+CORK_API struct cork_stream_consumer *
+cork_csv_consumer_new(char delimiter, char quote,
+                      void *user_data, cork_free_f free_user_data,
+                      cork_csv_rows_f rows);
+
+
+#endif /* LIBCORK_DS_CSV_H */
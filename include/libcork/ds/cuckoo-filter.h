@@ -0,0 +1,94 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_CUCKOO_FILTER_H
+#define LIBCORK_DS_CUCKOO_FILTER_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/hash.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/cuckoo-filter.h" */
+#define CORK_CUCKOO_FILTER_ERROR  0xe7967a8f
+
+enum cork_cuckoo_filter_error {
+    /* The filter doesn't have room for another element */
+    CORK_CUCKOO_FILTER_FULL,
+    /* A serialized filter is corrupt or was created on an incompatible
+     * platform */
+    CORK_CUCKOO_FILTER_INVALID
+};
+
+
+/*-----------------------------------------------------------------------
+ * Cuckoo filters
+ */
+
+struct cork_cuckoo_filter;
+
+CORK_API struct cork_cuckoo_filter *
+cork_cuckoo_filter_new(size_t expected_count);
+
+CORK_API void
+cork_cuckoo_filter_free(struct cork_cuckoo_filter *filter);
+
+CORK_API void
+cork_cuckoo_filter_clear(struct cork_cuckoo_filter *filter);
+
+CORK_API size_t
+cork_cuckoo_filter_count(const struct cork_cuckoo_filter *filter);
+
+CORK_API size_t
+cork_cuckoo_filter_byte_size(const struct cork_cuckoo_filter *filter);
+
+
+CORK_API int
+cork_cuckoo_filter_add_hash(struct cork_cuckoo_filter *filter,
+                            cork_big_hash hash);
+
+CORK_API bool
+cork_cuckoo_filter_contains_hash(const struct cork_cuckoo_filter *filter,
+                                 cork_big_hash hash);
+
+CORK_API bool
+cork_cuckoo_filter_delete_hash(struct cork_cuckoo_filter *filter,
+                               cork_big_hash hash);
+
+CORK_API int
+cork_cuckoo_filter_add(struct cork_cuckoo_filter *filter,
+                       const void *src, size_t len);
+
+CORK_API bool
+cork_cuckoo_filter_contains(const struct cork_cuckoo_filter *filter,
+                            const void *src, size_t len);
+
+CORK_API bool
+cork_cuckoo_filter_delete(struct cork_cuckoo_filter *filter,
+                          const void *src, size_t len);
+
+
+/* Appends a serialized copy of the filter to dest. */
+CORK_API void
+cork_cuckoo_filter_save(const struct cork_cuckoo_filter *filter,
+                        struct cork_buffer *dest);
+
+/* Creates a filter that uses a serialized copy in place, without copying it.
+ * src must be 8-byte aligned, and must outlive the filter. */
+CORK_API struct cork_cuckoo_filter *
+cork_cuckoo_filter_new_from_bytes(void *src, size_t size);
+
+
+#endif /* LIBCORK_DS_CUCKOO_FILTER_H */
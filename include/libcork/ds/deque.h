@@ -0,0 +1,126 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_DEQUE_H
+#define LIBCORK_DS_DEQUE_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+
+
+/*-----------------------------------------------------------------------
+ * Double-ended queues
+ */
+
+/* The elements live in fixed-size blocks, which are allocated as needed.  The
+ * block map is a power-of-2 sized array of block pointers, and each block
+ * holds a power-of-2 number of elements, so the deque's capacity is a power
+ * of 2 as well.  The elements occupy a contiguous (wrapping) range of
+ * positions in [0, capacity), starting at start.  All of these fields are
+ * public so that the accessor macros below can be inlined, but you should
+ * treat them as read-only. */
+
+struct cork_raw_deque {
+    void  **blocks;
+    size_t  size;
+    size_t  start;
+    /* capacity - 1, or 0 if we haven't allocated the block map yet */
+    size_t  mask;
+    unsigned int  block_shift;
+    size_t  element_size;
+};
+
+CORK_API void
+cork_raw_deque_init(struct cork_raw_deque *deque, size_t element_size);
+
+CORK_API void
+cork_raw_deque_done(struct cork_raw_deque *deque);
+
+CORK_API void
+cork_raw_deque_clear(struct cork_raw_deque *deque);
+
+/* Adds a new element to one end of the deque, returning a pointer to it.  The
+ * new element's contents are undefined. */
+CORK_API void *
+cork_raw_deque_push_back(struct cork_raw_deque *deque);
+
+CORK_API void *
+cork_raw_deque_push_front(struct cork_raw_deque *deque);
+
+/* The deque must not be empty. */
+CORK_API void
+cork_raw_deque_pop_back(struct cork_raw_deque *deque);
+
+CORK_API void
+cork_raw_deque_pop_front(struct cork_raw_deque *deque);
+
+#define cork_raw_deque_size(deque)      ((deque)->size)
+#define cork_raw_deque_is_empty(deque)  ((deque)->size == 0)
+
+#define cork_deque_position_(deque, i) \
+    (((deque)->start + (i)) & (deque)->mask)
+#define cork_deque_block_mask_(deque) \
+    ((((size_t) 1) << (deque)->block_shift) - 1)
+
+#define cork_raw_deque_at(deque, i) \
+    ((void *) \
+     ((char *) (deque)->blocks \
+      [cork_deque_position_(deque, i) >> (deque)->block_shift] + \
+      (cork_deque_position_(deque, i) & cork_deque_block_mask_(deque)) * \
+      (deque)->element_size))
+
+
+/*-----------------------------------------------------------------------
+ * Type-checked double-ended queues
+ */
+
+#define cork_deque(T) \
+    struct { \
+        T  **blocks; \
+        size_t  size; \
+        size_t  start; \
+        size_t  mask; \
+        unsigned int  block_shift; \
+        size_t  element_size; \
+    }
+
+#define cork_deque_to_raw(dq)  ((struct cork_raw_deque *) (void *) (dq))
+#define cork_deque_element_size(dq)  (sizeof((dq)->blocks[0][0]))
+#define cork_deque_size(dq)      ((dq)->size)
+#define cork_deque_is_empty(dq)  ((dq)->size == 0)
+
+#define cork_deque_init(dq) \
+    (cork_raw_deque_init(cork_deque_to_raw(dq), cork_deque_element_size(dq)))
+#define cork_deque_done(dq) \
+    (cork_raw_deque_done(cork_deque_to_raw(dq)))
+#define cork_deque_clear(dq) \
+    (cork_raw_deque_clear(cork_deque_to_raw(dq)))
+
+/* These are all lvalues. */
+#define cork_deque_at(dq, i) \
+    ((dq)->blocks[cork_deque_position_(dq, i) >> (dq)->block_shift] \
+                 [cork_deque_position_(dq, i) & cork_deque_block_mask_(dq)])
+#define cork_deque_front(dq)  cork_deque_at(dq, 0)
+#define cork_deque_back(dq)   cork_deque_at(dq, (dq)->size - 1)
+
+#define cork_deque_push_back(dq, element) \
+    (cork_raw_deque_push_back(cork_deque_to_raw(dq)), \
+     (cork_deque_back(dq) = (element), (void) 0))
+#define cork_deque_push_front(dq, element) \
+    (cork_raw_deque_push_front(cork_deque_to_raw(dq)), \
+     (cork_deque_front(dq) = (element), (void) 0))
+
+#define cork_deque_pop_back(dq) \
+    (cork_raw_deque_pop_back(cork_deque_to_raw(dq)))
+#define cork_deque_pop_front(dq) \
+    (cork_raw_deque_pop_front(cork_deque_to_raw(dq)))
+
+
+#endif /* LIBCORK_DS_DEQUE_H */
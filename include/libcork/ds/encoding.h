@@ -0,0 +1,118 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_ENCODING_H
+#define LIBCORK_DS_ENCODING_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+#include <libcork/ds/slice.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/encoding.h" */
+#define CORK_ENCODING_ERROR  0xcd85a046
+
+enum cork_encoding_error {
+    /* The input to a decoder isn't validly encoded */
+    CORK_ENCODING_INVALID
+};
+
+
+/*-----------------------------------------------------------------------
+ * Hex
+ */
+
+/* The number of characters needed to hex-encode size bytes. */
+#define cork_hex_encoded_size(size)  ((size) * 2)
+
+/* Appends the lowercase hex encoding of src to dest. */
+CORK_API void
+cork_hex_encode(struct cork_buffer *dest, const void *src, size_t size);
+
+/* Appends the decoded contents of src to dest.  Both uppercase and lowercase
+ * digits are allowed.  Returns an error, without changing dest, if src
+ * contains anything other than an even number of hex digits. */
+CORK_API int
+cork_hex_decode(struct cork_buffer *dest, const void *src, size_t size);
+
+#define cork_hex_encode_slice(dest, slice) \
+    (cork_hex_encode((dest), (slice)->buf, (slice)->size))
+
+#define cork_hex_decode_slice(dest, slice) \
+    (cork_hex_decode((dest), (slice)->buf, (slice)->size))
+
+
+/*-----------------------------------------------------------------------
+ * Base64
+ */
+
+/* The number of characters needed to base64-encode size bytes, including
+ * padding. */
+#define cork_base64_encoded_size(size)  ((((size) + 2) / 3) * 4)
+
+/* Appends the padded base64 encoding (using the standard RFC 4648 alphabet)
+ * of src to dest. */
+CORK_API void
+cork_base64_encode(struct cork_buffer *dest, const void *src, size_t size);
+
+/* Appends the decoded contents of src to dest.  src must be padded, and
+ * cannot contain whitespace or any unused trailing bits.  Returns an error,
+ * without changing dest, if src isn't valid. */
+CORK_API int
+cork_base64_decode(struct cork_buffer *dest, const void *src, size_t size);
+
+#define cork_base64_encode_slice(dest, slice) \
+    (cork_base64_encode((dest), (slice)->buf, (slice)->size))
+
+#define cork_base64_decode_slice(dest, slice) \
+    (cork_base64_decode((dest), (slice)->buf, (slice)->size))
+
+
+/*-----------------------------------------------------------------------
+ * UTF-8
+ */
+
+/* Returns an error if src isn't valid UTF-8.  Overlong encodings, surrogates,
+ * and code points above U+10FFFF are all invalid. */
+CORK_API int
+cork_utf8_validate(const void *src, size_t size);
+
+#define cork_utf8_validate_slice(slice) \
+    (cork_utf8_validate((slice)->buf, (slice)->size))
+
+
+/*-----------------------------------------------------------------------
+ * Escaping
+ */
+
+/* Appends src to dest, escaped so that it can appear between the quotes of a
+ * JSON string.  Bytes above 0x7f are copied as-is; use cork_utf8_validate
+ * first if you need to make sure that the result is valid JSON. */
+CORK_API void
+cork_json_escape(struct cork_buffer *dest, const void *src, size_t size);
+
+#define cork_json_escape_slice(dest, slice) \
+    (cork_json_escape((dest), (slice)->buf, (slice)->size))
+
+/* Appends src to dest, escaped so that it can appear between the quotes of a
+ * C string literal.  The result only contains printable ASCII characters. */
+CORK_API void
+cork_c_escape(struct cork_buffer *dest, const void *src, size_t size);
+
+#define cork_c_escape_slice(dest, slice) \
+    (cork_c_escape((dest), (slice)->buf, (slice)->size))
+
+
+#endif /* LIBCORK_DS_ENCODING_H */
@@ -0,0 +1,78 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_FRAMING_H
+#define LIBCORK_DS_FRAMING_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/callbacks.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/slice.h>
+#include <libcork/ds/stream.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/framing.h" */
+#define CORK_FRAMING_ERROR  0x0299b158
+
+enum cork_framing_error {
+    /* A length prefix is malformed, or the stream ends in the middle of a
+     * record */
+    CORK_FRAMING_INVALID,
+    /* A record is larger than the consumer allows */
+    CORK_FRAMING_TOO_LARGE
+};
+
+
+/*-----------------------------------------------------------------------
+ * Framing consumers
+ */
+
+/* The most records that we'll pass to the callback at once. */
+#define CORK_FRAMING_BATCH_SIZE  256
+
+/* Called with each batch of complete records.  The records are only valid
+ * until the callback returns. */
+typedef int
+(*cork_framing_records_f)(void *user_data,
+                          const struct cork_slice *records,
+                          size_t record_count);
+
+/* Records end with delimiter, which isn't included in the record.  The last
+ * record in the stream doesn't need a delimiter. */
+CORK_API struct cork_stream_consumer *
+cork_delimited_consumer_new(char delimiter,
+                            void *user_data, cork_free_f free_user_data,
+                            cork_framing_records_f records);
+
+/* Every record is exactly record_size bytes long. */
+CORK_API struct cork_stream_consumer *
+cork_fixed_size_consumer_new(size_t record_size,
+                             void *user_data, cork_free_f free_user_data,
+                             cork_framing_records_f records);
+
+/* Each record is preceded by its length, encoded as a LEB128 varint (the same
+ * encoding that cork_serializer_write_varint uses). */
+CORK_API struct cork_stream_consumer *
+cork_varint_prefix_consumer_new(size_t max_record_size,
+                                void *user_data, cork_free_f free_user_data,
+                                cork_framing_records_f records);
+
+/* Each record is preceded by its length, encoded as a big-endian uint32_t. */
+CORK_API struct cork_stream_consumer *
+cork_u32_prefix_consumer_new(size_t max_record_size,
+                             void *user_data, cork_free_f free_user_data,
+                             cork_framing_records_f records);
+
+
+#endif /* LIBCORK_DS_FRAMING_H */
@@ -0,0 +1,132 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_JSON_WRITER_H
+#define LIBCORK_DS_JSON_WRITER_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+#include <libcork/ds/stream.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/json-writer.h" */
+#define CORK_JSON_WRITER_ERROR  0x9e6568be
+
+enum cork_json_writer_error {
+    /* Trying to write something that would produce invalid JSON, such as a
+     * value without a key inside of an object */
+    CORK_JSON_WRITER_INVALID,
+    /* Containers are nested too deeply */
+    CORK_JSON_WRITER_TOO_DEEP
+};
+
+
+/*-----------------------------------------------------------------------
+ * JSON writers
+ */
+
+#define CORK_JSON_WRITER_MAX_DEPTH  64
+
+struct cork_json_writer {
+    /* Where the JSON is written to.  This either belongs to the caller, or
+     * points at buffer. */
+    struct cork_buffer  *dest;
+    /* Only used if we're writing to a stream consumer. */
+    struct cork_buffer  buffer;
+    struct cork_stream_consumer  *consumer;
+    size_t  flush_size;
+    bool  is_first_chunk;
+    /* Whether we need a comma before the next key or value. */
+    bool  need_comma;
+    /* Whether we've written a key, and need its value next. */
+    bool  after_key;
+    /* Whether we've written a complete top-level value. */
+    bool  done;
+    unsigned int  depth;
+    /* Whether each open container is an object or an array. */
+    bool  in_object[CORK_JSON_WRITER_MAX_DEPTH];
+};
+
+/* Appends JSON to dest, which must outlive the writer. */
+CORK_API void
+cork_json_writer_init(struct cork_json_writer *writer,
+                      struct cork_buffer *dest);
+
+/* Passes JSON to consumer in chunks of around flush_size bytes.  The writer
+ * doesn't take control of consumer. */
+CORK_API void
+cork_json_writer_init_stream(struct cork_json_writer *writer,
+                             struct cork_stream_consumer *consumer,
+                             size_t flush_size);
+
+CORK_API void
+cork_json_writer_done(struct cork_json_writer *writer);
+
+/* Makes sure that we've written a complete JSON value.  If we're writing to a
+ * stream consumer, also sends any remaining data and signals EOF. */
+CORK_API int
+cork_json_writer_finish(struct cork_json_writer *writer);
+
+
+CORK_API int
+cork_json_writer_start_object(struct cork_json_writer *writer);
+
+CORK_API int
+cork_json_writer_end_object(struct cork_json_writer *writer);
+
+CORK_API int
+cork_json_writer_start_array(struct cork_json_writer *writer);
+
+CORK_API int
+cork_json_writer_end_array(struct cork_json_writer *writer);
+
+CORK_API int
+cork_json_writer_key(struct cork_json_writer *writer, const char *key);
+
+CORK_API int
+cork_json_writer_key_n(struct cork_json_writer *writer,
+                       const void *key, size_t size);
+
+
+CORK_API int
+cork_json_writer_null(struct cork_json_writer *writer);
+
+CORK_API int
+cork_json_writer_bool(struct cork_json_writer *writer, bool value);
+
+CORK_API int
+cork_json_writer_int(struct cork_json_writer *writer, int64_t value);
+
+CORK_API int
+cork_json_writer_uint(struct cork_json_writer *writer, uint64_t value);
+
+/* NaNs and infinities are written as null. */
+CORK_API int
+cork_json_writer_double(struct cork_json_writer *writer, double value);
+
+CORK_API int
+cork_json_writer_string(struct cork_json_writer *writer, const char *str);
+
+CORK_API int
+cork_json_writer_string_n(struct cork_json_writer *writer,
+                          const void *str, size_t size);
+
+/* Writes pre-encoded JSON without checking it. */
+CORK_API int
+cork_json_writer_raw(struct cork_json_writer *writer,
+                     const void *json, size_t size);
+
+
+#endif /* LIBCORK_DS_JSON_WRITER_H */
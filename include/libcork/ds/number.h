@@ -0,0 +1,185 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_NUMBER_H
+#define LIBCORK_DS_NUMBER_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/slice.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/number.h" */
+#define CORK_NUMBER_ERROR  0x42b18a70
+
+enum cork_number_error {
+    /* The input isn't a validly formatted number */
+    CORK_NUMBER_INVALID,
+    /* The number can't be represented in the requested type */
+    CORK_NUMBER_OUT_OF_RANGE
+};
+
+
+/*-----------------------------------------------------------------------
+ * Integers
+ */
+
+/* Each of these parses the entire contents of src, which must contain an
+ * optional minus sign (for the signed types only) followed by one or more
+ * decimal digits.  Leading zeros are allowed; whitespace and plus signs are
+ * not.  On error, dest is not changed. */
+
+CORK_API int
+cork_parse_int8(const void *src, size_t size, int8_t *dest);
+
+CORK_API int
+cork_parse_int16(const void *src, size_t size, int16_t *dest);
+
+CORK_API int
+cork_parse_int32(const void *src, size_t size, int32_t *dest);
+
+CORK_API int
+cork_parse_int64(const void *src, size_t size, int64_t *dest);
+
+CORK_API int
+cork_parse_uint8(const void *src, size_t size, uint8_t *dest);
+
+CORK_API int
+cork_parse_uint16(const void *src, size_t size, uint16_t *dest);
+
+CORK_API int
+cork_parse_uint32(const void *src, size_t size, uint32_t *dest);
+
+CORK_API int
+cork_parse_uint64(const void *src, size_t size, uint64_t *dest);
+
+/* Like the above, but src must contain one or more hex digits, optionally
+ * preceded by "0x" or "0X".  Both uppercase and lowercase digits are
+ * allowed. */
+
+CORK_API int
+cork_parse_uint8_hex(const void *src, size_t size, uint8_t *dest);
+
+CORK_API int
+cork_parse_uint16_hex(const void *src, size_t size, uint16_t *dest);
+
+CORK_API int
+cork_parse_uint32_hex(const void *src, size_t size, uint32_t *dest);
+
+CORK_API int
+cork_parse_uint64_hex(const void *src, size_t size, uint64_t *dest);
+
+/* Like the above, but if src isn't validly formatted, and error_offset isn't
+ * NULL, we fill it in with the offset of the first invalid character (which
+ * is size if the input ends too early).  It isn't changed for any other
+ * error. */
+
+CORK_API int
+cork_parse_int8_ex(const void *src, size_t size, int8_t *dest,
+                   size_t *error_offset);
+
+CORK_API int
+cork_parse_int16_ex(const void *src, size_t size, int16_t *dest,
+                    size_t *error_offset);
+
+CORK_API int
+cork_parse_int32_ex(const void *src, size_t size, int32_t *dest,
+                    size_t *error_offset);
+
+CORK_API int
+cork_parse_int64_ex(const void *src, size_t size, int64_t *dest,
+                    size_t *error_offset);
+
+CORK_API int
+cork_parse_uint8_ex(const void *src, size_t size, uint8_t *dest,
+                    size_t *error_offset);
+
+CORK_API int
+cork_parse_uint16_ex(const void *src, size_t size, uint16_t *dest,
+                     size_t *error_offset);
+
+CORK_API int
+cork_parse_uint32_ex(const void *src, size_t size, uint32_t *dest,
+                     size_t *error_offset);
+
+CORK_API int
+cork_parse_uint64_ex(const void *src, size_t size, uint64_t *dest,
+                     size_t *error_offset);
+
+CORK_API int
+cork_parse_uint8_hex_ex(const void *src, size_t size, uint8_t *dest,
+                        size_t *error_offset);
+
+CORK_API int
+cork_parse_uint16_hex_ex(const void *src, size_t size, uint16_t *dest,
+                         size_t *error_offset);
+
+CORK_API int
+cork_parse_uint32_hex_ex(const void *src, size_t size, uint32_t *dest,
+                         size_t *error_offset);
+
+CORK_API int
+cork_parse_uint64_hex_ex(const void *src, size_t size, uint64_t *dest,
+                         size_t *error_offset);
+
+#define cork_parse_int8_slice(slice, dest) \
+    (cork_parse_int8((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_int16_slice(slice, dest) \
+    (cork_parse_int16((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_int32_slice(slice, dest) \
+    (cork_parse_int32((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_int64_slice(slice, dest) \
+    (cork_parse_int64((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint8_slice(slice, dest) \
+    (cork_parse_uint8((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint16_slice(slice, dest) \
+    (cork_parse_uint16((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint32_slice(slice, dest) \
+    (cork_parse_uint32((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint64_slice(slice, dest) \
+    (cork_parse_uint64((slice)->buf, (slice)->size, (dest)))
+
+#define cork_parse_uint8_hex_slice(slice, dest) \
+    (cork_parse_uint8_hex((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint16_hex_slice(slice, dest) \
+    (cork_parse_uint16_hex((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint32_hex_slice(slice, dest) \
+    (cork_parse_uint32_hex((slice)->buf, (slice)->size, (dest)))
+#define cork_parse_uint64_hex_slice(slice, dest) \
+    (cork_parse_uint64_hex((slice)->buf, (slice)->size, (dest)))
+
+
+/*-----------------------------------------------------------------------
+ * Floating-point numbers
+ */
+
+/* Parses the entire contents of src as a decimal floating-point number, with
+ * the usual syntax: an optional sign, digits with an optional decimal point,
+ * and an optional exponent.  "inf", "infinity", and "nan" are also allowed,
+ * in any case.  The result is correctly rounded.  Values too small to
+ * represent round to zero; values too large are an error. */
+CORK_API int
+cork_parse_double(const void *src, size_t size, double *dest);
+
+/* Like cork_parse_double, but fills in error_offset like the integer _ex
+ * functions. */
+CORK_API int
+cork_parse_double_ex(const void *src, size_t size, double *dest,
+                     size_t *error_offset);
+
+#define cork_parse_double_slice(slice, dest) \
+    (cork_parse_double((slice)->buf, (slice)->size, (dest)))
+
+
+#endif /* LIBCORK_DS_NUMBER_H */
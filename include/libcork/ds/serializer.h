@@ -0,0 +1,197 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_SERIALIZER_H
+#define LIBCORK_DS_SERIALIZER_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/array.h>
+#include <libcork/ds/bitset.h>
+#include <libcork/ds/buffer.h>
+#include <libcork/ds/hash-table.h>
+#include <libcork/ds/slice.h>
+#include <libcork/ds/stream.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/serializer.h" */
+#define CORK_SERIALIZER_ERROR  0x71aa4ab6
+
+enum cork_serializer_error {
+    /* The serialized data is corrupt or truncated */
+    CORK_SERIALIZER_INVALID,
+    /* The serialized data doesn't match what we're trying to read into */
+    CORK_SERIALIZER_MISMATCH
+};
+
+
+/*-----------------------------------------------------------------------
+ * Serializers
+ */
+
+struct cork_serializer;
+
+/* We don't take control of dest. */
+CORK_API struct cork_serializer *
+cork_serializer_new(struct cork_stream_consumer *dest);
+
+CORK_API void
+cork_serializer_free(struct cork_serializer *ser);
+
+/* The number of bytes written so far, including any that are still
+ * buffered. */
+CORK_API uint64_t
+cork_serializer_byte_count(const struct cork_serializer *ser);
+
+/* Writes the header, which must come first.  version is an application-level
+ * format version, which the reader can check. */
+CORK_API int
+cork_serializer_start(struct cork_serializer *ser, uint32_t version);
+
+/* Passes any buffered data along to the consumer, and then signals EOF. */
+CORK_API int
+cork_serializer_finish(struct cork_serializer *ser);
+
+CORK_API int
+cork_serializer_write_varint(struct cork_serializer *ser, uint64_t value);
+
+/* Zig-zag encoded, so that small negative numbers are small, too. */
+CORK_API int
+cork_serializer_write_svarint(struct cork_serializer *ser, int64_t value);
+
+/* Without a length prefix. */
+CORK_API int
+cork_serializer_write_raw(struct cork_serializer *ser,
+                          const void *src, size_t size);
+
+/* With a length prefix. */
+CORK_API int
+cork_serializer_write_bytes(struct cork_serializer *ser,
+                            const void *src, size_t size);
+
+CORK_API int
+cork_serializer_write_string(struct cork_serializer *ser, const char *str);
+
+CORK_API int
+cork_serializer_write_buffer(struct cork_serializer *ser,
+                             const struct cork_buffer *buffer);
+
+/* The array's elements are written as raw bytes, so they must not contain
+ * any pointers. */
+CORK_API int
+cork_serializer_write_raw_array(struct cork_serializer *ser,
+                                const struct cork_raw_array *array);
+
+#define cork_serializer_write_array(ser, array) \
+    (cork_serializer_write_raw_array((ser), cork_array_to_raw(array)))
+
+CORK_API int
+cork_serializer_write_bitset(struct cork_serializer *ser,
+                             const struct cork_bitset *set);
+
+typedef int
+(*cork_serializer_entry_writer)(struct cork_serializer *ser,
+                                const struct cork_hash_table_entry *entry,
+                                void *user_data);
+
+/* Writes the number of entries, and then calls write_entry for each one. */
+CORK_API int
+cork_serializer_write_hash_table(struct cork_serializer *ser,
+                                 struct cork_hash_table *table,
+                                 cork_serializer_entry_writer write_entry,
+                                 void *user_data);
+
+
+/*-----------------------------------------------------------------------
+ * Deserializers
+ */
+
+/* Reads directly from a region of memory (such as a memory-mapped file), or
+ * from a slice, without copying it. */
+struct cork_deserializer {
+    const uint8_t  *buf;
+    size_t  size;
+    size_t  pos;
+    /* The slice that we're reading from, if any. */
+    const struct cork_slice  *slice;
+};
+
+CORK_API void
+cork_deserializer_init(struct cork_deserializer *des,
+                       const void *buf, size_t size);
+
+/* slice must outlive des. */
+CORK_API void
+cork_deserializer_init_slice(struct cork_deserializer *des,
+                             const struct cork_slice *slice);
+
+#define cork_deserializer_remaining(des)  ((des)->size - (des)->pos)
+#define cork_deserializer_is_empty(des)  ((des)->pos == (des)->size)
+
+CORK_API int
+cork_deserializer_start(struct cork_deserializer *des, uint32_t *version);
+
+CORK_API int
+cork_deserializer_read_varint(struct cork_deserializer *des, uint64_t *dest);
+
+CORK_API int
+cork_deserializer_read_svarint(struct cork_deserializer *des, int64_t *dest);
+
+/* Returns a pointer into the underlying data, without copying it. */
+CORK_API int
+cork_deserializer_read_raw(struct cork_deserializer *des,
+                           const void **dest, size_t size);
+
+CORK_API int
+cork_deserializer_read_bytes(struct cork_deserializer *des,
+                             const void **dest, size_t *size);
+
+/* Fills in dest with the contents of a bytes field.  If we're reading from a
+ * slice, dest is a copy of that slice; otherwise it refers directly to the
+ * underlying memory. */
+CORK_API int
+cork_deserializer_read_slice(struct cork_deserializer *des,
+                             struct cork_slice *dest);
+
+/* Appends the contents of a bytes field to dest. */
+CORK_API int
+cork_deserializer_read_buffer(struct cork_deserializer *des,
+                              struct cork_buffer *dest);
+
+/* Appends the elements to dest, which must have the same element size as the
+ * array that was written. */
+CORK_API int
+cork_deserializer_read_raw_array(struct cork_deserializer *des,
+                                 struct cork_raw_array *dest);
+
+#define cork_deserializer_read_array(des, array) \
+    (cork_deserializer_read_raw_array((des), cork_array_to_raw(array)))
+
+CORK_API struct cork_bitset *
+cork_deserializer_read_bitset(struct cork_deserializer *des);
+
+typedef int
+(*cork_deserializer_entry_reader)(struct cork_deserializer *des,
+                                  struct cork_hash_table *table,
+                                  void *user_data);
+
+/* Reads the number of entries, and then calls read_entry for each one. */
+CORK_API int
+cork_deserializer_read_hash_table(struct cork_deserializer *des,
+                                  struct cork_hash_table *table,
+                                  cork_deserializer_entry_reader read_entry,
+                                  void *user_data);
+
+
+#endif /* LIBCORK_DS_SERIALIZER_H */
@@ -0,0 +1,184 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_SKETCH_H
+#define LIBCORK_DS_SKETCH_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/hash.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/ds/sketch.h" */
+#define CORK_SKETCH_ERROR  0x5608e3a2
+
+enum cork_sketch_error {
+    /* A serialized sketch is corrupt */
+    CORK_SKETCH_INVALID,
+    /* Trying to merge two sketches with different parameters */
+    CORK_SKETCH_MISMATCH
+};
+
+
+/*-----------------------------------------------------------------------
+ * HyperLogLog
+ */
+
+#define CORK_HLL_MIN_PRECISION  4
+#define CORK_HLL_MAX_PRECISION  18
+
+struct cork_hll;
+
+/* Uses 2^precision registers; the standard error of the estimate is about
+ * 1.04 / sqrt(2^precision). */
+CORK_API struct cork_hll *
+cork_hll_new(unsigned int precision);
+
+CORK_API void
+cork_hll_free(struct cork_hll *hll);
+
+CORK_API void
+cork_hll_clear(struct cork_hll *hll);
+
+CORK_API unsigned int
+cork_hll_precision(const struct cork_hll *hll);
+
+CORK_API void
+cork_hll_add_hash(struct cork_hll *hll, cork_big_hash hash);
+
+CORK_API void
+cork_hll_add_hashes(struct cork_hll *hll,
+                    const cork_big_hash *hashes, size_t count);
+
+CORK_API void
+cork_hll_add(struct cork_hll *hll, const void *src, size_t len);
+
+CORK_API uint64_t
+cork_hll_estimate(struct cork_hll *hll);
+
+CORK_API int
+cork_hll_merge(struct cork_hll *dest, struct cork_hll *src);
+
+CORK_API void
+cork_hll_save(struct cork_hll *hll, struct cork_buffer *dest);
+
+CORK_API struct cork_hll *
+cork_hll_new_from_bytes(const void *src, size_t size);
+
+
+/*-----------------------------------------------------------------------
+ * Count-Min sketches
+ */
+
+struct cork_count_min;
+
+CORK_API struct cork_count_min *
+cork_count_min_new(size_t width, size_t depth);
+
+CORK_API void
+cork_count_min_free(struct cork_count_min *cm);
+
+CORK_API void
+cork_count_min_clear(struct cork_count_min *cm);
+
+/* The sum of all of the counts that have been added. */
+CORK_API uint64_t
+cork_count_min_total(const struct cork_count_min *cm);
+
+CORK_API void
+cork_count_min_add_hash(struct cork_count_min *cm, cork_big_hash hash,
+                        uint64_t count);
+
+/* Adds 1 for each hash. */
+CORK_API void
+cork_count_min_add_hashes(struct cork_count_min *cm,
+                          const cork_big_hash *hashes, size_t count);
+
+CORK_API void
+cork_count_min_add(struct cork_count_min *cm, const void *src, size_t len,
+                   uint64_t count);
+
+CORK_API uint64_t
+cork_count_min_estimate_hash(const struct cork_count_min *cm,
+                             cork_big_hash hash);
+
+CORK_API uint64_t
+cork_count_min_estimate(const struct cork_count_min *cm,
+                        const void *src, size_t len);
+
+CORK_API int
+cork_count_min_merge(struct cork_count_min *dest,
+                     const struct cork_count_min *src);
+
+CORK_API void
+cork_count_min_save(const struct cork_count_min *cm, struct cork_buffer *dest);
+
+CORK_API struct cork_count_min *
+cork_count_min_new_from_bytes(const void *src, size_t size);
+
+
+/*-----------------------------------------------------------------------
+ * Space-Saving top-k
+ */
+
+struct cork_top_k_entry {
+    const void  *key;
+    size_t  key_size;
+    /* An upper bound on the key's true count. */
+    uint64_t  count;
+    /* count - error is a lower bound on the key's true count. */
+    uint64_t  error;
+};
+
+/* The largest capacity that cork_top_k_new_from_bytes will accept. */
+#define CORK_TOP_K_MAX_CAPACITY  (1 << 24)
+
+struct cork_top_k;
+
+CORK_API struct cork_top_k *
+cork_top_k_new(size_t capacity);
+
+CORK_API void
+cork_top_k_free(struct cork_top_k *top_k);
+
+CORK_API void
+cork_top_k_clear(struct cork_top_k *top_k);
+
+CORK_API size_t
+cork_top_k_size(const struct cork_top_k *top_k);
+
+/* Makes a copy of key if it isn't already being tracked. */
+CORK_API void
+cork_top_k_add(struct cork_top_k *top_k, const void *key, size_t key_size,
+               uint64_t count);
+
+/* Fills in dest with up to count entries, in descending order of count, and
+ * returns how many were filled in.  The keys are owned by the sketch, and are
+ * only valid until the next time it's modified. */
+CORK_API size_t
+cork_top_k_get(const struct cork_top_k *top_k,
+               struct cork_top_k_entry *dest, size_t count);
+
+CORK_API void
+cork_top_k_merge(struct cork_top_k *dest, const struct cork_top_k *src);
+
+CORK_API void
+cork_top_k_save(const struct cork_top_k *top_k, struct cork_buffer *dest);
+
+CORK_API struct cork_top_k *
+cork_top_k_new_from_bytes(const void *src, size_t size);
+
+
+#endif /* LIBCORK_DS_SKETCH_H */
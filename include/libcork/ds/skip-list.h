@@ -0,0 +1,117 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_SKIP_LIST_H
+#define LIBCORK_DS_SKIP_LIST_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/callbacks.h>
+#include <libcork/core/types.h>
+
+
+/*-----------------------------------------------------------------------
+ * Skip lists
+ */
+
+/* Returns a negative number, zero, or a positive number if key1 is less than,
+ * equal to, or greater than key2. */
+typedef int
+(*cork_skip_list_comparator)(const void *key1, const void *key2);
+
+struct cork_skip_list_entry {
+    /* This entry's key.  It never changes once the entry is added. */
+    void  *key;
+    /* This entry's value */
+    void * volatile  value;
+};
+
+struct cork_skip_list;
+
+CORK_API struct cork_skip_list *
+cork_skip_list_new(cork_skip_list_comparator comparator);
+
+/* Must not be called while any other thread is using the list. */
+CORK_API void
+cork_skip_list_free(struct cork_skip_list *list);
+
+/* Called on each entry's key and value when the entry's memory is
+ * reclaimed, or when the list is freed. */
+CORK_API void
+cork_skip_list_set_free_key(struct cork_skip_list *list, cork_free_f free_key);
+
+CORK_API void
+cork_skip_list_set_free_value(struct cork_skip_list *list,
+                              cork_free_f free_value);
+
+/* The result is only a snapshot if other threads are updating the list. */
+CORK_API size_t
+cork_skip_list_size(const struct cork_skip_list *list);
+
+
+/* These never block, and can run at the same time as any other operation
+ * except cork_skip_list_reclaim. */
+
+CORK_API void *
+cork_skip_list_get(const struct cork_skip_list *list, const void *key);
+
+CORK_API struct cork_skip_list_entry *
+cork_skip_list_get_entry(const struct cork_skip_list *list, const void *key);
+
+
+/* These lock the nodes around the key that they're modifying, so updates in
+ * different parts of the list don't contend with each other. */
+
+/* If key is already in the list, its value is replaced, the old value is
+ * returned in old_value, and the list does not take ownership of key. */
+CORK_API void
+cork_skip_list_put(struct cork_skip_list *list, void *key, void *value,
+                   bool *is_new, void **old_value);
+
+/* The entry's key and value aren't freed until the next call to
+ * cork_skip_list_reclaim. */
+CORK_API bool
+cork_skip_list_delete(struct cork_skip_list *list, const void *key);
+
+/* Frees the entries that have been deleted since the last call.  You must
+ * only call this when no other thread is reading or iterating through the
+ * list. */
+CORK_API void
+cork_skip_list_reclaim(struct cork_skip_list *list);
+
+
+/*-----------------------------------------------------------------------
+ * Iterating through a skip list
+ */
+
+struct cork_skip_list_node;
+
+struct cork_skip_list_iterator {
+    /* The next node to look at */
+    struct cork_skip_list_node  *next;
+};
+
+/* Starts at the list's smallest key. */
+CORK_API void
+cork_skip_list_iterator_init(const struct cork_skip_list *list,
+                             struct cork_skip_list_iterator *iterator);
+
+/* Starts at the smallest key that is greater than or equal to key. */
+CORK_API void
+cork_skip_list_iterator_init_at(const struct cork_skip_list *list,
+                                struct cork_skip_list_iterator *iterator,
+                                const void *key);
+
+/* Returns entries in ascending order of key, or NULL at the end of the
+ * list. */
+CORK_API struct cork_skip_list_entry *
+cork_skip_list_iterator_next(struct cork_skip_list_iterator *iterator);
+
+
+#endif /* LIBCORK_DS_SKIP_LIST_H */
@@ -0,0 +1,147 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_SLIST_H
+#define LIBCORK_DS_SLIST_H
+
+#include <libcork/core/api.h>
+#include <libcork/core/attributes.h>
+#include <libcork/core/types.h>
+
+
+struct cork_slist_item {
+    /* A pointer to the next element in the list, or NULL. */
+    struct cork_slist_item  *next;
+};
+
+typedef void
+(*cork_slist_map_func)(struct cork_slist_item *element, void *user_data);
+
+
+/*-----------------------------------------------------------------------
+ * Singly-linked lists
+ */
+
+/* Elements can only be added and removed at the head of the list, so this is
+ * a LIFO stack. */
+struct cork_slist {
+    struct cork_slist_item  *head;
+};
+
+#define CORK_SLIST_INIT  { NULL }
+
+#define cork_slist_init(list)  ((list)->head = NULL)
+
+#define cork_slist_head(list)  ((list)->head)
+#define cork_slist_is_empty(list)  ((list)->head == NULL)
+
+#define cork_slist_push(list, element) \
+    do { \
+        (element)->next = (list)->head; \
+        (list)->head = (element); \
+    } while (0)
+
+#define cork_slist_add_after(pred, element) \
+    do { \
+        (element)->next = (pred)->next; \
+        (pred)->next = (element); \
+    } while (0)
+
+/* pred must have a successor. */
+#define cork_slist_remove_after(pred) \
+    ((pred)->next = (pred)->next->next)
+
+CORK_ATTR_UNUSED
+static inline struct cork_slist_item *
+cork_slist_pop(struct cork_slist *list)
+{
+    struct cork_slist_item  *head = list->head;
+    if (head != NULL) {
+        list->head = head->next;
+    }
+    return head;
+}
+
+CORK_API void
+cork_slist_map(struct cork_slist *list,
+               cork_slist_map_func func, void *user_data);
+
+CORK_API size_t
+cork_slist_size(const struct cork_slist *list);
+
+
+/*-----------------------------------------------------------------------
+ * Singly-linked tail queues
+ */
+
+/* Elements can be added at either end, but only removed from the head, so
+ * this is a FIFO queue. */
+struct cork_stailq {
+    struct cork_slist_item  *head;
+    /* The next pointer of the last element, or &head if the queue is
+     * empty. */
+    struct cork_slist_item  **tail;
+};
+
+#define CORK_STAILQ_INIT(queue)  { NULL, &(queue).head }
+
+#define cork_stailq_init(queue) \
+    do { \
+        (queue)->head = NULL; \
+        (queue)->tail = &(queue)->head; \
+    } while (0)
+
+#define cork_stailq_head(queue)  ((queue)->head)
+#define cork_stailq_is_empty(queue)  ((queue)->head == NULL)
+
+#define cork_stailq_add(queue, element) \
+    do { \
+        (element)->next = NULL; \
+        *(queue)->tail = (element); \
+        (queue)->tail = &(element)->next; \
+    } while (0)
+
+#define cork_stailq_push(queue, element) \
+    do { \
+        if (((element)->next = (queue)->head) == NULL) { \
+            (queue)->tail = &(element)->next; \
+        } \
+        (queue)->head = (element); \
+    } while (0)
+
+/* Moves all of the elements in src to the end of dest, leaving src empty. */
+#define cork_stailq_concat(dest, src) \
+    do { \
+        if ((src)->head != NULL) { \
+            *(dest)->tail = (src)->head; \
+            (dest)->tail = (src)->tail; \
+            cork_stailq_init(src); \
+        } \
+    } while (0)
+
+CORK_ATTR_UNUSED
+static inline struct cork_slist_item *
+cork_stailq_pop(struct cork_stailq *queue)
+{
+    struct cork_slist_item  *head = queue->head;
+    if (head != NULL && (queue->head = head->next) == NULL) {
+        queue->tail = &queue->head;
+    }
+    return head;
+}
+
+CORK_API void
+cork_stailq_map(struct cork_stailq *queue,
+                cork_slist_map_func func, void *user_data);
+
+CORK_API size_t
+cork_stailq_size(const struct cork_stailq *queue);
+
+
+#endif /* LIBCORK_DS_SLIST_H */
@@ -0,0 +1,153 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_SLOT_MAP_H
+#define LIBCORK_DS_SLOT_MAP_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/array.h>
+
+
+/*-----------------------------------------------------------------------
+ * Slot maps
+ */
+
+/* The low 32 bits of a handle are an index into the slot table; the high 32
+ * bits are the slot's generation, which changes whenever the slot is reused,
+ * so that stale handles can be detected. */
+typedef uint64_t  cork_slot_handle;
+
+#define CORK_SLOT_HANDLE_NONE  ((cork_slot_handle) 0)
+
+struct cork_slot_map_priv;
+
+struct cork_raw_slot_map {
+    /* The live values, packed densely. */
+    struct cork_raw_array  values;
+    struct cork_slot_map_priv  *priv;
+};
+
+CORK_API void
+cork_raw_slot_map_init(struct cork_raw_slot_map *map, size_t element_size);
+
+CORK_API void
+cork_raw_slot_map_done(struct cork_raw_slot_map *map);
+
+CORK_API void
+cork_raw_slot_map_clear(struct cork_raw_slot_map *map);
+
+/* Adds a new value to the end of the dense array, returning a pointer to it.
+ * If handle isn't NULL, we fill it in with the new value's handle. */
+CORK_API void *
+cork_raw_slot_map_insert(struct cork_raw_slot_map *map,
+                         cork_slot_handle *handle);
+
+/* Returns NULL if handle is stale or invalid. */
+CORK_API void *
+cork_raw_slot_map_get(const struct cork_raw_slot_map *map,
+                      cork_slot_handle handle);
+
+/* Moves the last value in the dense array into the removed value's place. */
+CORK_API bool
+cork_raw_slot_map_remove(struct cork_raw_slot_map *map,
+                         cork_slot_handle handle);
+
+/* Returns the handle of the value at a particular position in the dense
+ * array. */
+CORK_API cork_slot_handle
+cork_raw_slot_map_handle_at(const struct cork_raw_slot_map *map, size_t index);
+
+
+/*-----------------------------------------------------------------------
+ * Type-checked slot maps
+ */
+
+#define cork_slot_map(T) \
+    struct { \
+        cork_array(T)  values; \
+        struct cork_slot_map_priv  *priv; \
+    }
+
+#define cork_slot_map_to_raw(sm) \
+    ((struct cork_raw_slot_map *) (void *) (sm))
+#define cork_slot_map_element_size(sm)  (sizeof((sm)->values.items[0]))
+
+#define cork_slot_map_init(sm) \
+    (cork_raw_slot_map_init(cork_slot_map_to_raw(sm), \
+                            cork_slot_map_element_size(sm)))
+#define cork_slot_map_done(sm) \
+    (cork_raw_slot_map_done(cork_slot_map_to_raw(sm)))
+#define cork_slot_map_clear(sm) \
+    (cork_raw_slot_map_clear(cork_slot_map_to_raw(sm)))
+
+#define cork_slot_map_size(sm)      ((sm)->values.size)
+#define cork_slot_map_is_empty(sm)  ((sm)->values.size == 0)
+
+/* Dense iteration: i ranges over [0, cork_slot_map_size(sm)). */
+#define cork_slot_map_at(sm, i)  ((sm)->values.items[(i)])
+#define cork_slot_map_handle_at(sm, i) \
+    (cork_raw_slot_map_handle_at(cork_slot_map_to_raw(sm), (i)))
+
+#define cork_slot_map_insert(sm, element, handle) \
+    (cork_raw_slot_map_insert(cork_slot_map_to_raw(sm), (handle)), \
+     ((sm)->values.items[(sm)->values.size - 1] = (element), (void) 0))
+#define cork_slot_map_insert_get(sm, handle) \
+    (cork_raw_slot_map_insert(cork_slot_map_to_raw(sm), (handle)), \
+     &(sm)->values.items[(sm)->values.size - 1])
+
+#define cork_slot_map_get(sm, handle) \
+    (cork_raw_slot_map_get(cork_slot_map_to_raw(sm), (handle)))
+#define cork_slot_map_remove(sm, handle) \
+    (cork_raw_slot_map_remove(cork_slot_map_to_raw(sm), (handle)))
+
+
+/*-----------------------------------------------------------------------
+ * Sparse sets
+ */
+
+/* A set of integers in the range [0, universe).  The members are kept packed
+ * in dense, in insertion order (modulo removals), and sparse maps each member
+ * to its position in dense. */
+struct cork_sparse_set {
+    uint32_t  *dense;
+    uint32_t  *sparse;
+    size_t  size;
+    size_t  universe;
+};
+
+CORK_API struct cork_sparse_set *
+cork_sparse_set_new(size_t universe);
+
+CORK_API void
+cork_sparse_set_free(struct cork_sparse_set *set);
+
+/* Constant time, regardless of the size of the universe. */
+#define cork_sparse_set_clear(set)  ((set)->size = 0)
+
+#define cork_sparse_set_size(set)  ((set)->size)
+
+/* Dense iteration: i ranges over [0, cork_sparse_set_size(set)). */
+#define cork_sparse_set_at(set, i)  ((set)->dense[(i)])
+
+#define cork_sparse_set_contains(set, value) \
+    ((set)->sparse[(value)] < (set)->size && \
+     (set)->dense[(set)->sparse[(value)]] == (value))
+
+/* Returns whether value was newly added to the set. */
+CORK_API bool
+cork_sparse_set_add(struct cork_sparse_set *set, uint32_t value);
+
+/* Returns whether value was in the set. */
+CORK_API bool
+cork_sparse_set_remove(struct cork_sparse_set *set, uint32_t value);
+
+
+#endif /* LIBCORK_DS_SLOT_MAP_H */
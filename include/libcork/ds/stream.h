@@ -12,9 +12,11 @@
 #define LIBCORK_DS_STREAM_H
 
 #include <stdio.h>
+#include <sys/types.h>
 
 #include <libcork/core/api.h>
 #include <libcork/core/types.h>
+#include <libcork/ds/managed-buffer.h>
 
 
 struct cork_stream_consumer {
@@ -51,6 +53,42 @@ cork_consume_file_from_path(struct cork_stream_consumer *consumer,
                             const char *path, int flags);
 
 
+/*-----------------------------------------------------------------------
+ * Chunk consumers
+ */
+
+/* Like a stream consumer, but each chunk is passed in as a managed buffer,
+ * which the consumer can keep after it returns by taking a reference to
+ * it. */
+struct cork_chunk_consumer {
+    int
+    (*chunk)(struct cork_chunk_consumer *consumer,
+             struct cork_managed_buffer *chunk, bool is_first_chunk);
+
+    int
+    (*eof)(struct cork_chunk_consumer *consumer);
+
+    void
+    (*free)(struct cork_chunk_consumer *consumer);
+};
+
+#define cork_chunk_consumer_chunk(consumer, chunk, is_first) \
+    ((consumer)->chunk((consumer), (chunk), (is_first)))
+
+#define cork_chunk_consumer_eof(consumer) \
+    ((consumer)->eof((consumer)))
+
+#define cork_chunk_consumer_free(consumer) \
+    ((consumer)->free((consumer)))
+
+/* Reads into buffers from a process-wide buffer pool. */
+CORK_API int
+cork_consume_fd_chunks(struct cork_chunk_consumer *consumer, int fd);
+
+CORK_API int
+cork_consume_file_chunks(struct cork_chunk_consumer *consumer, FILE *fp);
+
+
 CORK_API struct cork_stream_consumer *
 cork_fd_consumer_new(int fd);
 
@@ -61,4 +99,104 @@ CORK_API struct cork_stream_consumer *
 cork_file_from_path_consumer_new(const char *path, int flags);
 
 
+/*-----------------------------------------------------------------------
+ * Pull-based producers
+ */
+
+struct cork_stream_producer {
+    /* Copies up to size bytes of the stream into buf.  Returns the number of
+     * bytes copied, 0 at the end of the stream, or -1 on error. */
+    ssize_t
+    (*read)(struct cork_stream_producer *producer, void *buf, size_t size);
+
+    /* Points *buf at up to max_size bytes of the stream without copying
+     * them, and returns the number of bytes, 0 at the end of the stream, or
+     * -1 on error.  The data is valid until the next call to read or borrow.
+     * This can be NULL if the producer has no data of its own to lend. */
+    ssize_t
+    (*borrow)(struct cork_stream_producer *producer,
+              const void **buf, size_t max_size);
+
+    void
+    (*free)(struct cork_stream_producer *producer);
+};
+
+
+#define cork_stream_producer_read(producer, buf, size) \
+    ((producer)->read((producer), (buf), (size)))
+
+#define cork_stream_producer_can_borrow(producer) \
+    ((producer)->borrow != NULL)
+
+#define cork_stream_producer_borrow(producer, buf, max_size) \
+    ((producer)->borrow((producer), (buf), (max_size)))
+
+#define cork_stream_producer_free(producer) \
+    ((producer)->free((producer)))
+
+
+CORK_API struct cork_stream_producer *
+cork_fd_producer_new(int fd);
+
+CORK_API struct cork_stream_producer *
+cork_file_producer_new(FILE *fp);
+
+/* Maps the whole file into memory; returns NULL if we can't. */
+CORK_API struct cork_stream_producer *
+cork_mmap_producer_new(const char *path);
+
+/* buf must stay valid for the lifetime of the producer. */
+CORK_API struct cork_stream_producer *
+cork_buffer_producer_new(const void *buf, size_t size);
+
+
+/*-----------------------------------------------------------------------
+ * Pumps
+ */
+
+#define CORK_STREAM_PUMP_CHUNK_SIZE  65536
+
+/* Pulls chunks of at most chunk_size bytes (0 means
+ * CORK_STREAM_PUMP_CHUNK_SIZE) from producer and passes them to consumer,
+ * borrowing them if the producer supports it. */
+CORK_API int
+cork_stream_pump(struct cork_stream_producer *producer,
+                 struct cork_stream_consumer *consumer,
+                 size_t chunk_size);
+
+/* Like cork_stream_pump, but reads from producer in a separate thread.  At
+ * most max_chunks chunks are held between the two; once they're all full,
+ * the reading thread waits for the consumer to catch up. */
+CORK_API int
+cork_stream_pump_threaded(struct cork_stream_producer *producer,
+                          struct cork_stream_consumer *consumer,
+                          size_t chunk_size, size_t max_chunks);
+
+
+/*-----------------------------------------------------------------------
+ * Parallel file processing
+ */
+
+/* Creates the consumer for one range of the file. */
+typedef struct cork_stream_consumer *
+(*cork_range_consumer_new_f)(void *user_data, size_t range_index);
+
+/* Called in the calling thread once a range's consumer has seen the end of
+ * its range.  The consumer is freed when this returns. */
+typedef int
+(*cork_range_consumer_merge_f)(void *user_data, size_t range_index,
+                               struct cork_stream_consumer *consumer);
+
+/* Splits the file into range_count ranges, each of which starts just after
+ * a delimiter, and passes each range to its own consumer, using thread_count
+ * worker threads.  If ordered is true, ranges are merged in file order;
+ * otherwise they're merged as soon as they finish. */
+CORK_API int
+cork_consume_file_in_parallel(const char *path, char delimiter,
+                              size_t range_count, size_t thread_count,
+                              bool ordered, void *user_data,
+                              cork_range_consumer_new_f new_consumer,
+                              cork_range_consumer_merge_f merge);
+
+
 #endif /* LIBCORK_DS_STREAM_H */
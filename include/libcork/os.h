@@ -15,6 +15,7 @@
 
 #include <libcork/os/files.h>
 #include <libcork/os/process.h>
+#include <libcork/os/record-log.h>
 #include <libcork/os/subprocess.h>
 
 #endif /* LIBCORK_OS_H */
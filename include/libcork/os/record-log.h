@@ -0,0 +1,88 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_OS_RECORD_LOG_H
+#define LIBCORK_OS_RECORD_LOG_H
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/slice.h>
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+/* hash of "libcork/os/record-log.h" */
+#define CORK_RECORD_LOG_ERROR  0x73a67322
+
+enum cork_record_log_error {
+    /* A log segment is corrupt */
+    CORK_RECORD_LOG_CORRUPT,
+    /* A record is too large to be stored in the log */
+    CORK_RECORD_LOG_TOO_LARGE
+};
+
+
+/*-----------------------------------------------------------------------
+ * Writing to a record log
+ */
+
+#define CORK_RECORD_LOG_DEFAULT_SEGMENT_SIZE  (64 * 1024 * 1024)
+
+struct cork_record_log;
+
+/* Opens the log in the given directory, creating it if necessary.  Any
+ * partially written records at the end of the log are discarded.  A log can
+ * only have one writer, and a log object can't be shared between threads. */
+CORK_API struct cork_record_log *
+cork_record_log_open(const char *path, size_t segment_size);
+
+/* Commits any outstanding records before closing the log.  The log is freed
+ * even if that fails. */
+CORK_API int
+cork_record_log_close(struct cork_record_log *log);
+
+/* The position that the next record will be written at. */
+CORK_API uint64_t
+cork_record_log_end(const struct cork_record_log *log);
+
+/* The record isn't guaranteed to be on disk until the next commit. */
+CORK_API int
+cork_record_log_append(struct cork_record_log *log,
+                       const void *src, size_t size, uint64_t *position);
+
+/* Writes out every record that has been appended since the last commit, and
+ * flushes them to disk with a single fdatasync. */
+CORK_API int
+cork_record_log_commit(struct cork_record_log *log);
+
+
+/*-----------------------------------------------------------------------
+ * Reading from a record log
+ */
+
+struct cork_record_log_reader;
+
+CORK_API struct cork_record_log_reader *
+cork_record_log_reader_new(const char *path);
+
+CORK_API void
+cork_record_log_reader_free(struct cork_record_log_reader *reader);
+
+/* Fills in dest with the contents of the next record, without copying it.
+ * You must finish each slice when you're done with it; the record stays
+ * valid until then, even after the reader is freed.  At the end of the log,
+ * dest will be empty (cork_slice_is_empty). */
+CORK_API int
+cork_record_log_reader_next(struct cork_record_log_reader *reader,
+                            struct cork_slice *dest, uint64_t *position);
+
+
+#endif /* LIBCORK_OS_RECORD_LOG_H */
@@ -14,6 +14,7 @@
 /*** include all of the parts ***/
 
 #include <libcork/threads/atomics.h>
+#include <libcork/threads/atomic-stack.h>
 #include <libcork/threads/basics.h>
 
 #endif /* LIBCORK_THREADS_H */
@@ -0,0 +1,202 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_THREADS_ATOMIC_STACK_H
+#define LIBCORK_THREADS_ATOMIC_STACK_H
+
+#include <string.h>
+
+#include <libcork/config.h>
+#include <libcork/core/attributes.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/slist.h>
+#include <libcork/threads/atomics.h>
+#include <libcork/threads/basics.h>
+
+
+/*-----------------------------------------------------------------------
+ * Lock-free stacks
+ */
+
+/* A Treiber stack of intrusive cork_slist_items.  To avoid the ABA problem,
+ * the head pointer is paired with a counter that changes on every update, and
+ * both are replaced with a single double-width compare-and-swap. */
+
+struct cork_atomic_stack_top {
+    struct cork_slist_item  *head;
+    uintptr_t  tag;
+};
+
+#if CORK_CONFIG_ARCH_X64 && CORK_CONFIG_HAVE_GCC_ASM
+#define CORK_ATOMIC_STACK_CMPXCHG16B  1
+#define CORK_ATOMIC_STACK_CAS64  0
+#elif CORK_SIZEOF_POINTER == 4
+#define CORK_ATOMIC_STACK_CMPXCHG16B  0
+#define CORK_ATOMIC_STACK_CAS64  1
+#else
+#define CORK_ATOMIC_STACK_CMPXCHG16B  0
+#define CORK_ATOMIC_STACK_CAS64  0
+#endif
+
+struct cork_atomic_stack {
+#if CORK_ATOMIC_STACK_CMPXCHG16B
+    /* cmpxchg16b requires its operand to be 16-byte aligned. */
+    struct cork_atomic_stack_top  top __attribute__((aligned(16)));
+#elif CORK_ATOMIC_STACK_CAS64
+    struct cork_atomic_stack_top  top __attribute__((aligned(8)));
+#else
+    /* No double-width CAS on this platform, so fall back on a lock. */
+    struct cork_atomic_stack_top  top;
+    struct cork_spinlock  lock;
+#endif
+};
+
+#if CORK_ATOMIC_STACK_CMPXCHG16B || CORK_ATOMIC_STACK_CAS64
+#define CORK_ATOMIC_STACK_INIT  { { NULL, 0 } }
+#define cork_atomic_stack_init(stack) \
+    ((stack)->top.head = NULL, (stack)->top.tag = 0, (void) 0)
+#else
+#define CORK_ATOMIC_STACK_INIT  { { NULL, 0 }, CORK_SPINLOCK_INIT }
+#define cork_atomic_stack_init(stack) \
+    ((stack)->top.head = NULL, (stack)->top.tag = 0, \
+     cork_spinlock_init(&(stack)->lock), (void) 0)
+#endif
+
+/* The result is only a snapshot, since other threads might be updating the
+ * stack at the same time. */
+#define cork_atomic_stack_is_empty(stack) \
+    (((volatile struct cork_atomic_stack_top *) &(stack)->top)->head == NULL)
+
+/* If the stack's top is still equal to *expected, replaces it with desired
+ * and returns true.  Otherwise, loads the current top into *expected and
+ * returns false. */
+CORK_ATTR_UNUSED
+static inline bool
+cork_atomic_stack_top_cas(struct cork_atomic_stack *stack,
+                          struct cork_atomic_stack_top *expected,
+                          struct cork_atomic_stack_top desired)
+{
+#if CORK_ATOMIC_STACK_CMPXCHG16B
+    uint64_t  old_head = (uint64_t) (uintptr_t) expected->head;
+    uint64_t  old_tag = expected->tag;
+    char  result;
+    __asm__ __volatile__
+        ("lock; cmpxchg16b %0; setz %1"
+         : "+m" (stack->top), "=q" (result), "+a" (old_head), "+d" (old_tag)
+         : "b" ((uint64_t) (uintptr_t) desired.head),
+           "c" ((uint64_t) desired.tag)
+         : "cc", "memory");
+    expected->head = (struct cork_slist_item *) (uintptr_t) old_head;
+    expected->tag = old_tag;
+    return result != 0;
+#elif CORK_ATOMIC_STACK_CAS64
+    uint64_t  old_word;
+    uint64_t  new_word;
+    uint64_t  prior;
+    memcpy(&old_word, expected, sizeof(old_word));
+    memcpy(&new_word, &desired, sizeof(new_word));
+    prior = __sync_val_compare_and_swap
+        ((uint64_t *) (void *) &stack->top, old_word, new_word);
+    if (prior == old_word) {
+        return true;
+    }
+    memcpy(expected, &prior, sizeof(prior));
+    return false;
+#else
+    bool  result;
+    cork_spinlock_lock(&stack->lock);
+    result = (stack->top.head == expected->head &&
+              stack->top.tag == expected->tag);
+    if (result) {
+        stack->top = desired;
+    } else {
+        *expected = stack->top;
+    }
+    cork_spinlock_unlock(&stack->lock);
+    return result;
+#endif
+}
+
+/* A non-atomic read of the top.  If the two halves are torn, the next CAS
+ * will fail and give us a consistent copy. */
+#define cork_atomic_stack_top_load(stack, dest) \
+    do { \
+        volatile struct cork_atomic_stack_top  *__top = &(stack)->top; \
+        (dest)->tag = __top->tag; \
+        (dest)->head = __top->head; \
+    } while (0)
+
+/* Pushes a chain of elements, from first to last (which are already linked
+ * together via their next pointers), onto the stack in a single step. */
+CORK_ATTR_UNUSED
+static inline void
+cork_atomic_stack_push_chain(struct cork_atomic_stack *stack,
+                             struct cork_slist_item *first,
+                             struct cork_slist_item *last)
+{
+    struct cork_atomic_stack_top  old_top;
+    struct cork_atomic_stack_top  new_top;
+    cork_atomic_stack_top_load(stack, &old_top);
+    new_top.head = first;
+    do {
+        last->next = old_top.head;
+        new_top.tag = old_top.tag + 1;
+    } while (CORK_UNLIKELY(!cork_atomic_stack_top_cas
+                           (stack, &old_top, new_top)));
+}
+
+#define cork_atomic_stack_push(stack, element) \
+    (cork_atomic_stack_push_chain((stack), (element), (element)))
+
+/* Pops the top element from the stack, returning NULL if the stack is empty.
+ * Another thread might still be reading an element's next pointer after it
+ * has been popped, so elements must not be returned to the operating system
+ * while any thread might still pop from the stack; recycling them through a
+ * free list or memory pool is fine. */
+CORK_ATTR_UNUSED
+static inline struct cork_slist_item *
+cork_atomic_stack_pop(struct cork_atomic_stack *stack)
+{
+    struct cork_atomic_stack_top  old_top;
+    struct cork_atomic_stack_top  new_top;
+    cork_atomic_stack_top_load(stack, &old_top);
+    do {
+        if (old_top.head == NULL) {
+            return NULL;
+        }
+        new_top.head = old_top.head->next;
+        new_top.tag = old_top.tag + 1;
+    } while (CORK_UNLIKELY(!cork_atomic_stack_top_cas
+                           (stack, &old_top, new_top)));
+    return old_top.head;
+}
+
+/* Removes every element from the stack in one step, returning them as a
+ * NULL-terminated chain, most recently pushed first. */
+CORK_ATTR_UNUSED
+static inline struct cork_slist_item *
+cork_atomic_stack_pop_all(struct cork_atomic_stack *stack)
+{
+    struct cork_atomic_stack_top  old_top;
+    struct cork_atomic_stack_top  new_top;
+    cork_atomic_stack_top_load(stack, &old_top);
+    new_top.head = NULL;
+    do {
+        if (old_top.head == NULL) {
+            return NULL;
+        }
+        new_top.tag = old_top.tag + 1;
+    } while (CORK_UNLIKELY(!cork_atomic_stack_top_cas
+                           (stack, &old_top, new_top)));
+    return old_top.head;
+}
+
+
+#endif /* LIBCORK_THREADS_ATOMIC_STACK_H */
@@ -33,6 +33,10 @@
 #define cork_uint_cas              __sync_val_compare_and_swap
 #define cork_ptr_cas               __sync_val_compare_and_swap
 
+/* A full memory barrier: no loads or stores can be reordered across it, by
+ * either the compiler or the processor. */
+#define cork_memory_barrier        __sync_synchronize
+
 
 /*-----------------------------------------------------------------------
  * End of atomic implementations
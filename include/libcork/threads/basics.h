@@ -151,6 +151,38 @@ cork_thread_join(struct cork_thread *thread);
     } while (0)
 
 
+/*-----------------------------------------------------------------------
+ * Spin locks
+ */
+
+/* A very small lock that busy-waits instead of sleeping.  Only use this to
+ * protect short critical sections that never block. */
+
+struct cork_spinlock {
+    volatile int  locked;
+};
+
+#define CORK_SPINLOCK_INIT  { 0 }
+
+#define cork_spinlock_init(lock)  ((lock)->locked = 0)
+
+#define cork_spinlock_lock(lock) \
+    do { \
+        while (CORK_UNLIKELY(cork_int_cas(&(lock)->locked, 0, 1) != 0)) { \
+            while ((lock)->locked != 0) { cork_pause(); } \
+        } \
+    } while (0)
+
+#define cork_spinlock_try_lock(lock) \
+    (cork_int_cas(&(lock)->locked, 0, 1) == 0)
+
+#define cork_spinlock_unlock(lock) \
+    do { \
+        CORK_ATTR_UNUSED int  __prior = cork_int_cas(&(lock)->locked, 1, 0); \
+        assert(__prior == 1); \
+    } while (0)
+
+
 /*-----------------------------------------------------------------------
  * Thread-local storage
  */
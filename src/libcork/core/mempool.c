@@ -29,47 +29,60 @@
 
 
 
-struct cork_mempool {
-    size_t  element_size;
-    size_t  block_size;
-    struct cork_mempool_object  *free_list;
-    /* The number of objects that have been given out by
-     * cork_mempool_new but not returned via cork_mempool_free. */
-    size_t  allocated_count;
-    struct cork_mempool_block  *blocks;
-
-    void  *user_data;
-    cork_free_f  free_user_data;
-    cork_init_f  init_object;
-    cork_done_f  done_object;
-};
-
-struct cork_mempool_object {
-    /* When this object is unclaimed, it will be in the cork_mempool
-     * object's free_list using this pointer. */
-    struct cork_mempool_object  *next_free;
-};
-
 struct cork_mempool_block {
     struct cork_mempool_block  *next_block;
 };
 
-#define cork_mempool_object_size(mp) \
-    (sizeof(struct cork_mempool_object) + (mp)->element_size)
+#define cork_mempool_object_size(mp)  ((mp)->object_size)
 
-#define cork_mempool_get_header(obj) \
-    (((struct cork_mempool_object *) (obj)) - 1)
+#define cork_mempool_get_header(mp, obj) \
+    ((struct cork_mempool_object *) (((char *) (obj)) - (mp)->header_size))
 
-#define cork_mempool_get_object(hdr) \
-    ((void *) (((struct cork_mempool_object *) (hdr)) + 1))
+#define cork_mempool_get_object(mp, hdr) \
+    ((void *) (((char *) (hdr)) + (mp)->header_size))
 
 
-struct cork_mempool *
-cork_mempool_new_size_ex(size_t element_size, size_t block_size)
+#define cork_mempool_round_up(size, alignment) \
+    (((size) + (alignment) - 1) & ~((alignment) - 1))
+
+/* The offset of the first object's header within each block.  The first
+ * object's contents (not its header) must start on an alignment boundary;
+ * since object_size is a multiple of the alignment, every other object's
+ * will too. */
+#define cork_mempool_first_object(header_size, alignment) \
+    (cork_mempool_round_up \
+     (sizeof(struct cork_mempool_block) + (header_size), (alignment)) \
+     - (header_size))
+
+static struct cork_mempool *
+cork_mempool_new_internal(size_t element_size, size_t block_size,
+                          size_t header_size, size_t alignment)
 {
-    struct cork_mempool  *mp = cork_new(struct cork_mempool);
+    struct cork_mempool  *mp;
+    /* Each object must be large enough to hold the free list link while
+     * it's unclaimed. */
+    size_t  object_size = header_size + element_size;
+    if (object_size < sizeof(struct cork_mempool_object)) {
+        object_size = sizeof(struct cork_mempool_object);
+    }
+
+    assert((alignment & (alignment - 1)) == 0);
+    object_size = cork_mempool_round_up(object_size, alignment);
+
+    /* Every block must be able to hold at least one object, along with the
+     * block header and any padding needed to align that object. */
+    if (block_size <
+        cork_mempool_first_object(header_size, alignment) + object_size) {
+        block_size =
+            cork_mempool_first_object(header_size, alignment) + object_size;
+    }
+
+    mp = cork_new(struct cork_mempool);
     mp->element_size = element_size;
     mp->block_size = block_size;
+    mp->header_size = header_size;
+    mp->object_size = object_size;
+    mp->alignment = alignment;
     mp->free_list = NULL;
     mp->allocated_count = 0;
     mp->blocks = NULL;
@@ -80,6 +93,43 @@ cork_mempool_new_size_ex(size_t element_size, size_t block_size)
     return mp;
 }
 
+struct cork_mempool *
+cork_mempool_new_size_ex(size_t element_size, size_t block_size)
+{
+    return cork_mempool_new_internal
+        (element_size, block_size, sizeof(struct cork_mempool_object), 1);
+}
+
+struct cork_mempool *
+cork_mempool_new_aligned_size_ex(size_t element_size, size_t block_size,
+                                 size_t alignment)
+{
+    if (alignment < sizeof(void *)) {
+        alignment = sizeof(void *);
+    }
+    return cork_mempool_new_internal
+        (element_size, block_size, sizeof(struct cork_mempool_object),
+         alignment);
+}
+
+struct cork_mempool *
+cork_mempool_new_compact_size_ex(size_t element_size, size_t block_size)
+{
+    return cork_mempool_new_compact_aligned_size_ex
+        (element_size, block_size, sizeof(void *));
+}
+
+struct cork_mempool *
+cork_mempool_new_compact_aligned_size_ex(size_t element_size,
+                                         size_t block_size, size_t alignment)
+{
+    /* The free list link must be aligned, too. */
+    if (alignment < sizeof(void *)) {
+        alignment = sizeof(void *);
+    }
+    return cork_mempool_new_internal(element_size, block_size, 0, alignment);
+}
+
 void
 cork_mempool_free(struct cork_mempool *mp)
 {
@@ -90,7 +140,7 @@ cork_mempool_free(struct cork_mempool *mp)
         struct cork_mempool_object  *obj;
         for (obj = mp->free_list; obj != NULL; obj = obj->next_free) {
             mp->done_object
-                (mp->user_data, cork_mempool_get_object(obj));
+                (mp->user_data, cork_mempool_get_object(mp, obj));
         }
     }
 
@@ -113,6 +163,10 @@ cork_mempool_set_callbacks(struct cork_mempool *mp,
                            cork_init_f init_object,
                            cork_done_f done_object)
 {
+    /* A compact pool overwrites the start of each object when it's freed, so
+     * nothing that init_object sets up would survive. */
+    assert(mp->header_size > 0 ||
+           (init_object == NULL && done_object == NULL));
     cork_free_user_data(mp);
     mp->user_data = user_data;
     mp->free_user_data = free_user_data;
@@ -129,22 +183,34 @@ cork_mempool_new_block(struct cork_mempool *mp)
     /* Allocate the new block and add it to mp's block list. */
     struct cork_mempool_block  *block;
     void  *vblock;
+    size_t  first;
     DEBUG("Allocating new %zu-byte block\n", mp->block_size);
-    block = cork_malloc(mp->block_size);
+    if (mp->alignment > sizeof(void *)) {
+        if (CORK_UNLIKELY(posix_memalign
+                          (&vblock, mp->alignment, mp->block_size) != 0)) {
+            cork_abort("Cannot allocate %zu-byte memory pool block",
+                       mp->block_size);
+        }
+        block = vblock;
+    } else {
+        block = cork_malloc(mp->block_size);
+    }
     block->next_block = mp->blocks;
     mp->blocks = block;
     vblock = block;
 
     /* Divide the block's memory region into a bunch of objects. */
-    size_t  index = sizeof(struct cork_mempool_block);
-    for (index = sizeof(struct cork_mempool_block);
+    first = cork_mempool_first_object(mp->header_size, mp->alignment);
+    size_t  index;
+    for (index = first;
          (index + cork_mempool_object_size(mp)) <= mp->block_size;
          index += cork_mempool_object_size(mp)) {
         struct cork_mempool_object  *obj = vblock + index;
-        DEBUG("  New object at %p[%p]\n", cork_mempool_get_object(obj), obj);
+        DEBUG("  New object at %p[%p]\n",
+              cork_mempool_get_object(mp, obj), obj);
         if (mp->init_object != NULL) {
             mp->init_object
-                (mp->user_data, cork_mempool_get_object(obj));
+                (mp->user_data, cork_mempool_get_object(mp, obj));
         }
         obj->next_free = mp->free_list;
         mp->free_list = obj;
@@ -164,14 +230,14 @@ cork_mempool_new_object(struct cork_mempool *mp)
     obj = mp->free_list;
     mp->free_list = obj->next_free;
     mp->allocated_count++;
-    ptr = cork_mempool_get_object(obj);
+    ptr = cork_mempool_get_object(mp, obj);
     return ptr;
 }
 
 void
 cork_mempool_free_object(struct cork_mempool *mp, void *ptr)
 {
-    struct cork_mempool_object  *obj = cork_mempool_get_header(ptr);
+    struct cork_mempool_object  *obj = cork_mempool_get_header(mp, ptr);
     DEBUG("Returning %p[%p] to memory pool\n", ptr, obj);
     obj->next_free = mp->free_list;
     mp->free_list = obj;
@@ -8,7 +8,6 @@
  */
 
 #include <string.h>
-#include <stdio.h>
 
 #include "libcork/core/types.h"
 #include "libcork/core/u128.h"
@@ -62,24 +61,28 @@ cork_u128_to_decimal(char *dest, cork_u128 val)
 }
 
 
+static const char  cork_u128_hex_digits[] = "0123456789abcdef";
+
 const char *
-cork_u128_to_hex(char *buf, cork_u128 val)
+cork_u128_to_padded_hex(char *buf, cork_u128 val)
 {
-    uint64_t  hi = val._.be64.hi;
-    uint64_t  lo = val._.be64.lo;
-    if (hi == 0) {
-        snprintf(buf, CORK_U128_HEX_LENGTH, "%" PRIx64, lo);
-    } else {
-        snprintf(buf, CORK_U128_HEX_LENGTH, "%" PRIx64 "%016" PRIx64, hi, lo);
+    unsigned int  i;
+    for (i = 0; i < 16; i++) {
+        uint8_t  byte = cork_u128_be8(val, i);
+        buf[i * 2] = cork_u128_hex_digits[byte >> 4];
+        buf[i * 2 + 1] = cork_u128_hex_digits[byte & 0x0f];
     }
+    buf[CORK_U128_HEX_LENGTH - 1] = '\0';
     return buf;
 }
 
 const char *
-cork_u128_to_padded_hex(char *buf, cork_u128 val)
+cork_u128_to_hex(char *buf, cork_u128 val)
 {
-    uint64_t  hi = val._.be64.hi;
-    uint64_t  lo = val._.be64.lo;
-    snprintf(buf, CORK_U128_HEX_LENGTH, "%016" PRIx64 "%016" PRIx64, hi, lo);
-    return buf;
+    /* Skip over any leading zeroes, but always leave at least one digit. */
+    const char  *p = cork_u128_to_padded_hex(buf, val);
+    while (p[0] == '0' && p < &buf[CORK_U128_HEX_LENGTH - 2]) {
+        p++;
+    }
+    return p;
 }
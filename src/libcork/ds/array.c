@@ -35,19 +35,6 @@
  * Resizable arrays
  */
 
-struct cork_array_priv {
-    size_t  allocated_count;
-    size_t  allocated_size;
-    size_t  element_size;
-    size_t  initialized_count;
-    void  *user_data;
-    cork_free_f  free_user_data;
-    cork_init_f  init;
-    cork_done_f  done;
-    cork_init_f  reuse;
-    cork_done_f  remove;
-};
-
 void
 cork_raw_array_init(struct cork_raw_array *array, size_t element_size)
 {
@@ -58,6 +45,7 @@ cork_raw_array_init(struct cork_raw_array *array, size_t element_size)
     array->priv->allocated_size = 0;
     array->priv->element_size = element_size;
     array->priv->initialized_count = 0;
+    array->priv->pod = true;
     array->priv->user_data = NULL;
     array->priv->free_user_data = NULL;
     array->priv->init = NULL;
@@ -92,28 +80,55 @@ cork_raw_array_set_callback_data(struct cork_raw_array *array,
     array->priv->free_user_data = free_user_data;
 }
 
+/* Should be called whenever one of the callbacks changes. */
+static void
+cork_raw_array_update_pod(struct cork_raw_array *array)
+{
+    struct cork_array_priv  *priv = array->priv;
+    bool  pod = (priv->init == NULL && priv->done == NULL &&
+                 priv->reuse == NULL && priv->remove == NULL);
+    if (priv->pod && !pod) {
+        /* We don't keep track of which elements have been initialized in POD
+         * mode, so assume that anything we've handed out has been. */
+        if (priv->initialized_count < array->size) {
+            priv->initialized_count = array->size;
+        }
+    }
+    priv->pod = pod;
+}
+
 void
 cork_raw_array_set_init(struct cork_raw_array *array, cork_init_f init)
 {
     array->priv->init = init;
+    cork_raw_array_update_pod(array);
 }
 
 void
 cork_raw_array_set_done(struct cork_raw_array *array, cork_done_f done)
 {
     array->priv->done = done;
+    cork_raw_array_update_pod(array);
 }
 
 void
 cork_raw_array_set_reuse(struct cork_raw_array *array, cork_init_f reuse)
 {
     array->priv->reuse = reuse;
+    cork_raw_array_update_pod(array);
 }
 
 void
 cork_raw_array_set_remove(struct cork_raw_array *array, cork_done_f remove)
 {
     array->priv->remove = remove;
+    cork_raw_array_update_pod(array);
+}
+
+bool
+cork_raw_array_is_pod(const struct cork_raw_array *array)
+{
+    return array->priv->pod;
 }
 
 size_t
@@ -194,6 +209,9 @@ cork_raw_array_append(struct cork_raw_array *array)
     index = array->size++;
     cork_raw_array_ensure_size(array, array->size);
     element = cork_raw_array_at(array, index);
+    if (array->priv->pod) {
+        return element;
+    }
 
     /* Call the init or reset callback, depending on whether this entry has been
      * initialized before. */
@@ -219,6 +237,30 @@ cork_raw_array_append(struct cork_raw_array *array)
     return element;
 }
 
+void *
+cork_raw_array_append_n(struct cork_raw_array *array,
+                        const void *src, size_t count)
+{
+    size_t  element_size = array->priv->element_size;
+    size_t  index = array->size;
+    char  *first;
+
+    /* We copy the raw contents of src over the new elements, which would
+     * clobber (and leak) anything that an init or reuse callback set up. */
+    assert(array->priv->init == NULL && array->priv->reuse == NULL);
+
+    cork_raw_array_ensure_size(array, index + count);
+    first = cork_raw_array_at(array, index);
+    array->size += count;
+    if (!array->priv->pod && array->size > array->priv->initialized_count) {
+        array->priv->initialized_count = array->size;
+    }
+    if (count > 0) {
+        memcpy(first, src, count * element_size);
+    }
+    return first;
+}
+
 int
 cork_raw_array_copy(struct cork_raw_array *dest,
                     const struct cork_raw_array *src,
@@ -234,6 +276,15 @@ cork_raw_array_copy(struct cork_raw_array *dest,
     cork_array_clear(dest);
     cork_array_ensure_size(dest, src->size);
 
+    if (dest->priv->pod && copy == NULL) {
+        if (src->size > 0) {
+            memcpy(dest->items, src->items,
+                   src->size * dest->priv->element_size);
+        }
+        dest->size = src->size;
+        return 0;
+    }
+
     /* Initialize enough elements to hold the contents of src */
     reuse_count = dest->priv->initialized_count;
     if (src->size < reuse_count) {
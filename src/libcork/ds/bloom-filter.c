@@ -0,0 +1,330 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/bloom-filter.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Blocked Bloom filters
+ */
+
+/* Each element is mapped to a single 64-byte block (one cache line), and sets
+ * one bit in each of hash_count different 32-bit words within that block.
+ * Probes never touch more than one cache line, and the per-word operations
+ * are independent of each other, so the compiler can vectorize them. */
+
+#define CORK_BLOOM_FILTER_BLOCK_SIZE  64
+#define CORK_BLOOM_FILTER_BLOCK_BITS  (CORK_BLOOM_FILTER_BLOCK_SIZE * 8)
+#define CORK_BLOOM_FILTER_WORDS_PER_BLOCK  16
+#define CORK_BLOOM_FILTER_MAX_HASHES  CORK_BLOOM_FILTER_WORDS_PER_BLOCK
+
+/* Odd multipliers used to derive a bit index for each word from a single
+ * 32-bit hash value. */
+static const uint32_t  cork_bloom_filter_salts
+        [CORK_BLOOM_FILTER_WORDS_PER_BLOCK] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    0x9e3779b1U, 0x85ebca6bU, 0xc2b2ae35U, 0x27d4eb2fU,
+    0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U
+};
+
+struct cork_bloom_filter {
+    uint32_t  *words;
+    size_t  block_count;
+    unsigned int  hash_count;
+    /* Whether we allocated words ourselves, or are using someone else's
+     * serialized copy. */
+    bool  owns_words;
+};
+
+
+/* Returns log2(x) for x >= 1, without needing libm.  We only need a few bits
+ * of precision to size the filter. */
+static double
+cork_bloom_filter_log2(double x)
+{
+    double  result = 0.0;
+    double  bit = 1.0;
+    unsigned int  i;
+    while (x >= 2.0) {
+        x /= 2.0;
+        result += 1.0;
+    }
+    for (i = 0; i < 16; i++) {
+        x *= x;
+        bit /= 2.0;
+        if (x >= 2.0) {
+            x /= 2.0;
+            result += bit;
+        }
+    }
+    return result;
+}
+
+static struct cork_bloom_filter *
+cork_bloom_filter_new_empty(size_t block_count, unsigned int hash_count)
+{
+    struct cork_bloom_filter  *filter = cork_new(struct cork_bloom_filter);
+    filter->words = NULL;
+    filter->block_count = block_count;
+    filter->hash_count = hash_count;
+    filter->owns_words = false;
+    return filter;
+}
+
+struct cork_bloom_filter *
+cork_bloom_filter_new(size_t expected_count, double false_positive_rate)
+{
+    struct cork_bloom_filter  *filter;
+    double  log2_rate;
+    double  bits_per_element;
+    double  bit_count;
+    unsigned int  hash_count;
+    size_t  block_count;
+    size_t  byte_count;
+
+    assert(false_positive_rate > 0.0 && false_positive_rate < 1.0);
+    if (expected_count == 0) {
+        expected_count = 1;
+    }
+
+    /* The classic Bloom filter needs log2(1/p) / ln(2) bits per element, with
+     * log2(1/p) hash functions.  Confining each element to a single block
+     * makes the bits less evenly distributed, which we compensate for with
+     * some extra space. */
+    log2_rate = cork_bloom_filter_log2(1.0 / false_positive_rate);
+    bits_per_element = log2_rate * 1.4427 * 1.2;
+    hash_count = (unsigned int) (log2_rate + 0.5);
+    if (hash_count < 1) {
+        hash_count = 1;
+    } else if (hash_count > CORK_BLOOM_FILTER_MAX_HASHES) {
+        hash_count = CORK_BLOOM_FILTER_MAX_HASHES;
+    }
+
+    bit_count = bits_per_element * (double) expected_count;
+    block_count = (size_t) (bit_count / CORK_BLOOM_FILTER_BLOCK_BITS) + 1;
+    assert((uint64_t) block_count <= UINT32_MAX);
+
+    filter = cork_bloom_filter_new_empty(block_count, hash_count);
+    byte_count = block_count * CORK_BLOOM_FILTER_BLOCK_SIZE;
+    if (CORK_UNLIKELY(posix_memalign
+                      ((void **) &filter->words,
+                       CORK_BLOOM_FILTER_BLOCK_SIZE, byte_count) != 0)) {
+        cork_abort("Cannot allocate %zu-byte Bloom filter", byte_count);
+    }
+    memset(filter->words, 0, byte_count);
+    filter->owns_words = true;
+    return filter;
+}
+
+void
+cork_bloom_filter_free(struct cork_bloom_filter *filter)
+{
+    if (filter->owns_words) {
+        free(filter->words);
+    }
+    free(filter);
+}
+
+void
+cork_bloom_filter_clear(struct cork_bloom_filter *filter)
+{
+    memset(filter->words, 0, cork_bloom_filter_byte_size(filter));
+}
+
+unsigned int
+cork_bloom_filter_hash_count(const struct cork_bloom_filter *filter)
+{
+    return filter->hash_count;
+}
+
+size_t
+cork_bloom_filter_byte_size(const struct cork_bloom_filter *filter)
+{
+    return filter->block_count * CORK_BLOOM_FILTER_BLOCK_SIZE;
+}
+
+
+/* The upper half of the hash chooses the block; the lower half chooses the
+ * bits within the block. */
+#define cork_bloom_filter_block(filter, hash) \
+    ((filter)->words + \
+     ((((cork_u128_be64((hash).u128, 0) >> 32) * \
+        (uint64_t) (filter)->block_count) >> 32) * \
+      CORK_BLOOM_FILTER_WORDS_PER_BLOCK))
+
+#define cork_bloom_filter_word_index(offset, i) \
+    (((offset) + (i)) & (CORK_BLOOM_FILTER_WORDS_PER_BLOCK - 1))
+
+#define cork_bloom_filter_bit(key, i) \
+    (((uint32_t) 1) << (((key) * cork_bloom_filter_salts[(i)]) >> 27))
+
+void
+cork_bloom_filter_add_hash(struct cork_bloom_filter *filter,
+                           cork_big_hash hash)
+{
+    uint32_t  *block = cork_bloom_filter_block(filter, hash);
+    uint64_t  bits = cork_u128_be64(hash.u128, 1);
+    uint32_t  key = (uint32_t) bits;
+    unsigned int  offset = (unsigned int) (bits >> 32);
+    unsigned int  i;
+    for (i = 0; i < filter->hash_count; i++) {
+        block[cork_bloom_filter_word_index(offset, i)] |=
+            cork_bloom_filter_bit(key, i);
+    }
+}
+
+bool
+cork_bloom_filter_contains_hash(const struct cork_bloom_filter *filter,
+                                cork_big_hash hash)
+{
+    const uint32_t  *block = cork_bloom_filter_block(filter, hash);
+    uint64_t  bits = cork_u128_be64(hash.u128, 1);
+    uint32_t  key = (uint32_t) bits;
+    unsigned int  offset = (unsigned int) (bits >> 32);
+    uint32_t  missing = 0;
+    unsigned int  i;
+    /* Accumulate instead of returning early so that the loop has no
+     * data-dependent branches. */
+    for (i = 0; i < filter->hash_count; i++) {
+        uint32_t  bit = cork_bloom_filter_bit(key, i);
+        missing |= ~block[cork_bloom_filter_word_index(offset, i)] & bit;
+    }
+    return missing == 0;
+}
+
+static cork_big_hash
+cork_bloom_filter_hash(const void *src, size_t len)
+{
+    cork_big_hash  seed = {cork_u128_from_64(0, 0)};
+    return cork_big_hash_buffer(seed, src, len);
+}
+
+void
+cork_bloom_filter_add(struct cork_bloom_filter *filter,
+                      const void *src, size_t len)
+{
+    cork_bloom_filter_add_hash(filter, cork_bloom_filter_hash(src, len));
+}
+
+bool
+cork_bloom_filter_contains(const struct cork_bloom_filter *filter,
+                           const void *src, size_t len)
+{
+    return cork_bloom_filter_contains_hash
+        (filter, cork_bloom_filter_hash(src, len));
+}
+
+
+/*-----------------------------------------------------------------------
+ * Serialization
+ */
+
+/* The serialized form is a 64-byte header followed by the filter's blocks,
+ * in host byte order.  The header's size keeps the blocks cache-line aligned
+ * when the file is mapped into memory.  cork_big_hash_buffer gives different
+ * results depending on the pointer size, so we record that too. */
+
+#define CORK_BLOOM_FILTER_MAGIC  0x6d6c4243  /* "CBlm" */
+#define CORK_BLOOM_FILTER_VERSION  1
+
+struct cork_bloom_filter_header {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  hash_count;
+    uint32_t  pointer_size;
+    uint64_t  block_count;
+    uint8_t  reserved[40];
+};
+
+void
+cork_bloom_filter_save(const struct cork_bloom_filter *filter,
+                       struct cork_buffer *dest)
+{
+    struct cork_bloom_filter_header  header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CORK_BLOOM_FILTER_MAGIC;
+    header.version = CORK_BLOOM_FILTER_VERSION;
+    header.hash_count = filter->hash_count;
+    header.pointer_size = CORK_SIZEOF_POINTER;
+    header.block_count = filter->block_count;
+    cork_buffer_append(dest, &header, sizeof(header));
+    cork_buffer_append
+        (dest, filter->words, cork_bloom_filter_byte_size(filter));
+}
+
+static void
+cork_bloom_filter_invalid_set(const char *reason)
+{
+    cork_error_set
+        (CORK_BLOOM_FILTER_ERROR, CORK_BLOOM_FILTER_INVALID,
+         "Invalid Bloom filter: %s", reason);
+}
+
+struct cork_bloom_filter *
+cork_bloom_filter_new_from_bytes(void *src, size_t size)
+{
+    struct cork_bloom_filter_header  header;
+    struct cork_bloom_filter  *filter;
+
+    if (CORK_UNLIKELY(((uintptr_t) src & 0x07) != 0)) {
+        cork_bloom_filter_invalid_set("Data isn't 8-byte aligned");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(size < sizeof(header))) {
+        cork_bloom_filter_invalid_set("Data is too short");
+        return NULL;
+    }
+
+    memcpy(&header, src, sizeof(header));
+    if (CORK_UNLIKELY(header.magic != CORK_BLOOM_FILTER_MAGIC)) {
+        cork_bloom_filter_invalid_set("Bad magic number");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(header.version != CORK_BLOOM_FILTER_VERSION)) {
+        cork_bloom_filter_invalid_set("Unknown version");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(header.pointer_size != CORK_SIZEOF_POINTER)) {
+        cork_bloom_filter_invalid_set("Created on an incompatible platform");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(header.hash_count < 1 ||
+                      header.hash_count > CORK_BLOOM_FILTER_MAX_HASHES ||
+                      header.block_count < 1 ||
+                      header.block_count > UINT32_MAX)) {
+        cork_bloom_filter_invalid_set("Bad filter parameters");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(size - sizeof(header) !=
+                      header.block_count * CORK_BLOOM_FILTER_BLOCK_SIZE)) {
+        cork_bloom_filter_invalid_set("Data has the wrong size");
+        return NULL;
+    }
+
+    filter = cork_bloom_filter_new_empty
+        (header.block_count, header.hash_count);
+    filter->words = (uint32_t *) ((char *) src + sizeof(header));
+    return filter;
+}
@@ -0,0 +1,366 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "libcork/config.h"
+#if CORK_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/buffer-pool.h"
+#include "libcork/ds/managed-buffer.h"
+#include "libcork/ds/slist.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
+
+
+/*-----------------------------------------------------------------------
+ * Size classes
+ */
+
+/* Size class i holds buffers with a capacity of at least 2^i times the
+ * minimum size.  The largest class holds buffers of up to
+ * CORK_BUFFER_POOL_MAX_SIZE bytes. */
+#define CORK_BUFFER_POOL_MIN_BITS  6
+#define CORK_BUFFER_POOL_MIN_SIZE  (1 << CORK_BUFFER_POOL_MIN_BITS)
+#define CORK_BUFFER_POOL_CLASS_COUNT  15
+
+#define cork_buffer_pool_class_size(i)  \
+    (((size_t) CORK_BUFFER_POOL_MIN_SIZE) << (i))
+
+/* The smallest class whose buffers can hold size bytes.  This might be
+ * CORK_BUFFER_POOL_CLASS_COUNT, if the buffer is too large to pool. */
+static unsigned int
+cork_buffer_pool_class_for_size(size_t size)
+{
+    unsigned int  i = 0;
+    while (i < CORK_BUFFER_POOL_CLASS_COUNT &&
+           cork_buffer_pool_class_size(i) < size) {
+        i++;
+    }
+    return i;
+}
+
+/* The largest class whose minimum capacity fits in allocated_size.  Returns
+ * CORK_BUFFER_POOL_CLASS_COUNT if the buffer is too small or too large to
+ * pool. */
+static unsigned int
+cork_buffer_pool_class_for_capacity(size_t allocated_size)
+{
+    unsigned int  i;
+    if (allocated_size < CORK_BUFFER_POOL_MIN_SIZE ||
+        allocated_size > CORK_BUFFER_POOL_MAX_SIZE) {
+        return CORK_BUFFER_POOL_CLASS_COUNT;
+    }
+    for (i = 0; cork_buffer_pool_class_size(i + 1) <= allocated_size; i++) {
+        /* keep looking */
+    }
+    return i;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Pooled buffers
+ */
+
+struct cork_buffer_pool_entry {
+    struct cork_buffer  buffer;
+    struct cork_slist_item  item;
+    /* Only used by cork_buffer_pool_to_managed_buffer */
+    struct cork_managed_buffer  managed;
+    struct cork_buffer_pool  *pool;
+};
+
+#define cork_buffer_pool_entry_from_item(i) \
+    cork_container_of((i), struct cork_buffer_pool_entry, item)
+
+#define cork_buffer_pool_entry_from_buffer(b) \
+    cork_container_of((b), struct cork_buffer_pool_entry, buffer)
+
+static void
+cork_buffer_pool_entry_free(struct cork_buffer_pool_entry *entry)
+{
+    cork_buffer_done(&entry->buffer);
+    free(entry);
+}
+
+static void
+cork_buffer_pool_list_done(struct cork_slist *list)
+{
+    struct cork_slist_item  *item;
+    while ((item = cork_slist_pop(list)) != NULL) {
+        cork_buffer_pool_entry_free(cork_buffer_pool_entry_from_item(item));
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Thread caches
+ */
+
+/* Each thread keeps a few buffers of each size class for whichever pool it
+ * used most recently, so that a thread that repeatedly acquires and releases
+ * buffers doesn't have to touch the pool's lock.  Pools are identified by a
+ * unique ID rather than their address, since a thread cache can outlive its
+ * pool.  A thread's cached buffers are freed when the thread exits. */
+
+#define CORK_BUFFER_POOL_THREAD_CACHE_SIZE  4
+
+static volatile unsigned int  cork_buffer_pool_last_id = 0;
+
+struct cork_buffer_pool_thread_cache {
+    unsigned int  pool_id;
+    struct cork_slist  lists[CORK_BUFFER_POOL_CLASS_COUNT];
+    unsigned int  counts[CORK_BUFFER_POOL_CLASS_COUNT];
+};
+
+static void
+cork_buffer_pool_thread_cache_clear(struct cork_buffer_pool_thread_cache *tc)
+{
+    unsigned int  i;
+    for (i = 0; i < CORK_BUFFER_POOL_CLASS_COUNT; i++) {
+        cork_buffer_pool_list_done(&tc->lists[i]);
+        tc->counts[i] = 0;
+    }
+}
+
+#if CORK_HAVE_PTHREADS
+/* We can't use cork_tls, since we need to free the cached buffers when each
+ * thread exits. */
+
+static pthread_key_t  cork_buffer_pool_thread_cache_key;
+cork_once_barrier(cork_buffer_pool_thread_cache_barrier);
+
+static void
+cork_buffer_pool_thread_cache_destroy(void *vtc)
+{
+    struct cork_buffer_pool_thread_cache  *tc = vtc;
+    cork_buffer_pool_thread_cache_clear(tc);
+    free(tc);
+}
+
+static void
+cork_buffer_pool_thread_cache_create_key(void)
+{
+    CORK_ATTR_UNUSED int  rc;
+    rc = pthread_key_create(&cork_buffer_pool_thread_cache_key,
+                            cork_buffer_pool_thread_cache_destroy);
+    assert(rc == 0);
+}
+
+static struct cork_buffer_pool_thread_cache *
+cork_buffer_pool_thread_cache_get(void)
+{
+    struct cork_buffer_pool_thread_cache  *tc;
+    cork_once(cork_buffer_pool_thread_cache_barrier,
+              cork_buffer_pool_thread_cache_create_key());
+    tc = pthread_getspecific(cork_buffer_pool_thread_cache_key);
+    if (CORK_UNLIKELY(tc == NULL)) {
+        tc = cork_calloc(1, sizeof(struct cork_buffer_pool_thread_cache));
+        pthread_setspecific(cork_buffer_pool_thread_cache_key, tc);
+    }
+    return tc;
+}
+
+#else
+cork_tls(struct cork_buffer_pool_thread_cache,
+         cork_buffer_pool_thread_cache);
+#endif
+
+static struct cork_buffer_pool_thread_cache *
+cork_buffer_pool_get_thread_cache(unsigned int pool_id)
+{
+    struct cork_buffer_pool_thread_cache  *tc =
+        cork_buffer_pool_thread_cache_get();
+    if (CORK_UNLIKELY(tc->pool_id != pool_id)) {
+        /* The cached buffers belong to some other pool, which might not
+         * exist anymore. */
+        cork_buffer_pool_thread_cache_clear(tc);
+        tc->pool_id = pool_id;
+    }
+    return tc;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Buffer pools
+ */
+
+struct cork_buffer_pool {
+    unsigned int  id;
+    size_t  max_retained;
+    /* The remaining fields are protected by lock. */
+    struct cork_spinlock  lock;
+    size_t  retained;
+    struct cork_slist  lists[CORK_BUFFER_POOL_CLASS_COUNT];
+};
+
+struct cork_buffer_pool *
+cork_buffer_pool_new(size_t max_retained)
+{
+    struct cork_buffer_pool  *pool = cork_new(struct cork_buffer_pool);
+    unsigned int  i;
+    pool->id = cork_uint_atomic_add(&cork_buffer_pool_last_id, 1);
+    pool->max_retained = max_retained;
+    cork_spinlock_init(&pool->lock);
+    pool->retained = 0;
+    for (i = 0; i < CORK_BUFFER_POOL_CLASS_COUNT; i++) {
+        cork_slist_init(&pool->lists[i]);
+    }
+    return pool;
+}
+
+void
+cork_buffer_pool_free(struct cork_buffer_pool *pool)
+{
+    struct cork_buffer_pool_thread_cache  *tc =
+        cork_buffer_pool_thread_cache_get();
+    unsigned int  i;
+
+    /* We can only clear out the current thread's cache; any other thread's
+     * cache will be cleared the next time that thread uses a pool. */
+    if (tc->pool_id == pool->id) {
+        cork_buffer_pool_thread_cache_clear(tc);
+        tc->pool_id = 0;
+    }
+
+    for (i = 0; i < CORK_BUFFER_POOL_CLASS_COUNT; i++) {
+        cork_buffer_pool_list_done(&pool->lists[i]);
+    }
+    free(pool);
+}
+
+size_t
+cork_buffer_pool_retained(struct cork_buffer_pool *pool)
+{
+    size_t  retained;
+    cork_spinlock_lock(&pool->lock);
+    retained = pool->retained;
+    cork_spinlock_unlock(&pool->lock);
+    return retained;
+}
+
+struct cork_buffer *
+cork_buffer_pool_acquire(struct cork_buffer_pool *pool, size_t size)
+{
+    struct cork_buffer_pool_thread_cache  *tc;
+    struct cork_buffer_pool_entry  *entry;
+    struct cork_slist_item  *item;
+    unsigned int  class_index;
+
+    /* Leave room for the NUL terminator. */
+    class_index = cork_buffer_pool_class_for_size(size + 1);
+    if (CORK_UNLIKELY(class_index == CORK_BUFFER_POOL_CLASS_COUNT)) {
+        entry = cork_new(struct cork_buffer_pool_entry);
+        cork_buffer_init(&entry->buffer);
+        cork_buffer_ensure_size(&entry->buffer, size + 1);
+        return &entry->buffer;
+    }
+
+    tc = cork_buffer_pool_get_thread_cache(pool->id);
+    item = cork_slist_pop(&tc->lists[class_index]);
+    if (item != NULL) {
+        tc->counts[class_index]--;
+    } else {
+        cork_spinlock_lock(&pool->lock);
+        item = cork_slist_pop(&pool->lists[class_index]);
+        if (item != NULL) {
+            entry = cork_buffer_pool_entry_from_item(item);
+            pool->retained -= entry->buffer.allocated_size;
+        }
+        cork_spinlock_unlock(&pool->lock);
+    }
+
+    if (item != NULL) {
+        entry = cork_buffer_pool_entry_from_item(item);
+        cork_buffer_clear(&entry->buffer);
+        return &entry->buffer;
+    }
+
+    entry = cork_new(struct cork_buffer_pool_entry);
+    cork_buffer_init(&entry->buffer);
+    cork_buffer_ensure_size
+        (&entry->buffer, cork_buffer_pool_class_size(class_index));
+    cork_buffer_clear(&entry->buffer);
+    return &entry->buffer;
+}
+
+void
+cork_buffer_pool_release(struct cork_buffer_pool *pool,
+                         struct cork_buffer *buffer)
+{
+    struct cork_buffer_pool_entry  *entry =
+        cork_buffer_pool_entry_from_buffer(buffer);
+    struct cork_buffer_pool_thread_cache  *tc;
+    size_t  allocated_size = buffer->allocated_size;
+    unsigned int  class_index =
+        cork_buffer_pool_class_for_capacity(allocated_size);
+
+    if (CORK_UNLIKELY(class_index == CORK_BUFFER_POOL_CLASS_COUNT)) {
+        cork_buffer_pool_entry_free(entry);
+        return;
+    }
+
+    tc = cork_buffer_pool_get_thread_cache(pool->id);
+    if (tc->counts[class_index] < CORK_BUFFER_POOL_THREAD_CACHE_SIZE) {
+        cork_slist_push(&tc->lists[class_index], &entry->item);
+        tc->counts[class_index]++;
+        return;
+    }
+
+    cork_spinlock_lock(&pool->lock);
+    if (pool->retained + allocated_size <= pool->max_retained) {
+        cork_slist_push(&pool->lists[class_index], &entry->item);
+        pool->retained += allocated_size;
+        entry = NULL;
+    }
+    cork_spinlock_unlock(&pool->lock);
+
+    if (entry != NULL) {
+        cork_buffer_pool_entry_free(entry);
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Managed buffers
+ */
+
+static void
+cork_buffer_pool__managed_free(struct cork_managed_buffer *managed)
+{
+    struct cork_buffer_pool_entry  *entry =
+        cork_container_of(managed, struct cork_buffer_pool_entry, managed);
+    cork_buffer_pool_release(entry->pool, &entry->buffer);
+}
+
+static struct cork_managed_buffer_iface  CORK_BUFFER_POOL__MANAGED_BUFFER = {
+    cork_buffer_pool__managed_free
+};
+
+struct cork_managed_buffer *
+cork_buffer_pool_to_managed_buffer(struct cork_buffer_pool *pool,
+                                   struct cork_buffer *buffer)
+{
+    /* The entry already has room for the managed buffer, so we don't have to
+     * allocate anything. */
+    struct cork_buffer_pool_entry  *entry =
+        cork_buffer_pool_entry_from_buffer(buffer);
+    entry->managed.buf = buffer->buf;
+    entry->managed.size = buffer->size;
+    entry->managed.ref_count = 1;
+    entry->managed.iface = &CORK_BUFFER_POOL__MANAGED_BUFFER;
+    entry->pool = pool;
+    return &entry->managed;
+}
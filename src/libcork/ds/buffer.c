@@ -8,17 +8,93 @@
  * ----------------------------------------------------------------------
  */
 
+/* for mremap */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "libcork/config.h"
 #include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
 #include "libcork/core/types.h"
 #include "libcork/ds/buffer.h"
 #include "libcork/ds/managed-buffer.h"
 #include "libcork/ds/stream.h"
 #include "libcork/helpers/errors.h"
 
+#if CORK_HAVE_MREMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * Large buffers
+ */
+
+#if CORK_HAVE_MREMAP
+
+/* A buffer's storage comes from mmap if and only if its allocated size is at
+ * least CORK_BUFFER_LARGE_SIZE.  Growing a large buffer with mremap only has
+ * to update the page tables, whereas realloc might have to copy everything. */
+
+#define cork_buffer_is_large(buffer) \
+    ((buffer)->allocated_size >= CORK_BUFFER_LARGE_SIZE)
+
+static size_t
+cork_buffer_page_round(size_t size)
+{
+    size_t  page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static void
+cork_buffer_grow_large(struct cork_buffer *buffer, size_t new_size)
+{
+    void  *buf;
+    new_size = cork_buffer_page_round(new_size);
+    if (cork_buffer_is_large(buffer)) {
+        buf = mremap(buffer->buf, buffer->allocated_size, new_size,
+                     MREMAP_MAYMOVE);
+    } else {
+        buf = mmap(NULL, new_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf != MAP_FAILED && buffer->buf != NULL) {
+            /* This is the only time a large buffer's content is copied. */
+            memcpy(buf, buffer->buf, buffer->allocated_size);
+            free(buffer->buf);
+        }
+    }
+    if (CORK_UNLIKELY(buf == MAP_FAILED)) {
+        cork_abort("Cannot allocate %zu-byte buffer", new_size);
+    }
+    buffer->buf = buf;
+    buffer->allocated_size = new_size;
+}
+
+/* Returns the pages after the first length bytes (plus the NUL terminator)
+ * to the operating system. */
+static void
+cork_buffer_release_large(struct cork_buffer *buffer, size_t length)
+{
+    size_t  keep = cork_buffer_page_round(length + 1);
+    if (keep < buffer->allocated_size) {
+        madvise(((char *) buffer->buf) + keep,
+                buffer->allocated_size - keep, MADV_DONTNEED);
+    }
+}
+
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * Buffers
+ */
+
 
 void
 cork_buffer_init(struct cork_buffer *buffer)
@@ -42,7 +118,15 @@ void
 cork_buffer_done(struct cork_buffer *buffer)
 {
     if (buffer->buf != NULL) {
+#if CORK_HAVE_MREMAP
+        if (cork_buffer_is_large(buffer)) {
+            munmap(buffer->buf, buffer->allocated_size);
+        } else {
+            free(buffer->buf);
+        }
+#else
         free(buffer->buf);
+#endif
         buffer->buf = NULL;
     }
     buffer->size = 0;
@@ -87,6 +171,13 @@ cork_buffer_ensure_size(struct cork_buffer *buffer, size_t desired_size)
         new_size = desired_size;
     }
 
+#if CORK_HAVE_MREMAP
+    if (new_size >= CORK_BUFFER_LARGE_SIZE) {
+        cork_buffer_grow_large(buffer, new_size);
+        return;
+    }
+#endif
+
     buffer->buf = cork_realloc(buffer->buf, new_size);
     buffer->allocated_size = new_size;
 }
@@ -113,6 +204,11 @@ cork_buffer_truncate(struct cork_buffer *buffer, size_t length)
         } else {
             ((char *) buffer->buf)[length] = '\0';
         }
+#if CORK_HAVE_MREMAP
+        if (cork_buffer_is_large(buffer)) {
+            cork_buffer_release_large(buffer, length);
+        }
+#endif
     }
 }
 
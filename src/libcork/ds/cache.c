@@ -0,0 +1,663 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "libcork/core/callbacks.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/mempool.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/cache.h"
+#include "libcork/ds/dllist.h"
+#include "libcork/ds/hash-table.h"
+#include "libcork/ds/ring-buffer.h"
+#include "libcork/helpers/errors.h"
+#include "libcork/threads/basics.h"
+
+
+/*-----------------------------------------------------------------------
+ * Bounded caches
+ */
+
+/* The S3-FIFO small queue is allowed to hold 1/N of the cache's capacity. */
+#define CORK_CACHE_SMALL_QUEUE_RATIO  10
+
+/* Access frequencies saturate at this value. */
+#define CORK_CACHE_MAX_FREQ  3
+
+/* The number of ghost hashes to remember if the cache is only limited by
+ * bytes. */
+#define CORK_CACHE_DEFAULT_GHOST_SIZE  4096
+
+enum cork_cache_queue {
+    CORK_CACHE_SMALL_QUEUE,
+    CORK_CACHE_MAIN_QUEUE
+};
+
+struct cork_cache_entry {
+    void  *key;
+    void  *value;
+    size_t  size;
+    cork_hash  hash;
+    /* The CLOCK reference bit, or the S3-FIFO access frequency. */
+    unsigned int  freq;
+    enum cork_cache_queue  queue;
+    struct cork_dllist_item  item;
+};
+
+struct cork_cache_shard {
+    struct cork_spinlock  lock;
+    struct cork_cache  *cache;
+    /* Maps each key to its cork_cache_entry. */
+    struct cork_hash_table  table;
+    struct cork_mempool  *entry_mempool;
+    /* The LRU list, the CLOCK ring, or the S3-FIFO main queue.  In all cases,
+     * the next eviction candidate is at the head. */
+    struct cork_dllist  main;
+    /* The S3-FIFO small (probationary) queue. */
+    struct cork_dllist  small;
+    size_t  count;
+    size_t  bytes;
+    size_t  small_count;
+    size_t  small_bytes;
+    size_t  max_count;
+    size_t  max_bytes;
+    /* The S3-FIFO ghost queue, which holds the hashes of entries that were
+     * evicted from the small queue.  ghost_table maps each hash to the number
+     * of times it appears in ghost_fifo. */
+    struct cork_ring_buffer  ghost_fifo;
+    struct cork_hash_table  ghost_table;
+};
+
+struct cork_cache {
+    enum cork_cache_policy  policy;
+    bool  thread_safe;
+    size_t  shard_count;
+    struct cork_cache_shard  *shards;
+    cork_hash_table_hasher  hasher;
+    void  *user_data;
+    cork_free_f  free_user_data;
+    cork_cache_evict_f  evict;
+};
+
+#define cork_cache_shard_lock(cache, shard) \
+    do { \
+        if ((cache)->thread_safe) { \
+            cork_spinlock_lock(&(shard)->lock); \
+        } \
+    } while (0)
+
+#define cork_cache_shard_unlock(cache, shard) \
+    do { \
+        if ((cache)->thread_safe) { \
+            cork_spinlock_unlock(&(shard)->lock); \
+        } \
+    } while (0)
+
+#define cork_cache_entry_of(curr) \
+    (cork_container_of((curr), struct cork_cache_entry, item))
+
+
+/*-----------------------------------------------------------------------
+ * Ghost queue
+ */
+
+#define cork_cache_ghost_key(hash)  ((void *) (uintptr_t) (hash))
+
+static bool
+cork_cache_ghost_contains(struct cork_cache_shard *shard, cork_hash hash)
+{
+    return cork_hash_table_get_entry
+        (&shard->ghost_table, cork_cache_ghost_key(hash)) != NULL;
+}
+
+static void
+cork_cache_ghost_add(struct cork_cache_shard *shard, cork_hash hash)
+{
+    bool  is_new;
+    struct cork_hash_table_entry  *entry;
+
+    if (cork_ring_buffer_is_full(&shard->ghost_fifo)) {
+        void  *oldest = cork_ring_buffer_pop(&shard->ghost_fifo);
+        uintptr_t  count;
+        entry = cork_hash_table_get_entry(&shard->ghost_table, oldest);
+        count = (uintptr_t) entry->value - 1;
+        if (count == 0) {
+            cork_hash_table_delete(&shard->ghost_table, oldest, NULL, NULL);
+        } else {
+            entry->value = (void *) count;
+        }
+    }
+
+    entry = cork_hash_table_get_or_create
+        (&shard->ghost_table, cork_cache_ghost_key(hash), &is_new);
+    entry->value = (void *) ((uintptr_t) entry->value + 1);
+    cork_ring_buffer_add(&shard->ghost_fifo, cork_cache_ghost_key(hash));
+}
+
+static void
+cork_cache_ghost_clear(struct cork_cache_shard *shard)
+{
+    while (!cork_ring_buffer_is_empty(&shard->ghost_fifo)) {
+        cork_ring_buffer_pop(&shard->ghost_fifo);
+    }
+    cork_hash_table_clear(&shard->ghost_table);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Shards
+ */
+
+static void
+cork_cache_shard_init(struct cork_cache *cache, struct cork_cache_shard *shard,
+                      size_t max_count, size_t max_bytes,
+                      cork_hash_table_comparator comparator)
+{
+    cork_spinlock_init(&shard->lock);
+    shard->cache = cache;
+    cork_hash_table_init(&shard->table, 0, cache->hasher, comparator);
+    shard->entry_mempool =
+        cork_mempool_new_compact(struct cork_cache_entry);
+    cork_dllist_init(&shard->main);
+    cork_dllist_init(&shard->small);
+    shard->count = 0;
+    shard->bytes = 0;
+    shard->small_count = 0;
+    shard->small_bytes = 0;
+    shard->max_count = max_count;
+    shard->max_bytes = max_bytes;
+
+    if (cache->policy == CORK_CACHE_S3FIFO) {
+        size_t  ghost_size =
+            (max_count > 0)? max_count: CORK_CACHE_DEFAULT_GHOST_SIZE;
+        if (CORK_UNLIKELY(cork_ring_buffer_init
+                          (&shard->ghost_fifo, ghost_size) != 0)) {
+            cork_abort("Cannot allocate %zu-entry ghost queue", ghost_size);
+        }
+        cork_pointer_hash_table_init(&shard->ghost_table, 0);
+    }
+}
+
+/* Remove an entry from whichever queue it's in, without freeing it. */
+static void
+cork_cache_shard_unlink(struct cork_cache_shard *shard,
+                        struct cork_cache_entry *entry)
+{
+    cork_dllist_remove(&entry->item);
+    shard->count--;
+    shard->bytes -= entry->size;
+    if (entry->queue == CORK_CACHE_SMALL_QUEUE) {
+        shard->small_count--;
+        shard->small_bytes -= entry->size;
+    }
+}
+
+static void
+cork_cache_shard_link(struct cork_cache *cache, struct cork_cache_shard *shard,
+                      struct cork_cache_entry *entry)
+{
+    entry->freq = 0;
+    shard->count++;
+    shard->bytes += entry->size;
+
+    /* New S3-FIFO entries start off in the small queue, unless they were
+     * evicted recently enough to still be in the ghost queue. */
+    if (cache->policy == CORK_CACHE_S3FIFO &&
+        !cork_cache_ghost_contains(shard, entry->hash)) {
+        entry->queue = CORK_CACHE_SMALL_QUEUE;
+        shard->small_count++;
+        shard->small_bytes += entry->size;
+        cork_dllist_add(&shard->small, &entry->item);
+    } else {
+        entry->queue = CORK_CACHE_MAIN_QUEUE;
+        cork_dllist_add(&shard->main, &entry->item);
+    }
+}
+
+static void
+cork_cache_shard_touch(struct cork_cache *cache,
+                       struct cork_cache_shard *shard,
+                       struct cork_cache_entry *entry)
+{
+    switch (cache->policy) {
+        case CORK_CACHE_LRU:
+            cork_dllist_remove(&entry->item);
+            cork_dllist_add(&shard->main, &entry->item);
+            break;
+
+        case CORK_CACHE_CLOCK:
+            entry->freq = 1;
+            break;
+
+        case CORK_CACHE_S3FIFO:
+            if (entry->freq < CORK_CACHE_MAX_FREQ) {
+                entry->freq++;
+            }
+            break;
+
+        default:
+            cork_unreachable();
+    }
+}
+
+static void
+cork_cache_shard_evict_entry(struct cork_cache *cache,
+                             struct cork_cache_shard *shard,
+                             struct cork_cache_entry *entry)
+{
+    cork_hash_table_delete(&shard->table, entry->key, NULL, NULL);
+    cork_cache_shard_unlink(shard, entry);
+    if (cache->evict != NULL) {
+        cache->evict(cache->user_data, entry->key, entry->value);
+    }
+    cork_mempool_free_object_fast(shard->entry_mempool, entry);
+}
+
+/* Move the head of the main queue to its tail, giving it another pass. */
+#define cork_cache_shard_requeue(shard, entry) \
+    do { \
+        cork_dllist_remove(&(entry)->item); \
+        cork_dllist_add(&(shard)->main, &(entry)->item); \
+    } while (0)
+
+static bool
+cork_cache_shard_small_is_full(struct cork_cache_shard *shard)
+{
+    return
+        (shard->max_count > 0 &&
+         shard->small_count * CORK_CACHE_SMALL_QUEUE_RATIO
+         >= shard->max_count) ||
+        (shard->max_bytes > 0 &&
+         shard->small_bytes * CORK_CACHE_SMALL_QUEUE_RATIO
+         >= shard->max_bytes);
+}
+
+static void
+cork_cache_shard_evict_s3fifo(struct cork_cache *cache,
+                              struct cork_cache_shard *shard)
+{
+    struct cork_cache_entry  *entry;
+
+    if (!cork_dllist_is_empty(&shard->small) &&
+        (cork_dllist_is_empty(&shard->main) ||
+         cork_cache_shard_small_is_full(shard))) {
+        while (!cork_dllist_is_empty(&shard->small)) {
+            entry = cork_cache_entry_of(cork_dllist_start(&shard->small));
+            if (entry->freq > 1) {
+                /* Promote entries that were accessed while on probation. */
+                cork_dllist_remove(&entry->item);
+                shard->small_count--;
+                shard->small_bytes -= entry->size;
+                entry->queue = CORK_CACHE_MAIN_QUEUE;
+                entry->freq = 0;
+                cork_dllist_add(&shard->main, &entry->item);
+            } else {
+                cork_cache_ghost_add(shard, entry->hash);
+                cork_cache_shard_evict_entry(cache, shard, entry);
+                return;
+            }
+        }
+    }
+
+    while (true) {
+        entry = cork_cache_entry_of(cork_dllist_start(&shard->main));
+        if (entry->freq == 0) {
+            cork_cache_shard_evict_entry(cache, shard, entry);
+            return;
+        }
+        entry->freq--;
+        cork_cache_shard_requeue(shard, entry);
+    }
+}
+
+static void
+cork_cache_shard_evict_one(struct cork_cache *cache,
+                           struct cork_cache_shard *shard)
+{
+    struct cork_cache_entry  *entry;
+
+    switch (cache->policy) {
+        case CORK_CACHE_LRU:
+            entry = cork_cache_entry_of(cork_dllist_start(&shard->main));
+            cork_cache_shard_evict_entry(cache, shard, entry);
+            return;
+
+        case CORK_CACHE_CLOCK:
+            while (true) {
+                entry = cork_cache_entry_of(cork_dllist_start(&shard->main));
+                if (entry->freq == 0) {
+                    cork_cache_shard_evict_entry(cache, shard, entry);
+                    return;
+                }
+                entry->freq = 0;
+                cork_cache_shard_requeue(shard, entry);
+            }
+
+        case CORK_CACHE_S3FIFO:
+            cork_cache_shard_evict_s3fifo(cache, shard);
+            return;
+
+        default:
+            cork_unreachable();
+    }
+}
+
+static void
+cork_cache_shard_enforce_limits(struct cork_cache *cache,
+                                struct cork_cache_shard *shard)
+{
+    while ((shard->max_count > 0 && shard->count > shard->max_count) ||
+           (shard->max_bytes > 0 && shard->bytes > shard->max_bytes)) {
+        cork_cache_shard_evict_one(cache, shard);
+    }
+}
+
+static void
+cork_cache_shard_evict_list(struct cork_cache *cache,
+                            struct cork_cache_shard *shard,
+                            struct cork_dllist *list)
+{
+    struct cork_dllist_item  *curr = cork_dllist_start(list);
+    while (!cork_dllist_is_end(list, curr)) {
+        struct cork_cache_entry  *entry = cork_cache_entry_of(curr);
+        /* Grab the next pointer before we free the entry. */
+        curr = curr->next;
+        if (cache->evict != NULL) {
+            cache->evict(cache->user_data, entry->key, entry->value);
+        }
+        cork_mempool_free_object_fast(shard->entry_mempool, entry);
+    }
+    cork_dllist_init(list);
+}
+
+static void
+cork_cache_shard_clear(struct cork_cache *cache,
+                       struct cork_cache_shard *shard)
+{
+    cork_hash_table_clear(&shard->table);
+    cork_cache_shard_evict_list(cache, shard, &shard->small);
+    cork_cache_shard_evict_list(cache, shard, &shard->main);
+    shard->count = 0;
+    shard->bytes = 0;
+    shard->small_count = 0;
+    shard->small_bytes = 0;
+    if (cache->policy == CORK_CACHE_S3FIFO) {
+        cork_cache_ghost_clear(shard);
+    }
+}
+
+static void
+cork_cache_shard_done(struct cork_cache *cache,
+                      struct cork_cache_shard *shard)
+{
+    cork_cache_shard_clear(cache, shard);
+    cork_hash_table_done(&shard->table);
+    cork_mempool_free(shard->entry_mempool);
+    if (cache->policy == CORK_CACHE_S3FIFO) {
+        cork_ring_buffer_done(&shard->ghost_fifo);
+        cork_hash_table_done(&shard->ghost_table);
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Public interface
+ */
+
+static struct cork_cache *
+cork_cache_new_internal(size_t shard_count, bool thread_safe,
+                        enum cork_cache_policy policy,
+                        size_t max_count, size_t max_bytes,
+                        cork_hash_table_hasher hasher,
+                        cork_hash_table_comparator comparator)
+{
+    size_t  i;
+    struct cork_cache  *cache = cork_new(struct cork_cache);
+    assert(shard_count > 0);
+    cache->policy = policy;
+    cache->thread_safe = thread_safe;
+    cache->shard_count = shard_count;
+    cache->shards = cork_calloc(shard_count, sizeof(struct cork_cache_shard));
+    cache->hasher = hasher;
+    cache->user_data = NULL;
+    cache->free_user_data = NULL;
+    cache->evict = NULL;
+
+    /* Split the limits evenly between the shards, rounding up so that a
+     * sharded cache never holds less than what was asked for. */
+    for (i = 0; i < shard_count; i++) {
+        cork_cache_shard_init
+            (cache, &cache->shards[i],
+             (max_count + shard_count - 1) / shard_count,
+             (max_bytes + shard_count - 1) / shard_count,
+             comparator);
+    }
+    return cache;
+}
+
+struct cork_cache *
+cork_cache_new(enum cork_cache_policy policy,
+               size_t max_count, size_t max_bytes,
+               cork_hash_table_hasher hasher,
+               cork_hash_table_comparator comparator)
+{
+    return cork_cache_new_internal
+        (1, false, policy, max_count, max_bytes, hasher, comparator);
+}
+
+struct cork_cache *
+cork_cache_new_sharded(size_t shard_count, enum cork_cache_policy policy,
+                       size_t max_count, size_t max_bytes,
+                       cork_hash_table_hasher hasher,
+                       cork_hash_table_comparator comparator)
+{
+    return cork_cache_new_internal
+        (shard_count, true, policy, max_count, max_bytes, hasher, comparator);
+}
+
+void
+cork_cache_free(struct cork_cache *cache)
+{
+    size_t  i;
+    for (i = 0; i < cache->shard_count; i++) {
+        cork_cache_shard_done(cache, &cache->shards[i]);
+    }
+    cork_free_user_data(cache);
+    free(cache->shards);
+    free(cache);
+}
+
+void
+cork_cache_set_callbacks(struct cork_cache *cache,
+                         void *user_data, cork_free_f free_user_data,
+                         cork_cache_evict_f evict)
+{
+    cork_free_user_data(cache);
+    cache->user_data = user_data;
+    cache->free_user_data = free_user_data;
+    cache->evict = evict;
+}
+
+/* The hash table within each shard uses the low bits of the hash to choose a
+ * bin, so we use the high bits to choose the shard. */
+static struct cork_cache_shard *
+cork_cache_get_shard(struct cork_cache *cache, const void *key)
+{
+    if (cache->shard_count == 1) {
+        return &cache->shards[0];
+    } else {
+        cork_hash  hash = cache->hasher(key);
+        size_t  index = (size_t) (((uint64_t) hash * cache->shard_count) >> 32);
+        return &cache->shards[index];
+    }
+}
+
+void
+cork_cache_clear(struct cork_cache *cache)
+{
+    size_t  i;
+    for (i = 0; i < cache->shard_count; i++) {
+        struct cork_cache_shard  *shard = &cache->shards[i];
+        cork_cache_shard_lock(cache, shard);
+        cork_cache_shard_clear(cache, shard);
+        cork_cache_shard_unlock(cache, shard);
+    }
+}
+
+size_t
+cork_cache_size(const struct cork_cache *cache)
+{
+    size_t  i;
+    size_t  result = 0;
+    for (i = 0; i < cache->shard_count; i++) {
+        result += cache->shards[i].count;
+    }
+    return result;
+}
+
+size_t
+cork_cache_bytes(const struct cork_cache *cache)
+{
+    size_t  i;
+    size_t  result = 0;
+    for (i = 0; i < cache->shard_count; i++) {
+        result += cache->shards[i].bytes;
+    }
+    return result;
+}
+
+/* Returns the entry for key, and counts it as a use.  The shard must be
+ * locked. */
+static struct cork_cache_entry *
+cork_cache_shard_get(struct cork_cache *cache, struct cork_cache_shard *shard,
+                     const void *key)
+{
+    struct cork_hash_table_entry  *table_entry =
+        cork_hash_table_get_entry(&shard->table, key);
+    if (table_entry != NULL) {
+        struct cork_cache_entry  *entry = table_entry->value;
+        cork_cache_shard_touch(cache, shard, entry);
+        return entry;
+    }
+    return NULL;
+}
+
+void *
+cork_cache_get(struct cork_cache *cache, const void *key)
+{
+    struct cork_cache_shard  *shard = cork_cache_get_shard(cache, key);
+    struct cork_cache_entry  *entry;
+    void  *result = NULL;
+
+    cork_cache_shard_lock(cache, shard);
+    entry = cork_cache_shard_get(cache, shard, key);
+    if (entry != NULL) {
+        result = entry->value;
+    }
+    cork_cache_shard_unlock(cache, shard);
+    return result;
+}
+
+bool
+cork_cache_visit(struct cork_cache *cache, const void *key,
+                 void *user_data, cork_cache_visit_f visit)
+{
+    struct cork_cache_shard  *shard = cork_cache_get_shard(cache, key);
+    struct cork_cache_entry  *entry;
+
+    cork_cache_shard_lock(cache, shard);
+    entry = cork_cache_shard_get(cache, shard, key);
+    if (entry != NULL) {
+        visit(user_data, entry->key, entry->value);
+    }
+    cork_cache_shard_unlock(cache, shard);
+    return entry != NULL;
+}
+
+void
+cork_cache_put(struct cork_cache *cache, void *key, void *value, size_t size,
+               bool *is_new, void **old_key, void **old_value)
+{
+    struct cork_cache_shard  *shard = cork_cache_get_shard(cache, key);
+    struct cork_hash_table_entry  *table_entry;
+    struct cork_cache_entry  *entry;
+    bool  entry_is_new;
+
+    cork_cache_shard_lock(cache, shard);
+    table_entry = cork_hash_table_get_or_create
+        (&shard->table, key, &entry_is_new);
+
+    if (entry_is_new) {
+        entry = cork_mempool_new_object_fast(shard->entry_mempool);
+        entry->key = key;
+        entry->value = value;
+        entry->size = size;
+        entry->hash = table_entry->hash;
+        table_entry->value = entry;
+        cork_cache_shard_link(cache, shard, entry);
+        if (old_key != NULL) {
+            *old_key = NULL;
+        }
+        if (old_value != NULL) {
+            *old_value = NULL;
+        }
+    } else {
+        entry = table_entry->value;
+        if (old_key != NULL) {
+            *old_key = entry->key;
+        }
+        if (old_value != NULL) {
+            *old_value = entry->value;
+        }
+        table_entry->key = key;
+        entry->key = key;
+        entry->value = value;
+        shard->bytes = shard->bytes - entry->size + size;
+        if (entry->queue == CORK_CACHE_SMALL_QUEUE) {
+            shard->small_bytes = shard->small_bytes - entry->size + size;
+        }
+        entry->size = size;
+        cork_cache_shard_touch(cache, shard, entry);
+    }
+
+    if (is_new != NULL) {
+        *is_new = entry_is_new;
+    }
+
+    cork_cache_shard_enforce_limits(cache, shard);
+    cork_cache_shard_unlock(cache, shard);
+}
+
+bool
+cork_cache_delete(struct cork_cache *cache, const void *key,
+                  void **deleted_key, void **deleted_value)
+{
+    struct cork_cache_shard  *shard = cork_cache_get_shard(cache, key);
+    void  *vkey;
+    void  *ventry;
+    bool  found;
+
+    cork_cache_shard_lock(cache, shard);
+    found = cork_hash_table_delete(&shard->table, key, &vkey, &ventry);
+    if (found) {
+        struct cork_cache_entry  *entry = ventry;
+        if (deleted_key != NULL) {
+            *deleted_key = entry->key;
+        }
+        if (deleted_value != NULL) {
+            *deleted_value = entry->value;
+        }
+        cork_cache_shard_unlink(shard, entry);
+        cork_mempool_free_object_fast(shard->entry_mempool, entry);
+    }
+    cork_cache_shard_unlock(cache, shard);
+    return found;
+}
@@ -0,0 +1,819 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/attributes.h"
+#include "libcork/core/byte-order.h"
+#include "libcork/core/error.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/compression.h"
+#include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Blocks
+ */
+
+/* Compressed blocks use the same sequence encoding as LZ4: a token whose
+ * high nibble is the number of literals and whose low nibble is the length
+ * of the match (minus CORK_LZ_MIN_MATCH), with 15 meaning that more length
+ * bytes follow; then the literals; then a little-endian 16-bit offset back
+ * to the start of the match.  The last sequence of a block only contains
+ * literals.  Like LZ4, the compressor never starts a match in the last
+ * CORK_LZ_MATCH_FIND_LIMIT bytes, and always ends a block with at least
+ * CORK_LZ_LAST_LITERALS literals. */
+
+#define CORK_LZ_MIN_MATCH  4
+#define CORK_LZ_LAST_LITERALS  5
+#define CORK_LZ_MATCH_FIND_LIMIT  12
+#define CORK_LZ_MAX_DISTANCE  65535
+
+#define CORK_LZ_HASH_LOG  12
+#define CORK_LZ_HASH_SIZE  (1 << CORK_LZ_HASH_LOG)
+
+/* The longer we go without finding a match, the more bytes we skip before
+ * trying again, so that we don't waste much time on incompressible data. */
+#define CORK_LZ_SKIP_TRIGGER  6
+
+/* How many bytes the decompressor copies at once in its fast paths. */
+#define CORK_LZ_COPY_SIZE  16
+
+static inline uint32_t
+cork_lz_read32(const uint8_t *src)
+{
+    uint32_t  value;
+    memcpy(&value, src, sizeof(uint32_t));
+    return value;
+}
+
+static inline uint64_t
+cork_lz_read64(const uint8_t *src)
+{
+    uint64_t  value;
+    memcpy(&value, src, sizeof(uint64_t));
+    return value;
+}
+
+static inline unsigned int
+cork_lz_hash(uint32_t sequence)
+{
+    return (sequence * UINT32_C(2654435761)) >> (32 - CORK_LZ_HASH_LOG);
+}
+
+/* Returns how many bytes match starting at ip and match, without reading
+ * past limit. */
+static inline size_t
+cork_lz_count(const uint8_t *ip, const uint8_t *match, const uint8_t *limit)
+{
+    const uint8_t  *start = ip;
+    while (ip + sizeof(uint64_t) <= limit &&
+           cork_lz_read64(ip) == cork_lz_read64(match)) {
+        ip += sizeof(uint64_t);
+        match += sizeof(uint64_t);
+    }
+    while (ip < limit && *ip == *match) {
+        ip++;
+        match++;
+    }
+    return ip - start;
+}
+
+static inline uint8_t *
+cork_lz_write_length(uint8_t *op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = length;
+    return op;
+}
+
+static inline uint8_t *
+cork_lz_write_literals(uint8_t *op, uint8_t *token,
+                       const uint8_t *literals, size_t length)
+{
+    if (length >= 15) {
+        *token = 15 << 4;
+        op = cork_lz_write_length(op, length - 15);
+    } else {
+        *token = length << 4;
+    }
+    memcpy(op, literals, length);
+    return op + length;
+}
+
+static size_t
+cork_lz_compress_with_table(uint32_t *table, const uint8_t *src,
+                            size_t src_size, uint8_t *dest)
+{
+    const uint8_t  *ip = src;
+    const uint8_t  *anchor = src;
+    const uint8_t  *iend = src + src_size;
+    const uint8_t  *match_find_limit;
+    const uint8_t  *match_limit;
+    uint8_t  *op = dest;
+    uint8_t  *token;
+
+    if (src_size <= CORK_LZ_MATCH_FIND_LIMIT) {
+        goto last_literals;
+    }
+    match_find_limit = iend - CORK_LZ_MATCH_FIND_LIMIT;
+    match_limit = iend - CORK_LZ_LAST_LITERALS;
+
+    memset(table, 0, CORK_LZ_HASH_SIZE * sizeof(uint32_t));
+    ip++;
+
+    for (;;) {
+        const uint8_t  *match;
+        unsigned int  attempts = 1 << CORK_LZ_SKIP_TRIGGER;
+        size_t  offset;
+        size_t  length;
+
+        /* Find the next match */
+        for (;;) {
+            uint32_t  sequence;
+            unsigned int  hash;
+            if (ip > match_find_limit) {
+                goto last_literals;
+            }
+            sequence = cork_lz_read32(ip);
+            hash = cork_lz_hash(sequence);
+            match = src + table[hash];
+            table[hash] = ip - src;
+            if (ip - match <= CORK_LZ_MAX_DISTANCE &&
+                cork_lz_read32(match) == sequence) {
+                break;
+            }
+            ip += attempts++ >> CORK_LZ_SKIP_TRIGGER;
+        }
+
+        /* The match might start before the sequence that we hashed. */
+        while (ip > anchor && match > src && ip[-1] == match[-1]) {
+            ip--;
+            match--;
+        }
+
+        token = op++;
+        op = cork_lz_write_literals(op, token, anchor, ip - anchor);
+
+        offset = ip - match;
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+
+        length = cork_lz_count
+            (ip + CORK_LZ_MIN_MATCH, match + CORK_LZ_MIN_MATCH, match_limit);
+        ip += CORK_LZ_MIN_MATCH + length;
+        if (length >= 15) {
+            *token |= 15;
+            op = cork_lz_write_length(op, length - 15);
+        } else {
+            *token |= length;
+        }
+        anchor = ip;
+
+        /* Fill in a position from within the match, which helps the next
+         * search when the data is repetitive. */
+        table[cork_lz_hash(cork_lz_read32(ip - 2))] = ip - 2 - src;
+    }
+
+last_literals:
+    token = op++;
+    op = cork_lz_write_literals(op, token, anchor, iend - anchor);
+    return op - dest;
+}
+
+size_t
+cork_lz_compress_block(const void *src, size_t src_size, void *dest)
+{
+    uint32_t  table[CORK_LZ_HASH_SIZE];
+    return cork_lz_compress_with_table(table, src, src_size, dest);
+}
+
+/* Adds any extra length bytes to *length.  Returns -1 if we run out of
+ * input. */
+static inline int
+cork_lz_read_length(const uint8_t **ip, const uint8_t *iend, size_t *length)
+{
+    unsigned int  byte;
+    do {
+        if (CORK_UNLIKELY(*ip == iend)) {
+            return -1;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+ssize_t
+cork_lz_decompress_block(const void *src, size_t src_size,
+                         void *dest, size_t dest_size)
+{
+    const uint8_t  *ip = src;
+    const uint8_t  *iend = ip + src_size;
+    uint8_t  *op = dest;
+    uint8_t  *oend = op + dest_size;
+
+    /* Every length and offset is checked against the ends of the buffers
+     * before we use it.  When there's enough room, we copy a fixed
+     * CORK_LZ_COPY_SIZE bytes at a time, even if that goes past the end of
+     * the literals or match; anything extra is overwritten by the next
+     * sequence. */
+    for (;;) {
+        unsigned int  token;
+        size_t  length;
+        size_t  offset;
+        const uint8_t  *match;
+
+        if (CORK_UNLIKELY(ip == iend)) {
+            return -1;
+        }
+        token = *ip++;
+        length = token >> 4;
+
+        /* Most sequences have short literals and a short match that's far
+         * enough back that it doesn't overlap; when there's enough room in
+         * both buffers, we can copy those with a fixed number of bytes. */
+        if (length != 15 &&
+            CORK_LIKELY((size_t) (iend - ip) >= CORK_LZ_COPY_SIZE + 2 &&
+                        (size_t) (oend - op) >= 2 * CORK_LZ_COPY_SIZE)) {
+            memcpy(op, ip, CORK_LZ_COPY_SIZE);
+            ip += length;
+            op += length;
+            offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            length = token & 15;
+            if (length != 15 && offset >= CORK_LZ_COPY_SIZE &&
+                CORK_LIKELY(offset <= (size_t) (op - (uint8_t *) dest))) {
+                match = op - offset;
+                memcpy(op, match, CORK_LZ_COPY_SIZE);
+                memcpy(op + CORK_LZ_COPY_SIZE, match + CORK_LZ_COPY_SIZE,
+                       14 + CORK_LZ_MIN_MATCH - CORK_LZ_COPY_SIZE);
+                op += length + CORK_LZ_MIN_MATCH;
+                continue;
+            }
+            goto match;
+        }
+
+        /* Literals */
+        if (length == 15) {
+            rii_check(cork_lz_read_length(&ip, iend, &length));
+        }
+        if (CORK_UNLIKELY(length > (size_t) (iend - ip) ||
+                          length > (size_t) (oend - op))) {
+            return -1;
+        }
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+
+        /* The last sequence doesn't have a match. */
+        if (ip == iend) {
+            return op - (uint8_t *) dest;
+        }
+
+        /* Match */
+        if (CORK_UNLIKELY(iend - ip < 2)) {
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        length = token & 15;
+
+    match:
+        if (CORK_UNLIKELY(offset == 0 ||
+                          offset > (size_t) (op - (uint8_t *) dest))) {
+            return -1;
+        }
+        match = op - offset;
+        if (length == 15) {
+            rii_check(cork_lz_read_length(&ip, iend, &length));
+        }
+        length += CORK_LZ_MIN_MATCH;
+        if (CORK_UNLIKELY(length > (size_t) (oend - op))) {
+            return -1;
+        }
+
+        if (offset >= CORK_LZ_COPY_SIZE &&
+            CORK_LIKELY((size_t) (oend - op) >= length + CORK_LZ_COPY_SIZE)) {
+            /* Each copy reads from before where it writes, so overlapping
+             * copies see the bytes we've just written. */
+            uint8_t  *end = op + length;
+            do {
+                memcpy(op, match, CORK_LZ_COPY_SIZE);
+                op += CORK_LZ_COPY_SIZE;
+                match += CORK_LZ_COPY_SIZE;
+            } while (op < end);
+            op = end;
+        } else if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            /* The match overlaps the bytes that it produces, so it repeats
+             * the last offset bytes.  Each copy doubles the size of the
+             * pattern that we can copy from. */
+            uint8_t  *end = op + length;
+            while (op < end) {
+                size_t  size = op - match;
+                if (size > (size_t) (end - op)) {
+                    size = end - op;
+                }
+                memcpy(op, match, size);
+                op += size;
+            }
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Frames
+ */
+
+/* A compressed stream is one or more frames.  Each frame starts with a
+ * header:
+ *
+ *   4 bytes  magic number (0x89 'C' 'L' 'Z')
+ *   1 byte   flags
+ *
+ * followed by any number of blocks, each of which is:
+ *
+ *   4 bytes  little-endian block size; if the high bit is set, the block is
+ *            stored without compression
+ *   4 bytes  (only if CORK_LZ_FLAG_CHECKSUM is set) little-endian
+ *            cork_stable_hash_buffer of the uncompressed block
+ *   N bytes  block contents
+ *
+ * A block size of 0 marks the end of the frame.  Blocks are compressed
+ * independently, and never contain more than CORK_LZ_MAX_BLOCK_SIZE bytes of
+ * uncompressed data. */
+
+static const uint8_t  CORK_LZ_MAGIC[4] = { 0x89, 'C', 'L', 'Z' };
+
+#define CORK_LZ_FRAME_HEADER_SIZE  5
+#define CORK_LZ_BLOCK_HEADER_SIZE  4
+#define CORK_LZ_CHECKSUM_SIZE  4
+
+#define CORK_LZ_FLAG_CHECKSUM  0x01
+#define CORK_LZ_BLOCK_UNCOMPRESSED  UINT32_C(0x80000000)
+
+#define CORK_LZ_CHECKSUM_SEED  0
+
+#define CORK_LZ_MAX_COMPRESSED_BLOCK_SIZE \
+    cork_lz_compress_bound(CORK_LZ_MAX_BLOCK_SIZE)
+
+static inline void
+cork_lz_write_u32(uint8_t *dest, uint32_t value)
+{
+    value = CORK_UINT32_HOST_TO_LITTLE(value);
+    memcpy(dest, &value, sizeof(uint32_t));
+}
+
+static inline uint32_t
+cork_lz_read_u32(const uint8_t *src)
+{
+    uint32_t  value;
+    memcpy(&value, src, sizeof(uint32_t));
+    return CORK_UINT32_LITTLE_TO_HOST(value);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Compressor
+ */
+
+struct cork_lz_compressor {
+    struct cork_stream_consumer  parent;
+    struct cork_stream_consumer  *dest;
+    bool  checksum;
+    /* Whether we've sent the current frame's header yet */
+    bool  started;
+    /* Input that doesn't fill up a block yet */
+    uint8_t  *pending;
+    size_t  pending_size;
+    /* The frame header (for the first block), block header, and compressed
+     * contents of the block we're about to send */
+    uint8_t  *output;
+    uint32_t  table[CORK_LZ_HASH_SIZE];
+};
+
+#define CORK_LZ_COMPRESSOR_OUTPUT_SIZE \
+    (CORK_LZ_FRAME_HEADER_SIZE + CORK_LZ_BLOCK_HEADER_SIZE + \
+     CORK_LZ_CHECKSUM_SIZE + CORK_LZ_MAX_COMPRESSED_BLOCK_SIZE)
+
+static void
+cork_lz_compressor_reset(struct cork_lz_compressor *self)
+{
+    self->started = false;
+    self->pending_size = 0;
+}
+
+static uint8_t *
+cork_lz_compressor_start(struct cork_lz_compressor *self, uint8_t *op)
+{
+    if (!self->started) {
+        memcpy(op, CORK_LZ_MAGIC, sizeof(CORK_LZ_MAGIC));
+        op[4] = self->checksum? CORK_LZ_FLAG_CHECKSUM: 0;
+        op += CORK_LZ_FRAME_HEADER_SIZE;
+    }
+    return op;
+}
+
+static int
+cork_lz_compressor_send(struct cork_lz_compressor *self, uint8_t *end)
+{
+    bool  is_first_chunk = !self->started;
+    self->started = true;
+    return cork_stream_consumer_data
+        (self->dest, self->output, end - self->output, is_first_chunk);
+}
+
+static int
+cork_lz_compressor_block(struct cork_lz_compressor *self,
+                         const uint8_t *src, size_t size)
+{
+    uint8_t  *op = cork_lz_compressor_start(self, self->output);
+    uint8_t  *header = op;
+    size_t  compressed_size;
+
+    op += CORK_LZ_BLOCK_HEADER_SIZE;
+    if (self->checksum) {
+        cork_lz_write_u32(op, cork_stable_hash_buffer
+                          (CORK_LZ_CHECKSUM_SEED, src, size));
+        op += CORK_LZ_CHECKSUM_SIZE;
+    }
+
+    compressed_size = cork_lz_compress_with_table(self->table, src, size, op);
+    if (compressed_size < size) {
+        cork_lz_write_u32(header, compressed_size);
+        op += compressed_size;
+    } else {
+        cork_lz_write_u32(header, size | CORK_LZ_BLOCK_UNCOMPRESSED);
+        memcpy(op, src, size);
+        op += size;
+    }
+    return cork_lz_compressor_send(self, op);
+}
+
+static int
+cork_lz_compressor__data(struct cork_stream_consumer *consumer,
+                         const void *vbuf, size_t size, bool is_first_chunk)
+{
+    struct cork_lz_compressor  *self =
+        cork_container_of(consumer, struct cork_lz_compressor, parent);
+    const uint8_t  *buf = vbuf;
+
+    if (is_first_chunk) {
+        cork_lz_compressor_reset(self);
+    }
+
+    if (self->pending_size > 0) {
+        size_t  needed = CORK_LZ_MAX_BLOCK_SIZE - self->pending_size;
+        if (size < needed) {
+            memcpy(self->pending + self->pending_size, buf, size);
+            self->pending_size += size;
+            return 0;
+        }
+        memcpy(self->pending + self->pending_size, buf, needed);
+        ei_check(cork_lz_compressor_block
+                 (self, self->pending, CORK_LZ_MAX_BLOCK_SIZE));
+        self->pending_size = 0;
+        buf += needed;
+        size -= needed;
+    }
+
+    /* Compress full blocks straight out of the caller's chunk. */
+    while (size >= CORK_LZ_MAX_BLOCK_SIZE) {
+        ei_check(cork_lz_compressor_block(self, buf, CORK_LZ_MAX_BLOCK_SIZE));
+        buf += CORK_LZ_MAX_BLOCK_SIZE;
+        size -= CORK_LZ_MAX_BLOCK_SIZE;
+    }
+
+    memcpy(self->pending, buf, size);
+    self->pending_size = size;
+    return 0;
+
+error:
+    cork_lz_compressor_reset(self);
+    return -1;
+}
+
+static int
+cork_lz_compressor__eof(struct cork_stream_consumer *consumer)
+{
+    struct cork_lz_compressor  *self =
+        cork_container_of(consumer, struct cork_lz_compressor, parent);
+    uint8_t  *op;
+
+    if (self->pending_size > 0) {
+        ei_check(cork_lz_compressor_block
+                 (self, self->pending, self->pending_size));
+    }
+
+    op = cork_lz_compressor_start(self, self->output);
+    cork_lz_write_u32(op, 0);
+    op += CORK_LZ_BLOCK_HEADER_SIZE;
+    ei_check(cork_lz_compressor_send(self, op));
+    ei_check(cork_stream_consumer_eof(self->dest));
+    cork_lz_compressor_reset(self);
+    return 0;
+
+error:
+    cork_lz_compressor_reset(self);
+    return -1;
+}
+
+static void
+cork_lz_compressor__free(struct cork_stream_consumer *consumer)
+{
+    struct cork_lz_compressor  *self =
+        cork_container_of(consumer, struct cork_lz_compressor, parent);
+    cork_stream_consumer_free(self->dest);
+    free(self->pending);
+    free(self->output);
+    free(self);
+}
+
+struct cork_stream_consumer *
+cork_lz_compressor_new(struct cork_stream_consumer *dest, bool checksum)
+{
+    struct cork_lz_compressor  *self = cork_new(struct cork_lz_compressor);
+    self->parent.data = cork_lz_compressor__data;
+    self->parent.eof = cork_lz_compressor__eof;
+    self->parent.free = cork_lz_compressor__free;
+    self->dest = dest;
+    self->checksum = checksum;
+    self->pending = cork_malloc(CORK_LZ_MAX_BLOCK_SIZE);
+    self->output = cork_malloc(CORK_LZ_COMPRESSOR_OUTPUT_SIZE);
+    cork_lz_compressor_reset(self);
+    return &self->parent;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Decompressor
+ */
+
+enum cork_lz_decompressor_state {
+    CORK_LZ_FRAME_HEADER,
+    CORK_LZ_BLOCK_HEADER,
+    CORK_LZ_BLOCK_CONTENTS
+};
+
+struct cork_lz_decompressor {
+    struct cork_stream_consumer  parent;
+    struct cork_stream_consumer  *dest;
+    enum cork_lz_decompressor_state  state;
+    /* How many bytes the current frame header, block header, or block
+     * takes up, and where it starts in the stream */
+    size_t  needed;
+    size_t  item_offset;
+    /* An incomplete header or block from a previous chunk */
+    struct cork_buffer  partial;
+    /* The offset within the stream of the current chunk */
+    size_t  offset;
+    bool  checksum;
+    uint32_t  block_header;
+    size_t  block_offset;
+    /* Whether we've seen a complete frame */
+    bool  finished_frame;
+    bool  started;
+    uint8_t  *output;
+};
+
+static void
+cork_lz_decompressor_reset(struct cork_lz_decompressor *self)
+{
+    self->state = CORK_LZ_FRAME_HEADER;
+    self->needed = CORK_LZ_FRAME_HEADER_SIZE;
+    cork_buffer_clear(&self->partial);
+    self->offset = 0;
+    self->finished_frame = false;
+    self->started = false;
+}
+
+static int
+cork_lz_decompressor_frame_header(struct cork_lz_decompressor *self,
+                                  const uint8_t *src)
+{
+    if (CORK_UNLIKELY(memcmp(src, CORK_LZ_MAGIC, sizeof(CORK_LZ_MAGIC)) != 0)) {
+        cork_error_set
+            (CORK_COMPRESSION_ERROR, CORK_COMPRESSION_INVALID,
+             "Invalid compressed frame header at offset %zu",
+             self->item_offset);
+        return -1;
+    }
+    if (CORK_UNLIKELY((src[4] & ~CORK_LZ_FLAG_CHECKSUM) != 0)) {
+        cork_error_set
+            (CORK_COMPRESSION_ERROR, CORK_COMPRESSION_INVALID,
+             "Unsupported compressed frame flags (0x%02x) at offset %zu",
+             (unsigned int) src[4], self->item_offset);
+        return -1;
+    }
+    self->checksum = (src[4] & CORK_LZ_FLAG_CHECKSUM) != 0;
+    self->state = CORK_LZ_BLOCK_HEADER;
+    self->needed = CORK_LZ_BLOCK_HEADER_SIZE;
+    return 0;
+}
+
+static int
+cork_lz_decompressor_block_header(struct cork_lz_decompressor *self,
+                                  const uint8_t *src)
+{
+    uint32_t  header = cork_lz_read_u32(src);
+    size_t  size = header & ~CORK_LZ_BLOCK_UNCOMPRESSED;
+    size_t  max_size = (header & CORK_LZ_BLOCK_UNCOMPRESSED)?
+        CORK_LZ_MAX_BLOCK_SIZE: CORK_LZ_MAX_COMPRESSED_BLOCK_SIZE;
+
+    if (header == 0) {
+        self->finished_frame = true;
+        self->state = CORK_LZ_FRAME_HEADER;
+        self->needed = CORK_LZ_FRAME_HEADER_SIZE;
+        return 0;
+    }
+    if (CORK_UNLIKELY(size == 0 || size > max_size)) {
+        cork_error_set
+            (CORK_COMPRESSION_ERROR, CORK_COMPRESSION_INVALID,
+             "Invalid compressed block size (%zu bytes) at offset %zu",
+             size, self->item_offset);
+        return -1;
+    }
+    self->block_header = header;
+    self->block_offset = self->item_offset;
+    self->state = CORK_LZ_BLOCK_CONTENTS;
+    self->needed = size + (self->checksum? CORK_LZ_CHECKSUM_SIZE: 0);
+    return 0;
+}
+
+static int
+cork_lz_decompressor_block(struct cork_lz_decompressor *self,
+                           const uint8_t *src)
+{
+    size_t  size = self->block_header & ~CORK_LZ_BLOCK_UNCOMPRESSED;
+    const uint8_t  *contents = src;
+    bool  is_first_chunk;
+
+    if (self->checksum) {
+        contents += CORK_LZ_CHECKSUM_SIZE;
+    }
+
+    /* Stored blocks can be passed along without copying them. */
+    if (!(self->block_header & CORK_LZ_BLOCK_UNCOMPRESSED)) {
+        ssize_t  decompressed_size = cork_lz_decompress_block
+            (contents, size, self->output, CORK_LZ_MAX_BLOCK_SIZE);
+        if (CORK_UNLIKELY(decompressed_size < 0)) {
+            cork_error_set
+                (CORK_COMPRESSION_ERROR, CORK_COMPRESSION_INVALID,
+                 "Corrupt compressed block at offset %zu",
+                 self->block_offset);
+            return -1;
+        }
+        contents = self->output;
+        size = decompressed_size;
+    }
+
+    if (self->checksum &&
+        CORK_UNLIKELY(cork_lz_read_u32(src) != cork_stable_hash_buffer
+                      (CORK_LZ_CHECKSUM_SEED, contents, size))) {
+        cork_error_set
+            (CORK_COMPRESSION_ERROR, CORK_COMPRESSION_CHECKSUM,
+             "Checksum mismatch in compressed block at offset %zu",
+             self->block_offset);
+        return -1;
+    }
+
+    self->state = CORK_LZ_BLOCK_HEADER;
+    self->needed = CORK_LZ_BLOCK_HEADER_SIZE;
+    if (size == 0) {
+        return 0;
+    }
+    is_first_chunk = !self->started;
+    self->started = true;
+    return cork_stream_consumer_data(self->dest, contents, size, is_first_chunk);
+}
+
+static int
+cork_lz_decompressor_process(struct cork_lz_decompressor *self,
+                             const uint8_t *src)
+{
+    switch (self->state) {
+        case CORK_LZ_FRAME_HEADER:
+            return cork_lz_decompressor_frame_header(self, src);
+        case CORK_LZ_BLOCK_HEADER:
+            return cork_lz_decompressor_block_header(self, src);
+        default:
+            return cork_lz_decompressor_block(self, src);
+    }
+}
+
+static int
+cork_lz_decompressor__data(struct cork_stream_consumer *consumer,
+                           const void *vbuf, size_t size, bool is_first_chunk)
+{
+    struct cork_lz_decompressor  *self =
+        cork_container_of(consumer, struct cork_lz_decompressor, parent);
+    const uint8_t  *buf = vbuf;
+    size_t  pos = 0;
+
+    if (is_first_chunk) {
+        cork_lz_decompressor_reset(self);
+    }
+
+    while (pos < size) {
+        const uint8_t  *item;
+        if (self->partial.size == 0) {
+            self->item_offset = self->offset + pos;
+            if (size - pos >= self->needed) {
+                /* The whole item is in this chunk. */
+                item = buf + pos;
+                pos += self->needed;
+                ei_check(cork_lz_decompressor_process(self, item));
+                continue;
+            }
+        }
+
+        {
+            size_t  available = size - pos;
+            size_t  missing = self->needed - self->partial.size;
+            if (available < missing) {
+                cork_buffer_append(&self->partial, buf + pos, available);
+                break;
+            }
+            cork_buffer_append(&self->partial, buf + pos, missing);
+            pos += missing;
+            ei_check(cork_lz_decompressor_process(self, self->partial.buf));
+            cork_buffer_clear(&self->partial);
+        }
+    }
+
+    self->offset += size;
+    return 0;
+
+error:
+    cork_lz_decompressor_reset(self);
+    return -1;
+}
+
+static int
+cork_lz_decompressor__eof(struct cork_stream_consumer *consumer)
+{
+    struct cork_lz_decompressor  *self =
+        cork_container_of(consumer, struct cork_lz_decompressor, parent);
+
+    if (CORK_UNLIKELY(self->state != CORK_LZ_FRAME_HEADER ||
+                      self->partial.size > 0 || !self->finished_frame)) {
+        cork_error_set
+            (CORK_COMPRESSION_ERROR, CORK_COMPRESSION_INVALID,
+             "Truncated compressed stream at offset %zu", self->offset);
+        goto error;
+    }
+    ei_check(cork_stream_consumer_eof(self->dest));
+    cork_lz_decompressor_reset(self);
+    return 0;
+
+error:
+    cork_lz_decompressor_reset(self);
+    return -1;
+}
+
+static void
+cork_lz_decompressor__free(struct cork_stream_consumer *consumer)
+{
+    struct cork_lz_decompressor  *self =
+        cork_container_of(consumer, struct cork_lz_decompressor, parent);
+    cork_stream_consumer_free(self->dest);
+    cork_buffer_done(&self->partial);
+    free(self->output);
+    free(self);
+}
+
+struct cork_stream_consumer *
+cork_lz_decompressor_new(struct cork_stream_consumer *dest)
+{
+    struct cork_lz_decompressor  *self = cork_new(struct cork_lz_decompressor);
+    self->parent.data = cork_lz_decompressor__data;
+    self->parent.eof = cork_lz_decompressor__eof;
+    self->parent.free = cork_lz_decompressor__free;
+    self->dest = dest;
+    cork_buffer_init(&self->partial);
+    self->output = cork_malloc(CORK_LZ_MAX_BLOCK_SIZE);
+    self->checksum = false;
+    self->block_header = 0;
+    self->block_offset = 0;
+    self->item_offset = 0;
+    cork_lz_decompressor_reset(self);
+    return &self->parent;
+}
@@ -0,0 +1,544 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/config.h"
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/csv.h"
+#include "libcork/ds/slice.h"
+#include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * Finding special characters
+ */
+
+/* We look at the input 64 bytes at a time, and build up bitmasks telling us
+ * which of those bytes are quotes, delimiters, and newlines.  (This is the
+ * approach that simdjson and simdcsv use.)  A prefix XOR of the quote mask
+ * tells us which bytes are inside of quotes; a doubled quote turns quoting
+ * off and back on again, so it doesn't need any special handling here.  Any
+ * delimiter or newline that isn't inside of quotes ends a field. */
+
+struct cork_csv_masks {
+    uint64_t  quotes;
+    uint64_t  delimiters;
+    uint64_t  newlines;
+};
+
+static inline unsigned int
+cork_csv_ctz64(uint64_t x)
+{
+#if CORK_CONFIG_GCC_VERSION >= 30400
+    return __builtin_ctzll(x);
+#else
+    unsigned int  result = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+static inline unsigned int
+cork_csv_clz64(uint64_t x)
+{
+#if CORK_CONFIG_GCC_VERSION >= 30400
+    return __builtin_clzll(x);
+#else
+    unsigned int  result = 0;
+    while ((x & UINT64_C(0x8000000000000000)) == 0) {
+        x <<= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+/* Bit i of the result is the XOR of bits 0 through i of x. */
+static inline uint64_t
+cork_csv_prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+
+/*-----------------------------------------------------------------------
+ * CSV consumers
+ */
+
+struct cork_csv {
+    struct cork_stream_consumer  parent;
+    uint8_t  delimiter;
+    uint8_t  quote;
+    bool  has_quote;
+
+    void  *user_data;
+    cork_free_f  free_user_data;
+    cork_csv_rows_f  rows_callback;
+
+    /* The current batch.  Each row's fields pointer isn't filled in until
+     * we pass the batch to the callback, since the fields array might be
+     * reallocated while we're filling it. */
+    cork_array(struct cork_csv_row)  rows;
+    cork_array(struct cork_slice)  fields;
+    /* Where the current row's fields start in the fields array. */
+    size_t  row_first_field;
+
+    /* Unescaped copies of any quoted fields that contain doubled quotes.
+     * We make sure that this is big enough for everything in the current
+     * chunk before adding the first field to it, so that it's never
+     * reallocated while a batch points into it. */
+    struct cork_buffer  scratch;
+    size_t  scratch_budget;
+
+    /* A row that started in a previous chunk, and whether it ends inside of
+     * quotes. */
+    struct cork_buffer  partial;
+    bool  partial_in_quotes;
+    size_t  partial_offset;
+
+    /* The offset within the stream of the chunk we're looking at, and of the
+     * region of it that we're tokenizing, for error messages. */
+    size_t  offset;
+    size_t  region_offset;
+};
+
+static void
+cork_csv_find_masks(struct cork_csv *self, const uint8_t *src,
+                    size_t size, struct cork_csv_masks *masks)
+{
+    uint8_t  padded[64];
+    uint64_t  valid = (size >= 64)? UINT64_MAX: ((UINT64_C(1) << size) - 1);
+
+    if (size < 64) {
+        memset(padded, 0, sizeof(padded));
+        memcpy(padded, src, size);
+        src = padded;
+    }
+
+#if defined(__SSE2__)
+    {
+        __m128i  delimiter = _mm_set1_epi8(self->delimiter);
+        __m128i  quote = _mm_set1_epi8(self->quote);
+        __m128i  newline = _mm_set1_epi8('\n');
+        unsigned int  i;
+        masks->quotes = 0;
+        masks->delimiters = 0;
+        masks->newlines = 0;
+        for (i = 0; i < 4; i++) {
+            __m128i  block = _mm_loadu_si128((const __m128i *) (src + i * 16));
+            masks->quotes |= ((uint64_t) (uint16_t) _mm_movemask_epi8
+                              (_mm_cmpeq_epi8(block, quote))) << (i * 16);
+            masks->delimiters |= ((uint64_t) (uint16_t) _mm_movemask_epi8
+                                  (_mm_cmpeq_epi8(block, delimiter)))
+                << (i * 16);
+            masks->newlines |= ((uint64_t) (uint16_t) _mm_movemask_epi8
+                                (_mm_cmpeq_epi8(block, newline))) << (i * 16);
+        }
+    }
+#else
+    {
+        unsigned int  i;
+        masks->quotes = 0;
+        masks->delimiters = 0;
+        masks->newlines = 0;
+        for (i = 0; i < 64; i++) {
+            uint64_t  bit = UINT64_C(1) << i;
+            if (src[i] == self->quote) {
+                masks->quotes |= bit;
+            } else if (src[i] == self->delimiter) {
+                masks->delimiters |= bit;
+            } else if (src[i] == '\n') {
+                masks->newlines |= bit;
+            }
+        }
+    }
+#endif
+
+    masks->quotes &= self->has_quote? valid: 0;
+    masks->delimiters &= valid;
+    masks->newlines &= valid;
+}
+
+static void
+cork_csv_clear_batch(struct cork_csv *self)
+{
+    cork_array_clear(&self->rows);
+    cork_array_clear(&self->fields);
+    self->row_first_field = 0;
+    self->scratch.size = 0;
+}
+
+static int
+cork_csv_deliver(struct cork_csv *self)
+{
+    size_t  i;
+    size_t  field_index = 0;
+    int  rc;
+
+    if (cork_array_is_empty(&self->rows)) {
+        return 0;
+    }
+
+    for (i = 0; i < cork_array_size(&self->rows); i++) {
+        struct cork_csv_row  *row = &cork_array_at(&self->rows, i);
+        row->fields = &cork_array_at(&self->fields, field_index);
+        field_index += row->field_count;
+    }
+
+    rc = self->rows_callback
+        (self->user_data, cork_array_elements(&self->rows),
+         cork_array_size(&self->rows));
+    cork_csv_clear_batch(self);
+    return rc;
+}
+
+static int
+cork_csv_add_quoted_field(struct cork_csv *self, struct cork_slice *field,
+                          const uint8_t *src, size_t start, size_t end)
+{
+    const uint8_t  *curr = src + start + 1;
+    const uint8_t  *last = src + end - 1;
+    bool  has_escapes = false;
+
+    if (CORK_UNLIKELY(src[start] != self->quote)) {
+        const uint8_t  *stray = memchr(src + start, self->quote, end - start);
+        cork_error_set
+            (CORK_CSV_ERROR, CORK_CSV_INVALID,
+             "Unexpected quote at offset %zu",
+             self->region_offset + (stray - src));
+        return -1;
+    }
+
+    /* Make sure that the closing quote is the last thing in the field, and
+     * that any quotes before it are doubled. */
+    for (;;) {
+        const uint8_t  *next = (curr <= last)?
+            memchr(curr, self->quote, last - curr + 1): NULL;
+        if (CORK_UNLIKELY(next == NULL)) {
+            cork_error_set
+                (CORK_CSV_ERROR, CORK_CSV_INVALID,
+                 "Unterminated quoted field at offset %zu",
+                 self->region_offset + start);
+            return -1;
+        }
+        if (next == last) {
+            break;
+        }
+        if (CORK_UNLIKELY(next[1] != self->quote)) {
+            cork_error_set
+                (CORK_CSV_ERROR, CORK_CSV_INVALID,
+                 "Unexpected character after closing quote at offset %zu",
+                 self->region_offset + (next + 1 - src));
+            return -1;
+        }
+        has_escapes = true;
+        curr = next + 2;
+    }
+
+    if (CORK_LIKELY(!has_escapes)) {
+        cork_slice_init_static(field, src + start + 1, end - start - 2);
+    } else {
+        uint8_t  *out;
+        size_t  out_size = 0;
+        if (self->scratch.allocated_size < self->scratch_budget) {
+            cork_buffer_ensure_size(&self->scratch, self->scratch_budget);
+        }
+        out = ((uint8_t *) self->scratch.buf) + self->scratch.size;
+        for (curr = src + start + 1; curr < last; curr++) {
+            out[out_size++] = *curr;
+            if (*curr == self->quote) {
+                curr++;
+            }
+        }
+        self->scratch.size += out_size;
+        cork_slice_init_static(field, out, out_size);
+    }
+    return 0;
+}
+
+static int
+cork_csv_add_field(struct cork_csv *self, const uint8_t *src,
+                   size_t start, size_t end, bool has_quote, bool row_end)
+{
+    struct cork_slice  *field;
+    if (row_end && end > start && src[end - 1] == '\r') {
+        end--;
+    }
+    field = cork_array_append_get(&self->fields);
+    if (CORK_LIKELY(!has_quote)) {
+        cork_slice_init_static(field, src + start, end - start);
+        return 0;
+    }
+    return cork_csv_add_quoted_field(self, field, src, start, end);
+}
+
+static int
+cork_csv_end_row(struct cork_csv *self, const uint8_t *src,
+                 size_t start, size_t end)
+{
+    struct cork_csv_row  *row;
+
+    /* Skip blank lines. */
+    if (end == start || (end == start + 1 && src[start] == '\r')) {
+        self->fields.size = self->row_first_field;
+        return 0;
+    }
+
+    row = cork_array_append_get(&self->rows);
+    row->fields = NULL;
+    row->field_count = cork_array_size(&self->fields) - self->row_first_field;
+    self->row_first_field = cork_array_size(&self->fields);
+    if (cork_array_size(&self->rows) == CORK_CSV_BATCH_SIZE) {
+        return cork_csv_deliver(self);
+    }
+    return 0;
+}
+
+/* Adds every complete row in src to the current batch, passing the batch to
+ * the callback whenever it fills up.  src must start at the beginning of a
+ * row.  If at_end is true, the end of src also ends the last row; otherwise
+ * we fill in where the incomplete last row starts, and whether it ends
+ * inside of quotes. */
+static int
+cork_csv_tokenize(struct cork_csv *self, const uint8_t *src, size_t size,
+                  bool at_end, size_t *partial_start, bool *partial_in_quotes)
+{
+    size_t  block_start;
+    size_t  row_start = 0;
+    size_t  field_start = 0;
+    /* One past the last quote in any earlier block, or 0 if there isn't
+     * one. */
+    size_t  quote_end = 0;
+    bool  in_quotes = false;
+
+    for (block_start = 0; block_start < size; block_start += 64) {
+        struct cork_csv_masks  masks;
+        uint64_t  inside;
+        uint64_t  bits;
+
+        cork_csv_find_masks
+            (self, src + block_start, size - block_start, &masks);
+        inside = cork_csv_prefix_xor(masks.quotes);
+        if (in_quotes) {
+            inside = ~inside;
+        }
+        in_quotes = (inside >> 63) != 0;
+
+        bits = (masks.delimiters | masks.newlines) & ~inside;
+        while (bits != 0) {
+            unsigned int  bit = cork_csv_ctz64(bits);
+            size_t  pos = block_start + bit;
+            uint64_t  before = masks.quotes & ((UINT64_C(1) << bit) - 1);
+            size_t  last_quote_end = (before != 0)?
+                block_start + 64 - cork_csv_clz64(before): quote_end;
+            bool  is_newline = ((masks.newlines >> bit) & 1) != 0;
+
+            rii_check(cork_csv_add_field
+                      (self, src, field_start, pos,
+                       last_quote_end > field_start, is_newline));
+            field_start = pos + 1;
+            if (is_newline) {
+                rii_check(cork_csv_end_row(self, src, row_start, pos));
+                row_start = pos + 1;
+            }
+            bits &= bits - 1;
+        }
+
+        if (masks.quotes != 0) {
+            quote_end = block_start + 64 - cork_csv_clz64(masks.quotes);
+        }
+    }
+
+    if (!at_end) {
+        /* Forget about any fields that we've found in the incomplete row;
+         * we'll find them again once we have the rest of it. */
+        self->fields.size = self->row_first_field;
+        *partial_start = row_start;
+        *partial_in_quotes = in_quotes;
+        return 0;
+    }
+
+    if (CORK_UNLIKELY(in_quotes)) {
+        cork_error_set
+            (CORK_CSV_ERROR, CORK_CSV_INVALID,
+             "Unterminated quoted field at offset %zu",
+             self->region_offset + field_start);
+        return -1;
+    }
+    if (row_start < size) {
+        rii_check(cork_csv_add_field
+                  (self, src, field_start, size,
+                   quote_end > field_start, true));
+        rii_check(cork_csv_end_row(self, src, row_start, size));
+    }
+    return 0;
+}
+
+/* Returns the index of the newline that ends the partial row, or size if
+ * src doesn't contain it. */
+static size_t
+cork_csv_find_row_end(struct cork_csv *self, const uint8_t *src, size_t size)
+{
+    size_t  block_start;
+    for (block_start = 0; block_start < size; block_start += 64) {
+        struct cork_csv_masks  masks;
+        uint64_t  inside;
+        uint64_t  newlines;
+        cork_csv_find_masks
+            (self, src + block_start, size - block_start, &masks);
+        inside = cork_csv_prefix_xor(masks.quotes);
+        if (self->partial_in_quotes) {
+            inside = ~inside;
+        }
+        self->partial_in_quotes = (inside >> 63) != 0;
+        newlines = masks.newlines & ~inside;
+        if (newlines != 0) {
+            return block_start + cork_csv_ctz64(newlines);
+        }
+    }
+    return size;
+}
+
+static void
+cork_csv_reset(struct cork_csv *self)
+{
+    cork_csv_clear_batch(self);
+    cork_buffer_clear(&self->partial);
+    self->partial_in_quotes = false;
+    self->partial_offset = 0;
+    self->offset = 0;
+}
+
+static int
+cork_csv__data(struct cork_stream_consumer *consumer,
+               const void *vbuf, size_t size, bool is_first_chunk)
+{
+    struct cork_csv  *self = cork_container_of(consumer, struct cork_csv, parent);
+    const uint8_t  *buf = vbuf;
+    size_t  start = 0;
+    size_t  partial_start;
+    bool  partial_in_quotes;
+
+    if (is_first_chunk) {
+        cork_csv_reset(self);
+    }
+    self->scratch_budget = self->partial.size + size;
+
+    if (self->partial.size > 0) {
+        size_t  row_end = cork_csv_find_row_end(self, buf, size);
+        if (row_end == size) {
+            cork_buffer_append(&self->partial, buf, size);
+            self->offset += size;
+            return 0;
+        }
+        cork_buffer_append(&self->partial, buf, row_end);
+        self->region_offset = self->partial_offset;
+        ei_check(cork_csv_tokenize
+                 (self, self->partial.buf, self->partial.size, true,
+                  NULL, NULL));
+        start = row_end + 1;
+    }
+
+    self->region_offset = self->offset + start;
+    ei_check(cork_csv_tokenize
+             (self, buf + start, size - start, false,
+              &partial_start, &partial_in_quotes));
+    ei_check(cork_csv_deliver(self));
+
+    /* Hold on to any incomplete row at the end of the chunk. */
+    cork_buffer_set(&self->partial, buf + start + partial_start,
+                    size - start - partial_start);
+    self->partial_in_quotes = partial_in_quotes;
+    self->partial_offset = self->offset + start + partial_start;
+    self->offset += size;
+    return 0;
+
+error:
+    cork_csv_reset(self);
+    return -1;
+}
+
+static int
+cork_csv__eof(struct cork_stream_consumer *consumer)
+{
+    struct cork_csv  *self = cork_container_of(consumer, struct cork_csv, parent);
+    self->scratch_budget = self->partial.size;
+    self->region_offset = self->partial_offset;
+    ei_check(cork_csv_tokenize
+             (self, self->partial.buf, self->partial.size, true, NULL, NULL));
+    ei_check(cork_csv_deliver(self));
+    cork_csv_reset(self);
+    return 0;
+
+error:
+    cork_csv_reset(self);
+    return -1;
+}
+
+static void
+cork_csv__free(struct cork_stream_consumer *consumer)
+{
+    struct cork_csv  *self = cork_container_of(consumer, struct cork_csv, parent);
+    if (self->free_user_data != NULL) {
+        self->free_user_data(self->user_data);
+    }
+    cork_array_done(&self->rows);
+    cork_array_done(&self->fields);
+    cork_buffer_done(&self->scratch);
+    cork_buffer_done(&self->partial);
+    free(self);
+}
+
+struct cork_stream_consumer *
+cork_csv_consumer_new(char delimiter, char quote,
+                      void *user_data, cork_free_f free_user_data,
+                      cork_csv_rows_f rows)
+{
+    struct cork_csv  *self = cork_new(struct cork_csv);
+    self->parent.data = cork_csv__data;
+    self->parent.eof = cork_csv__eof;
+    self->parent.free = cork_csv__free;
+    self->delimiter = delimiter;
+    self->quote = quote;
+    self->has_quote = (quote != '\0');
+    self->user_data = user_data;
+    self->free_user_data = free_user_data;
+    self->rows_callback = rows;
+    cork_array_init(&self->rows);
+    cork_array_init(&self->fields);
+    self->row_first_field = 0;
+    cork_buffer_init(&self->scratch);
+    self->scratch_budget = 0;
+    cork_buffer_init(&self->partial);
+    self->partial_in_quotes = false;
+    self->partial_offset = 0;
+    self->offset = 0;
+    self->region_offset = 0;
+    return &self->parent;
+}
@@ -0,0 +1,432 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/cuckoo-filter.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Cuckoo filters
+ */
+
+/* Each bucket holds four 16-bit fingerprints, packed into a single uint64_t.
+ * A fingerprint of 0 marks an empty slot.  Every element has two candidate
+ * buckets; the second is derived from the first and the fingerprint alone
+ * ("partial-key cuckoo hashing"), so that we can move fingerprints between
+ * buckets without knowing the original elements. */
+
+#define CORK_CUCKOO_FILTER_SLOTS  4
+#define CORK_CUCKOO_FILTER_MAX_KICKS  500
+
+#define CORK_CUCKOO_FILTER_LANES  UINT64_C(0x0001000100010001)
+#define CORK_CUCKOO_FILTER_HIGH_BITS  UINT64_C(0x8000800080008000)
+
+struct cork_cuckoo_filter {
+    uint64_t  *buckets;
+    size_t  bucket_count;
+    size_t  count;
+    uint64_t  rng;
+    /* If an insertion runs out of kicks, we hold onto the last displaced
+     * fingerprint here, and the filter is full until it finds a home. */
+    bool  has_victim;
+    uint16_t  victim_fingerprint;
+    size_t  victim_index;
+    /* Whether we allocated buckets ourselves, or are using someone else's
+     * serialized copy. */
+    bool  owns_buckets;
+};
+
+#define cork_cuckoo_filter_mask(filter)  ((filter)->bucket_count - 1)
+
+#define cork_cuckoo_filter_get_slot(bucket, slot) \
+    ((uint16_t) ((bucket) >> (16 * (slot))))
+
+#define cork_cuckoo_filter_set_slot(bucket, slot, fp) \
+    ((bucket) = ((bucket) & ~(UINT64_C(0xffff) << (16 * (slot)))) | \
+                ((uint64_t) (fp) << (16 * (slot))))
+
+/* Checks all four slots of a bucket at once, using the usual "does this word
+ * contain a zero lane" trick. */
+static inline bool
+cork_cuckoo_filter_bucket_has(uint64_t bucket, uint16_t fp)
+{
+    uint64_t  x = bucket ^ (fp * CORK_CUCKOO_FILTER_LANES);
+    return ((x - CORK_CUCKOO_FILTER_LANES) & ~x &
+            CORK_CUCKOO_FILTER_HIGH_BITS) != 0;
+}
+
+static inline size_t
+cork_cuckoo_filter_alt_index(const struct cork_cuckoo_filter *filter,
+                             size_t index, uint16_t fp)
+{
+    return (index ^ (size_t) (fp * UINT32_C(0x5bd1e995))) &
+        cork_cuckoo_filter_mask(filter);
+}
+
+static inline uint16_t
+cork_cuckoo_filter_fingerprint(cork_big_hash hash)
+{
+    uint16_t  fp = (uint16_t) (cork_u128_be64(hash.u128, 1) >> 48);
+    return (fp == 0)? 1: fp;
+}
+
+#define cork_cuckoo_filter_index(filter, hash) \
+    ((size_t) cork_u128_be64((hash).u128, 0) & \
+     cork_cuckoo_filter_mask(filter))
+
+static bool
+cork_cuckoo_filter_bucket_insert(uint64_t *bucket, uint16_t fp)
+{
+    unsigned int  slot;
+    for (slot = 0; slot < CORK_CUCKOO_FILTER_SLOTS; slot++) {
+        if (cork_cuckoo_filter_get_slot(*bucket, slot) == 0) {
+            cork_cuckoo_filter_set_slot(*bucket, slot, fp);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+cork_cuckoo_filter_bucket_delete(uint64_t *bucket, uint16_t fp)
+{
+    unsigned int  slot;
+    for (slot = 0; slot < CORK_CUCKOO_FILTER_SLOTS; slot++) {
+        if (cork_cuckoo_filter_get_slot(*bucket, slot) == fp) {
+            cork_cuckoo_filter_set_slot(*bucket, slot, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* xorshift64 */
+static inline uint64_t
+cork_cuckoo_filter_random(struct cork_cuckoo_filter *filter)
+{
+    filter->rng ^= filter->rng << 13;
+    filter->rng ^= filter->rng >> 7;
+    filter->rng ^= filter->rng << 17;
+    return filter->rng;
+}
+
+
+static struct cork_cuckoo_filter *
+cork_cuckoo_filter_new_empty(size_t bucket_count)
+{
+    struct cork_cuckoo_filter  *filter = cork_new(struct cork_cuckoo_filter);
+    filter->buckets = NULL;
+    filter->bucket_count = bucket_count;
+    filter->count = 0;
+    filter->rng = UINT64_C(0x9e3779b97f4a7c15);
+    filter->has_victim = false;
+    filter->victim_fingerprint = 0;
+    filter->victim_index = 0;
+    filter->owns_buckets = false;
+    return filter;
+}
+
+struct cork_cuckoo_filter *
+cork_cuckoo_filter_new(size_t expected_count)
+{
+    struct cork_cuckoo_filter  *filter;
+    /* Cuckoo filters with 4-slot buckets can reliably reach a 95% load
+     * factor, and the bucket count must be a power of 2. */
+    size_t  min_bucket_count =
+        (expected_count * 20 / 19 + CORK_CUCKOO_FILTER_SLOTS - 1) /
+        CORK_CUCKOO_FILTER_SLOTS;
+    size_t  bucket_count = 1;
+    while (bucket_count < min_bucket_count) {
+        bucket_count <<= 1;
+    }
+
+    filter = cork_cuckoo_filter_new_empty(bucket_count);
+    filter->buckets = cork_calloc(bucket_count, sizeof(uint64_t));
+    filter->owns_buckets = true;
+    return filter;
+}
+
+void
+cork_cuckoo_filter_free(struct cork_cuckoo_filter *filter)
+{
+    if (filter->owns_buckets) {
+        free(filter->buckets);
+    }
+    free(filter);
+}
+
+void
+cork_cuckoo_filter_clear(struct cork_cuckoo_filter *filter)
+{
+    memset(filter->buckets, 0, cork_cuckoo_filter_byte_size(filter));
+    filter->count = 0;
+    filter->has_victim = false;
+}
+
+size_t
+cork_cuckoo_filter_count(const struct cork_cuckoo_filter *filter)
+{
+    return filter->count;
+}
+
+size_t
+cork_cuckoo_filter_byte_size(const struct cork_cuckoo_filter *filter)
+{
+    return filter->bucket_count * sizeof(uint64_t);
+}
+
+
+/* Places a fingerprint into one of its two buckets, evicting other
+ * fingerprints as needed.  If we run out of kicks, the last displaced
+ * fingerprint becomes the filter's victim. */
+static void
+cork_cuckoo_filter_insert(struct cork_cuckoo_filter *filter,
+                          size_t index, uint16_t fp)
+{
+    size_t  alt_index = cork_cuckoo_filter_alt_index(filter, index, fp);
+    unsigned int  kick;
+
+    if (cork_cuckoo_filter_bucket_insert(&filter->buckets[index], fp) ||
+        cork_cuckoo_filter_bucket_insert(&filter->buckets[alt_index], fp)) {
+        return;
+    }
+
+    /* Both buckets are full, so start evicting random fingerprints into their
+     * own alternate buckets. */
+    if (cork_cuckoo_filter_random(filter) & 1) {
+        index = alt_index;
+    }
+    for (kick = 0; kick < CORK_CUCKOO_FILTER_MAX_KICKS; kick++) {
+        unsigned int  slot =
+            cork_cuckoo_filter_random(filter) % CORK_CUCKOO_FILTER_SLOTS;
+        uint16_t  displaced =
+            cork_cuckoo_filter_get_slot(filter->buckets[index], slot);
+        cork_cuckoo_filter_set_slot(filter->buckets[index], slot, fp);
+        fp = displaced;
+        index = cork_cuckoo_filter_alt_index(filter, index, fp);
+        if (cork_cuckoo_filter_bucket_insert(&filter->buckets[index], fp)) {
+            return;
+        }
+    }
+
+    filter->has_victim = true;
+    filter->victim_fingerprint = fp;
+    filter->victim_index = index;
+}
+
+int
+cork_cuckoo_filter_add_hash(struct cork_cuckoo_filter *filter,
+                            cork_big_hash hash)
+{
+    if (CORK_UNLIKELY(filter->has_victim)) {
+        cork_error_set
+            (CORK_CUCKOO_FILTER_ERROR, CORK_CUCKOO_FILTER_FULL,
+             "Cuckoo filter is full (%zu elements)", filter->count);
+        return -1;
+    }
+
+    /* Even if this leaves behind a victim, the element we were asked to add
+     * is in the filter; it's only some other fingerprint that has nowhere to
+     * go. */
+    filter->count++;
+    cork_cuckoo_filter_insert
+        (filter, cork_cuckoo_filter_index(filter, hash),
+         cork_cuckoo_filter_fingerprint(hash));
+    return 0;
+}
+
+bool
+cork_cuckoo_filter_contains_hash(const struct cork_cuckoo_filter *filter,
+                                 cork_big_hash hash)
+{
+    uint16_t  fp = cork_cuckoo_filter_fingerprint(hash);
+    size_t  index = cork_cuckoo_filter_index(filter, hash);
+    size_t  alt_index = cork_cuckoo_filter_alt_index(filter, index, fp);
+    return
+        cork_cuckoo_filter_bucket_has(filter->buckets[index], fp) ||
+        cork_cuckoo_filter_bucket_has(filter->buckets[alt_index], fp) ||
+        (filter->has_victim && filter->victim_fingerprint == fp &&
+         (filter->victim_index == index ||
+          filter->victim_index == alt_index));
+}
+
+bool
+cork_cuckoo_filter_delete_hash(struct cork_cuckoo_filter *filter,
+                               cork_big_hash hash)
+{
+    uint16_t  fp = cork_cuckoo_filter_fingerprint(hash);
+    size_t  index = cork_cuckoo_filter_index(filter, hash);
+    size_t  alt_index = cork_cuckoo_filter_alt_index(filter, index, fp);
+
+    if (filter->has_victim && filter->victim_fingerprint == fp &&
+        (filter->victim_index == index || filter->victim_index == alt_index)) {
+        filter->has_victim = false;
+        filter->count--;
+        return true;
+    }
+
+    if (cork_cuckoo_filter_bucket_delete(&filter->buckets[index], fp) ||
+        cork_cuckoo_filter_bucket_delete(&filter->buckets[alt_index], fp)) {
+        filter->count--;
+        /* We might have just made room for the victim. */
+        if (filter->has_victim) {
+            filter->has_victim = false;
+            cork_cuckoo_filter_insert
+                (filter, filter->victim_index, filter->victim_fingerprint);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+static cork_big_hash
+cork_cuckoo_filter_hash(const void *src, size_t len)
+{
+    cork_big_hash  seed = {cork_u128_from_64(0, 0)};
+    return cork_big_hash_buffer(seed, src, len);
+}
+
+int
+cork_cuckoo_filter_add(struct cork_cuckoo_filter *filter,
+                       const void *src, size_t len)
+{
+    return cork_cuckoo_filter_add_hash
+        (filter, cork_cuckoo_filter_hash(src, len));
+}
+
+bool
+cork_cuckoo_filter_contains(const struct cork_cuckoo_filter *filter,
+                            const void *src, size_t len)
+{
+    return cork_cuckoo_filter_contains_hash
+        (filter, cork_cuckoo_filter_hash(src, len));
+}
+
+bool
+cork_cuckoo_filter_delete(struct cork_cuckoo_filter *filter,
+                          const void *src, size_t len)
+{
+    return cork_cuckoo_filter_delete_hash
+        (filter, cork_cuckoo_filter_hash(src, len));
+}
+
+
+/*-----------------------------------------------------------------------
+ * Serialization
+ */
+
+/* The serialized form is a 64-byte header followed by the buckets, in host
+ * byte order. */
+
+#define CORK_CUCKOO_FILTER_MAGIC  0x6b634343  /* "CCck" */
+#define CORK_CUCKOO_FILTER_VERSION  1
+
+struct cork_cuckoo_filter_header {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  pointer_size;
+    uint16_t  has_victim;
+    uint16_t  victim_fingerprint;
+    uint64_t  bucket_count;
+    uint64_t  count;
+    uint64_t  victim_index;
+    uint8_t  reserved[24];
+};
+
+void
+cork_cuckoo_filter_save(const struct cork_cuckoo_filter *filter,
+                        struct cork_buffer *dest)
+{
+    struct cork_cuckoo_filter_header  header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CORK_CUCKOO_FILTER_MAGIC;
+    header.version = CORK_CUCKOO_FILTER_VERSION;
+    header.pointer_size = CORK_SIZEOF_POINTER;
+    header.has_victim = filter->has_victim;
+    header.victim_fingerprint = filter->victim_fingerprint;
+    header.bucket_count = filter->bucket_count;
+    header.count = filter->count;
+    header.victim_index = filter->victim_index;
+    cork_buffer_append(dest, &header, sizeof(header));
+    cork_buffer_append
+        (dest, filter->buckets, cork_cuckoo_filter_byte_size(filter));
+}
+
+static void
+cork_cuckoo_filter_invalid_set(const char *reason)
+{
+    cork_error_set
+        (CORK_CUCKOO_FILTER_ERROR, CORK_CUCKOO_FILTER_INVALID,
+         "Invalid cuckoo filter: %s", reason);
+}
+
+struct cork_cuckoo_filter *
+cork_cuckoo_filter_new_from_bytes(void *src, size_t size)
+{
+    struct cork_cuckoo_filter_header  header;
+    struct cork_cuckoo_filter  *filter;
+
+    if (CORK_UNLIKELY(((uintptr_t) src & 0x07) != 0)) {
+        cork_cuckoo_filter_invalid_set("Data isn't 8-byte aligned");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(size < sizeof(header))) {
+        cork_cuckoo_filter_invalid_set("Data is too short");
+        return NULL;
+    }
+
+    memcpy(&header, src, sizeof(header));
+    if (CORK_UNLIKELY(header.magic != CORK_CUCKOO_FILTER_MAGIC)) {
+        cork_cuckoo_filter_invalid_set("Bad magic number");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(header.version != CORK_CUCKOO_FILTER_VERSION)) {
+        cork_cuckoo_filter_invalid_set("Unknown version");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(header.pointer_size != CORK_SIZEOF_POINTER)) {
+        cork_cuckoo_filter_invalid_set("Created on an incompatible platform");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(header.bucket_count == 0 ||
+                      (header.bucket_count & (header.bucket_count - 1)) != 0 ||
+                      header.bucket_count > SIZE_MAX / sizeof(uint64_t) ||
+                      (header.has_victim &&
+                       header.victim_index >= header.bucket_count))) {
+        cork_cuckoo_filter_invalid_set("Bad filter parameters");
+        return NULL;
+    }
+
+    if (CORK_UNLIKELY(size - sizeof(header) !=
+                      header.bucket_count * sizeof(uint64_t))) {
+        cork_cuckoo_filter_invalid_set("Data has the wrong size");
+        return NULL;
+    }
+
+    filter = cork_cuckoo_filter_new_empty(header.bucket_count);
+    filter->buckets = (uint64_t *) ((char *) src + sizeof(header));
+    filter->count = header.count;
+    filter->has_victim = header.has_victim;
+    filter->victim_fingerprint = header.victim_fingerprint;
+    filter->victim_index = header.victim_index;
+    return filter;
+}
@@ -0,0 +1,182 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/deque.h"
+#include "libcork/helpers/errors.h"
+
+#ifndef CORK_DEQUE_DEBUG
+#define CORK_DEQUE_DEBUG 0
+#endif
+
+#if CORK_DEQUE_DEBUG
+#include <stdio.h>
+#define DEBUG(...) \
+    do { \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } while (0)
+#else
+#define DEBUG(...) /* nothing */
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * Double-ended queues
+ */
+
+/* We try to make each block about this large. */
+#define CORK_DEQUE_BLOCK_SIZE  4096
+
+/* The number of entries in a new block map. */
+#define CORK_DEQUE_INITIAL_BLOCK_COUNT  4
+
+#define cork_raw_deque_capacity(deque) \
+    (((deque)->blocks == NULL)? 0: (deque)->mask + 1)
+
+void
+cork_raw_deque_init(struct cork_raw_deque *deque, size_t element_size)
+{
+    deque->blocks = NULL;
+    deque->size = 0;
+    deque->start = 0;
+    deque->mask = 0;
+    deque->element_size = element_size;
+    deque->block_shift = 0;
+    while ((element_size << (deque->block_shift + 1)) <=
+           CORK_DEQUE_BLOCK_SIZE) {
+        deque->block_shift++;
+    }
+}
+
+void
+cork_raw_deque_done(struct cork_raw_deque *deque)
+{
+    if (deque->blocks != NULL) {
+        size_t  block_count = cork_raw_deque_capacity(deque) >>
+            deque->block_shift;
+        size_t  i;
+        for (i = 0; i < block_count; i++) {
+            if (deque->blocks[i] != NULL) {
+                free(deque->blocks[i]);
+            }
+        }
+        free(deque->blocks);
+    }
+}
+
+void
+cork_raw_deque_clear(struct cork_raw_deque *deque)
+{
+    /* Hold onto the blocks so that we can reuse them. */
+    deque->size = 0;
+    deque->start = 0;
+}
+
+/* Doubles the size of the block map.  The blocks are rearranged so that the
+ * block containing the first element comes first.  If the first element isn't
+ * at the start of its block, then that block also contains the last few
+ * elements, which we move into a new block at the end. */
+static void
+cork_raw_deque_grow(struct cork_raw_deque *deque)
+{
+    size_t  old_count;
+    size_t  new_count;
+    void  **new_blocks;
+    size_t  first;
+    size_t  offset;
+    size_t  i;
+
+    if (deque->blocks == NULL) {
+        DEBUG("Allocating initial block map for deque %p", (void *) deque);
+        deque->blocks =
+            cork_calloc(CORK_DEQUE_INITIAL_BLOCK_COUNT, sizeof(void *));
+        deque->mask =
+            (CORK_DEQUE_INITIAL_BLOCK_COUNT << deque->block_shift) - 1;
+        deque->start = 0;
+        return;
+    }
+
+    old_count = cork_raw_deque_capacity(deque) >> deque->block_shift;
+    new_count = old_count * 2;
+    DEBUG("Growing block map for deque %p from %zu to %zu blocks",
+          (void *) deque, old_count, new_count);
+
+    new_blocks = cork_calloc(new_count, sizeof(void *));
+    first = deque->start >> deque->block_shift;
+    offset = deque->start & cork_deque_block_mask_(deque);
+    for (i = 0; i < old_count; i++) {
+        new_blocks[i] = deque->blocks[(first + i) & (old_count - 1)];
+    }
+    if (offset > 0) {
+        new_blocks[old_count] =
+            cork_malloc(deque->element_size << deque->block_shift);
+        memcpy(new_blocks[old_count], new_blocks[0],
+               offset * deque->element_size);
+    }
+
+    free(deque->blocks);
+    deque->blocks = new_blocks;
+    deque->start = offset;
+    deque->mask = (new_count << deque->block_shift) - 1;
+}
+
+static void *
+cork_raw_deque_claim(struct cork_raw_deque *deque, size_t position)
+{
+    size_t  block = position >> deque->block_shift;
+    if (CORK_UNLIKELY(deque->blocks[block] == NULL)) {
+        deque->blocks[block] =
+            cork_malloc(deque->element_size << deque->block_shift);
+    }
+    return (char *) deque->blocks[block] +
+        (position & cork_deque_block_mask_(deque)) * deque->element_size;
+}
+
+void *
+cork_raw_deque_push_back(struct cork_raw_deque *deque)
+{
+    if (CORK_UNLIKELY(deque->size == cork_raw_deque_capacity(deque))) {
+        cork_raw_deque_grow(deque);
+    }
+    deque->size++;
+    return cork_raw_deque_claim
+        (deque, cork_deque_position_(deque, deque->size - 1));
+}
+
+void *
+cork_raw_deque_push_front(struct cork_raw_deque *deque)
+{
+    if (CORK_UNLIKELY(deque->size == cork_raw_deque_capacity(deque))) {
+        cork_raw_deque_grow(deque);
+    }
+    deque->start = (deque->start - 1) & deque->mask;
+    deque->size++;
+    return cork_raw_deque_claim(deque, deque->start);
+}
+
+void
+cork_raw_deque_pop_back(struct cork_raw_deque *deque)
+{
+    assert(deque->size > 0);
+    deque->size--;
+}
+
+void
+cork_raw_deque_pop_front(struct cork_raw_deque *deque)
+{
+    assert(deque->size > 0);
+    deque->start = (deque->start + 1) & deque->mask;
+    deque->size--;
+}
@@ -0,0 +1,883 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "libcork/config.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/encoding.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if CORK_CONFIG_HAVE_GCC_TARGET_ATTRIBUTE
+#include <tmmintrin.h>
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * SIMD support
+ */
+
+/* The SSSE3 versions of each function are compiled with a target attribute,
+ * so that the rest of the library doesn't need to be compiled with -mssse3,
+ * and we check at runtime whether the current processor supports them.  Each
+ * one handles as many complete 16-byte blocks as it can, and returns how much
+ * of the input it consumed; the portable code handles whatever is left.  If
+ * the SSSE3 decoders find an invalid block, they stop before it, and let the
+ * portable code find the error. */
+
+#if CORK_CONFIG_HAVE_GCC_TARGET_ATTRIBUTE
+#define CORK_ENCODING_HAVE_SSSE3  1
+#define CORK_ATTR_SSSE3  __attribute__((target("ssse3")))
+#define cork_encoding_ssse3_supported()  __builtin_cpu_supports("ssse3")
+#else
+#define CORK_ENCODING_HAVE_SSSE3  0
+#endif
+
+/* Returns a pointer to where the next size bytes of dest should go. */
+static uint8_t *
+cork_encoding_reserve(struct cork_buffer *dest, size_t size)
+{
+    /* The SIMD decoders can write up to 16 bytes past the end of their
+     * output. */
+    cork_buffer_ensure_size(dest, dest->size + size + 16);
+    return ((uint8_t *) dest->buf) + dest->size;
+}
+
+static void
+cork_encoding_commit(struct cork_buffer *dest, size_t size)
+{
+    dest->size += size;
+    ((char *) dest->buf)[dest->size] = '\0';
+}
+
+static void
+cork_encoding_abort(struct cork_buffer *dest)
+{
+    ((char *) dest->buf)[dest->size] = '\0';
+}
+
+
+/*-----------------------------------------------------------------------
+ * Hex
+ */
+
+static const char  cork_hex_digits[] = "0123456789abcdef";
+
+static const int8_t  cork_hex_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+#if CORK_ENCODING_HAVE_SSSE3
+CORK_ATTR_SSSE3
+static size_t
+cork_hex_encode_ssse3(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    const __m128i  digits = _mm_setr_epi8
+        ('0', '1', '2', '3', '4', '5', '6', '7',
+         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i  low_nibble = _mm_set1_epi8(0x0f);
+    size_t  i;
+    for (i = 0; i + 16 <= size; i += 16) {
+        __m128i  in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i  hi = _mm_and_si128(_mm_srli_epi16(in, 4), low_nibble);
+        __m128i  lo = _mm_and_si128(in, low_nibble);
+        hi = _mm_shuffle_epi8(digits, hi);
+        lo = _mm_shuffle_epi8(digits, lo);
+        _mm_storeu_si128
+            ((__m128i *) (dest + i * 2), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128
+            ((__m128i *) (dest + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+/* Converts 16 hex digits into their values, and sets *valid to false if any
+ * of them aren't hex digits. */
+CORK_ATTR_SSSE3
+static __m128i
+cork_hex_decode_ssse3_values(__m128i in, bool *valid)
+{
+    /* Each comparison is unsigned: x <= max iff min(x, max) == x. */
+    __m128i  digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+    __m128i  is_digit =
+        _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i  alpha = _mm_sub_epi8
+        (_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i  is_alpha =
+        _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff) {
+        *valid = false;
+    }
+    return _mm_or_si128
+        (_mm_and_si128(is_digit, digit),
+         _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+CORK_ATTR_SSSE3
+static size_t
+cork_hex_decode_ssse3(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    /* Multiplies the first digit of each pair by 16 and adds the second. */
+    const __m128i  weights = _mm_set1_epi16(0x0110);
+    size_t  i;
+    for (i = 0; i + 32 <= size; i += 32) {
+        bool  valid = true;
+        __m128i  v0 = cork_hex_decode_ssse3_values
+            (_mm_loadu_si128((const __m128i *) (src + i)), &valid);
+        __m128i  v1 = cork_hex_decode_ssse3_values
+            (_mm_loadu_si128((const __m128i *) (src + i + 16)), &valid);
+        if (CORK_UNLIKELY(!valid)) {
+            break;
+        }
+        _mm_storeu_si128
+            ((__m128i *) (dest + i / 2),
+             _mm_packus_epi16(_mm_maddubs_epi16(v0, weights),
+                              _mm_maddubs_epi16(v1, weights)));
+    }
+    return i;
+}
+#endif
+
+void
+cork_hex_encode(struct cork_buffer *dest, const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    uint8_t  *out = cork_encoding_reserve(dest, cork_hex_encoded_size(size));
+    size_t  i = 0;
+#if CORK_ENCODING_HAVE_SSSE3
+    if (size >= 16 && cork_encoding_ssse3_supported()) {
+        i = cork_hex_encode_ssse3(out, src, size);
+    }
+#endif
+    for (; i < size; i++) {
+        out[i * 2] = cork_hex_digits[src[i] >> 4];
+        out[i * 2 + 1] = cork_hex_digits[src[i] & 0x0f];
+    }
+    cork_encoding_commit(dest, cork_hex_encoded_size(size));
+}
+
+int
+cork_hex_decode(struct cork_buffer *dest, const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    uint8_t  *out;
+    size_t  i = 0;
+
+    if (CORK_UNLIKELY((size % 2) != 0)) {
+        cork_error_set
+            (CORK_ENCODING_ERROR, CORK_ENCODING_INVALID,
+             "Hex data must have an even number of digits");
+        return -1;
+    }
+
+    out = cork_encoding_reserve(dest, size / 2);
+#if CORK_ENCODING_HAVE_SSSE3
+    if (size >= 32 && cork_encoding_ssse3_supported()) {
+        i = cork_hex_decode_ssse3(out, src, size);
+    }
+#endif
+    for (; i < size; i += 2) {
+        int  hi = cork_hex_values[src[i]];
+        int  lo = cork_hex_values[src[i + 1]];
+        if (CORK_UNLIKELY((hi | lo) < 0)) {
+            cork_error_set
+                (CORK_ENCODING_ERROR, CORK_ENCODING_INVALID,
+                 "Invalid hex digit at offset %zu", (hi < 0)? i: i + 1);
+            cork_encoding_abort(dest);
+            return -1;
+        }
+        out[i / 2] = (hi << 4) | lo;
+    }
+    cork_encoding_commit(dest, size / 2);
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Base64
+ */
+
+static const char  cork_base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const int8_t  cork_base64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+#if CORK_ENCODING_HAVE_SSSE3
+/* The SSSE3 base64 code uses the approach described in "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions" (Muła and Lemire, 2018),
+ * scaled down to 128-bit registers. */
+
+CORK_ATTR_SSSE3
+static size_t
+cork_base64_encode_ssse3(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    /* Moves each group of 3 input bytes into a 32-bit lane, in the order
+     * that the multiplies below expect. */
+    const __m128i  spread = _mm_setr_epi8
+        (1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    /* For each class of 6-bit value (as computed below), the offset that
+     * turns the value into the right ASCII character. */
+    const __m128i  offsets = _mm_setr_epi8
+        ('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+         '/' - 63, 'A', 0, 0);
+    size_t  i;
+    size_t  j = 0;
+
+    /* We load 16 bytes at a time but only consume 12 of them. */
+    for (i = 0; i + 16 <= size; i += 12, j += 16) {
+        __m128i  in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i  t0;
+        __m128i  t1;
+        __m128i  values;
+        __m128i  classes;
+
+        in = _mm_shuffle_epi8(in, spread);
+        t0 = _mm_mulhi_epu16
+            (_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+             _mm_set1_epi32(0x04000040));
+        t1 = _mm_mullo_epi16
+            (_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+             _mm_set1_epi32(0x01000010));
+        values = _mm_or_si128(t0, t1);
+
+        /* 0-25 → 13, 26-51 → 0, 52-61 → 1-10, 62 → 11, 63 → 12 */
+        classes = _mm_subs_epu8(values, _mm_set1_epi8(51));
+        classes = _mm_or_si128
+            (classes,
+             _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values),
+                           _mm_set1_epi8(13)));
+        _mm_storeu_si128
+            ((__m128i *) (dest + j),
+             _mm_add_epi8(values, _mm_shuffle_epi8(offsets, classes)));
+    }
+    return i;
+}
+
+CORK_ATTR_SSSE3
+static size_t
+cork_base64_decode_ssse3(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    /* Each input character's high and low nibbles select a bitmask from
+     * these tables; the character is valid iff the two bitmasks don't
+     * overlap. */
+    const __m128i  lut_lo = _mm_setr_epi8
+        (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i  lut_hi = _mm_setr_epi8
+        (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    /* The offset that turns each valid character into its 6-bit value,
+     * indexed by the high nibble ('/' gets its own entry). */
+    const __m128i  lut_roll = _mm_setr_epi8
+        (0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i  mask_2f = _mm_set1_epi8(0x2f);
+    /* Packs four 6-bit values in each 32-bit lane into 3 bytes. */
+    const __m128i  pack = _mm_setr_epi8
+        (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t  i;
+    size_t  j = 0;
+
+    for (i = 0; i + 16 <= size; i += 16, j += 12) {
+        __m128i  in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i  hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+        __m128i  lo_nibbles = _mm_and_si128(in, mask_2f);
+        __m128i  lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i  hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i  roll;
+        __m128i  out;
+
+        if (CORK_UNLIKELY
+            (_mm_movemask_epi8(_mm_cmpeq_epi8
+                               (_mm_and_si128(lo, hi), _mm_setzero_si128()))
+             != 0xffff)) {
+            break;
+        }
+
+        roll = _mm_shuffle_epi8
+            (lut_roll,
+             _mm_add_epi8(_mm_cmpeq_epi8(in, mask_2f), hi_nibbles));
+        in = _mm_add_epi8(in, roll);
+
+        out = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+        out = _mm_madd_epi16(out, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128
+            ((__m128i *) (dest + j), _mm_shuffle_epi8(out, pack));
+    }
+    return i;
+}
+#endif
+
+void
+cork_base64_encode(struct cork_buffer *dest, const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    size_t  encoded_size = cork_base64_encoded_size(size);
+    uint8_t  *out = cork_encoding_reserve(dest, encoded_size);
+    size_t  i = 0;
+    size_t  j;
+
+#if CORK_ENCODING_HAVE_SSSE3
+    if (size >= 16 && cork_encoding_ssse3_supported()) {
+        i = cork_base64_encode_ssse3(out, src, size);
+    }
+#endif
+
+    for (j = i / 3 * 4; i + 3 <= size; i += 3, j += 4) {
+        uint32_t  group =
+            ((uint32_t) src[i] << 16) | ((uint32_t) src[i + 1] << 8) |
+            src[i + 2];
+        out[j] = cork_base64_digits[group >> 18];
+        out[j + 1] = cork_base64_digits[(group >> 12) & 0x3f];
+        out[j + 2] = cork_base64_digits[(group >> 6) & 0x3f];
+        out[j + 3] = cork_base64_digits[group & 0x3f];
+    }
+
+    if (i + 1 == size) {
+        uint32_t  group = (uint32_t) src[i] << 16;
+        out[j] = cork_base64_digits[group >> 18];
+        out[j + 1] = cork_base64_digits[(group >> 12) & 0x3f];
+        out[j + 2] = '=';
+        out[j + 3] = '=';
+    } else if (i + 2 == size) {
+        uint32_t  group =
+            ((uint32_t) src[i] << 16) | ((uint32_t) src[i + 1] << 8);
+        out[j] = cork_base64_digits[group >> 18];
+        out[j + 1] = cork_base64_digits[(group >> 12) & 0x3f];
+        out[j + 2] = cork_base64_digits[(group >> 6) & 0x3f];
+        out[j + 3] = '=';
+    }
+
+    cork_encoding_commit(dest, encoded_size);
+}
+
+static int
+cork_base64_invalid_char(struct cork_buffer *dest, size_t offset)
+{
+    cork_error_set
+        (CORK_ENCODING_ERROR, CORK_ENCODING_INVALID,
+         "Invalid base64 character at offset %zu", offset);
+    cork_encoding_abort(dest);
+    return -1;
+}
+
+int
+cork_base64_decode(struct cork_buffer *dest, const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    size_t  padding = 0;
+    size_t  decoded_size;
+    size_t  full_size;
+    uint8_t  *out;
+    size_t  i = 0;
+    size_t  j;
+
+    if (CORK_UNLIKELY((size % 4) != 0)) {
+        cork_error_set
+            (CORK_ENCODING_ERROR, CORK_ENCODING_INVALID,
+             "Base64 data must be a multiple of 4 characters");
+        return -1;
+    }
+
+    if (size > 0 && src[size - 1] == '=') {
+        padding = (src[size - 2] == '=')? 2: 1;
+    }
+    decoded_size = size / 4 * 3 - padding;
+    /* The size of the input that doesn't include the final padded group. */
+    full_size = (padding == 0)? size: size - 4;
+
+    out = cork_encoding_reserve(dest, decoded_size);
+#if CORK_ENCODING_HAVE_SSSE3
+    if (full_size >= 16 && cork_encoding_ssse3_supported()) {
+        i = cork_base64_decode_ssse3(out, src, full_size);
+    }
+#endif
+
+    for (j = i / 4 * 3; i < full_size; i += 4, j += 3) {
+        int  v0 = cork_base64_values[src[i]];
+        int  v1 = cork_base64_values[src[i + 1]];
+        int  v2 = cork_base64_values[src[i + 2]];
+        int  v3 = cork_base64_values[src[i + 3]];
+        uint32_t  group;
+        if (CORK_UNLIKELY((v0 | v1 | v2 | v3) < 0)) {
+            size_t  offset = i;
+            while (cork_base64_values[src[offset]] >= 0) {
+                offset++;
+            }
+            return cork_base64_invalid_char(dest, offset);
+        }
+        group = (v0 << 18) | (v1 << 12) | (v2 << 6) | v3;
+        out[j] = group >> 16;
+        out[j + 1] = (group >> 8) & 0xff;
+        out[j + 2] = group & 0xff;
+    }
+
+    if (padding > 0) {
+        int  v0 = cork_base64_values[src[i]];
+        int  v1 = cork_base64_values[src[i + 1]];
+        int  v2 = (padding == 1)? cork_base64_values[src[i + 2]]: 0;
+        uint32_t  group;
+        if (CORK_UNLIKELY(v0 < 0)) {
+            return cork_base64_invalid_char(dest, i);
+        }
+        if (CORK_UNLIKELY(v1 < 0)) {
+            return cork_base64_invalid_char(dest, i + 1);
+        }
+        if (CORK_UNLIKELY(v2 < 0)) {
+            return cork_base64_invalid_char(dest, i + 2);
+        }
+        group = (v0 << 18) | (v1 << 12) | (v2 << 6);
+        if (CORK_UNLIKELY((group & ((padding == 1)? 0xff: 0xffff)) != 0)) {
+            cork_error_set
+                (CORK_ENCODING_ERROR, CORK_ENCODING_INVALID,
+                 "Base64 data has unused trailing bits");
+            cork_encoding_abort(dest);
+            return -1;
+        }
+        out[j] = group >> 16;
+        if (padding == 1) {
+            out[j + 1] = (group >> 8) & 0xff;
+        }
+    }
+
+    cork_encoding_commit(dest, decoded_size);
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * UTF-8
+ */
+
+/* Returns the offset of the first invalid sequence in src, starting from
+ * start, or size if there aren't any. */
+static size_t
+cork_utf8_find_error(const uint8_t *src, size_t start, size_t size)
+{
+    size_t  i = start;
+    while (i < size) {
+        uint8_t  ch = src[i];
+        /* The range of the second byte, and the number of bytes in the
+         * sequence. */
+        uint8_t  min = 0x80;
+        uint8_t  max = 0xbf;
+        size_t  length;
+        size_t  j;
+
+        if (ch < 0x80) {
+            i++;
+            continue;
+        } else if (ch >= 0xc2 && ch <= 0xdf) {
+            length = 2;
+        } else if (ch >= 0xe0 && ch <= 0xef) {
+            length = 3;
+            if (ch == 0xe0) {
+                /* Overlong */
+                min = 0xa0;
+            } else if (ch == 0xed) {
+                /* Surrogates */
+                max = 0x9f;
+            }
+        } else if (ch >= 0xf0 && ch <= 0xf4) {
+            length = 4;
+            if (ch == 0xf0) {
+                /* Overlong */
+                min = 0x90;
+            } else if (ch == 0xf4) {
+                /* Above U+10FFFF */
+                max = 0x8f;
+            }
+        } else {
+            return i;
+        }
+
+        if (CORK_UNLIKELY(size - i < length ||
+                          src[i + 1] < min || src[i + 1] > max)) {
+            return i;
+        }
+        for (j = 2; j < length; j++) {
+            if (CORK_UNLIKELY((src[i + j] & 0xc0) != 0x80)) {
+                return i;
+            }
+        }
+        i += length;
+    }
+    return size;
+}
+
+/* Returns the start of the character that contains offset i (or i itself if
+ * it's not in the middle of a character). */
+static size_t
+cork_utf8_character_start(const uint8_t *src, size_t i)
+{
+    size_t  start = i;
+    while (start > 0 && i - start < 3 && (src[start - 1] & 0xc0) == 0x80) {
+        start--;
+    }
+    if (start > 0 && src[start - 1] >= 0xc0) {
+        return start - 1;
+    }
+    return start;
+}
+
+#if CORK_ENCODING_HAVE_SSSE3
+/* This is the "lookup" algorithm from "Validating UTF-8 In Less Than One
+ * Instruction Per Byte" (Keiser and Lemire, 2021), using 128-bit registers.
+ * Each byte is classified by three table lookups — on the high and low
+ * nibbles of the previous byte, and the high nibble of the current byte —
+ * whose intersection is non-zero for any invalid two-byte sequence.  The
+ * remaining cases (missing or extra continuation bytes in 3- and 4-byte
+ * sequences) are checked by looking two and three bytes back. */
+
+#define CORK_UTF8_TOO_SHORT   (1 << 0)
+#define CORK_UTF8_TOO_LONG    (1 << 1)
+#define CORK_UTF8_OVERLONG_3  (1 << 2)
+#define CORK_UTF8_TOO_LARGE   (1 << 3)
+#define CORK_UTF8_SURROGATE   (1 << 4)
+#define CORK_UTF8_OVERLONG_2  (1 << 5)
+#define CORK_UTF8_TOO_LARGE_1000  (1 << 6)
+#define CORK_UTF8_OVERLONG_4  (1 << 6)
+#define CORK_UTF8_TWO_CONTS   (1 << 7)
+#define CORK_UTF8_CARRY \
+    (CORK_UTF8_TOO_SHORT | CORK_UTF8_TOO_LONG | CORK_UTF8_TWO_CONTS)
+
+CORK_ATTR_SSSE3
+static __m128i
+cork_utf8_check_block_ssse3(__m128i in, __m128i prev_in)
+{
+    const __m128i  byte_1_high_table = _mm_setr_epi8
+        (CORK_UTF8_TOO_LONG, CORK_UTF8_TOO_LONG,
+         CORK_UTF8_TOO_LONG, CORK_UTF8_TOO_LONG,
+         CORK_UTF8_TOO_LONG, CORK_UTF8_TOO_LONG,
+         CORK_UTF8_TOO_LONG, CORK_UTF8_TOO_LONG,
+         CORK_UTF8_TWO_CONTS, CORK_UTF8_TWO_CONTS,
+         CORK_UTF8_TWO_CONTS, CORK_UTF8_TWO_CONTS,
+         CORK_UTF8_TOO_SHORT | CORK_UTF8_OVERLONG_2,
+         CORK_UTF8_TOO_SHORT,
+         CORK_UTF8_TOO_SHORT | CORK_UTF8_OVERLONG_3 | CORK_UTF8_SURROGATE,
+         (char) (CORK_UTF8_TOO_SHORT | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000 | CORK_UTF8_OVERLONG_4));
+    const __m128i  byte_1_low_table = _mm_setr_epi8
+        ((char) (CORK_UTF8_CARRY | CORK_UTF8_OVERLONG_3 |
+                 CORK_UTF8_OVERLONG_2 | CORK_UTF8_OVERLONG_4),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_OVERLONG_2),
+         (char) CORK_UTF8_CARRY,
+         (char) CORK_UTF8_CARRY,
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000 | CORK_UTF8_SURROGATE),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000),
+         (char) (CORK_UTF8_CARRY | CORK_UTF8_TOO_LARGE |
+                 CORK_UTF8_TOO_LARGE_1000));
+    const __m128i  byte_2_high_table = _mm_setr_epi8
+        (CORK_UTF8_TOO_SHORT, CORK_UTF8_TOO_SHORT,
+         CORK_UTF8_TOO_SHORT, CORK_UTF8_TOO_SHORT,
+         CORK_UTF8_TOO_SHORT, CORK_UTF8_TOO_SHORT,
+         CORK_UTF8_TOO_SHORT, CORK_UTF8_TOO_SHORT,
+         (char) (CORK_UTF8_TOO_LONG | CORK_UTF8_OVERLONG_2 |
+                 CORK_UTF8_TWO_CONTS | CORK_UTF8_OVERLONG_3 |
+                 CORK_UTF8_TOO_LARGE_1000 | CORK_UTF8_OVERLONG_4),
+         (char) (CORK_UTF8_TOO_LONG | CORK_UTF8_OVERLONG_2 |
+                 CORK_UTF8_TWO_CONTS | CORK_UTF8_OVERLONG_3 |
+                 CORK_UTF8_TOO_LARGE),
+         (char) (CORK_UTF8_TOO_LONG | CORK_UTF8_OVERLONG_2 |
+                 CORK_UTF8_TWO_CONTS | CORK_UTF8_SURROGATE |
+                 CORK_UTF8_TOO_LARGE),
+         (char) (CORK_UTF8_TOO_LONG | CORK_UTF8_OVERLONG_2 |
+                 CORK_UTF8_TWO_CONTS | CORK_UTF8_SURROGATE |
+                 CORK_UTF8_TOO_LARGE),
+         CORK_UTF8_TOO_SHORT, CORK_UTF8_TOO_SHORT,
+         CORK_UTF8_TOO_SHORT, CORK_UTF8_TOO_SHORT);
+    const __m128i  low_nibble = _mm_set1_epi8(0x0f);
+
+    __m128i  prev1 = _mm_alignr_epi8(in, prev_in, 15);
+    __m128i  prev2 = _mm_alignr_epi8(in, prev_in, 14);
+    __m128i  prev3 = _mm_alignr_epi8(in, prev_in, 13);
+    __m128i  byte_1_high = _mm_shuffle_epi8
+        (byte_1_high_table,
+         _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+    __m128i  byte_1_low = _mm_shuffle_epi8
+        (byte_1_low_table, _mm_and_si128(prev1, low_nibble));
+    __m128i  byte_2_high = _mm_shuffle_epi8
+        (byte_2_high_table,
+         _mm_and_si128(_mm_srli_epi16(in, 4), low_nibble));
+    __m128i  special_cases =
+        _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    /* The high bit is set for any byte that must be the second or third
+     * continuation byte of a 3- or 4-byte sequence.  This must line up
+     * exactly with the TWO_CONTS bit from above. */
+    __m128i  is_third_byte =
+        _mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xe0 - 0x80)));
+    __m128i  is_fourth_byte =
+        _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xf0 - 0x80)));
+    __m128i  must_be_continuation = _mm_and_si128
+        (_mm_or_si128(is_third_byte, is_fourth_byte),
+         _mm_set1_epi8((char) 0x80));
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+/* Returns the offset of the first block that might contain an error.  If
+ * there aren't any, everything before the returned offset is valid except
+ * possibly for an incomplete character at the very end. */
+CORK_ATTR_SSSE3
+static size_t
+cork_utf8_validate_ssse3(const uint8_t *src, size_t size)
+{
+    /* Nonzero for any of the last three bytes of a block that start a
+     * character that doesn't fit in the block. */
+    const __m128i  incomplete_max = _mm_setr_epi8
+        (-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+         (char) (0xf0 - 1), (char) (0xe0 - 1), (char) (0xc0 - 1));
+    __m128i  prev_in = _mm_setzero_si128();
+    __m128i  prev_incomplete = _mm_setzero_si128();
+    size_t  i;
+
+    for (i = 0; i + 16 <= size; i += 16) {
+        __m128i  in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i  error;
+        if (_mm_movemask_epi8(in) == 0) {
+            /* Pure ASCII, so the only possible error is an incomplete
+             * character at the end of the previous block. */
+            error = prev_incomplete;
+        } else {
+            error = cork_utf8_check_block_ssse3(in, prev_in);
+            prev_incomplete = _mm_subs_epu8(in, incomplete_max);
+        }
+        if (CORK_UNLIKELY
+            (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128()))
+             != 0xffff)) {
+            break;
+        }
+        if (_mm_movemask_epi8(in) == 0) {
+            prev_incomplete = _mm_setzero_si128();
+        }
+        prev_in = in;
+    }
+    return i;
+}
+#endif
+
+int
+cork_utf8_validate(const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    size_t  start = 0;
+    size_t  error;
+
+#if CORK_ENCODING_HAVE_SSSE3
+    if (size >= 16 && cork_encoding_ssse3_supported()) {
+        /* Let the portable code check the tail of the input, or find the
+         * exact location of an error, starting from the beginning of the
+         * character that straddles the block boundary. */
+        start = cork_utf8_character_start
+            (src, cork_utf8_validate_ssse3(src, size));
+    }
+#endif
+
+    error = cork_utf8_find_error(src, start, size);
+    if (CORK_UNLIKELY(error != size)) {
+        cork_error_set
+            (CORK_ENCODING_ERROR, CORK_ENCODING_INVALID,
+             "Invalid UTF-8 sequence at offset %zu", error);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Escaping
+ */
+
+/* We find the next byte that needs to be escaped, append everything before
+ * it in one go, and then escape that one byte.  SSE2 is always available on
+ * x86-64, so we don't need a runtime check to use it here.  We check 32 bytes
+ * at a time, since most strings don't need to be escaped at all. */
+
+#if defined(__SSE2__)
+/* Returns a mask of which bytes of in are control characters, quotes, or
+ * backslashes, and (if also_high is true) which are 0x7f or above. */
+static unsigned int
+cork_escape_mask_sse2(__m128i in, bool also_high)
+{
+    __m128i  needs_escape = _mm_or_si128
+        (_mm_cmpeq_epi8(_mm_min_epu8(in, _mm_set1_epi8(0x1f)), in),
+         _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('"')),
+                      _mm_cmpeq_epi8(in, _mm_set1_epi8('\\'))));
+    if (also_high) {
+        needs_escape = _mm_or_si128
+            (needs_escape,
+             _mm_cmpeq_epi8(_mm_max_epu8(in, _mm_set1_epi8(0x7f)), in));
+    }
+    return _mm_movemask_epi8(needs_escape);
+}
+#endif
+
+static size_t
+cork_escape_find(const uint8_t *src, size_t start, size_t size,
+                 bool also_high)
+{
+    size_t  i = start;
+#if defined(__SSE2__)
+    for (; i + 32 <= size; i += 32) {
+        unsigned int  mask =
+            cork_escape_mask_sse2
+                (_mm_loadu_si128((const __m128i *) (src + i)), also_high) |
+            (cork_escape_mask_sse2
+                (_mm_loadu_si128((const __m128i *) (src + i + 16)),
+                 also_high) << 16);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < size; i++) {
+        uint8_t  ch = src[i];
+        if (ch < 0x20 || ch == '"' || ch == '\\' || (also_high && ch >= 0x7f)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+void
+cork_json_escape(struct cork_buffer *dest, const void *vsrc, size_t size)
+{
+    static const char  digits[] = "0123456789abcdef";
+    const uint8_t  *src = vsrc;
+    size_t  i = 0;
+    while (true) {
+        size_t  next = cork_escape_find(src, i, size, false);
+        char  escaped[6];
+        if (next > i) {
+            cork_buffer_append(dest, src + i, next - i);
+        }
+        if (next == size) {
+            return;
+        }
+
+        escaped[0] = '\\';
+        switch (src[next]) {
+            case '"':  escaped[1] = '"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            default:
+                escaped[1] = 'u';
+                escaped[2] = '0';
+                escaped[3] = '0';
+                escaped[4] = digits[src[next] >> 4];
+                escaped[5] = digits[src[next] & 0x0f];
+                cork_buffer_append_fast(dest, escaped, 6);
+                i = next + 1;
+                continue;
+        }
+        cork_buffer_append_fast(dest, escaped, 2);
+        i = next + 1;
+    }
+}
+
+void
+cork_c_escape(struct cork_buffer *dest, const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    size_t  i = 0;
+    while (true) {
+        size_t  next = cork_escape_find(src, i, size, true);
+        char  escaped[4];
+        if (next > i) {
+            cork_buffer_append(dest, src + i, next - i);
+        }
+        if (next == size) {
+            return;
+        }
+
+        escaped[0] = '\\';
+        switch (src[next]) {
+            case '"':  escaped[1] = '"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\a': escaped[1] = 'a'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            case '\v': escaped[1] = 'v'; break;
+            default:
+                /* Always use three octal digits, so that the escape can't
+                 * absorb any digits that follow it. */
+                escaped[1] = '0' + (src[next] >> 6);
+                escaped[2] = '0' + ((src[next] >> 3) & 0x07);
+                escaped[3] = '0' + (src[next] & 0x07);
+                cork_buffer_append_fast(dest, escaped, 4);
+                i = next + 1;
+                continue;
+        }
+        cork_buffer_append_fast(dest, escaped, 2);
+        i = next + 1;
+    }
+}
@@ -14,13 +14,119 @@
 #include <unistd.h>
 #include <sys/types.h>
 
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/buffer-pool.h"
+#include "libcork/ds/managed-buffer.h"
 #include "libcork/ds/stream.h"
+#include "libcork/threads/basics.h"
 #include "libcork/helpers/errors.h"
 #include "libcork/helpers/posix.h"
 
 #define BUFFER_SIZE  4096
 
 
+/*-----------------------------------------------------------------------
+ * Pooled chunks
+ */
+
+/* Chunk consumers get larger chunks than stream consumers, since we're not
+ * reading them onto the stack.  The pool always leaves room for a NUL
+ * terminator, so we ask for one byte less than the size of the buffers that
+ * we want, which keeps each chunk in the 64KB size class instead of the next
+ * one up. */
+#define CHUNK_BUFFER_SIZE  65536
+#define CHUNK_SIZE  (CHUNK_BUFFER_SIZE - 1)
+
+/* The pool is shared by every producer in the process, and is never freed,
+ * since a consumer can hold on to a chunk for as long as it likes.  It keeps
+ * up to 16 spare chunk buffers. */
+#define CHUNK_POOL_MAX_RETAINED  (16 * CHUNK_BUFFER_SIZE)
+
+static struct cork_buffer_pool  *chunk_pool;
+cork_once_barrier(chunk_pool);
+
+static struct cork_buffer_pool *
+cork_stream_chunk_pool(void)
+{
+    cork_once(chunk_pool,
+              chunk_pool = cork_buffer_pool_new(CHUNK_POOL_MAX_RETAINED));
+    return chunk_pool;
+}
+
+/* Passes the first size bytes of buffer to consumer as a managed chunk.  The
+ * buffer goes back into the pool once the consumer has dropped any
+ * references that it took. */
+static int
+cork_chunk_consumer_pooled_chunk(struct cork_chunk_consumer *consumer,
+                                 struct cork_buffer *buffer, size_t size,
+                                 bool is_first)
+{
+    struct cork_managed_buffer  *chunk;
+    int  rc;
+    buffer->size = size;
+    chunk = cork_buffer_pool_to_managed_buffer
+        (cork_stream_chunk_pool(), buffer);
+    rc = cork_chunk_consumer_chunk(consumer, chunk, is_first);
+    cork_managed_buffer_unref(chunk);
+    return rc;
+}
+
+int
+cork_consume_fd_chunks(struct cork_chunk_consumer *consumer, int fd)
+{
+    struct cork_buffer_pool  *pool = cork_stream_chunk_pool();
+    bool  first = true;
+
+    while (true) {
+        struct cork_buffer  *buffer =
+            cork_buffer_pool_acquire(pool, CHUNK_SIZE);
+        ssize_t  bytes_read = read(fd, buffer->buf, CHUNK_SIZE);
+        if (bytes_read > 0) {
+            rii_check(cork_chunk_consumer_pooled_chunk
+                      (consumer, buffer, bytes_read, first));
+            first = false;
+            continue;
+        }
+
+        cork_buffer_pool_release(pool, buffer);
+        if (bytes_read == 0) {
+            return cork_chunk_consumer_eof(consumer);
+        } else if (errno != EINTR) {
+            cork_system_error_set();
+            return -1;
+        }
+    }
+}
+
+int
+cork_consume_file_chunks(struct cork_chunk_consumer *consumer, FILE *fp)
+{
+    struct cork_buffer_pool  *pool = cork_stream_chunk_pool();
+    bool  first = true;
+
+    while (true) {
+        struct cork_buffer  *buffer =
+            cork_buffer_pool_acquire(pool, CHUNK_SIZE);
+        size_t  bytes_read = fread(buffer->buf, 1, CHUNK_SIZE, fp);
+        if (bytes_read > 0) {
+            rii_check(cork_chunk_consumer_pooled_chunk
+                      (consumer, buffer, bytes_read, first));
+            first = false;
+            continue;
+        }
+
+        cork_buffer_pool_release(pool, buffer);
+        if (feof(fp)) {
+            return cork_chunk_consumer_eof(consumer);
+        } else if (errno != EINTR) {
+            cork_system_error_set();
+            return -1;
+        }
+        clearerr(fp);
+    }
+}
+
+
 /*-----------------------------------------------------------------------
  * Producers
  */
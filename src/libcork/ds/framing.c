@@ -0,0 +1,405 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/byte-order.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/framing.h"
+#include "libcork/ds/slice.h"
+#include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Framing consumers
+ */
+
+/* Records that fit entirely within a chunk are passed to the callback as
+ * slices of that chunk, so we have to pass along every complete record
+ * before we return from the data method.  A record that spans chunks is
+ * copied into the partial buffer until we've seen all of it; we don't change
+ * that buffer until the batch that contains the completed record has been
+ * passed along. */
+
+enum cork_framing_mode {
+    CORK_FRAMING_DELIMITED,
+    CORK_FRAMING_FIXED_SIZE,
+    CORK_FRAMING_VARINT_PREFIX,
+    CORK_FRAMING_U32_PREFIX
+};
+
+#define CORK_FRAMING_MAX_VARINT_SIZE  10
+
+struct cork_framer {
+    struct cork_stream_consumer  parent;
+    enum cork_framing_mode  mode;
+    uint8_t  delimiter;
+    /* The size of every record for CORK_FRAMING_FIXED_SIZE, and the largest
+     * allowed record for the prefix modes. */
+    size_t  record_size;
+
+    void  *user_data;
+    cork_free_f  free_user_data;
+    cork_framing_records_f  records_callback;
+
+    cork_array(struct cork_slice)  records;
+
+    /* An incomplete record from a previous chunk, including its length
+     * prefix, and where it started in the stream. */
+    struct cork_buffer  partial;
+    size_t  partial_offset;
+    /* The offset within the stream of the current chunk. */
+    size_t  offset;
+};
+
+static int
+cork_framer_deliver(struct cork_framer *self)
+{
+    int  rc;
+    if (cork_array_is_empty(&self->records)) {
+        return 0;
+    }
+    rc = self->records_callback
+        (self->user_data, cork_array_elements(&self->records),
+         cork_array_size(&self->records));
+    cork_array_clear(&self->records);
+    return rc;
+}
+
+static int
+cork_framer_add(struct cork_framer *self, const void *buf, size_t size)
+{
+    cork_slice_init_static(cork_array_append_get(&self->records), buf, size);
+    if (cork_array_size(&self->records) == CORK_FRAMING_BATCH_SIZE) {
+        return cork_framer_deliver(self);
+    }
+    return 0;
+}
+
+/* Tries to decode a length prefix from the start of src.  Returns 1 if we
+ * found a complete prefix, 0 if we need more data, and -1 on error. */
+static int
+cork_framer_parse_prefix(struct cork_framer *self, const uint8_t *src,
+                         size_t size, size_t record_offset,
+                         size_t *prefix_size, size_t *record_size)
+{
+    uint64_t  value = 0;
+
+    if (self->mode == CORK_FRAMING_U32_PREFIX) {
+        uint32_t  be_value;
+        if (size < sizeof(uint32_t)) {
+            return 0;
+        }
+        memcpy(&be_value, src, sizeof(uint32_t));
+        value = CORK_UINT32_BIG_TO_HOST(be_value);
+        *prefix_size = sizeof(uint32_t);
+    } else {
+        size_t  i;
+        for (i = 0; ; i++) {
+            if (i == size) {
+                return 0;
+            }
+            if (CORK_UNLIKELY(i == CORK_FRAMING_MAX_VARINT_SIZE)) {
+                cork_error_set
+                    (CORK_FRAMING_ERROR, CORK_FRAMING_INVALID,
+                     "Invalid length prefix at offset %zu", record_offset);
+                return -1;
+            }
+            value |= ((uint64_t) (src[i] & 0x7f)) << (7 * i);
+            if (src[i] < 0x80) {
+                break;
+            }
+        }
+        *prefix_size = i + 1;
+    }
+
+    if (CORK_UNLIKELY(value > self->record_size)) {
+        cork_error_set
+            (CORK_FRAMING_ERROR, CORK_FRAMING_TOO_LARGE,
+             "Record at offset %zu is too large (%" PRIu64 " bytes)",
+             record_offset, value);
+        return -1;
+    }
+    *record_size = value;
+    return 1;
+}
+
+/* Adds the next part of the current chunk to the partial record.  Returns 1
+ * if that completes the record, 0 if we need more data, and -1 on error.
+ * Fills in how much of the chunk we used either way. */
+static int
+cork_framer_complete_partial(struct cork_framer *self,
+                             const uint8_t *src, size_t size, size_t *used)
+{
+    size_t  prefix_size = 0;
+    size_t  record_size;
+    size_t  needed;
+    size_t  pos = 0;
+
+    switch (self->mode) {
+        case CORK_FRAMING_DELIMITED:
+        {
+            const uint8_t  *end = memchr(src, self->delimiter, size);
+            if (end == NULL) {
+                cork_buffer_append(&self->partial, src, size);
+                *used = size;
+                return 0;
+            }
+            cork_buffer_append(&self->partial, src, end - src);
+            *used = end - src + 1;
+            return cork_framer_add
+                (self, self->partial.buf, self->partial.size) == 0? 1: -1;
+        }
+
+        case CORK_FRAMING_FIXED_SIZE:
+            record_size = self->record_size;
+            break;
+
+        default:
+        {
+            /* The length prefix is at most a few bytes, so we move it over
+             * one byte at a time until we can decode it. */
+            int  rc;
+            while ((rc = cork_framer_parse_prefix
+                    (self, self->partial.buf, self->partial.size,
+                     self->partial_offset, &prefix_size, &record_size))
+                   == 0) {
+                if (pos == size) {
+                    *used = size;
+                    return 0;
+                }
+                cork_buffer_append(&self->partial, src + pos++, 1);
+            }
+            if (rc < 0) {
+                return -1;
+            }
+            break;
+        }
+    }
+
+    needed = prefix_size + record_size - self->partial.size;
+    if (size - pos < needed) {
+        cork_buffer_append(&self->partial, src + pos, size - pos);
+        *used = size;
+        return 0;
+    }
+    cork_buffer_append(&self->partial, src + pos, needed);
+    *used = pos + needed;
+    rii_check(cork_framer_add
+              (self, (const uint8_t *) self->partial.buf + prefix_size,
+               record_size));
+    return 1;
+}
+
+/* Adds every complete record in src to the current batch, and returns how
+ * much of src they take up, or -1 on error. */
+static ssize_t
+cork_framer_split(struct cork_framer *self, const uint8_t *src, size_t size)
+{
+    size_t  pos = 0;
+
+    switch (self->mode) {
+        case CORK_FRAMING_DELIMITED:
+        {
+            const uint8_t  *end;
+            while ((end = memchr(src + pos, self->delimiter, size - pos))
+                   != NULL) {
+                rii_check(cork_framer_add(self, src + pos, end - src - pos));
+                pos = end - src + 1;
+            }
+            return pos;
+        }
+
+        case CORK_FRAMING_FIXED_SIZE:
+            while (size - pos >= self->record_size) {
+                rii_check(cork_framer_add(self, src + pos, self->record_size));
+                pos += self->record_size;
+            }
+            return pos;
+
+        default:
+            for (;;) {
+                size_t  prefix_size;
+                size_t  record_size;
+                int  rc = cork_framer_parse_prefix
+                    (self, src + pos, size - pos, self->offset + pos,
+                     &prefix_size, &record_size);
+                if (rc <= 0) {
+                    return (rc == 0)? (ssize_t) pos: -1;
+                }
+                if (size - pos - prefix_size < record_size) {
+                    return pos;
+                }
+                rii_check(cork_framer_add
+                          (self, src + pos + prefix_size, record_size));
+                pos += prefix_size + record_size;
+            }
+    }
+}
+
+static void
+cork_framer_reset(struct cork_framer *self)
+{
+    cork_array_clear(&self->records);
+    cork_buffer_clear(&self->partial);
+    self->partial_offset = 0;
+    self->offset = 0;
+}
+
+static int
+cork_framer__data(struct cork_stream_consumer *consumer,
+                  const void *vbuf, size_t size, bool is_first_chunk)
+{
+    struct cork_framer  *self =
+        cork_container_of(consumer, struct cork_framer, parent);
+    const uint8_t  *buf = vbuf;
+    size_t  start = 0;
+    ssize_t  used;
+
+    if (is_first_chunk) {
+        cork_framer_reset(self);
+    }
+
+    if (self->partial.size > 0) {
+        int  rc = cork_framer_complete_partial(self, buf, size, &start);
+        if (CORK_UNLIKELY(rc < 0)) {
+            goto error;
+        } else if (rc == 0) {
+            self->offset += size;
+            return 0;
+        }
+    }
+
+    used = cork_framer_split(self, buf + start, size - start);
+    if (CORK_UNLIKELY(used < 0)) {
+        goto error;
+    }
+    ei_check(cork_framer_deliver(self));
+
+    /* Hold on to any incomplete record at the end of the chunk. */
+    start += used;
+    cork_buffer_set(&self->partial, buf + start, size - start);
+    self->partial_offset = self->offset + start;
+    self->offset += size;
+    return 0;
+
+error:
+    cork_framer_reset(self);
+    return -1;
+}
+
+static int
+cork_framer__eof(struct cork_stream_consumer *consumer)
+{
+    struct cork_framer  *self =
+        cork_container_of(consumer, struct cork_framer, parent);
+
+    if (self->partial.size > 0) {
+        if (self->mode == CORK_FRAMING_DELIMITED) {
+            ei_check(cork_framer_add
+                     (self, self->partial.buf, self->partial.size));
+            ei_check(cork_framer_deliver(self));
+        } else {
+            cork_error_set
+                (CORK_FRAMING_ERROR, CORK_FRAMING_INVALID,
+                 "Truncated record at offset %zu", self->partial_offset);
+            goto error;
+        }
+    }
+    cork_framer_reset(self);
+    return 0;
+
+error:
+    cork_framer_reset(self);
+    return -1;
+}
+
+static void
+cork_framer__free(struct cork_stream_consumer *consumer)
+{
+    struct cork_framer  *self =
+        cork_container_of(consumer, struct cork_framer, parent);
+    if (self->free_user_data != NULL) {
+        self->free_user_data(self->user_data);
+    }
+    cork_array_done(&self->records);
+    cork_buffer_done(&self->partial);
+    free(self);
+}
+
+static struct cork_stream_consumer *
+cork_framer_new(enum cork_framing_mode mode, uint8_t delimiter,
+                size_t record_size,
+                void *user_data, cork_free_f free_user_data,
+                cork_framing_records_f records)
+{
+    struct cork_framer  *self = cork_new(struct cork_framer);
+    self->parent.data = cork_framer__data;
+    self->parent.eof = cork_framer__eof;
+    self->parent.free = cork_framer__free;
+    self->mode = mode;
+    self->delimiter = delimiter;
+    self->record_size = record_size;
+    self->user_data = user_data;
+    self->free_user_data = free_user_data;
+    self->records_callback = records;
+    cork_array_init(&self->records);
+    cork_buffer_init(&self->partial);
+    self->partial_offset = 0;
+    self->offset = 0;
+    return &self->parent;
+}
+
+struct cork_stream_consumer *
+cork_delimited_consumer_new(char delimiter,
+                            void *user_data, cork_free_f free_user_data,
+                            cork_framing_records_f records)
+{
+    return cork_framer_new
+        (CORK_FRAMING_DELIMITED, delimiter, 0,
+         user_data, free_user_data, records);
+}
+
+struct cork_stream_consumer *
+cork_fixed_size_consumer_new(size_t record_size,
+                             void *user_data, cork_free_f free_user_data,
+                             cork_framing_records_f records)
+{
+    assert(record_size > 0);
+    return cork_framer_new
+        (CORK_FRAMING_FIXED_SIZE, 0, record_size,
+         user_data, free_user_data, records);
+}
+
+struct cork_stream_consumer *
+cork_varint_prefix_consumer_new(size_t max_record_size,
+                                void *user_data, cork_free_f free_user_data,
+                                cork_framing_records_f records)
+{
+    return cork_framer_new
+        (CORK_FRAMING_VARINT_PREFIX, 0, max_record_size,
+         user_data, free_user_data, records);
+}
+
+struct cork_stream_consumer *
+cork_u32_prefix_consumer_new(size_t max_record_size,
+                             void *user_data, cork_free_f free_user_data,
+                             cork_framing_records_f records)
+{
+    return cork_framer_new
+        (CORK_FRAMING_U32_PREFIX, 0, max_record_size,
+         user_data, free_user_data, records);
+}
@@ -0,0 +1,786 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/encoding.h"
+#include "libcork/ds/json-writer.h"
+#include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Integers
+ */
+
+static const char  cork_json_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+#define CORK_JSON_UINT_LENGTH  20
+
+/* Renders value into the end of buf (which must have room for
+ * CORK_JSON_UINT_LENGTH characters), two digits at a time, and returns a
+ * pointer to the first digit. */
+static char *
+cork_json_format_uint(char *buf, uint64_t value)
+{
+    char  *p = buf + CORK_JSON_UINT_LENGTH;
+    while (value >= 100) {
+        unsigned int  pair = (unsigned int) (value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        p[0] = cork_json_digit_pairs[pair];
+        p[1] = cork_json_digit_pairs[pair + 1];
+    }
+    if (value >= 10) {
+        unsigned int  pair = (unsigned int) value * 2;
+        p -= 2;
+        p[0] = cork_json_digit_pairs[pair];
+        p[1] = cork_json_digit_pairs[pair + 1];
+    } else {
+        *--p = '0' + (char) value;
+    }
+    return p;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Doubles
+ */
+
+/* We use the Grisu2 algorithm from "Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers" (Loitsch, 2010), following the
+ * implementation in RapidJSON.  It produces the shortest representation that
+ * round-trips for nearly every double, and a correct (if slightly longer) one
+ * for the rest, using only 64-bit integer arithmetic. */
+
+/* An unpacked floating-point number: f * 2^e. */
+struct cork_json_diy_fp {
+    uint64_t  f;
+    int  e;
+};
+
+#define CORK_JSON_DP_SIGNIFICAND_SIZE  52
+#define CORK_JSON_DP_EXPONENT_BIAS  (0x3ff + CORK_JSON_DP_SIGNIFICAND_SIZE)
+#define CORK_JSON_DP_MIN_EXPONENT  (-CORK_JSON_DP_EXPONENT_BIAS)
+#define CORK_JSON_DP_EXPONENT_MASK  UINT64_C(0x7ff0000000000000)
+#define CORK_JSON_DP_SIGNIFICAND_MASK  UINT64_C(0x000fffffffffffff)
+#define CORK_JSON_DP_HIDDEN_BIT  UINT64_C(0x0010000000000000)
+
+static struct cork_json_diy_fp
+cork_json_diy_fp_from_double(double d)
+{
+    struct cork_json_diy_fp  result;
+    uint64_t  u;
+    int  biased_e;
+    uint64_t  significand;
+    memcpy(&u, &d, sizeof(u));
+    biased_e = (int) ((u & CORK_JSON_DP_EXPONENT_MASK) >>
+                      CORK_JSON_DP_SIGNIFICAND_SIZE);
+    significand = u & CORK_JSON_DP_SIGNIFICAND_MASK;
+    if (biased_e != 0) {
+        result.f = significand + CORK_JSON_DP_HIDDEN_BIT;
+        result.e = biased_e - CORK_JSON_DP_EXPONENT_BIAS;
+    } else {
+        /* Subnormal */
+        result.f = significand;
+        result.e = CORK_JSON_DP_MIN_EXPONENT + 1;
+    }
+    return result;
+}
+
+static struct cork_json_diy_fp
+cork_json_diy_fp_multiply(struct cork_json_diy_fp x, struct cork_json_diy_fp y)
+{
+    /* The upper 64 bits of the 128-bit product, rounded. */
+    const uint64_t  m32 = UINT64_C(0xffffffff);
+    uint64_t  a = x.f >> 32;
+    uint64_t  b = x.f & m32;
+    uint64_t  c = y.f >> 32;
+    uint64_t  d = y.f & m32;
+    uint64_t  ac = a * c;
+    uint64_t  bc = b * c;
+    uint64_t  ad = a * d;
+    uint64_t  bd = b * d;
+    uint64_t  tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    struct cork_json_diy_fp  result;
+    tmp += UINT64_C(1) << 31;
+    result.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+static struct cork_json_diy_fp
+cork_json_diy_fp_normalize(struct cork_json_diy_fp x)
+{
+    while ((x.f & (UINT64_C(1) << 63)) == 0) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/* Calculates the normalized boundaries m- and m+ of v; any number strictly
+ * between them rounds to v. */
+static void
+cork_json_diy_fp_boundaries(struct cork_json_diy_fp v,
+                            struct cork_json_diy_fp *minus,
+                            struct cork_json_diy_fp *plus)
+{
+    struct cork_json_diy_fp  pl;
+    struct cork_json_diy_fp  mi;
+
+    pl.f = (v.f << 1) + 1;
+    pl.e = v.e - 1;
+    while ((pl.f & (CORK_JSON_DP_HIDDEN_BIT << 1)) == 0) {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 64 - CORK_JSON_DP_SIGNIFICAND_SIZE - 2;
+    pl.e -= 64 - CORK_JSON_DP_SIGNIFICAND_SIZE - 2;
+
+    /* The lower boundary is closer if v is a power of 2. */
+    if (v.f == CORK_JSON_DP_HIDDEN_BIT) {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    } else {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *minus = mi;
+    *plus = pl;
+}
+
+/* 10^k for k = -348, -340, ..., 340, normalized to 64 bits. */
+static const struct cork_json_diy_fp  cork_json_cached_powers[] = {
+    {UINT64_C(0xfa8fd5a0081c0288), -1220},
+    {UINT64_C(0xbaaee17fa23ebf76), -1193},
+    {UINT64_C(0x8b16fb203055ac76), -1166},
+    {UINT64_C(0xcf42894a5dce35ea), -1140},
+    {UINT64_C(0x9a6bb0aa55653b2d), -1113},
+    {UINT64_C(0xe61acf033d1a45df), -1087},
+    {UINT64_C(0xab70fe17c79ac6ca), -1060},
+    {UINT64_C(0xff77b1fcbebcdc4f), -1034},
+    {UINT64_C(0xbe5691ef416bd60c), -1007},
+    {UINT64_C(0x8dd01fad907ffc3c), -980},
+    {UINT64_C(0xd3515c2831559a83), -954},
+    {UINT64_C(0x9d71ac8fada6c9b5), -927},
+    {UINT64_C(0xea9c227723ee8bcb), -901},
+    {UINT64_C(0xaecc49914078536d), -874},
+    {UINT64_C(0x823c12795db6ce57), -847},
+    {UINT64_C(0xc21094364dfb5637), -821},
+    {UINT64_C(0x9096ea6f3848984f), -794},
+    {UINT64_C(0xd77485cb25823ac7), -768},
+    {UINT64_C(0xa086cfcd97bf97f4), -741},
+    {UINT64_C(0xef340a98172aace5), -715},
+    {UINT64_C(0xb23867fb2a35b28e), -688},
+    {UINT64_C(0x84c8d4dfd2c63f3b), -661},
+    {UINT64_C(0xc5dd44271ad3cdba), -635},
+    {UINT64_C(0x936b9fcebb25c996), -608},
+    {UINT64_C(0xdbac6c247d62a584), -582},
+    {UINT64_C(0xa3ab66580d5fdaf6), -555},
+    {UINT64_C(0xf3e2f893dec3f126), -529},
+    {UINT64_C(0xb5b5ada8aaff80b8), -502},
+    {UINT64_C(0x87625f056c7c4a8b), -475},
+    {UINT64_C(0xc9bcff6034c13053), -449},
+    {UINT64_C(0x964e858c91ba2655), -422},
+    {UINT64_C(0xdff9772470297ebd), -396},
+    {UINT64_C(0xa6dfbd9fb8e5b88f), -369},
+    {UINT64_C(0xf8a95fcf88747d94), -343},
+    {UINT64_C(0xb94470938fa89bcf), -316},
+    {UINT64_C(0x8a08f0f8bf0f156b), -289},
+    {UINT64_C(0xcdb02555653131b6), -263},
+    {UINT64_C(0x993fe2c6d07b7fac), -236},
+    {UINT64_C(0xe45c10c42a2b3b06), -210},
+    {UINT64_C(0xaa242499697392d3), -183},
+    {UINT64_C(0xfd87b5f28300ca0e), -157},
+    {UINT64_C(0xbce5086492111aeb), -130},
+    {UINT64_C(0x8cbccc096f5088cc), -103},
+    {UINT64_C(0xd1b71758e219652c), -77},
+    {UINT64_C(0x9c40000000000000), -50},
+    {UINT64_C(0xe8d4a51000000000), -24},
+    {UINT64_C(0xad78ebc5ac620000), 3},
+    {UINT64_C(0x813f3978f8940984), 30},
+    {UINT64_C(0xc097ce7bc90715b3), 56},
+    {UINT64_C(0x8f7e32ce7bea5c70), 83},
+    {UINT64_C(0xd5d238a4abe98068), 109},
+    {UINT64_C(0x9f4f2726179a2245), 136},
+    {UINT64_C(0xed63a231d4c4fb27), 162},
+    {UINT64_C(0xb0de65388cc8ada8), 189},
+    {UINT64_C(0x83c7088e1aab65db), 216},
+    {UINT64_C(0xc45d1df942711d9a), 242},
+    {UINT64_C(0x924d692ca61be758), 269},
+    {UINT64_C(0xda01ee641a708dea), 295},
+    {UINT64_C(0xa26da3999aef774a), 322},
+    {UINT64_C(0xf209787bb47d6b85), 348},
+    {UINT64_C(0xb454e4a179dd1877), 375},
+    {UINT64_C(0x865b86925b9bc5c2), 402},
+    {UINT64_C(0xc83553c5c8965d3d), 428},
+    {UINT64_C(0x952ab45cfa97a0b3), 455},
+    {UINT64_C(0xde469fbd99a05fe3), 481},
+    {UINT64_C(0xa59bc234db398c25), 508},
+    {UINT64_C(0xf6c69a72a3989f5c), 534},
+    {UINT64_C(0xb7dcbf5354e9bece), 561},
+    {UINT64_C(0x88fcf317f22241e2), 588},
+    {UINT64_C(0xcc20ce9bd35c78a5), 614},
+    {UINT64_C(0x98165af37b2153df), 641},
+    {UINT64_C(0xe2a0b5dc971f303a), 667},
+    {UINT64_C(0xa8d9d1535ce3b396), 694},
+    {UINT64_C(0xfb9b7cd9a4a7443c), 720},
+    {UINT64_C(0xbb764c4ca7a44410), 747},
+    {UINT64_C(0x8bab8eefb6409c1a), 774},
+    {UINT64_C(0xd01fef10a657842c), 800},
+    {UINT64_C(0x9b10a4e5e9913129), 827},
+    {UINT64_C(0xe7109bfba19c0c9d), 853},
+    {UINT64_C(0xac2820d9623bf429), 880},
+    {UINT64_C(0x80444b5e7aa7cf85), 907},
+    {UINT64_C(0xbf21e44003acdd2d), 933},
+    {UINT64_C(0x8e679c2f5e44ff8f), 960},
+    {UINT64_C(0xd433179d9c8cb841), 986},
+    {UINT64_C(0x9e19db92b4e31ba9), 1013},
+    {UINT64_C(0xeb96bf6ebadf77d9), 1039},
+    {UINT64_C(0xaf87023b9bf0ee6b), 1066}
+};
+
+/* Returns a cached power of ten c = 10^-k such that the product of c and a
+ * number with binary exponent e has a binary exponent between -60 and -32. */
+static struct cork_json_diy_fp
+cork_json_cached_power(int e, int *k)
+{
+    /* dk is always positive, so we can round up without ceil(). */
+    double  dk = (-61 - e) * 0.30102999566398114 + 347;
+    int  ik = (int) dk;
+    unsigned int  index;
+    if (dk - ik > 0.0) {
+        ik++;
+    }
+    index = (unsigned int) ((ik >> 3) + 1);
+    *k = -(-348 + (int) (index << 3));
+    return cork_json_cached_powers[index];
+}
+
+static const uint64_t  cork_json_pow10[] = {
+    UINT64_C(1),
+    UINT64_C(10),
+    UINT64_C(100),
+    UINT64_C(1000),
+    UINT64_C(10000),
+    UINT64_C(100000),
+    UINT64_C(1000000),
+    UINT64_C(10000000),
+    UINT64_C(100000000),
+    UINT64_C(1000000000),
+    UINT64_C(10000000000),
+    UINT64_C(100000000000),
+    UINT64_C(1000000000000),
+    UINT64_C(10000000000000),
+    UINT64_C(100000000000000),
+    UINT64_C(1000000000000000),
+    UINT64_C(10000000000000000),
+    UINT64_C(100000000000000000),
+    UINT64_C(1000000000000000000),
+    UINT64_C(10000000000000000000)
+};
+
+static unsigned int
+cork_json_count_digits(uint32_t n)
+{
+    /* DigitGen never passes in a number with more than 9 digits. */
+    unsigned int  count = 1;
+    while (count < 9 && n >= cork_json_pow10[count]) {
+        count++;
+    }
+    return count;
+}
+
+/* Moves the last digit closer to the true value, as long as it stays within
+ * the rounding interval. */
+static void
+cork_json_grisu_round(char *buf, int len, uint64_t delta, uint64_t rest,
+                      uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w ||
+            wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void
+cork_json_digit_gen(struct cork_json_diy_fp w, struct cork_json_diy_fp mp,
+                    uint64_t delta, char *buf, int *len, int *k)
+{
+    struct cork_json_diy_fp  one;
+    uint64_t  wp_w = mp.f - w.f;
+    uint32_t  p1;
+    uint64_t  p2;
+    int  kappa;
+
+    one.f = UINT64_C(1) << -mp.e;
+    one.e = mp.e;
+    p1 = (uint32_t) (mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+    kappa = (int) cork_json_count_digits(p1);
+    *len = 0;
+
+    while (kappa > 0) {
+        uint32_t  divisor = (uint32_t) cork_json_pow10[kappa - 1];
+        uint32_t  d = p1 / divisor;
+        uint64_t  tmp;
+        p1 %= divisor;
+        if (d != 0 || *len != 0) {
+            buf[(*len)++] = '0' + (char) d;
+        }
+        kappa--;
+        tmp = ((uint64_t) p1 << -one.e) + p2;
+        if (tmp <= delta) {
+            *k += kappa;
+            cork_json_grisu_round
+                (buf, *len, delta, tmp,
+                 cork_json_pow10[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    while (true) {
+        char  d;
+        p2 *= 10;
+        delta *= 10;
+        d = (char) (p2 >> -one.e);
+        if (d != 0 || *len != 0) {
+            buf[(*len)++] = '0' + d;
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            cork_json_grisu_round
+                (buf, *len, delta, p2, one.f,
+                 wp_w * ((-kappa < 20)? cork_json_pow10[-kappa]: 0));
+            return;
+        }
+    }
+}
+
+/* Fills in buf with the decimal digits of value, which must be positive and
+ * finite, such that value = digits * 10^k.  buf must have room for 17
+ * digits. */
+static void
+cork_json_grisu2(double value, char *buf, int *len, int *k)
+{
+    struct cork_json_diy_fp  v = cork_json_diy_fp_from_double(value);
+    struct cork_json_diy_fp  w_m;
+    struct cork_json_diy_fp  w_p;
+    struct cork_json_diy_fp  c_mk;
+    struct cork_json_diy_fp  w;
+    struct cork_json_diy_fp  wp;
+    struct cork_json_diy_fp  wm;
+
+    cork_json_diy_fp_boundaries(v, &w_m, &w_p);
+    c_mk = cork_json_cached_power(w_p.e, k);
+    w = cork_json_diy_fp_multiply(cork_json_diy_fp_normalize(v), c_mk);
+    wp = cork_json_diy_fp_multiply(w_p, c_mk);
+    wm = cork_json_diy_fp_multiply(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+    cork_json_digit_gen(w, wp, wp.f - wm.f, buf, len, k);
+}
+
+/* The longest possible result is something like "-1.2345678901234567e-308". */
+#define CORK_JSON_DOUBLE_LENGTH  32
+
+/* Renders value into buf, and returns the length of the result.  We use the
+ * same layout as JavaScript's Number.prototype.toString: plain decimal
+ * notation for exponents between -7 and 20, and scientific notation
+ * otherwise. */
+static size_t
+cork_json_format_double(char *buf, double value)
+{
+    char  digits[18];
+    char  *p = buf;
+    int  len;
+    int  k;
+    /* The position of the decimal point relative to the start of digits */
+    int  point;
+    int  i;
+
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (value == 0.0) {
+        *p++ = '0';
+        return p - buf;
+    }
+
+    cork_json_grisu2(value, digits, &len, &k);
+    point = len + k;
+
+    if (len <= point && point <= 21) {
+        /* 1234e7 → 12340000000 */
+        memcpy(p, digits, len);
+        p += len;
+        for (i = len; i < point; i++) {
+            *p++ = '0';
+        }
+    } else if (0 < point && point <= 21) {
+        /* 1234e-2 → 12.34 */
+        memcpy(p, digits, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, len - point);
+        p += len - point;
+    } else if (-6 < point && point <= 0) {
+        /* 1234e-6 → 0.001234 */
+        *p++ = '0';
+        *p++ = '.';
+        for (i = point; i < 0; i++) {
+            *p++ = '0';
+        }
+        memcpy(p, digits, len);
+        p += len;
+    } else {
+        /* 1234e30 → 1.234e+33 */
+        int  exponent = point - 1;
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        if (exponent < 0) {
+            *p++ = '-';
+            exponent = -exponent;
+        } else {
+            *p++ = '+';
+        }
+        if (exponent >= 100) {
+            *p++ = '0' + (char) (exponent / 100);
+            exponent %= 100;
+            *p++ = cork_json_digit_pairs[exponent * 2];
+            *p++ = cork_json_digit_pairs[exponent * 2 + 1];
+        } else if (exponent >= 10) {
+            *p++ = cork_json_digit_pairs[exponent * 2];
+            *p++ = cork_json_digit_pairs[exponent * 2 + 1];
+        } else {
+            *p++ = '0' + (char) exponent;
+        }
+    }
+
+    return p - buf;
+}
+
+
+/*-----------------------------------------------------------------------
+ * JSON writers
+ */
+
+static void
+cork_json_writer_init_common(struct cork_json_writer *writer)
+{
+    writer->need_comma = false;
+    writer->after_key = false;
+    writer->done = false;
+    writer->depth = 0;
+}
+
+void
+cork_json_writer_init(struct cork_json_writer *writer,
+                      struct cork_buffer *dest)
+{
+    writer->dest = dest;
+    cork_buffer_init(&writer->buffer);
+    writer->consumer = NULL;
+    writer->flush_size = 0;
+    writer->is_first_chunk = true;
+    cork_json_writer_init_common(writer);
+}
+
+void
+cork_json_writer_init_stream(struct cork_json_writer *writer,
+                             struct cork_stream_consumer *consumer,
+                             size_t flush_size)
+{
+    writer->dest = &writer->buffer;
+    cork_buffer_init(&writer->buffer);
+    /* Allocate the buffer once up front, so that we (usually) never have to
+     * resize it. */
+    cork_buffer_ensure_size(&writer->buffer, flush_size + 64);
+    writer->consumer = consumer;
+    writer->flush_size = flush_size;
+    writer->is_first_chunk = true;
+    cork_json_writer_init_common(writer);
+}
+
+void
+cork_json_writer_done(struct cork_json_writer *writer)
+{
+    cork_buffer_done(&writer->buffer);
+}
+
+static int
+cork_json_writer_flush(struct cork_json_writer *writer)
+{
+    if (writer->buffer.size > 0) {
+        rii_check(cork_stream_consumer_data
+                  (writer->consumer, writer->buffer.buf, writer->buffer.size,
+                   writer->is_first_chunk));
+        writer->is_first_chunk = false;
+        cork_buffer_clear(&writer->buffer);
+    }
+    return 0;
+}
+
+#define cork_json_writer_maybe_flush(writer) \
+    (((writer)->consumer != NULL && \
+      (writer)->buffer.size >= (writer)->flush_size)? \
+     cork_json_writer_flush((writer)): 0)
+
+int
+cork_json_writer_finish(struct cork_json_writer *writer)
+{
+    if (CORK_UNLIKELY(!writer->done)) {
+        cork_error_set
+            (CORK_JSON_WRITER_ERROR, CORK_JSON_WRITER_INVALID,
+             "JSON value is incomplete");
+        return -1;
+    }
+    if (writer->consumer != NULL) {
+        rii_check(cork_json_writer_flush(writer));
+        return cork_stream_consumer_eof(writer->consumer);
+    }
+    return 0;
+}
+
+static int
+cork_json_writer_invalid(const char *message)
+{
+    cork_error_set
+        (CORK_JSON_WRITER_ERROR, CORK_JSON_WRITER_INVALID, "%s", message);
+    return -1;
+}
+
+/* Checks that a value is allowed here, and adds a comma if needed. */
+static int
+cork_json_writer_before_value(struct cork_json_writer *writer)
+{
+    if (writer->depth == 0) {
+        if (CORK_UNLIKELY(writer->done)) {
+            return cork_json_writer_invalid
+                ("Cannot write more than one top-level JSON value");
+        }
+    } else if (writer->in_object[writer->depth - 1]) {
+        if (CORK_UNLIKELY(!writer->after_key)) {
+            return cork_json_writer_invalid
+                ("Values in a JSON object need a key");
+        }
+    } else if (writer->need_comma) {
+        cork_buffer_append_fast(writer->dest, ",", 1);
+    }
+    return 0;
+}
+
+static int
+cork_json_writer_after_value(struct cork_json_writer *writer)
+{
+    writer->after_key = false;
+    writer->need_comma = true;
+    if (writer->depth == 0) {
+        writer->done = true;
+    }
+    return cork_json_writer_maybe_flush(writer);
+}
+
+static int
+cork_json_writer_start(struct cork_json_writer *writer, bool in_object,
+                       char ch)
+{
+    rii_check(cork_json_writer_before_value(writer));
+    if (CORK_UNLIKELY(writer->depth == CORK_JSON_WRITER_MAX_DEPTH)) {
+        cork_error_set
+            (CORK_JSON_WRITER_ERROR, CORK_JSON_WRITER_TOO_DEEP,
+             "JSON containers can only be nested %u deep",
+             CORK_JSON_WRITER_MAX_DEPTH);
+        return -1;
+    }
+    writer->in_object[writer->depth++] = in_object;
+    writer->after_key = false;
+    writer->need_comma = false;
+    cork_buffer_append_fast(writer->dest, &ch, 1);
+    return 0;
+}
+
+static int
+cork_json_writer_end(struct cork_json_writer *writer, bool in_object,
+                     char ch)
+{
+    if (CORK_UNLIKELY(writer->depth == 0 ||
+                      writer->in_object[writer->depth - 1] != in_object)) {
+        return cork_json_writer_invalid
+            (in_object? "Not inside of a JSON object":
+             "Not inside of a JSON array");
+    }
+    if (CORK_UNLIKELY(writer->after_key)) {
+        return cork_json_writer_invalid("JSON object key needs a value");
+    }
+    writer->depth--;
+    cork_buffer_append_fast(writer->dest, &ch, 1);
+    return cork_json_writer_after_value(writer);
+}
+
+int
+cork_json_writer_start_object(struct cork_json_writer *writer)
+{
+    return cork_json_writer_start(writer, true, '{');
+}
+
+int
+cork_json_writer_end_object(struct cork_json_writer *writer)
+{
+    return cork_json_writer_end(writer, true, '}');
+}
+
+int
+cork_json_writer_start_array(struct cork_json_writer *writer)
+{
+    return cork_json_writer_start(writer, false, '[');
+}
+
+int
+cork_json_writer_end_array(struct cork_json_writer *writer)
+{
+    return cork_json_writer_end(writer, false, ']');
+}
+
+static void
+cork_json_writer_append_string(struct cork_json_writer *writer,
+                               const void *str, size_t size)
+{
+    cork_buffer_append_fast(writer->dest, "\"", 1);
+    cork_json_escape(writer->dest, str, size);
+    cork_buffer_append_fast(writer->dest, "\"", 1);
+}
+
+int
+cork_json_writer_key_n(struct cork_json_writer *writer,
+                       const void *key, size_t size)
+{
+    if (CORK_UNLIKELY(writer->depth == 0 ||
+                      !writer->in_object[writer->depth - 1])) {
+        return cork_json_writer_invalid("Keys must be inside a JSON object");
+    }
+    if (CORK_UNLIKELY(writer->after_key)) {
+        return cork_json_writer_invalid("JSON object key needs a value");
+    }
+    if (writer->need_comma) {
+        cork_buffer_append_fast(writer->dest, ",", 1);
+    }
+    cork_json_writer_append_string(writer, key, size);
+    cork_buffer_append_fast(writer->dest, ":", 1);
+    writer->after_key = true;
+    return 0;
+}
+
+int
+cork_json_writer_key(struct cork_json_writer *writer, const char *key)
+{
+    return cork_json_writer_key_n(writer, key, strlen(key));
+}
+
+int
+cork_json_writer_raw(struct cork_json_writer *writer,
+                     const void *json, size_t size)
+{
+    rii_check(cork_json_writer_before_value(writer));
+    cork_buffer_append_fast(writer->dest, json, size);
+    return cork_json_writer_after_value(writer);
+}
+
+int
+cork_json_writer_null(struct cork_json_writer *writer)
+{
+    return cork_json_writer_raw(writer, "null", 4);
+}
+
+int
+cork_json_writer_bool(struct cork_json_writer *writer, bool value)
+{
+    return value?
+        cork_json_writer_raw(writer, "true", 4):
+        cork_json_writer_raw(writer, "false", 5);
+}
+
+int
+cork_json_writer_int(struct cork_json_writer *writer, int64_t value)
+{
+    char  buf[CORK_JSON_UINT_LENGTH + 1];
+    char  *start;
+    if (value < 0) {
+        /* Negate as unsigned so that INT64_MIN works. */
+        start = cork_json_format_uint(buf + 1, -(uint64_t) value);
+        *--start = '-';
+    } else {
+        start = cork_json_format_uint(buf + 1, value);
+    }
+    return cork_json_writer_raw
+        (writer, start, buf + sizeof(buf) - start);
+}
+
+int
+cork_json_writer_uint(struct cork_json_writer *writer, uint64_t value)
+{
+    char  buf[CORK_JSON_UINT_LENGTH];
+    char  *start = cork_json_format_uint(buf, value);
+    return cork_json_writer_raw
+        (writer, start, buf + sizeof(buf) - start);
+}
+
+int
+cork_json_writer_double(struct cork_json_writer *writer, double value)
+{
+    char  buf[CORK_JSON_DOUBLE_LENGTH];
+    if (CORK_UNLIKELY(isnan(value) || isinf(value))) {
+        return cork_json_writer_null(writer);
+    }
+    return cork_json_writer_raw
+        (writer, buf, cork_json_format_double(buf, value));
+}
+
+int
+cork_json_writer_string_n(struct cork_json_writer *writer,
+                          const void *str, size_t size)
+{
+    rii_check(cork_json_writer_before_value(writer));
+    cork_json_writer_append_string(writer, str, size);
+    return cork_json_writer_after_value(writer);
+}
+
+int
+cork_json_writer_string(struct cork_json_writer *writer, const char *str)
+{
+    return cork_json_writer_string_n(writer, str, strlen(str));
+}
@@ -0,0 +1,437 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/stream.h"
+#include "libcork/threads/basics.h"
+#include "libcork/helpers/errors.h"
+#include "libcork/helpers/posix.h"
+
+
+/* How much of its range a worker passes to its consumer at a time. */
+#define CHUNK_SIZE  (1024 * 1024)
+
+/* How much we read at a time when looking for a delimiter without a
+ * mapping. */
+#define SCAN_SIZE  65536
+
+
+/*-----------------------------------------------------------------------
+ * Ranges
+ */
+
+enum cork_range_state {
+    CORK_RANGE_PENDING,
+    CORK_RANGE_DONE,
+    CORK_RANGE_FAILED
+};
+
+struct cork_range {
+    size_t  index;
+    off_t  start;
+    off_t  end;
+    struct cork_stream_consumer  *consumer;
+    /* Protected by the job's lock */
+    enum cork_range_state  state;
+    /* The error that the range's consumer ran into, which we'll raise again
+     * in the calling thread. */
+    cork_error_class  error_class;
+    cork_error_code  error_code;
+    const char  *error_message;
+};
+
+struct cork_parallel_job {
+    int  fd;
+    /* NULL if we couldn't map the file, in which case we use pread. */
+    const char  *map;
+    off_t  size;
+    struct cork_range  *ranges;
+    size_t  range_count;
+
+    pthread_mutex_t  lock;
+    pthread_cond_t  range_finished;
+    /* The remaining fields are protected by lock */
+    size_t  next_range;
+    /* Ranges that have finished but haven't been merged yet, in the order
+     * that they finished. */
+    size_t  *finished;
+    size_t  finished_head;
+    size_t  finished_tail;
+    /* Set when the merge fails, so that workers stop early */
+    bool  cancelled;
+};
+
+static int
+cork_parallel_job_pread(struct cork_parallel_job *job, void *buf,
+                        size_t size, off_t offset)
+{
+    while (size > 0) {
+        ssize_t  bytes_read = pread(job->fd, buf, size, offset);
+        if (bytes_read > 0) {
+            buf = (char *) buf + bytes_read;
+            size -= bytes_read;
+            offset += bytes_read;
+        } else if (bytes_read == 0) {
+            cork_error_set
+                (CORK_BUILTIN_ERROR, CORK_SYSTEM_ERROR,
+                 "File shrank while we were reading it");
+            return -1;
+        } else if (errno != EINTR) {
+            cork_system_error_set();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Returns the position just after the first delimiter at or after from, or
+ * the end of the file if there isn't one. */
+static int
+cork_parallel_job_find_delimiter(struct cork_parallel_job *job,
+                                 char delimiter, off_t from, off_t *dest)
+{
+    char  buf[SCAN_SIZE];
+
+    if (job->map != NULL) {
+        const char  *found =
+            memchr(job->map + from, delimiter, job->size - from);
+        *dest = (found == NULL)? job->size: found - job->map + 1;
+        return 0;
+    }
+
+    while (from < job->size) {
+        size_t  size = (job->size - from < SCAN_SIZE)?
+            job->size - from: SCAN_SIZE;
+        const char  *found;
+        rii_check(cork_parallel_job_pread(job, buf, size, from));
+        found = memchr(buf, delimiter, size);
+        if (found != NULL) {
+            *dest = from + (found - buf) + 1;
+            return 0;
+        }
+        from += size;
+    }
+    *dest = job->size;
+    return 0;
+}
+
+/* The nominal boundaries are evenly spaced; we then move each one forward
+ * to the start of the next record.  A record that spans several boundaries
+ * leaves some empty ranges behind it. */
+static int
+cork_parallel_job_split(struct cork_parallel_job *job, char delimiter)
+{
+    size_t  i;
+    off_t  prev_end = 0;
+    for (i = 0; i < job->range_count; i++) {
+        struct cork_range  *range = &job->ranges[i];
+        off_t  nominal = (off_t)
+            ((uint64_t) job->size * (i + 1) / job->range_count);
+        range->start = prev_end;
+        if (i == job->range_count - 1 || nominal <= prev_end) {
+            range->end = (i == job->range_count - 1)? job->size: prev_end;
+        } else {
+            rii_check(cork_parallel_job_find_delimiter
+                      (job, delimiter, nominal - 1, &range->end));
+        }
+        prev_end = range->end;
+    }
+    return 0;
+}
+
+static bool
+cork_parallel_job_is_cancelled(struct cork_parallel_job *job)
+{
+    bool  cancelled;
+    pthread_mutex_lock(&job->lock);
+    cancelled = job->cancelled;
+    pthread_mutex_unlock(&job->lock);
+    return cancelled;
+}
+
+static int
+cork_parallel_consume_range(struct cork_parallel_job *job,
+                            struct cork_range *range, char *buf)
+{
+    struct cork_stream_consumer  *consumer = range->consumer;
+    off_t  offset = range->start;
+    bool  first = true;
+
+    while (offset < range->end) {
+        size_t  size = (range->end - offset < CHUNK_SIZE)?
+            range->end - offset: CHUNK_SIZE;
+        const char  *chunk;
+        if (CORK_UNLIKELY(cork_parallel_job_is_cancelled(job))) {
+            return 0;
+        }
+        if (job->map != NULL) {
+            chunk = job->map + offset;
+        } else {
+            rii_check(cork_parallel_job_pread(job, buf, size, offset));
+            chunk = buf;
+        }
+        rii_check(cork_stream_consumer_data(consumer, chunk, size, first));
+        first = false;
+        offset += size;
+    }
+    return cork_stream_consumer_eof(consumer);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Workers
+ */
+
+struct cork_parallel_worker {
+    struct cork_thread_body  parent;
+    struct cork_parallel_job  *job;
+};
+
+static int
+cork_parallel_worker__run(struct cork_thread_body *vself)
+{
+    struct cork_parallel_worker  *self =
+        cork_container_of(vself, struct cork_parallel_worker, parent);
+    struct cork_parallel_job  *job = self->job;
+    char  *buf = (job->map == NULL)? cork_malloc(CHUNK_SIZE): NULL;
+
+    while (true) {
+        struct cork_range  *range;
+        int  rc;
+
+        pthread_mutex_lock(&job->lock);
+        if (job->cancelled || job->next_range == job->range_count) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        range = &job->ranges[job->next_range++];
+        pthread_mutex_unlock(&job->lock);
+
+        rc = cork_parallel_consume_range(job, range, buf);
+        if (CORK_UNLIKELY(rc != 0)) {
+            range->error_class = cork_error_get_class();
+            range->error_code = cork_error_get_code();
+            range->error_message = cork_strdup(cork_error_message());
+            cork_error_clear();
+        }
+
+        pthread_mutex_lock(&job->lock);
+        range->state = (rc == 0)? CORK_RANGE_DONE: CORK_RANGE_FAILED;
+        job->finished[job->finished_tail++] = range->index;
+        pthread_cond_signal(&job->range_finished);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    free(buf);
+    return 0;
+}
+
+static void
+cork_parallel_worker__free(struct cork_thread_body *vself)
+{
+    struct cork_parallel_worker  *self =
+        cork_container_of(vself, struct cork_parallel_worker, parent);
+    free(self);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Merging
+ */
+
+/* Waits for the next range that we're allowed to merge. */
+static struct cork_range *
+cork_parallel_job_next_finished(struct cork_parallel_job *job, bool ordered,
+                                size_t merged)
+{
+    struct cork_range  *range;
+    pthread_mutex_lock(&job->lock);
+    if (ordered) {
+        range = &job->ranges[merged];
+        while (range->state == CORK_RANGE_PENDING) {
+            pthread_cond_wait(&job->range_finished, &job->lock);
+        }
+    } else {
+        while (job->finished_head == job->finished_tail) {
+            pthread_cond_wait(&job->range_finished, &job->lock);
+        }
+        range = &job->ranges[job->finished[job->finished_head++]];
+    }
+    pthread_mutex_unlock(&job->lock);
+    return range;
+}
+
+/* Stops the workers and waits for them to finish, without losing the error
+ * that made us stop. */
+static void
+cork_parallel_job_cancel(struct cork_parallel_job *job,
+                         struct cork_thread **threads, size_t thread_count)
+{
+    cork_error_class  error_class = cork_error_get_class();
+    cork_error_code  error_code = cork_error_get_code();
+    const char  *message = cork_strdup(cork_error_message());
+    size_t  i;
+
+    pthread_mutex_lock(&job->lock);
+    job->cancelled = true;
+    pthread_mutex_unlock(&job->lock);
+    for (i = 0; i < thread_count; i++) {
+        cork_thread_join(threads[i]);
+    }
+
+    cork_error_clear();
+    cork_error_set(error_class, error_code, "%s", message);
+    cork_strfree(message);
+}
+
+static int
+cork_parallel_job_run(struct cork_parallel_job *job, size_t thread_count,
+                      bool ordered, void *user_data,
+                      cork_range_consumer_merge_f merge)
+{
+    struct cork_thread  **threads =
+        cork_calloc(thread_count, sizeof(struct cork_thread *));
+    size_t  started;
+    size_t  merged;
+    int  rc = 0;
+
+    for (started = 0; started < thread_count; started++) {
+        struct cork_parallel_worker  *worker =
+            cork_new(struct cork_parallel_worker);
+        worker->parent.run = cork_parallel_worker__run;
+        worker->parent.free = cork_parallel_worker__free;
+        worker->job = job;
+        threads[started] = cork_thread_new("parallel-file", &worker->parent);
+        if (CORK_UNLIKELY(cork_thread_start(threads[started]) != 0)) {
+            cork_thread_free(threads[started]);
+            goto error;
+        }
+    }
+
+    for (merged = 0; merged < job->range_count; merged++) {
+        struct cork_range  *range =
+            cork_parallel_job_next_finished(job, ordered, merged);
+        if (CORK_UNLIKELY(range->state == CORK_RANGE_FAILED)) {
+            cork_error_set(range->error_class, range->error_code,
+                           "%s", range->error_message);
+            goto error;
+        }
+        if (merge != NULL) {
+            ei_check(merge(user_data, range->index, range->consumer));
+        }
+        cork_stream_consumer_free(range->consumer);
+        range->consumer = NULL;
+    }
+
+    for (started = 0; started < thread_count; started++) {
+        if (cork_thread_join(threads[started]) != 0) {
+            rc = -1;
+        }
+    }
+    free(threads);
+    return rc;
+
+error:
+    cork_parallel_job_cancel(job, threads, started);
+    free(threads);
+    return -1;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Parallel file processing
+ */
+
+int
+cork_consume_file_in_parallel(const char *path, char delimiter,
+                              size_t range_count, size_t thread_count,
+                              bool ordered, void *user_data,
+                              cork_range_consumer_new_f new_consumer,
+                              cork_range_consumer_merge_f merge)
+{
+    struct cork_parallel_job  job;
+    struct stat  info;
+    size_t  i;
+    int  rc = -1;
+
+    assert(range_count > 0);
+    assert(thread_count > 0);
+    if (thread_count > range_count) {
+        thread_count = range_count;
+    }
+
+    rii_check_posix(job.fd = open(path, O_RDONLY));
+    job.map = NULL;
+    job.ranges = cork_calloc(range_count, sizeof(struct cork_range));
+    job.range_count = range_count;
+    job.finished = cork_calloc(range_count, sizeof(size_t));
+    job.finished_head = 0;
+    job.finished_tail = 0;
+    job.next_range = 0;
+    job.cancelled = false;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.range_finished, NULL);
+    for (i = 0; i < range_count; i++) {
+        job.ranges[i].index = i;
+        job.ranges[i].state = CORK_RANGE_PENDING;
+    }
+
+    ei_check_posix(fstat(job.fd, &info));
+    job.size = info.st_size;
+
+    /* If we can't map the file, each worker reads its range with pread
+     * instead. */
+    if (job.size > 0) {
+        void  *map = mmap(NULL, job.size, PROT_READ, MAP_SHARED, job.fd, 0);
+        if (map != MAP_FAILED) {
+#if defined(MADV_SEQUENTIAL)
+            madvise(map, job.size, MADV_SEQUENTIAL);
+#endif
+            job.map = map;
+        }
+    }
+
+    ei_check(cork_parallel_job_split(&job, delimiter));
+    for (i = 0; i < range_count; i++) {
+        ep_check(job.ranges[i].consumer = new_consumer(user_data, i));
+    }
+    rc = cork_parallel_job_run(&job, thread_count, ordered, user_data, merge);
+
+error:
+    for (i = 0; i < range_count; i++) {
+        if (job.ranges[i].consumer != NULL) {
+            cork_stream_consumer_free(job.ranges[i].consumer);
+        }
+        if (job.ranges[i].error_message != NULL) {
+            cork_strfree(job.ranges[i].error_message);
+        }
+    }
+    if (job.map != NULL) {
+        munmap((void *) job.map, job.size);
+    }
+    pthread_cond_destroy(&job.range_finished);
+    pthread_mutex_destroy(&job.lock);
+    free(job.finished);
+    free(job.ranges);
+    close(job.fd);
+    return rc;
+}
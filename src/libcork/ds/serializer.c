@@ -0,0 +1,453 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/byte-order.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/bitset.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/hash-table.h"
+#include "libcork/ds/serializer.h"
+#include "libcork/ds/slice.h"
+#include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
+
+
+/* The header is a 4-byte magic number, a format version byte, a flags byte,
+ * and then the application's version as a varint.  Everything after that is
+ * a sequence of fields, whose meaning is up to the application.  Integers are
+ * encoded as LEB128 varints; arrays are written in host byte order, so the
+ * header records the byte order of the machine that wrote it. */
+
+static const uint8_t  CORK_SERIALIZER_MAGIC[4] = { 'C', 'k', 'S', 'r' };
+#define CORK_SERIALIZER_FORMAT_VERSION  1
+#define CORK_SERIALIZER_FLAG_BIG_ENDIAN  0x01
+
+#if CORK_HOST_ENDIANNESS == CORK_BIG_ENDIAN
+#define CORK_SERIALIZER_HOST_FLAGS  CORK_SERIALIZER_FLAG_BIG_ENDIAN
+#else
+#define CORK_SERIALIZER_HOST_FLAGS  0
+#endif
+
+#define CORK_SERIALIZER_MAX_VARINT_SIZE  10
+
+
+/*-----------------------------------------------------------------------
+ * Serializers
+ */
+
+/* Small fields are collected in a buffer, which we hand off to the consumer
+ * once it gets this big.  Large fields are passed straight through to the
+ * consumer without being copied. */
+#define CORK_SERIALIZER_FLUSH_SIZE  (64 * 1024)
+#define CORK_SERIALIZER_DIRECT_SIZE  (8 * 1024)
+
+struct cork_serializer {
+    struct cork_stream_consumer  *dest;
+    struct cork_buffer  buf;
+    uint64_t  flushed_count;
+    bool  is_first_chunk;
+};
+
+struct cork_serializer *
+cork_serializer_new(struct cork_stream_consumer *dest)
+{
+    struct cork_serializer  *ser = cork_new(struct cork_serializer);
+    ser->dest = dest;
+    cork_buffer_init(&ser->buf);
+    cork_buffer_ensure_size(&ser->buf, CORK_SERIALIZER_FLUSH_SIZE);
+    ser->flushed_count = 0;
+    ser->is_first_chunk = true;
+    return ser;
+}
+
+void
+cork_serializer_free(struct cork_serializer *ser)
+{
+    cork_buffer_done(&ser->buf);
+    free(ser);
+}
+
+uint64_t
+cork_serializer_byte_count(const struct cork_serializer *ser)
+{
+    return ser->flushed_count + ser->buf.size;
+}
+
+static int
+cork_serializer_send(struct cork_serializer *ser, const void *src, size_t size)
+{
+    bool  is_first_chunk = ser->is_first_chunk;
+    ser->is_first_chunk = false;
+    ser->flushed_count += size;
+    return cork_stream_consumer_data(ser->dest, src, size, is_first_chunk);
+}
+
+static int
+cork_serializer_flush(struct cork_serializer *ser)
+{
+    int  rc = 0;
+    if (ser->buf.size > 0) {
+        rc = cork_serializer_send(ser, ser->buf.buf, ser->buf.size);
+        cork_buffer_clear(&ser->buf);
+    }
+    return rc;
+}
+
+int
+cork_serializer_finish(struct cork_serializer *ser)
+{
+    rii_check(cork_serializer_flush(ser));
+    return cork_stream_consumer_eof(ser->dest);
+}
+
+int
+cork_serializer_write_raw(struct cork_serializer *ser,
+                          const void *src, size_t size)
+{
+    if (size >= CORK_SERIALIZER_DIRECT_SIZE) {
+        rii_check(cork_serializer_flush(ser));
+        return cork_serializer_send(ser, src, size);
+    }
+    cork_buffer_append_fast(&ser->buf, src, size);
+    if (ser->buf.size >= CORK_SERIALIZER_FLUSH_SIZE) {
+        return cork_serializer_flush(ser);
+    }
+    return 0;
+}
+
+int
+cork_serializer_write_varint(struct cork_serializer *ser, uint64_t value)
+{
+    uint8_t  *dest;
+    cork_buffer_ensure_size
+        (&ser->buf, ser->buf.size + CORK_SERIALIZER_MAX_VARINT_SIZE);
+    dest = (uint8_t *) ser->buf.buf + ser->buf.size;
+    while (value >= 0x80) {
+        *dest++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *dest++ = (uint8_t) value;
+    ser->buf.size = dest - (uint8_t *) ser->buf.buf;
+    if (CORK_UNLIKELY(ser->buf.size >= CORK_SERIALIZER_FLUSH_SIZE)) {
+        return cork_serializer_flush(ser);
+    }
+    return 0;
+}
+
+int
+cork_serializer_write_svarint(struct cork_serializer *ser, int64_t value)
+{
+    uint64_t  zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    return cork_serializer_write_varint(ser, zigzag);
+}
+
+int
+cork_serializer_start(struct cork_serializer *ser, uint32_t version)
+{
+    uint8_t  header[6];
+    memcpy(header, CORK_SERIALIZER_MAGIC, sizeof(CORK_SERIALIZER_MAGIC));
+    header[4] = CORK_SERIALIZER_FORMAT_VERSION;
+    header[5] = CORK_SERIALIZER_HOST_FLAGS;
+    rii_check(cork_serializer_write_raw(ser, header, sizeof(header)));
+    return cork_serializer_write_varint(ser, version);
+}
+
+int
+cork_serializer_write_bytes(struct cork_serializer *ser,
+                            const void *src, size_t size)
+{
+    rii_check(cork_serializer_write_varint(ser, size));
+    return cork_serializer_write_raw(ser, src, size);
+}
+
+int
+cork_serializer_write_string(struct cork_serializer *ser, const char *str)
+{
+    return cork_serializer_write_bytes(ser, str, strlen(str));
+}
+
+int
+cork_serializer_write_buffer(struct cork_serializer *ser,
+                             const struct cork_buffer *buffer)
+{
+    return cork_serializer_write_bytes(ser, buffer->buf, buffer->size);
+}
+
+int
+cork_serializer_write_raw_array(struct cork_serializer *ser,
+                                const struct cork_raw_array *array)
+{
+    size_t  element_size = cork_raw_array_element_size(array);
+    size_t  count = cork_raw_array_size(array);
+    rii_check(cork_serializer_write_varint(ser, element_size));
+    rii_check(cork_serializer_write_varint(ser, count));
+    return cork_serializer_write_raw
+        (ser, cork_raw_array_elements(array), element_size * count);
+}
+
+int
+cork_serializer_write_bitset(struct cork_serializer *ser,
+                             const struct cork_bitset *set)
+{
+    rii_check(cork_serializer_write_varint(ser, set->bit_count));
+    return cork_serializer_write_raw(ser, set->bits, set->byte_count);
+}
+
+int
+cork_serializer_write_hash_table(struct cork_serializer *ser,
+                                 struct cork_hash_table *table,
+                                 cork_serializer_entry_writer write_entry,
+                                 void *user_data)
+{
+    struct cork_hash_table_iterator  iter;
+    struct cork_hash_table_entry  *entry;
+    rii_check(cork_serializer_write_varint
+              (ser, cork_hash_table_size(table)));
+    cork_hash_table_iterator_init(table, &iter);
+    while ((entry = cork_hash_table_iterator_next(&iter)) != NULL) {
+        rii_check(write_entry(ser, entry, user_data));
+    }
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Deserializers
+ */
+
+#define cork_deserializer_invalid(...) \
+    cork_error_set(CORK_SERIALIZER_ERROR, CORK_SERIALIZER_INVALID, \
+                   __VA_ARGS__)
+
+#define cork_deserializer_mismatch(...) \
+    cork_error_set(CORK_SERIALIZER_ERROR, CORK_SERIALIZER_MISMATCH, \
+                   __VA_ARGS__)
+
+void
+cork_deserializer_init(struct cork_deserializer *des,
+                       const void *buf, size_t size)
+{
+    des->buf = buf;
+    des->size = size;
+    des->pos = 0;
+    des->slice = NULL;
+}
+
+void
+cork_deserializer_init_slice(struct cork_deserializer *des,
+                             const struct cork_slice *slice)
+{
+    cork_deserializer_init(des, slice->buf, slice->size);
+    des->slice = slice;
+}
+
+int
+cork_deserializer_read_raw(struct cork_deserializer *des,
+                           const void **dest, size_t size)
+{
+    if (CORK_UNLIKELY(size > cork_deserializer_remaining(des))) {
+        cork_deserializer_invalid
+            ("Need %zu bytes, but only %zu remain",
+             size, cork_deserializer_remaining(des));
+        return -1;
+    }
+    *dest = des->buf + des->pos;
+    des->pos += size;
+    return 0;
+}
+
+int
+cork_deserializer_read_varint(struct cork_deserializer *des, uint64_t *dest)
+{
+    const uint8_t  *curr = des->buf + des->pos;
+    const uint8_t  *end = des->buf + des->size;
+    uint64_t  value = 0;
+    unsigned int  shift;
+
+    for (shift = 0; curr < end && shift < 64; shift += 7) {
+        uint8_t  byte = *curr++;
+        value |= ((uint64_t) (byte & 0x7f)) << shift;
+        if (byte < 0x80) {
+            des->pos = curr - des->buf;
+            *dest = value;
+            return 0;
+        }
+    }
+
+    cork_deserializer_invalid("Invalid varint");
+    return -1;
+}
+
+int
+cork_deserializer_read_svarint(struct cork_deserializer *des, int64_t *dest)
+{
+    uint64_t  zigzag;
+    rii_check(cork_deserializer_read_varint(des, &zigzag));
+    *dest = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+    return 0;
+}
+
+int
+cork_deserializer_start(struct cork_deserializer *des, uint32_t *version)
+{
+    const uint8_t  *header;
+    uint64_t  full_version;
+
+    rii_check(cork_deserializer_read_raw(des, (const void **) &header, 6));
+    if (CORK_UNLIKELY(memcmp(header, CORK_SERIALIZER_MAGIC,
+                             sizeof(CORK_SERIALIZER_MAGIC)) != 0)) {
+        cork_deserializer_invalid("Bad magic number");
+        return -1;
+    }
+    if (CORK_UNLIKELY(header[4] != CORK_SERIALIZER_FORMAT_VERSION)) {
+        cork_deserializer_invalid("Unknown format version %u", header[4]);
+        return -1;
+    }
+    if (CORK_UNLIKELY(header[5] != CORK_SERIALIZER_HOST_FLAGS)) {
+        cork_deserializer_mismatch("Written on a host with a different "
+                                   "byte order");
+        return -1;
+    }
+
+    rii_check(cork_deserializer_read_varint(des, &full_version));
+    if (CORK_UNLIKELY(full_version > UINT32_MAX)) {
+        cork_deserializer_invalid("Invalid version");
+        return -1;
+    }
+    if (version != NULL) {
+        *version = full_version;
+    }
+    return 0;
+}
+
+/* Reads a varint that is going to be used as a size_t, and which must not be
+ * bigger than the amount of data that's left. */
+static int
+cork_deserializer_read_length(struct cork_deserializer *des, size_t *dest,
+                              size_t element_size)
+{
+    uint64_t  length;
+    rii_check(cork_deserializer_read_varint(des, &length));
+    if (CORK_UNLIKELY(element_size != 0 &&
+                      length > cork_deserializer_remaining(des) /
+                      element_size)) {
+        cork_deserializer_invalid("Length %" PRIu64 " is too large", length);
+        return -1;
+    }
+    *dest = length;
+    return 0;
+}
+
+int
+cork_deserializer_read_bytes(struct cork_deserializer *des,
+                             const void **dest, size_t *size)
+{
+    rii_check(cork_deserializer_read_length(des, size, 1));
+    return cork_deserializer_read_raw(des, dest, *size);
+}
+
+int
+cork_deserializer_read_slice(struct cork_deserializer *des,
+                             struct cork_slice *dest)
+{
+    const void  *buf;
+    size_t  size;
+    rii_check(cork_deserializer_read_bytes(des, &buf, &size));
+    if (des->slice == NULL) {
+        cork_slice_init_static(dest, buf, size);
+        return 0;
+    } else {
+        size_t  offset = (const uint8_t *) buf - des->buf;
+        return cork_slice_copy(dest, des->slice, offset, size);
+    }
+}
+
+int
+cork_deserializer_read_buffer(struct cork_deserializer *des,
+                              struct cork_buffer *dest)
+{
+    const void  *buf;
+    size_t  size;
+    rii_check(cork_deserializer_read_bytes(des, &buf, &size));
+    cork_buffer_append(dest, buf, size);
+    return 0;
+}
+
+int
+cork_deserializer_read_raw_array(struct cork_deserializer *des,
+                                 struct cork_raw_array *dest)
+{
+    uint64_t  element_size;
+    size_t  count;
+    size_t  i;
+    const uint8_t  *src;
+
+    rii_check(cork_deserializer_read_varint(des, &element_size));
+    if (CORK_UNLIKELY(element_size !=
+                      cork_raw_array_element_size(dest))) {
+        cork_deserializer_mismatch
+            ("Array has %" PRIu64 "-byte elements, expected %zu",
+             element_size, cork_raw_array_element_size(dest));
+        return -1;
+    }
+    rii_check(cork_deserializer_read_length(des, &count, element_size));
+    rii_check(cork_deserializer_read_raw
+              (des, (const void **) &src, count * element_size));
+
+    cork_raw_array_ensure_size(dest, cork_raw_array_size(dest) + count);
+    for (i = 0; i < count; i++, src += element_size) {
+        memcpy(cork_raw_array_append(dest), src, element_size);
+    }
+    return 0;
+}
+
+struct cork_bitset *
+cork_deserializer_read_bitset(struct cork_deserializer *des)
+{
+    uint64_t  bit_count;
+    const void  *bits;
+    struct cork_bitset  *set;
+
+    rpi_check(cork_deserializer_read_varint(des, &bit_count));
+    if (CORK_UNLIKELY(bit_count / 8 > cork_deserializer_remaining(des))) {
+        cork_deserializer_invalid("Bit set is too large");
+        return NULL;
+    }
+    set = cork_bitset_new(bit_count);
+    if (CORK_UNLIKELY(cork_deserializer_read_raw
+                      (des, &bits, set->byte_count) != 0)) {
+        cork_bitset_free(set);
+        return NULL;
+    }
+    memcpy(set->bits, bits, set->byte_count);
+    return set;
+}
+
+int
+cork_deserializer_read_hash_table(struct cork_deserializer *des,
+                                  struct cork_hash_table *table,
+                                  cork_deserializer_entry_reader read_entry,
+                                  void *user_data)
+{
+    size_t  count;
+    size_t  i;
+    /* Each entry takes up at least one byte. */
+    rii_check(cork_deserializer_read_length(des, &count, 1));
+    cork_hash_table_ensure_size(table, cork_hash_table_size(table) + count);
+    for (i = 0; i < count; i++) {
+        rii_check(read_entry(des, table, user_data));
+    }
+    return 0;
+}
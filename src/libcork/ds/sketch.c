@@ -0,0 +1,1033 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/byte-order.h"
+#include "libcork/core/error.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/hash-table.h"
+#include "libcork/ds/sketch.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Serialization helpers
+ */
+
+/* All of the sketches are serialized with big-endian integers, so that
+ * sketches built on different workers can be merged together. */
+
+static void
+cork_sketch_append_u8(struct cork_buffer *dest, uint8_t val)
+{
+    cork_buffer_append(dest, &val, sizeof(val));
+}
+
+static void
+cork_sketch_append_u32(struct cork_buffer *dest, uint32_t val)
+{
+    CORK_UINT32_HOST_TO_BIG_IN_PLACE(val);
+    cork_buffer_append(dest, &val, sizeof(val));
+}
+
+static void
+cork_sketch_append_u64(struct cork_buffer *dest, uint64_t val)
+{
+    CORK_UINT64_HOST_TO_BIG_IN_PLACE(val);
+    cork_buffer_append(dest, &val, sizeof(val));
+}
+
+struct cork_sketch_reader {
+    const uint8_t  *buf;
+    size_t  size;
+};
+
+static void
+cork_sketch_invalid_set(const char *reason)
+{
+    cork_error_set
+        (CORK_SKETCH_ERROR, CORK_SKETCH_INVALID,
+         "Invalid sketch: %s", reason);
+}
+
+static int
+cork_sketch_read(struct cork_sketch_reader *reader, void *dest, size_t size)
+{
+    if (CORK_UNLIKELY(reader->size < size)) {
+        cork_sketch_invalid_set("Data is too short");
+        return -1;
+    }
+    memcpy(dest, reader->buf, size);
+    reader->buf += size;
+    reader->size -= size;
+    return 0;
+}
+
+static int
+cork_sketch_read_u8(struct cork_sketch_reader *reader, uint8_t *dest)
+{
+    return cork_sketch_read(reader, dest, sizeof(uint8_t));
+}
+
+static int
+cork_sketch_read_u32(struct cork_sketch_reader *reader, uint32_t *dest)
+{
+    rii_check(cork_sketch_read(reader, dest, sizeof(uint32_t)));
+    CORK_UINT32_BIG_TO_HOST_IN_PLACE(*dest);
+    return 0;
+}
+
+static int
+cork_sketch_read_u64(struct cork_sketch_reader *reader, uint64_t *dest)
+{
+    rii_check(cork_sketch_read(reader, dest, sizeof(uint64_t)));
+    CORK_UINT64_BIG_TO_HOST_IN_PLACE(*dest);
+    return 0;
+}
+
+static int
+cork_sketch_read_header(struct cork_sketch_reader *reader, uint32_t magic)
+{
+    uint32_t  actual_magic;
+    uint8_t  version;
+    rii_check(cork_sketch_read_u32(reader, &actual_magic));
+    if (CORK_UNLIKELY(actual_magic != magic)) {
+        cork_sketch_invalid_set("Bad magic number");
+        return -1;
+    }
+    rii_check(cork_sketch_read_u8(reader, &version));
+    if (CORK_UNLIKELY(version != 1)) {
+        cork_sketch_invalid_set("Unknown version");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+cork_sketch_read_done(struct cork_sketch_reader *reader)
+{
+    if (CORK_UNLIKELY(reader->size != 0)) {
+        cork_sketch_invalid_set("Extra data at end of sketch");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+cork_sketch_mismatch_set(const char *what)
+{
+    cork_error_set
+        (CORK_SKETCH_ERROR, CORK_SKETCH_MISMATCH,
+         "Cannot merge %s with different parameters", what);
+}
+
+static cork_big_hash
+cork_sketch_hash(const void *src, size_t len)
+{
+    cork_big_hash  seed = {cork_u128_from_64(0, 0)};
+    return cork_big_hash_buffer(seed, src, len);
+}
+
+
+/*-----------------------------------------------------------------------
+ * HyperLogLog
+ */
+
+/* Until it has enough entries to make the registers worth allocating, an HLL
+ * is "sparse": it holds a sorted list of (index, rank) pairs for the nonzero
+ * registers, each encoded as a uint32_t (index << 8 | rank).  New pairs are
+ * appended to an unsorted temporary list, which is sorted and merged into the
+ * main list in batches. */
+
+#define CORK_HLL_MAGIC  0x43484c4c  /* "CHLL" */
+#define CORK_HLL_SPARSE  0
+#define CORK_HLL_DENSE  1
+
+#define cork_hll_sparse_entry(index, rank)  (((uint32_t) (index) << 8) | (rank))
+#define cork_hll_sparse_index(entry)  ((entry) >> 8)
+#define cork_hll_sparse_rank(entry)  ((uint8_t) ((entry) & 0xff))
+
+struct cork_hll {
+    unsigned int  precision;
+    size_t  register_count;
+    /* NULL while the HLL is sparse */
+    uint8_t  *registers;
+    uint32_t  *sparse;
+    size_t  sparse_size;
+    uint32_t  *pending;
+    size_t  pending_size;
+    size_t  pending_max;
+};
+
+static inline unsigned int
+cork_sketch_clz64(uint64_t x)
+{
+#if CORK_CONFIG_GCC_VERSION >= 30400
+    return __builtin_clzll(x);
+#else
+    unsigned int  result = 0;
+    while ((x & UINT64_C(0x8000000000000000)) == 0) {
+        x <<= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+struct cork_hll *
+cork_hll_new(unsigned int precision)
+{
+    struct cork_hll  *hll = cork_new(struct cork_hll);
+    assert(precision >= CORK_HLL_MIN_PRECISION &&
+           precision <= CORK_HLL_MAX_PRECISION);
+    hll->precision = precision;
+    hll->register_count = ((size_t) 1) << precision;
+    hll->registers = NULL;
+    hll->sparse = NULL;
+    hll->sparse_size = 0;
+    /* Once the sparse list takes up as much space as the registers would,
+     * we switch over to the dense representation. */
+    hll->pending_max = hll->register_count / sizeof(uint32_t) / 4;
+    if (hll->pending_max < 16) {
+        hll->pending_max = 16;
+    }
+    hll->pending = cork_calloc(hll->pending_max, sizeof(uint32_t));
+    hll->pending_size = 0;
+    return hll;
+}
+
+void
+cork_hll_free(struct cork_hll *hll)
+{
+    if (hll->registers != NULL) {
+        free(hll->registers);
+    }
+    if (hll->sparse != NULL) {
+        free(hll->sparse);
+    }
+    free(hll->pending);
+    free(hll);
+}
+
+void
+cork_hll_clear(struct cork_hll *hll)
+{
+    if (hll->registers != NULL) {
+        free(hll->registers);
+        hll->registers = NULL;
+    }
+    if (hll->sparse != NULL) {
+        free(hll->sparse);
+        hll->sparse = NULL;
+    }
+    hll->sparse_size = 0;
+    hll->pending_size = 0;
+}
+
+unsigned int
+cork_hll_precision(const struct cork_hll *hll)
+{
+    return hll->precision;
+}
+
+static int
+cork_hll_sparse_compare(const void *va, const void *vb)
+{
+    uint32_t  a = *(const uint32_t *) va;
+    uint32_t  b = *(const uint32_t *) vb;
+    return (a < b)? -1: (a > b)? 1: 0;
+}
+
+static void
+cork_hll_to_dense(struct cork_hll *hll)
+{
+    size_t  i;
+    hll->registers = cork_calloc(hll->register_count, sizeof(uint8_t));
+    for (i = 0; i < hll->sparse_size; i++) {
+        uint32_t  entry = hll->sparse[i];
+        hll->registers[cork_hll_sparse_index(entry)] =
+            cork_hll_sparse_rank(entry);
+    }
+    free(hll->sparse);
+    hll->sparse = NULL;
+    hll->sparse_size = 0;
+}
+
+/* Merges the pending list into the sparse list.  Because entries sort by
+ * index and then by rank, the last entry for each index is the one to
+ * keep. */
+static void
+cork_hll_flush(struct cork_hll *hll)
+{
+    uint32_t  *merged;
+    size_t  i = 0;
+    size_t  j = 0;
+    size_t  size = 0;
+
+    if (hll->pending_size == 0) {
+        return;
+    }
+
+    if (hll->registers != NULL) {
+        for (i = 0; i < hll->pending_size; i++) {
+            uint32_t  entry = hll->pending[i];
+            uint8_t  *reg = &hll->registers[cork_hll_sparse_index(entry)];
+            if (cork_hll_sparse_rank(entry) > *reg) {
+                *reg = cork_hll_sparse_rank(entry);
+            }
+        }
+        hll->pending_size = 0;
+        return;
+    }
+
+    qsort(hll->pending, hll->pending_size, sizeof(uint32_t),
+          cork_hll_sparse_compare);
+    merged = cork_calloc(hll->sparse_size + hll->pending_size,
+                         sizeof(uint32_t));
+    while (i < hll->sparse_size || j < hll->pending_size) {
+        uint32_t  next;
+        if (j == hll->pending_size ||
+            (i < hll->sparse_size && hll->sparse[i] < hll->pending[j])) {
+            next = hll->sparse[i++];
+        } else {
+            next = hll->pending[j++];
+        }
+        if (size > 0 &&
+            cork_hll_sparse_index(merged[size - 1]) ==
+            cork_hll_sparse_index(next)) {
+            merged[size - 1] = next;
+        } else {
+            merged[size++] = next;
+        }
+    }
+
+    if (hll->sparse != NULL) {
+        free(hll->sparse);
+    }
+    hll->sparse = merged;
+    hll->sparse_size = size;
+    hll->pending_size = 0;
+
+    if (hll->sparse_size * sizeof(uint32_t) >= hll->register_count) {
+        cork_hll_to_dense(hll);
+    }
+}
+
+static inline void
+cork_hll_add_entry(struct cork_hll *hll, size_t index, uint8_t rank)
+{
+    if (hll->registers != NULL) {
+        if (rank > hll->registers[index]) {
+            hll->registers[index] = rank;
+        }
+    } else {
+        if (CORK_UNLIKELY(hll->pending_size == hll->pending_max)) {
+            cork_hll_flush(hll);
+            if (hll->registers != NULL) {
+                cork_hll_add_entry(hll, index, rank);
+                return;
+            }
+        }
+        hll->pending[hll->pending_size++] = cork_hll_sparse_entry(index, rank);
+    }
+}
+
+/* The top precision bits choose the register; the rank is the position of
+ * the leftmost 1 bit in the rest of the hash. */
+static inline void
+cork_hll_add_hash_inline(struct cork_hll *hll, cork_big_hash hash)
+{
+    uint64_t  bits = cork_u128_be64(hash.u128, 0);
+    size_t  index = (size_t) (bits >> (64 - hll->precision));
+    uint64_t  rest =
+        (bits << hll->precision) | (UINT64_C(1) << (hll->precision - 1));
+    cork_hll_add_entry(hll, index, cork_sketch_clz64(rest) + 1);
+}
+
+void
+cork_hll_add_hash(struct cork_hll *hll, cork_big_hash hash)
+{
+    cork_hll_add_hash_inline(hll, hash);
+}
+
+void
+cork_hll_add_hashes(struct cork_hll *hll,
+                    const cork_big_hash *hashes, size_t count)
+{
+    size_t  i;
+    for (i = 0; i < count; i++) {
+        cork_hll_add_hash_inline(hll, hashes[i]);
+    }
+}
+
+void
+cork_hll_add(struct cork_hll *hll, const void *src, size_t len)
+{
+    cork_hll_add_hash_inline(hll, cork_sketch_hash(src, len));
+}
+
+/* Returns ln(x) for x >= 1, without needing libm. */
+static double
+cork_sketch_ln(double x)
+{
+    double  result = 0.0;
+    double  bit = 1.0;
+    unsigned int  i;
+    while (x >= 2.0) {
+        x /= 2.0;
+        result += 1.0;
+    }
+    for (i = 0; i < 40; i++) {
+        x *= x;
+        bit /= 2.0;
+        if (x >= 2.0) {
+            x /= 2.0;
+            result += bit;
+        }
+    }
+    return result * 0.69314718055994530942;
+}
+
+#define cork_hll_inverse_pow2(rank)  (1.0 / (double) (UINT64_C(1) << (rank)))
+
+uint64_t
+cork_hll_estimate(struct cork_hll *hll)
+{
+    double  m = (double) hll->register_count;
+    double  alpha;
+    double  sum = 0.0;
+    size_t  zeros = 0;
+    double  estimate;
+    size_t  i;
+
+    cork_hll_flush(hll);
+    if (hll->registers != NULL) {
+        for (i = 0; i < hll->register_count; i++) {
+            sum += cork_hll_inverse_pow2(hll->registers[i]);
+            if (hll->registers[i] == 0) {
+                zeros++;
+            }
+        }
+    } else {
+        zeros = hll->register_count - hll->sparse_size;
+        sum = (double) zeros;
+        for (i = 0; i < hll->sparse_size; i++) {
+            sum += cork_hll_inverse_pow2(cork_hll_sparse_rank(hll->sparse[i]));
+        }
+    }
+
+    switch (hll->register_count) {
+        case 16:  alpha = 0.673; break;
+        case 32:  alpha = 0.697; break;
+        case 64:  alpha = 0.709; break;
+        default:  alpha = 0.7213 / (1.0 + 1.079 / m); break;
+    }
+
+    estimate = alpha * m * m / sum;
+    /* Use linear counting for small cardinalities.  With a 64-bit hash, we
+     * don't need a correction for large cardinalities. */
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * cork_sketch_ln(m / (double) zeros);
+    }
+    return (uint64_t) (estimate + 0.5);
+}
+
+int
+cork_hll_merge(struct cork_hll *dest, struct cork_hll *src)
+{
+    size_t  i;
+
+    if (CORK_UNLIKELY(dest->precision != src->precision)) {
+        cork_sketch_mismatch_set("HyperLogLogs");
+        return -1;
+    }
+
+    cork_hll_flush(src);
+    if (src->registers != NULL) {
+        cork_hll_flush(dest);
+        if (dest->registers == NULL) {
+            cork_hll_to_dense(dest);
+        }
+        for (i = 0; i < dest->register_count; i++) {
+            if (src->registers[i] > dest->registers[i]) {
+                dest->registers[i] = src->registers[i];
+            }
+        }
+    } else {
+        for (i = 0; i < src->sparse_size; i++) {
+            cork_hll_add_entry
+                (dest, cork_hll_sparse_index(src->sparse[i]),
+                 cork_hll_sparse_rank(src->sparse[i]));
+        }
+    }
+    return 0;
+}
+
+void
+cork_hll_save(struct cork_hll *hll, struct cork_buffer *dest)
+{
+    size_t  i;
+    cork_hll_flush(hll);
+    cork_sketch_append_u32(dest, CORK_HLL_MAGIC);
+    cork_sketch_append_u8(dest, 1);
+    cork_sketch_append_u8(dest, hll->precision);
+    if (hll->registers != NULL) {
+        cork_sketch_append_u8(dest, CORK_HLL_DENSE);
+        cork_buffer_append(dest, hll->registers, hll->register_count);
+    } else {
+        cork_sketch_append_u8(dest, CORK_HLL_SPARSE);
+        cork_sketch_append_u32(dest, hll->sparse_size);
+        for (i = 0; i < hll->sparse_size; i++) {
+            cork_sketch_append_u32(dest, hll->sparse[i]);
+        }
+    }
+}
+
+struct cork_hll *
+cork_hll_new_from_bytes(const void *src, size_t size)
+{
+    struct cork_sketch_reader  reader = { src, size };
+    struct cork_hll  *hll;
+    uint8_t  precision;
+    uint8_t  encoding;
+    uint32_t  sparse_size;
+    size_t  i;
+
+    rpi_check(cork_sketch_read_header(&reader, CORK_HLL_MAGIC));
+    rpi_check(cork_sketch_read_u8(&reader, &precision));
+    rpi_check(cork_sketch_read_u8(&reader, &encoding));
+    if (CORK_UNLIKELY(precision < CORK_HLL_MIN_PRECISION ||
+                      precision > CORK_HLL_MAX_PRECISION)) {
+        cork_sketch_invalid_set("Bad HyperLogLog precision");
+        return NULL;
+    }
+
+    hll = cork_hll_new(precision);
+    if (encoding == CORK_HLL_DENSE) {
+        hll->registers = cork_malloc(hll->register_count);
+        ei_check(cork_sketch_read
+                 (&reader, hll->registers, hll->register_count));
+        for (i = 0; i < hll->register_count; i++) {
+            if (CORK_UNLIKELY(hll->registers[i] > 65 - precision)) {
+                cork_sketch_invalid_set("Bad HyperLogLog register");
+                goto error;
+            }
+        }
+    } else if (encoding == CORK_HLL_SPARSE) {
+        ei_check(cork_sketch_read_u32(&reader, &sparse_size));
+        if (CORK_UNLIKELY(sparse_size > hll->register_count)) {
+            cork_sketch_invalid_set("Bad HyperLogLog size");
+            goto error;
+        }
+        hll->sparse = cork_calloc(sparse_size + 1, sizeof(uint32_t));
+        for (i = 0; i < sparse_size; i++) {
+            uint32_t  entry;
+            ei_check(cork_sketch_read_u32(&reader, &entry));
+            if (CORK_UNLIKELY
+                (cork_hll_sparse_index(entry) >= hll->register_count ||
+                 cork_hll_sparse_rank(entry) > 65 - precision ||
+                 (i > 0 && cork_hll_sparse_index(entry) <=
+                           cork_hll_sparse_index(hll->sparse[i - 1])))) {
+                cork_sketch_invalid_set("Bad HyperLogLog entry");
+                goto error;
+            }
+            hll->sparse[i] = entry;
+            hll->sparse_size++;
+        }
+    } else {
+        cork_sketch_invalid_set("Unknown HyperLogLog encoding");
+        goto error;
+    }
+
+    ei_check(cork_sketch_read_done(&reader));
+    return hll;
+
+error:
+    cork_hll_free(hll);
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Count-Min sketches
+ */
+
+/* Each of the depth rows uses a different hash function, which we derive
+ * from the two halves of a single cork_big_hash. */
+
+#define CORK_COUNT_MIN_MAGIC  0x43434d53  /* "CCMS" */
+
+struct cork_count_min {
+    size_t  width;
+    size_t  depth;
+    uint64_t  total;
+    uint64_t  *counters;
+};
+
+struct cork_count_min *
+cork_count_min_new(size_t width, size_t depth)
+{
+    struct cork_count_min  *cm = cork_new(struct cork_count_min);
+    assert(width > 0 && depth > 0);
+    cm->width = width;
+    cm->depth = depth;
+    cm->total = 0;
+    cm->counters = cork_calloc(width * depth, sizeof(uint64_t));
+    return cm;
+}
+
+void
+cork_count_min_free(struct cork_count_min *cm)
+{
+    free(cm->counters);
+    free(cm);
+}
+
+void
+cork_count_min_clear(struct cork_count_min *cm)
+{
+    memset(cm->counters, 0, cm->width * cm->depth * sizeof(uint64_t));
+    cm->total = 0;
+}
+
+uint64_t
+cork_count_min_total(const struct cork_count_min *cm)
+{
+    return cm->total;
+}
+
+#define cork_count_min_counter(cm, row, h1, h2) \
+    ((cm)->counters[(row) * (cm)->width + \
+                    (size_t) (((h1) + (row) * (h2)) % (cm)->width)])
+
+static inline void
+cork_count_min_add_hash_inline(struct cork_count_min *cm,
+                               cork_big_hash hash, uint64_t count)
+{
+    uint64_t  h1 = cork_u128_be64(hash.u128, 0);
+    uint64_t  h2 = cork_u128_be64(hash.u128, 1);
+    size_t  row;
+    for (row = 0; row < cm->depth; row++) {
+        cork_count_min_counter(cm, row, h1, h2) += count;
+    }
+    cm->total += count;
+}
+
+void
+cork_count_min_add_hash(struct cork_count_min *cm, cork_big_hash hash,
+                        uint64_t count)
+{
+    cork_count_min_add_hash_inline(cm, hash, count);
+}
+
+void
+cork_count_min_add_hashes(struct cork_count_min *cm,
+                          const cork_big_hash *hashes, size_t count)
+{
+    size_t  i;
+    for (i = 0; i < count; i++) {
+        cork_count_min_add_hash_inline(cm, hashes[i], 1);
+    }
+}
+
+void
+cork_count_min_add(struct cork_count_min *cm, const void *src, size_t len,
+                   uint64_t count)
+{
+    cork_count_min_add_hash_inline(cm, cork_sketch_hash(src, len), count);
+}
+
+uint64_t
+cork_count_min_estimate_hash(const struct cork_count_min *cm,
+                             cork_big_hash hash)
+{
+    uint64_t  h1 = cork_u128_be64(hash.u128, 0);
+    uint64_t  h2 = cork_u128_be64(hash.u128, 1);
+    uint64_t  result = UINT64_MAX;
+    size_t  row;
+    for (row = 0; row < cm->depth; row++) {
+        uint64_t  counter = cork_count_min_counter(cm, row, h1, h2);
+        if (counter < result) {
+            result = counter;
+        }
+    }
+    return result;
+}
+
+uint64_t
+cork_count_min_estimate(const struct cork_count_min *cm,
+                        const void *src, size_t len)
+{
+    return cork_count_min_estimate_hash(cm, cork_sketch_hash(src, len));
+}
+
+int
+cork_count_min_merge(struct cork_count_min *dest,
+                     const struct cork_count_min *src)
+{
+    size_t  i;
+    if (CORK_UNLIKELY(dest->width != src->width ||
+                      dest->depth != src->depth)) {
+        cork_sketch_mismatch_set("Count-Min sketches");
+        return -1;
+    }
+    for (i = 0; i < dest->width * dest->depth; i++) {
+        dest->counters[i] += src->counters[i];
+    }
+    dest->total += src->total;
+    return 0;
+}
+
+void
+cork_count_min_save(const struct cork_count_min *cm, struct cork_buffer *dest)
+{
+    size_t  i;
+    cork_sketch_append_u32(dest, CORK_COUNT_MIN_MAGIC);
+    cork_sketch_append_u8(dest, 1);
+    cork_sketch_append_u64(dest, cm->width);
+    cork_sketch_append_u64(dest, cm->depth);
+    cork_sketch_append_u64(dest, cm->total);
+    for (i = 0; i < cm->width * cm->depth; i++) {
+        cork_sketch_append_u64(dest, cm->counters[i]);
+    }
+}
+
+struct cork_count_min *
+cork_count_min_new_from_bytes(const void *src, size_t size)
+{
+    struct cork_sketch_reader  reader = { src, size };
+    struct cork_count_min  *cm;
+    uint64_t  width;
+    uint64_t  depth;
+    size_t  i;
+
+    rpi_check(cork_sketch_read_header(&reader, CORK_COUNT_MIN_MAGIC));
+    rpi_check(cork_sketch_read_u64(&reader, &width));
+    rpi_check(cork_sketch_read_u64(&reader, &depth));
+    /* Make sure that the counters are all there before allocating space for
+     * them. */
+    if (CORK_UNLIKELY(width == 0 || depth == 0 ||
+                      reader.size % sizeof(uint64_t) != 0 ||
+                      reader.size / sizeof(uint64_t) == 0 ||
+                      width > (reader.size / sizeof(uint64_t) - 1) / depth ||
+                      width * depth !=
+                      reader.size / sizeof(uint64_t) - 1)) {
+        cork_sketch_invalid_set("Bad Count-Min dimensions");
+        return NULL;
+    }
+
+    cm = cork_count_min_new(width, depth);
+    ei_check(cork_sketch_read_u64(&reader, &cm->total));
+    for (i = 0; i < cm->width * cm->depth; i++) {
+        ei_check(cork_sketch_read_u64(&reader, &cm->counters[i]));
+    }
+    return cm;
+
+error:
+    cork_count_min_free(cm);
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Space-Saving top-k
+ */
+
+/* We keep at most capacity counters.  The counters are arranged in a binary
+ * min-heap ordered by count, and are also indexed by key in a hash table.
+ * When we see a key that isn't being tracked and we're out of counters, we
+ * take over the counter with the smallest count, and record that count as
+ * the new key's possible overestimate. */
+
+#define CORK_TOP_K_MAGIC  0x43544f50  /* "CTOP" */
+
+struct cork_top_k_counter {
+    struct cork_top_k_entry  public;
+    cork_hash  hash;
+    size_t  heap_index;
+};
+
+struct cork_top_k {
+    size_t  capacity;
+    size_t  size;
+    struct cork_top_k_counter  **heap;
+    struct cork_hash_table  table;
+};
+
+static cork_hash
+cork_top_k_counter_hash(const void *vcounter)
+{
+    const struct cork_top_k_counter  *counter = vcounter;
+    return counter->hash;
+}
+
+static bool
+cork_top_k_counter_equals(const void *vc1, const void *vc2)
+{
+    const struct cork_top_k_counter  *c1 = vc1;
+    const struct cork_top_k_counter  *c2 = vc2;
+    return c1->public.key_size == c2->public.key_size &&
+        memcmp(c1->public.key, c2->public.key, c1->public.key_size) == 0;
+}
+
+struct cork_top_k *
+cork_top_k_new(size_t capacity)
+{
+    struct cork_top_k  *top_k = cork_new(struct cork_top_k);
+    assert(capacity > 0);
+    top_k->capacity = capacity;
+    top_k->size = 0;
+    top_k->heap = cork_calloc(capacity, sizeof(struct cork_top_k_counter *));
+    cork_hash_table_init
+        (&top_k->table, capacity,
+         cork_top_k_counter_hash, cork_top_k_counter_equals);
+    return top_k;
+}
+
+static void
+cork_top_k_counter_free(struct cork_top_k_counter *counter)
+{
+    free((void *) counter->public.key);
+    free(counter);
+}
+
+void
+cork_top_k_clear(struct cork_top_k *top_k)
+{
+    size_t  i;
+    cork_hash_table_clear(&top_k->table);
+    for (i = 0; i < top_k->size; i++) {
+        cork_top_k_counter_free(top_k->heap[i]);
+    }
+    top_k->size = 0;
+}
+
+void
+cork_top_k_free(struct cork_top_k *top_k)
+{
+    cork_top_k_clear(top_k);
+    cork_hash_table_done(&top_k->table);
+    free(top_k->heap);
+    free(top_k);
+}
+
+size_t
+cork_top_k_size(const struct cork_top_k *top_k)
+{
+    return top_k->size;
+}
+
+#define cork_top_k_heap_set(top_k, i, counter) \
+    do { \
+        (top_k)->heap[(i)] = (counter); \
+        (counter)->heap_index = (i); \
+    } while (0)
+
+static void
+cork_top_k_sift_up(struct cork_top_k *top_k, size_t i)
+{
+    struct cork_top_k_counter  *counter = top_k->heap[i];
+    while (i > 0) {
+        size_t  parent = (i - 1) / 2;
+        if (top_k->heap[parent]->public.count <= counter->public.count) {
+            break;
+        }
+        cork_top_k_heap_set(top_k, i, top_k->heap[parent]);
+        i = parent;
+    }
+    cork_top_k_heap_set(top_k, i, counter);
+}
+
+static void
+cork_top_k_sift_down(struct cork_top_k *top_k, size_t i)
+{
+    struct cork_top_k_counter  *counter = top_k->heap[i];
+    while (true) {
+        size_t  child = 2 * i + 1;
+        if (child >= top_k->size) {
+            break;
+        }
+        if (child + 1 < top_k->size &&
+            top_k->heap[child + 1]->public.count <
+            top_k->heap[child]->public.count) {
+            child++;
+        }
+        if (counter->public.count <= top_k->heap[child]->public.count) {
+            break;
+        }
+        cork_top_k_heap_set(top_k, i, top_k->heap[child]);
+        i = child;
+    }
+    cork_top_k_heap_set(top_k, i, counter);
+}
+
+static struct cork_top_k_counter *
+cork_top_k_add_internal(struct cork_top_k *top_k,
+                        const void *key, size_t key_size, uint64_t count)
+{
+    struct cork_top_k_counter  lookup;
+    struct cork_top_k_counter  *counter;
+    void  *key_copy;
+
+    lookup.public.key = key;
+    lookup.public.key_size = key_size;
+    lookup.hash = cork_hash_buffer(0, key, key_size);
+    counter = cork_hash_table_get(&top_k->table, &lookup);
+    if (counter != NULL) {
+        counter->public.count += count;
+        cork_top_k_sift_down(top_k, counter->heap_index);
+        return counter;
+    }
+
+    key_copy = cork_malloc(key_size + 1);
+    memcpy(key_copy, key, key_size);
+
+    if (top_k->size < top_k->capacity) {
+        counter = cork_new(struct cork_top_k_counter);
+        counter->public.key = key_copy;
+        counter->public.key_size = key_size;
+        counter->public.count = count;
+        counter->public.error = 0;
+        counter->hash = lookup.hash;
+        cork_top_k_heap_set(top_k, top_k->size, counter);
+        top_k->size++;
+        cork_top_k_sift_up(top_k, counter->heap_index);
+    } else {
+        counter = top_k->heap[0];
+        cork_hash_table_delete(&top_k->table, counter, NULL, NULL);
+        free((void *) counter->public.key);
+        counter->public.key = key_copy;
+        counter->public.key_size = key_size;
+        counter->public.error = counter->public.count;
+        counter->public.count += count;
+        counter->hash = lookup.hash;
+        cork_top_k_sift_down(top_k, 0);
+    }
+
+    cork_hash_table_put(&top_k->table, counter, counter, NULL, NULL, NULL);
+    return counter;
+}
+
+void
+cork_top_k_add(struct cork_top_k *top_k, const void *key, size_t key_size,
+               uint64_t count)
+{
+    cork_top_k_add_internal(top_k, key, key_size, count);
+}
+
+static int
+cork_top_k_entry_compare(const void *va, const void *vb)
+{
+    const struct cork_top_k_entry  *a = va;
+    const struct cork_top_k_entry  *b = vb;
+    return (a->count > b->count)? -1: (a->count < b->count)? 1: 0;
+}
+
+size_t
+cork_top_k_get(const struct cork_top_k *top_k,
+               struct cork_top_k_entry *dest, size_t count)
+{
+    size_t  i;
+    struct cork_top_k_entry  *all;
+
+    all = cork_calloc(top_k->size + 1, sizeof(struct cork_top_k_entry));
+    for (i = 0; i < top_k->size; i++) {
+        all[i] = top_k->heap[i]->public;
+    }
+    qsort(all, top_k->size, sizeof(struct cork_top_k_entry),
+          cork_top_k_entry_compare);
+
+    if (count > top_k->size) {
+        count = top_k->size;
+    }
+    memcpy(dest, all, count * sizeof(struct cork_top_k_entry));
+    free(all);
+    return count;
+}
+
+void
+cork_top_k_merge(struct cork_top_k *dest, const struct cork_top_k *src)
+{
+    size_t  i;
+    for (i = 0; i < src->size; i++) {
+        const struct cork_top_k_entry  *entry = &src->heap[i]->public;
+        struct cork_top_k_counter  *counter = cork_top_k_add_internal
+            (dest, entry->key, entry->key_size, entry->count);
+        counter->public.error += entry->error;
+    }
+}
+
+void
+cork_top_k_save(const struct cork_top_k *top_k, struct cork_buffer *dest)
+{
+    size_t  i;
+    cork_sketch_append_u32(dest, CORK_TOP_K_MAGIC);
+    cork_sketch_append_u8(dest, 1);
+    cork_sketch_append_u64(dest, top_k->capacity);
+    cork_sketch_append_u64(dest, top_k->size);
+    for (i = 0; i < top_k->size; i++) {
+        const struct cork_top_k_entry  *entry = &top_k->heap[i]->public;
+        cork_sketch_append_u64(dest, entry->count);
+        cork_sketch_append_u64(dest, entry->error);
+        cork_sketch_append_u32(dest, entry->key_size);
+        cork_buffer_append(dest, entry->key, entry->key_size);
+    }
+}
+
+struct cork_top_k *
+cork_top_k_new_from_bytes(const void *src, size_t size)
+{
+    struct cork_sketch_reader  reader = { src, size };
+    struct cork_top_k  *top_k;
+    uint64_t  capacity;
+    uint64_t  count;
+    size_t  i;
+
+    rpi_check(cork_sketch_read_header(&reader, CORK_TOP_K_MAGIC));
+    rpi_check(cork_sketch_read_u64(&reader, &capacity));
+    rpi_check(cork_sketch_read_u64(&reader, &count));
+    /* Each counter needs at least 20 bytes. */
+    if (CORK_UNLIKELY(capacity == 0 || capacity > CORK_TOP_K_MAX_CAPACITY ||
+                      count > capacity || count > reader.size / 20)) {
+        cork_sketch_invalid_set("Bad top-k size");
+        return NULL;
+    }
+
+    top_k = cork_top_k_new(capacity);
+    for (i = 0; i < count; i++) {
+        struct cork_top_k_counter  *counter;
+        uint64_t  key_count;
+        uint64_t  error;
+        uint32_t  key_size;
+        ei_check(cork_sketch_read_u64(&reader, &key_count));
+        ei_check(cork_sketch_read_u64(&reader, &error));
+        ei_check(cork_sketch_read_u32(&reader, &key_size));
+        if (CORK_UNLIKELY(reader.size < key_size || error > key_count)) {
+            cork_sketch_invalid_set("Bad top-k counter");
+            goto error;
+        }
+        counter = cork_top_k_add_internal
+            (top_k, reader.buf, key_size, key_count);
+        counter->public.error = error;
+        reader.buf += key_size;
+        reader.size -= key_size;
+    }
+    ei_check(cork_sketch_read_done(&reader));
+    return top_k;
+
+error:
+    cork_top_k_free(top_k);
+    return NULL;
+}
@@ -0,0 +1,494 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/callbacks.h"
+#include "libcork/core/mempool.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/skip-list.h"
+#include "libcork/ds/slist.h"
+#include "libcork/threads/atomic-stack.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
+
+
+/*-----------------------------------------------------------------------
+ * Skip lists
+ */
+
+/* This is the "lazy" skip list of Herlihy, Lev, Luchangco, and Shavit.
+ * Readers never take a lock; they just follow the next pointers, skipping
+ * over any nodes that are only partially linked in or that have been marked
+ * for deletion.  Writers lock the predecessors of the node that they're
+ * adding or removing, check that nothing has changed underneath them, and
+ * then link or unlink the node one level at a time.
+ *
+ * A deleted node might still be being read by some other thread, so we can't
+ * reuse its memory right away.  Instead we push it onto a retired stack, and
+ * the caller frees everything on that stack when it knows that there are no
+ * readers (cork_skip_list_reclaim). */
+
+/* With a branching factor of 4, this is enough for 2^48 entries. */
+#define CORK_SKIP_LIST_MAX_HEIGHT  24
+
+struct cork_skip_list_node {
+    /* Must be first, so that we can cast between the two types. */
+    struct cork_skip_list_entry  entry;
+    struct cork_spinlock  lock;
+    unsigned int  height;
+    volatile bool  marked;
+    volatile bool  fully_linked;
+    /* A link in the list's retired stack. */
+    struct cork_slist_item  retired;
+    struct cork_skip_list_node * volatile  next[];
+};
+
+#define cork_skip_list_node_size(height) \
+    (sizeof(struct cork_skip_list_node) + \
+     (height) * sizeof(struct cork_skip_list_node *))
+
+struct cork_skip_list {
+    cork_skip_list_comparator  comparator;
+    cork_free_f  free_key;
+    cork_free_f  free_value;
+    volatile size_t  size;
+    /* Used to choose the height of each new node. */
+    volatile unsigned int  seed;
+    /* A sentinel at the start of the list, which has the maximum height. */
+    struct cork_skip_list_node  *head;
+    /* Nodes of each height are allocated from a separate memory pool, which
+     * is created the first time we need it.  The pools aren't thread-safe,
+     * so they're protected by a lock of their own. */
+    struct cork_spinlock  pool_lock;
+    struct cork_mempool  *pools[CORK_SKIP_LIST_MAX_HEIGHT];
+    struct cork_atomic_stack  retired;
+};
+
+
+static struct cork_skip_list_node *
+cork_skip_list_node_new(struct cork_skip_list *list, unsigned int height)
+{
+    struct cork_skip_list_node  *node;
+    struct cork_mempool  **pool = &list->pools[height - 1];
+    unsigned int  i;
+
+    cork_spinlock_lock(&list->pool_lock);
+    if (CORK_UNLIKELY(*pool == NULL)) {
+        *pool = cork_mempool_new_size(cork_skip_list_node_size(height));
+    }
+    node = cork_mempool_new_object_fast(*pool);
+    cork_spinlock_unlock(&list->pool_lock);
+
+    cork_spinlock_init(&node->lock);
+    node->height = height;
+    node->marked = false;
+    node->fully_linked = false;
+    for (i = 0; i < height; i++) {
+        node->next[i] = NULL;
+    }
+    return node;
+}
+
+static void
+cork_skip_list_node_free(struct cork_skip_list *list,
+                         struct cork_skip_list_node *node)
+{
+    if (list->free_key != NULL) {
+        list->free_key(node->entry.key);
+    }
+    if (list->free_value != NULL) {
+        list->free_value(node->entry.value);
+    }
+    cork_spinlock_lock(&list->pool_lock);
+    cork_mempool_free_object_fast(list->pools[node->height - 1], node);
+    cork_spinlock_unlock(&list->pool_lock);
+}
+
+/* Each node has height h with probability (3/4) * (1/4)^(h-1). */
+static unsigned int
+cork_skip_list_random_height(struct cork_skip_list *list)
+{
+    unsigned int  height = 1;
+    uint32_t  bits = cork_uint_atomic_add(&list->seed, 0x9e3779b9U);
+    /* Scramble the counter, using the MurmurHash3 finalizer. */
+    bits ^= bits >> 16;
+    bits *= 0x85ebca6bU;
+    bits ^= bits >> 13;
+    bits *= 0xc2b2ae35U;
+    bits ^= bits >> 16;
+    while ((bits & 0x03) == 0 && height < CORK_SKIP_LIST_MAX_HEIGHT) {
+        height++;
+        bits >>= 2;
+        if (bits == 0) {
+            break;
+        }
+    }
+    return height;
+}
+
+
+struct cork_skip_list *
+cork_skip_list_new(cork_skip_list_comparator comparator)
+{
+    struct cork_skip_list  *list = cork_new(struct cork_skip_list);
+    unsigned int  i;
+    list->comparator = comparator;
+    list->free_key = NULL;
+    list->free_value = NULL;
+    list->size = 0;
+    list->seed = 0;
+    cork_spinlock_init(&list->pool_lock);
+    for (i = 0; i < CORK_SKIP_LIST_MAX_HEIGHT; i++) {
+        list->pools[i] = NULL;
+    }
+    cork_atomic_stack_init(&list->retired);
+    list->head = cork_malloc
+        (cork_skip_list_node_size(CORK_SKIP_LIST_MAX_HEIGHT));
+    list->head->entry.key = NULL;
+    list->head->entry.value = NULL;
+    cork_spinlock_init(&list->head->lock);
+    list->head->height = CORK_SKIP_LIST_MAX_HEIGHT;
+    list->head->marked = false;
+    list->head->fully_linked = true;
+    for (i = 0; i < CORK_SKIP_LIST_MAX_HEIGHT; i++) {
+        list->head->next[i] = NULL;
+    }
+    return list;
+}
+
+void
+cork_skip_list_free(struct cork_skip_list *list)
+{
+    struct cork_skip_list_node  *curr;
+    unsigned int  i;
+
+    cork_skip_list_reclaim(list);
+    for (curr = list->head->next[0]; curr != NULL; ) {
+        struct cork_skip_list_node  *next = curr->next[0];
+        cork_skip_list_node_free(list, curr);
+        curr = next;
+    }
+    for (i = 0; i < CORK_SKIP_LIST_MAX_HEIGHT; i++) {
+        if (list->pools[i] != NULL) {
+            cork_mempool_free(list->pools[i]);
+        }
+    }
+    free(list->head);
+    free(list);
+}
+
+void
+cork_skip_list_set_free_key(struct cork_skip_list *list, cork_free_f free_key)
+{
+    list->free_key = free_key;
+}
+
+void
+cork_skip_list_set_free_value(struct cork_skip_list *list,
+                              cork_free_f free_value)
+{
+    list->free_value = free_value;
+}
+
+size_t
+cork_skip_list_size(const struct cork_skip_list *list)
+{
+    return list->size;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Searching
+ */
+
+/* Fills in the predecessor and successor of key at every level, and returns
+ * the highest level at which key was found, or -1 if it wasn't. */
+static int
+cork_skip_list_find(const struct cork_skip_list *list, const void *key,
+                    struct cork_skip_list_node **preds,
+                    struct cork_skip_list_node **succs)
+{
+    int  found_level = -1;
+    int  level;
+    struct cork_skip_list_node  *pred = list->head;
+    for (level = CORK_SKIP_LIST_MAX_HEIGHT - 1; level >= 0; level--) {
+        struct cork_skip_list_node  *curr = pred->next[level];
+        int  cmp = 1;
+        while (curr != NULL &&
+               (cmp = list->comparator(key, curr->entry.key)) > 0) {
+            pred = curr;
+            curr = pred->next[level];
+        }
+        if (found_level == -1 && curr != NULL && cmp == 0) {
+            found_level = level;
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return found_level;
+}
+
+/* Returns the first node whose key is greater than or equal to key.  We can
+ * stop descending as soon as we find an exact match. */
+static struct cork_skip_list_node *
+cork_skip_list_find_ge(const struct cork_skip_list *list, const void *key)
+{
+    int  level;
+    struct cork_skip_list_node  *pred = list->head;
+    struct cork_skip_list_node  *curr = NULL;
+    for (level = CORK_SKIP_LIST_MAX_HEIGHT - 1; level >= 0; level--) {
+        int  cmp = 1;
+        curr = pred->next[level];
+        while (curr != NULL &&
+               (cmp = list->comparator(key, curr->entry.key)) > 0) {
+            pred = curr;
+            curr = pred->next[level];
+        }
+        if (cmp == 0 && curr != NULL) {
+            return curr;
+        }
+    }
+    return curr;
+}
+
+struct cork_skip_list_entry *
+cork_skip_list_get_entry(const struct cork_skip_list *list, const void *key)
+{
+    struct cork_skip_list_node  *node = cork_skip_list_find_ge(list, key);
+    if (node != NULL && node->fully_linked && !node->marked &&
+        list->comparator(key, node->entry.key) == 0) {
+        return &node->entry;
+    }
+    return NULL;
+}
+
+void *
+cork_skip_list_get(const struct cork_skip_list *list, const void *key)
+{
+    struct cork_skip_list_entry  *entry = cork_skip_list_get_entry(list, key);
+    return (entry == NULL)? NULL: entry->value;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Updating
+ */
+
+/* Locks each distinct predecessor in preds[0..height). */
+static void
+cork_skip_list_lock_preds(struct cork_skip_list_node **preds,
+                          unsigned int height)
+{
+    unsigned int  level;
+    for (level = 0; level < height; level++) {
+        if (level == 0 || preds[level] != preds[level - 1]) {
+            cork_spinlock_lock(&preds[level]->lock);
+        }
+    }
+}
+
+static void
+cork_skip_list_unlock_preds(struct cork_skip_list_node **preds,
+                            unsigned int height)
+{
+    unsigned int  level;
+    for (level = 0; level < height; level++) {
+        if (level == 0 || preds[level] != preds[level - 1]) {
+            cork_spinlock_unlock(&preds[level]->lock);
+        }
+    }
+}
+
+void
+cork_skip_list_put(struct cork_skip_list *list, void *key, void *value,
+                   bool *is_new, void **old_value)
+{
+    struct cork_skip_list_node  *preds[CORK_SKIP_LIST_MAX_HEIGHT];
+    struct cork_skip_list_node  *succs[CORK_SKIP_LIST_MAX_HEIGHT];
+    unsigned int  height = cork_skip_list_random_height(list);
+
+    while (true) {
+        struct cork_skip_list_node  *node;
+        unsigned int  level;
+        bool  valid = true;
+        int  found_level = cork_skip_list_find(list, key, preds, succs);
+
+        if (found_level != -1) {
+            node = succs[found_level];
+            if (!node->marked) {
+                /* Wait for whoever is adding the node to finish. */
+                while (!node->fully_linked) {
+                    cork_pause();
+                }
+                cork_spinlock_lock(&node->lock);
+                if (CORK_UNLIKELY(node->marked)) {
+                    /* It was deleted in the meantime; try again. */
+                    cork_spinlock_unlock(&node->lock);
+                    continue;
+                }
+                if (old_value != NULL) {
+                    *old_value = node->entry.value;
+                }
+                node->entry.value = value;
+                cork_spinlock_unlock(&node->lock);
+                if (is_new != NULL) {
+                    *is_new = false;
+                }
+                return;
+            }
+            /* The node is being deleted; try again once it's gone. */
+            cork_pause();
+            continue;
+        }
+
+        cork_skip_list_lock_preds(preds, height);
+        for (level = 0; valid && level < height; level++) {
+            valid = !preds[level]->marked &&
+                (succs[level] == NULL || !succs[level]->marked) &&
+                preds[level]->next[level] == succs[level];
+        }
+        if (CORK_UNLIKELY(!valid)) {
+            cork_skip_list_unlock_preds(preds, height);
+            continue;
+        }
+
+        node = cork_skip_list_node_new(list, height);
+        node->entry.key = key;
+        node->entry.value = value;
+        for (level = 0; level < height; level++) {
+            node->next[level] = succs[level];
+        }
+        /* Make sure the node's contents are visible before the node is. */
+        cork_memory_barrier();
+        for (level = 0; level < height; level++) {
+            preds[level]->next[level] = node;
+        }
+        node->fully_linked = true;
+        cork_skip_list_unlock_preds(preds, height);
+        cork_uint_atomic_add(&list->size, 1);
+        if (is_new != NULL) {
+            *is_new = true;
+        }
+        if (old_value != NULL) {
+            *old_value = NULL;
+        }
+        return;
+    }
+}
+
+bool
+cork_skip_list_delete(struct cork_skip_list *list, const void *key)
+{
+    struct cork_skip_list_node  *preds[CORK_SKIP_LIST_MAX_HEIGHT];
+    struct cork_skip_list_node  *succs[CORK_SKIP_LIST_MAX_HEIGHT];
+    struct cork_skip_list_node  *victim = NULL;
+
+    while (true) {
+        int  found_level = cork_skip_list_find(list, key, preds, succs);
+        unsigned int  level;
+        bool  valid = true;
+
+        if (victim == NULL) {
+            struct cork_skip_list_node  *node;
+            if (found_level == -1) {
+                return false;
+            }
+            /* Only delete a node that's been fully added, and that we found
+             * at its top level (otherwise we can't be sure that we have the
+             * right predecessor at every level). */
+            node = succs[found_level];
+            if (!node->fully_linked || node->marked ||
+                (unsigned int) found_level != node->height - 1) {
+                if (node->marked) {
+                    return false;
+                }
+                cork_pause();
+                continue;
+            }
+            cork_spinlock_lock(&node->lock);
+            if (node->marked) {
+                cork_spinlock_unlock(&node->lock);
+                return false;
+            }
+            node->marked = true;
+            victim = node;
+        }
+
+        cork_skip_list_lock_preds(preds, victim->height);
+        for (level = 0; valid && level < victim->height; level++) {
+            valid = !preds[level]->marked &&
+                preds[level]->next[level] == victim;
+        }
+        if (CORK_UNLIKELY(!valid)) {
+            cork_skip_list_unlock_preds(preds, victim->height);
+            continue;
+        }
+
+        for (level = victim->height; level-- > 0; ) {
+            preds[level]->next[level] = victim->next[level];
+        }
+        cork_spinlock_unlock(&victim->lock);
+        cork_skip_list_unlock_preds(preds, victim->height);
+        cork_uint_atomic_sub(&list->size, 1);
+        cork_atomic_stack_push(&list->retired, &victim->retired);
+        return true;
+    }
+}
+
+void
+cork_skip_list_reclaim(struct cork_skip_list *list)
+{
+    struct cork_slist_item  *curr = cork_atomic_stack_pop_all(&list->retired);
+    while (curr != NULL) {
+        struct cork_slist_item  *next = curr->next;
+        cork_skip_list_node_free
+            (list, cork_container_of(curr, struct cork_skip_list_node,
+                                     retired));
+        curr = next;
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Iterating
+ */
+
+void
+cork_skip_list_iterator_init(const struct cork_skip_list *list,
+                             struct cork_skip_list_iterator *iterator)
+{
+    iterator->next = list->head->next[0];
+}
+
+void
+cork_skip_list_iterator_init_at(const struct cork_skip_list *list,
+                                struct cork_skip_list_iterator *iterator,
+                                const void *key)
+{
+    iterator->next = cork_skip_list_find_ge(list, key);
+}
+
+struct cork_skip_list_entry *
+cork_skip_list_iterator_next(struct cork_skip_list_iterator *iterator)
+{
+    struct cork_skip_list_node  *curr = iterator->next;
+    /* Skip over nodes that are being added or deleted. */
+    while (curr != NULL && (!curr->fully_linked || curr->marked)) {
+        curr = curr->next[0];
+    }
+    if (curr == NULL) {
+        iterator->next = NULL;
+        return NULL;
+    }
+    iterator->next = curr->next[0];
+    return &curr->entry;
+}
@@ -0,0 +1,64 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include "libcork/core/api.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/slist.h"
+
+
+static void
+cork_slist_item_map(struct cork_slist_item *curr,
+                    cork_slist_map_func func, void *user_data)
+{
+    while (curr != NULL) {
+        /* Extract the next pointer now, just in case func frees the
+         * list item. */
+        struct cork_slist_item  *next = curr->next;
+        func(curr, user_data);
+        curr = next;
+    }
+}
+
+static size_t
+cork_slist_item_count(const struct cork_slist_item *curr)
+{
+    size_t  size = 0;
+    for (; curr != NULL; curr = curr->next) {
+        size++;
+    }
+    return size;
+}
+
+
+void
+cork_slist_map(struct cork_slist *list,
+               cork_slist_map_func func, void *user_data)
+{
+    cork_slist_item_map(list->head, func, user_data);
+}
+
+size_t
+cork_slist_size(const struct cork_slist *list)
+{
+    return cork_slist_item_count(list->head);
+}
+
+
+void
+cork_stailq_map(struct cork_stailq *queue,
+                cork_slist_map_func func, void *user_data)
+{
+    cork_slist_item_map(queue->head, func, user_data);
+}
+
+size_t
+cork_stailq_size(const struct cork_stailq *queue)
+{
+    return cork_slist_item_count(queue->head);
+}
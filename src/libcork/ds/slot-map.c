@@ -0,0 +1,231 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/slot-map.h"
+
+
+/*-----------------------------------------------------------------------
+ * Slot maps
+ */
+
+/* A slot's generation is odd while it holds a live value, and even while it's
+ * on the free list.  That means that CORK_SLOT_HANDLE_NONE (generation 0) is
+ * never valid, and neither is a handle for a free slot. */
+
+#define CORK_SLOT_MAP_NO_SLOT  UINT32_MAX
+
+struct cork_slot {
+    uint32_t  generation;
+    /* The index of the slot's value in the dense array if the slot is live;
+     * otherwise the next slot on the free list. */
+    uint32_t  index;
+};
+
+struct cork_slot_map_priv {
+    cork_array(struct cork_slot)  slots;
+    /* The slot that owns each value in the dense array. */
+    cork_array(uint32_t)  owners;
+    uint32_t  free_head;
+};
+
+#define cork_slot_handle_new(generation, index) \
+    ((((cork_slot_handle) (generation)) << 32) | (index))
+#define cork_slot_handle_generation(handle)  ((uint32_t) ((handle) >> 32))
+#define cork_slot_handle_index(handle)  ((uint32_t) (handle))
+
+void
+cork_raw_slot_map_init(struct cork_raw_slot_map *map, size_t element_size)
+{
+    cork_raw_array_init(&map->values, element_size);
+    map->priv = cork_new(struct cork_slot_map_priv);
+    cork_array_init(&map->priv->slots);
+    cork_array_init(&map->priv->owners);
+    map->priv->free_head = CORK_SLOT_MAP_NO_SLOT;
+}
+
+void
+cork_raw_slot_map_done(struct cork_raw_slot_map *map)
+{
+    cork_raw_array_done(&map->values);
+    cork_array_done(&map->priv->slots);
+    cork_array_done(&map->priv->owners);
+    free(map->priv);
+}
+
+void
+cork_raw_slot_map_clear(struct cork_raw_slot_map *map)
+{
+    size_t  i;
+    /* Free each live slot, so that existing handles become stale. */
+    for (i = 0; i < map->values.size; i++) {
+        uint32_t  slot_index = cork_array_at(&map->priv->owners, i);
+        struct cork_slot  *slot = &cork_array_at(&map->priv->slots, slot_index);
+        slot->generation++;
+        slot->index = map->priv->free_head;
+        map->priv->free_head = slot_index;
+    }
+    cork_raw_array_clear(&map->values);
+    cork_array_clear(&map->priv->owners);
+}
+
+void *
+cork_raw_slot_map_insert(struct cork_raw_slot_map *map,
+                         cork_slot_handle *handle)
+{
+    struct cork_slot_map_priv  *priv = map->priv;
+    uint32_t  slot_index;
+    struct cork_slot  *slot;
+
+    if (priv->free_head != CORK_SLOT_MAP_NO_SLOT) {
+        slot_index = priv->free_head;
+        slot = &cork_array_at(&priv->slots, slot_index);
+        priv->free_head = slot->index;
+    } else {
+        assert(cork_array_size(&priv->slots) < CORK_SLOT_MAP_NO_SLOT);
+        slot_index = cork_array_size(&priv->slots);
+        slot = cork_array_append_get(&priv->slots);
+        slot->generation = 0;
+    }
+
+    slot->generation++;
+    slot->index = map->values.size;
+    cork_array_append(&priv->owners, slot_index);
+    if (handle != NULL) {
+        *handle = cork_slot_handle_new(slot->generation, slot_index);
+    }
+    return cork_raw_array_append(&map->values);
+}
+
+static struct cork_slot *
+cork_raw_slot_map_find(const struct cork_raw_slot_map *map,
+                       cork_slot_handle handle)
+{
+    uint32_t  slot_index = cork_slot_handle_index(handle);
+    uint32_t  generation = cork_slot_handle_generation(handle);
+    struct cork_slot  *slot;
+    if (CORK_UNLIKELY(slot_index >= cork_array_size(&map->priv->slots) ||
+                      (generation & 1) == 0)) {
+        return NULL;
+    }
+    slot = &cork_array_at(&map->priv->slots, slot_index);
+    return (slot->generation == generation)? slot: NULL;
+}
+
+void *
+cork_raw_slot_map_get(const struct cork_raw_slot_map *map,
+                      cork_slot_handle handle)
+{
+    struct cork_slot  *slot = cork_raw_slot_map_find(map, handle);
+    if (CORK_UNLIKELY(slot == NULL)) {
+        return NULL;
+    }
+    return cork_raw_array_at(&map->values, slot->index);
+}
+
+bool
+cork_raw_slot_map_remove(struct cork_raw_slot_map *map,
+                         cork_slot_handle handle)
+{
+    struct cork_slot_map_priv  *priv = map->priv;
+    struct cork_slot  *slot = cork_raw_slot_map_find(map, handle);
+    size_t  last;
+
+    if (CORK_UNLIKELY(slot == NULL)) {
+        return false;
+    }
+
+    /* Fill the hole in the dense array with its last value. */
+    last = map->values.size - 1;
+    if (slot->index != last) {
+        uint32_t  moved_slot = cork_array_at(&priv->owners, last);
+        memcpy(cork_raw_array_at(&map->values, slot->index),
+               cork_raw_array_at(&map->values, last),
+               cork_raw_array_element_size(&map->values));
+        cork_array_at(&priv->owners, slot->index) = moved_slot;
+        cork_array_at(&priv->slots, moved_slot).index = slot->index;
+    }
+    /* The values array doesn't have any callbacks, so we can shrink it
+     * directly. */
+    map->values.size--;
+    priv->owners.size--;
+
+    slot->generation++;
+    slot->index = priv->free_head;
+    priv->free_head = cork_slot_handle_index(handle);
+    return true;
+}
+
+cork_slot_handle
+cork_raw_slot_map_handle_at(const struct cork_raw_slot_map *map, size_t index)
+{
+    uint32_t  slot_index = cork_array_at(&map->priv->owners, index);
+    return cork_slot_handle_new
+        (cork_array_at(&map->priv->slots, slot_index).generation, slot_index);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Sparse sets
+ */
+
+struct cork_sparse_set *
+cork_sparse_set_new(size_t universe)
+{
+    struct cork_sparse_set  *set = cork_new(struct cork_sparse_set);
+    assert((uint64_t) universe <= UINT32_MAX);
+    set->dense = cork_calloc(universe, sizeof(uint32_t));
+    set->sparse = cork_calloc(universe, sizeof(uint32_t));
+    set->size = 0;
+    set->universe = universe;
+    return set;
+}
+
+void
+cork_sparse_set_free(struct cork_sparse_set *set)
+{
+    free(set->dense);
+    free(set->sparse);
+    free(set);
+}
+
+bool
+cork_sparse_set_add(struct cork_sparse_set *set, uint32_t value)
+{
+    assert(value < set->universe);
+    if (cork_sparse_set_contains(set, value)) {
+        return false;
+    }
+    set->dense[set->size] = value;
+    set->sparse[value] = set->size;
+    set->size++;
+    return true;
+}
+
+bool
+cork_sparse_set_remove(struct cork_sparse_set *set, uint32_t value)
+{
+    uint32_t  index;
+    uint32_t  last;
+    assert(value < set->universe);
+    if (!cork_sparse_set_contains(set, value)) {
+        return false;
+    }
+    index = set->sparse[value];
+    last = set->dense[--set->size];
+    set->dense[index] = last;
+    set->sparse[last] = index;
+    return true;
+}
@@ -0,0 +1,443 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/stream.h"
+#include "libcork/threads/basics.h"
+#include "libcork/helpers/errors.h"
+#include "libcork/helpers/posix.h"
+
+
+/*-----------------------------------------------------------------------
+ * File producers
+ */
+
+struct cork_fd_producer {
+    struct cork_stream_producer  parent;
+    int  fd;
+};
+
+static ssize_t
+cork_fd_producer__read(struct cork_stream_producer *vself,
+                       void *buf, size_t size)
+{
+    struct cork_fd_producer  *self =
+        cork_container_of(vself, struct cork_fd_producer, parent);
+    while (true) {
+        ssize_t  bytes_read = read(self->fd, buf, size);
+        if (bytes_read >= 0) {
+            return bytes_read;
+        } else if (errno != EINTR) {
+            cork_system_error_set();
+            return -1;
+        }
+    }
+}
+
+static void
+cork_fd_producer__free(struct cork_stream_producer *vself)
+{
+    struct cork_fd_producer  *self =
+        cork_container_of(vself, struct cork_fd_producer, parent);
+    free(self);
+}
+
+struct cork_stream_producer *
+cork_fd_producer_new(int fd)
+{
+    struct cork_fd_producer  *self = cork_new(struct cork_fd_producer);
+    self->parent.read = cork_fd_producer__read;
+    self->parent.borrow = NULL;
+    self->parent.free = cork_fd_producer__free;
+    self->fd = fd;
+    return &self->parent;
+}
+
+
+struct cork_file_producer {
+    struct cork_stream_producer  parent;
+    FILE  *fp;
+};
+
+static ssize_t
+cork_file_producer__read(struct cork_stream_producer *vself,
+                         void *buf, size_t size)
+{
+    struct cork_file_producer  *self =
+        cork_container_of(vself, struct cork_file_producer, parent);
+    while (true) {
+        size_t  bytes_read = fread(buf, 1, size, self->fp);
+        if (bytes_read > 0 || feof(self->fp)) {
+            return bytes_read;
+        } else if (errno != EINTR) {
+            cork_system_error_set();
+            return -1;
+        }
+        clearerr(self->fp);
+    }
+}
+
+static void
+cork_file_producer__free(struct cork_stream_producer *vself)
+{
+    struct cork_file_producer  *self =
+        cork_container_of(vself, struct cork_file_producer, parent);
+    free(self);
+}
+
+struct cork_stream_producer *
+cork_file_producer_new(FILE *fp)
+{
+    struct cork_file_producer  *self = cork_new(struct cork_file_producer);
+    self->parent.read = cork_file_producer__read;
+    self->parent.borrow = NULL;
+    self->parent.free = cork_file_producer__free;
+    self->fp = fp;
+    return &self->parent;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Memory producers
+ */
+
+/* Used for both mapped files and caller-provided buffers; the only
+ * difference is whether we have to unmap the data when we're done. */
+struct cork_memory_producer {
+    struct cork_stream_producer  parent;
+    const uint8_t  *buf;
+    size_t  size;
+    size_t  pos;
+    bool  mapped;
+};
+
+static ssize_t
+cork_memory_producer__read(struct cork_stream_producer *vself,
+                           void *buf, size_t size)
+{
+    struct cork_memory_producer  *self =
+        cork_container_of(vself, struct cork_memory_producer, parent);
+    if (size > self->size - self->pos) {
+        size = self->size - self->pos;
+    }
+    memcpy(buf, self->buf + self->pos, size);
+    self->pos += size;
+    return size;
+}
+
+static ssize_t
+cork_memory_producer__borrow(struct cork_stream_producer *vself,
+                             const void **buf, size_t max_size)
+{
+    struct cork_memory_producer  *self =
+        cork_container_of(vself, struct cork_memory_producer, parent);
+    if (max_size > self->size - self->pos) {
+        max_size = self->size - self->pos;
+    }
+    *buf = self->buf + self->pos;
+    self->pos += max_size;
+    return max_size;
+}
+
+static void
+cork_memory_producer__free(struct cork_stream_producer *vself)
+{
+    struct cork_memory_producer  *self =
+        cork_container_of(vself, struct cork_memory_producer, parent);
+    if (self->mapped) {
+        munmap((void *) self->buf, self->size);
+    }
+    free(self);
+}
+
+static struct cork_memory_producer *
+cork_memory_producer_new(const void *buf, size_t size, bool mapped)
+{
+    struct cork_memory_producer  *self =
+        cork_new(struct cork_memory_producer);
+    self->parent.read = cork_memory_producer__read;
+    self->parent.borrow = cork_memory_producer__borrow;
+    self->parent.free = cork_memory_producer__free;
+    self->buf = buf;
+    self->size = size;
+    self->pos = 0;
+    self->mapped = mapped;
+    return self;
+}
+
+struct cork_stream_producer *
+cork_buffer_producer_new(const void *buf, size_t size)
+{
+    return &cork_memory_producer_new(buf, size, false)->parent;
+}
+
+struct cork_stream_producer *
+cork_mmap_producer_new(const char *path)
+{
+    int  fd;
+    struct stat  info;
+    void  *buf = NULL;
+
+    rpi_check_posix(fd = open(path, O_RDONLY));
+    ei_check_posix(fstat(fd, &info));
+
+    /* You can't map an empty file, but we don't need to. */
+    if (info.st_size > 0) {
+        buf = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (CORK_UNLIKELY(buf == MAP_FAILED)) {
+            cork_system_error_set();
+            goto error;
+        }
+#if defined(MADV_SEQUENTIAL)
+        madvise(buf, info.st_size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    /* The mapping stays valid after we close the file. */
+    close(fd);
+    return &cork_memory_producer_new(buf, info.st_size, buf != NULL)->parent;
+
+error:
+    close(fd);
+    return NULL;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Pumps
+ */
+
+int
+cork_stream_pump(struct cork_stream_producer *producer,
+                 struct cork_stream_consumer *consumer,
+                 size_t chunk_size)
+{
+    void  *buf = NULL;
+    bool  first = true;
+
+    if (chunk_size == 0) {
+        chunk_size = CORK_STREAM_PUMP_CHUNK_SIZE;
+    }
+    if (!cork_stream_producer_can_borrow(producer)) {
+        buf = cork_malloc(chunk_size);
+    }
+
+    while (true) {
+        const void  *chunk = buf;
+        ssize_t  size;
+        if (buf == NULL) {
+            size = cork_stream_producer_borrow(producer, &chunk, chunk_size);
+        } else {
+            size = cork_stream_producer_read(producer, buf, chunk_size);
+        }
+        if (CORK_UNLIKELY(size < 0)) {
+            goto error;
+        } else if (size == 0) {
+            break;
+        }
+        ei_check(cork_stream_consumer_data(consumer, chunk, size, first));
+        first = false;
+    }
+
+    free(buf);
+    return cork_stream_consumer_eof(consumer);
+
+error:
+    free(buf);
+    return -1;
+}
+
+
+/* The reading thread fills chunks in a ring, and the calling thread passes
+ * them along to the consumer.  Neither side holds the lock while it's
+ * touching the contents of a chunk; the reader only ever writes into chunks
+ * that aren't in [head, head + count), and the consumer only reads the chunk
+ * at head. */
+struct cork_threaded_pump {
+    struct cork_thread_body  parent;
+    struct cork_stream_producer  *producer;
+    size_t  chunk_size;
+    size_t  max_chunks;
+    char  *bufs;
+    size_t  *sizes;
+
+    pthread_mutex_t  lock;
+    pthread_cond_t  not_full;
+    pthread_cond_t  not_empty;
+    size_t  head;
+    size_t  count;
+    /* Set by the reader once it has seen the end of the stream or an error */
+    bool  done;
+    /* Set by the consumer if it wants the reader to stop early */
+    bool  cancelled;
+};
+
+static int
+cork_threaded_pump__run(struct cork_thread_body *vself)
+{
+    struct cork_threaded_pump  *self =
+        cork_container_of(vself, struct cork_threaded_pump, parent);
+
+    while (true) {
+        size_t  slot;
+        ssize_t  size;
+
+        pthread_mutex_lock(&self->lock);
+        while (self->count == self->max_chunks && !self->cancelled) {
+            pthread_cond_wait(&self->not_full, &self->lock);
+        }
+        if (self->cancelled) {
+            pthread_mutex_unlock(&self->lock);
+            return 0;
+        }
+        slot = (self->head + self->count) % self->max_chunks;
+        pthread_mutex_unlock(&self->lock);
+
+        size = cork_stream_producer_read
+            (self->producer, self->bufs + slot * self->chunk_size,
+             self->chunk_size);
+
+        pthread_mutex_lock(&self->lock);
+        if (size <= 0) {
+            self->done = true;
+        } else {
+            self->sizes[slot] = size;
+            self->count++;
+        }
+        pthread_cond_signal(&self->not_empty);
+        pthread_mutex_unlock(&self->lock);
+
+        if (size <= 0) {
+            return (size < 0)? -1: 0;
+        }
+    }
+}
+
+static void
+cork_threaded_pump__free(struct cork_thread_body *vself)
+{
+    /* The pump lives on the stack of cork_stream_pump_threaded. */
+}
+
+/* Stops the reading thread after the consumer has failed.  We want to report
+ * the consumer's error, not anything that the reader might have run into in
+ * the meantime. */
+static void
+cork_threaded_pump_cancel(struct cork_threaded_pump *self,
+                          struct cork_thread *thread)
+{
+    cork_error_class  error_class = cork_error_get_class();
+    cork_error_code  error_code = cork_error_get_code();
+    const char  *message = cork_strdup(cork_error_message());
+
+    pthread_mutex_lock(&self->lock);
+    self->cancelled = true;
+    pthread_cond_signal(&self->not_full);
+    pthread_mutex_unlock(&self->lock);
+
+    cork_thread_join(thread);
+    cork_error_clear();
+    cork_error_set(error_class, error_code, "%s", message);
+    cork_strfree(message);
+}
+
+int
+cork_stream_pump_threaded(struct cork_stream_producer *producer,
+                          struct cork_stream_consumer *consumer,
+                          size_t chunk_size, size_t max_chunks)
+{
+    struct cork_threaded_pump  self;
+    struct cork_thread  *thread;
+    bool  first = true;
+    int  rc = 0;
+
+    if (chunk_size == 0) {
+        chunk_size = CORK_STREAM_PUMP_CHUNK_SIZE;
+    }
+    assert(max_chunks > 0);
+
+    self.parent.run = cork_threaded_pump__run;
+    self.parent.free = cork_threaded_pump__free;
+    self.producer = producer;
+    self.chunk_size = chunk_size;
+    self.max_chunks = max_chunks;
+    self.bufs = cork_malloc(chunk_size * max_chunks);
+    self.sizes = cork_calloc(max_chunks, sizeof(size_t));
+    pthread_mutex_init(&self.lock, NULL);
+    pthread_cond_init(&self.not_full, NULL);
+    pthread_cond_init(&self.not_empty, NULL);
+    self.head = 0;
+    self.count = 0;
+    self.done = false;
+    self.cancelled = false;
+
+    thread = cork_thread_new("stream-pump", &self.parent);
+    if (CORK_UNLIKELY(cork_thread_start(thread) != 0)) {
+        cork_thread_free(thread);
+        rc = -1;
+        goto done;
+    }
+
+    while (true) {
+        size_t  slot;
+
+        pthread_mutex_lock(&self.lock);
+        while (self.count == 0 && !self.done) {
+            pthread_cond_wait(&self.not_empty, &self.lock);
+        }
+        if (self.count == 0) {
+            pthread_mutex_unlock(&self.lock);
+            break;
+        }
+        slot = self.head;
+        pthread_mutex_unlock(&self.lock);
+
+        rc = cork_stream_consumer_data
+            (consumer, self.bufs + slot * chunk_size, self.sizes[slot], first);
+        first = false;
+        if (CORK_UNLIKELY(rc != 0)) {
+            cork_threaded_pump_cancel(&self, thread);
+            goto done;
+        }
+
+        pthread_mutex_lock(&self.lock);
+        self.head = (self.head + 1) % max_chunks;
+        self.count--;
+        pthread_cond_signal(&self.not_full);
+        pthread_mutex_unlock(&self.lock);
+    }
+
+    /* The reader has finished; this reports its error, if it had one. */
+    rc = cork_thread_join(thread);
+    if (rc == 0) {
+        rc = cork_stream_consumer_eof(consumer);
+    }
+
+done:
+    pthread_cond_destroy(&self.not_empty);
+    pthread_cond_destroy(&self.not_full);
+    pthread_mutex_destroy(&self.lock);
+    free(self.sizes);
+    free(self.bufs);
+    return rc;
+}
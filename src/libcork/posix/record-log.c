@@ -0,0 +1,773 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libcork/config.h"
+#include "libcork/core/allocator.h"
+#include "libcork/core/byte-order.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/managed-buffer.h"
+#include "libcork/ds/slice.h"
+#include "libcork/helpers/errors.h"
+#include "libcork/helpers/posix.h"
+#include "libcork/os/files.h"
+#include "libcork/os/record-log.h"
+#include "libcork/threads/basics.h"
+
+
+#if !defined(CORK_DEBUG_RECORD_LOG)
+#define CORK_DEBUG_RECORD_LOG  0
+#endif
+
+#if CORK_DEBUG_RECORD_LOG
+#include <stdio.h>
+#define DEBUG(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define DEBUG(...) /* no debug messages */
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * File format
+ */
+
+/* A log is a directory of segment files.  Each segment is named after the
+ * position of its first record (as a 20-digit decimal number), and starts
+ * with a 32-byte header:
+ *
+ *   magic        4 bytes, "CkLg"
+ *   version      uint32, little-endian
+ *   base         uint64, little-endian; the position of the segment's first
+ *                byte, which must match the file name
+ *   reserved     16 bytes of zeroes
+ *
+ * This is followed by the records.  Each record has an 8-byte header
+ * containing the length of its payload and a CRC-32C checksum of the length
+ * and payload (both little-endian uint32s), followed by the payload itself,
+ * padded to a multiple of 8 bytes.  Segments are preallocated, so the unused
+ * part of a segment is filled with zeroes.  An all-zero record header marks
+ * the end of the segment; that can never be a valid record, since the
+ * checksum of a zero length isn't zero.
+ *
+ * A record's position is its segment's base plus the record's offset within
+ * the segment file. */
+
+static const uint8_t  CORK_RECORD_LOG_MAGIC[4] = { 'C', 'k', 'L', 'g' };
+#define CORK_RECORD_LOG_VERSION  1
+#define CORK_RECORD_LOG_HEADER_SIZE  32
+#define CORK_RECORD_LOG_RECORD_HEADER_SIZE  8
+
+#define cork_record_log_record_size(payload_size) \
+    (((payload_size) + CORK_RECORD_LOG_RECORD_HEADER_SIZE + 7) & ~((size_t) 7))
+
+#define CORK_RECORD_LOG_SEGMENT_SUFFIX  ".log"
+#define CORK_RECORD_LOG_SEGMENT_NAME_LENGTH  24
+
+#define cork_record_log_corrupt(...) \
+    cork_error_set(CORK_RECORD_LOG_ERROR, CORK_RECORD_LOG_CORRUPT, \
+                   __VA_ARGS__)
+
+
+/*-----------------------------------------------------------------------
+ * CRC-32C
+ */
+
+/* A slicing-by-8 implementation of the Castagnoli CRC, which has better error
+ * detection than the classic CRC-32 polynomial. */
+
+#define CORK_CRC32C_POLYNOMIAL  0x82f63b78
+
+static uint32_t  cork_crc32c_table[8][256];
+
+cork_once_barrier(cork_crc32c);
+
+static void
+cork_crc32c_init(void)
+{
+    unsigned int  i;
+    unsigned int  j;
+    for (i = 0; i < 256; i++) {
+        uint32_t  crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ ((crc & 1)? CORK_CRC32C_POLYNOMIAL: 0);
+        }
+        cork_crc32c_table[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        uint32_t  crc = cork_crc32c_table[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = cork_crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            cork_crc32c_table[j][i] = crc;
+        }
+    }
+}
+
+static uint32_t
+cork_crc32c_update(uint32_t crc, const void *vsrc, size_t size)
+{
+    const uint8_t  *src = vsrc;
+    cork_once(cork_crc32c, cork_crc32c_init());
+
+    while (size >= 8) {
+        uint32_t  lo = crc ^ ((uint32_t) src[0] | ((uint32_t) src[1] << 8) |
+                              ((uint32_t) src[2] << 16) |
+                              ((uint32_t) src[3] << 24));
+        crc = cork_crc32c_table[7][lo & 0xff] ^
+              cork_crc32c_table[6][(lo >> 8) & 0xff] ^
+              cork_crc32c_table[5][(lo >> 16) & 0xff] ^
+              cork_crc32c_table[4][lo >> 24] ^
+              cork_crc32c_table[3][src[4]] ^
+              cork_crc32c_table[2][src[5]] ^
+              cork_crc32c_table[1][src[6]] ^
+              cork_crc32c_table[0][src[7]];
+        src += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = cork_crc32c_table[0][(crc ^ *src++) & 0xff] ^ (crc >> 8);
+        size--;
+    }
+    return crc;
+}
+
+static uint32_t
+cork_record_log_checksum(uint32_t le_length, const void *payload, size_t size)
+{
+    uint32_t  crc = 0xffffffff;
+    crc = cork_crc32c_update(crc, &le_length, sizeof(le_length));
+    crc = cork_crc32c_update(crc, payload, size);
+    return ~crc;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Segments
+ */
+
+static void
+cork_record_log_segment_path(struct cork_buffer *dest, const char *dir,
+                             uint64_t base)
+{
+    cork_buffer_printf
+        (dest, "%s/%020" PRIu64 CORK_RECORD_LOG_SEGMENT_SUFFIX, dir, base);
+}
+
+typedef cork_array(uint64_t)  cork_record_log_bases;
+
+static int
+cork_record_log_compare_bases(const void *vb1, const void *vb2)
+{
+    uint64_t  b1 = *(const uint64_t *) vb1;
+    uint64_t  b2 = *(const uint64_t *) vb2;
+    return (b1 < b2)? -1: (b1 > b2)? 1: 0;
+}
+
+/* Fills in bases with the base position of each segment in the log, in
+ * order. */
+static int
+cork_record_log_list_segments(const char *path, cork_record_log_bases *bases)
+{
+    DIR  *dir;
+    struct dirent  *entry;
+
+    rip_check_posix(dir = opendir(path));
+    while ((entry = readdir(dir)) != NULL) {
+        const char  *name = entry->d_name;
+        uint64_t  base = 0;
+        size_t  i;
+        if (strlen(name) != CORK_RECORD_LOG_SEGMENT_NAME_LENGTH ||
+            strcmp(name + 20, CORK_RECORD_LOG_SEGMENT_SUFFIX) != 0) {
+            continue;
+        }
+        for (i = 0; i < 20 && name[i] >= '0' && name[i] <= '9'; i++) {
+            base = base * 10 + (name[i] - '0');
+        }
+        if (i == 20) {
+            cork_array_append(bases, base);
+        }
+    }
+    closedir(dir);
+
+    if (!cork_array_is_empty(bases)) {
+        qsort(bases->items, cork_array_size(bases), sizeof(uint64_t),
+              cork_record_log_compare_bases);
+    }
+    return 0;
+}
+
+static int
+cork_record_log_map(int fd, size_t size, void **dest)
+{
+    *dest = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (CORK_UNLIKELY(*dest == MAP_FAILED)) {
+        cork_system_error_set();
+        return -1;
+    }
+    return 0;
+}
+
+static int
+cork_record_log_check_header(const uint8_t *buf, size_t size, uint64_t base)
+{
+    uint32_t  version;
+    uint64_t  header_base;
+    if (CORK_UNLIKELY(size < CORK_RECORD_LOG_HEADER_SIZE ||
+                      memcmp(buf, CORK_RECORD_LOG_MAGIC,
+                             sizeof(CORK_RECORD_LOG_MAGIC)) != 0)) {
+        cork_record_log_corrupt("Log segment has an invalid header");
+        return -1;
+    }
+    memcpy(&version, buf + 4, sizeof(version));
+    memcpy(&header_base, buf + 8, sizeof(header_base));
+    if (CORK_UNLIKELY(CORK_UINT32_LITTLE_TO_HOST(version) !=
+                      CORK_RECORD_LOG_VERSION)) {
+        cork_record_log_corrupt("Unknown log segment version");
+        return -1;
+    }
+    if (CORK_UNLIKELY(CORK_UINT64_LITTLE_TO_HOST(header_base) != base)) {
+        cork_record_log_corrupt("Log segment has the wrong base position");
+        return -1;
+    }
+    return 0;
+}
+
+/* Parses the record at offset.  Returns true and fills in payload_size if
+ * there's a valid record there; returns false if we've reached the end of the
+ * segment, or if the record is corrupt or incomplete. */
+static bool
+cork_record_log_parse(const uint8_t *buf, size_t size, size_t offset,
+                      size_t *payload_size)
+{
+    uint32_t  le_length;
+    uint32_t  le_checksum;
+    size_t  length;
+
+    if (size - offset < CORK_RECORD_LOG_RECORD_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(&le_length, buf + offset, sizeof(le_length));
+    memcpy(&le_checksum, buf + offset + 4, sizeof(le_checksum));
+    length = CORK_UINT32_LITTLE_TO_HOST(le_length);
+    if (length > size - offset - CORK_RECORD_LOG_RECORD_HEADER_SIZE) {
+        return false;
+    }
+    if (CORK_UINT32_LITTLE_TO_HOST(le_checksum) !=
+        cork_record_log_checksum
+        (le_length, buf + offset + CORK_RECORD_LOG_RECORD_HEADER_SIZE,
+         length)) {
+        return false;
+    }
+    *payload_size = length;
+    return true;
+}
+
+/* Returns whether everything from offset to the end of the segment is
+ * zero — i.e., whether the segment ended cleanly. */
+static bool
+cork_record_log_is_clean_end(const uint8_t *buf, size_t size, size_t offset)
+{
+    size_t  end = offset + CORK_RECORD_LOG_RECORD_HEADER_SIZE;
+    if (end > size) {
+        end = size;
+    }
+    for (; offset < end; offset++) {
+        if (buf[offset] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Writing
+ */
+
+/* Records are collected in a buffer and written out in large chunks.  Large
+ * records bypass the buffer. */
+#define CORK_RECORD_LOG_WRITE_SIZE  (1024 * 1024)
+#define CORK_RECORD_LOG_DIRECT_SIZE  (64 * 1024)
+
+struct cork_record_log {
+    struct cork_buffer  path;
+    size_t  segment_size;
+    int  fd;
+    /* The position of the current segment */
+    uint64_t  base;
+    /* Where the next record will go in the current segment */
+    size_t  offset;
+    /* How much of the current segment has been written to the file; the
+     * rest is in pending. */
+    size_t  written;
+    bool  needs_sync;
+    struct cork_buffer  pending;
+};
+
+static int
+cork_record_log_pwrite(int fd, const void *vsrc, size_t size, off_t offset)
+{
+    const char  *src = vsrc;
+    while (size > 0) {
+        ssize_t  written;
+        rii_check_posix(written = pwrite(fd, src, size, offset));
+        src += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+static int
+cork_record_log_sync_fd(int fd)
+{
+#if CORK_HAVE_FDATASYNC
+    rii_check_posix(fdatasync(fd));
+#else
+    rii_check_posix(fsync(fd));
+#endif
+    return 0;
+}
+
+/* Makes sure that the segment has room for size bytes, and that any space
+ * that we haven't written to yet is zeroed. */
+static int
+cork_record_log_preallocate(int fd, size_t size)
+{
+#if CORK_HAVE_FALLOCATE
+    int  rc = posix_fallocate(fd, 0, size);
+    if (CORK_UNLIKELY(rc != 0)) {
+        cork_system_error_set_explicit(rc);
+        return -1;
+    }
+#else
+    struct stat  info;
+    rii_check_posix(fstat(fd, &info));
+    if ((size_t) info.st_size < size) {
+        rii_check_posix(ftruncate(fd, size));
+    }
+#endif
+    return 0;
+}
+
+/* Makes sure that a newly created segment file is durable. */
+static int
+cork_record_log_sync_dir(struct cork_record_log *log)
+{
+    int  fd;
+    int  rc;
+    rii_check_posix(fd = open(log->path.buf, O_RDONLY));
+    rc = cork_record_log_sync_fd(fd);
+    close(fd);
+    return rc;
+}
+
+static int
+cork_record_log_create_segment(struct cork_record_log *log, uint64_t base)
+{
+    struct cork_buffer  segment_path = CORK_BUFFER_INIT();
+    uint8_t  header[CORK_RECORD_LOG_HEADER_SIZE];
+    uint32_t  version = CORK_UINT32_HOST_TO_LITTLE(CORK_RECORD_LOG_VERSION);
+    uint64_t  le_base = CORK_UINT64_HOST_TO_LITTLE(base);
+
+    cork_record_log_segment_path(&segment_path, log->path.buf, base);
+    DEBUG("Creating log segment %s\n", (char *) segment_path.buf);
+    memset(header, 0, sizeof(header));
+    memcpy(header, CORK_RECORD_LOG_MAGIC, sizeof(CORK_RECORD_LOG_MAGIC));
+    memcpy(header + 4, &version, sizeof(version));
+    memcpy(header + 8, &le_base, sizeof(le_base));
+
+    ei_check_posix(log->fd = open
+                   (segment_path.buf, O_RDWR | O_CREAT | O_TRUNC, 0644));
+    ei_check(cork_record_log_preallocate(log->fd, log->segment_size));
+    ei_check(cork_record_log_pwrite(log->fd, header, sizeof(header), 0));
+    ei_check(cork_record_log_sync_fd(log->fd));
+    ei_check(cork_record_log_sync_dir(log));
+    log->base = base;
+    log->offset = CORK_RECORD_LOG_HEADER_SIZE;
+    log->written = CORK_RECORD_LOG_HEADER_SIZE;
+    cork_buffer_done(&segment_path);
+    return 0;
+
+error:
+    if (log->fd != -1) {
+        close(log->fd);
+        log->fd = -1;
+    }
+    cork_buffer_done(&segment_path);
+    return -1;
+}
+
+/* Opens the last segment of an existing log, and finds the end of its last
+ * valid record.  Anything after that is a partial write from a crash, which
+ * we zero out. */
+static int
+cork_record_log_recover_segment(struct cork_record_log *log, uint64_t base)
+{
+    struct cork_buffer  segment_path = CORK_BUFFER_INIT();
+    struct stat  info;
+    void  *map = MAP_FAILED;
+    size_t  offset = CORK_RECORD_LOG_HEADER_SIZE;
+    size_t  payload_size;
+
+    cork_record_log_segment_path(&segment_path, log->path.buf, base);
+    DEBUG("Recovering log segment %s\n", (char *) segment_path.buf);
+    ei_check_posix(log->fd = open(segment_path.buf, O_RDWR));
+    ei_check_posix(fstat(log->fd, &info));
+    if (info.st_size < CORK_RECORD_LOG_HEADER_SIZE) {
+        /* We crashed while creating the segment. */
+        close(log->fd);
+        log->fd = -1;
+        cork_buffer_done(&segment_path);
+        return cork_record_log_create_segment(log, base);
+    }
+
+    ei_check(cork_record_log_map(log->fd, info.st_size, &map));
+    ei_check(cork_record_log_check_header(map, info.st_size, base));
+    while (cork_record_log_parse(map, info.st_size, offset, &payload_size)) {
+        offset += cork_record_log_record_size(payload_size);
+    }
+    munmap(map, info.st_size);
+    map = MAP_FAILED;
+
+    DEBUG("  Last record ends at %zu\n", offset);
+    ei_check_posix(ftruncate(log->fd, offset));
+    ei_check(cork_record_log_preallocate(log->fd, log->segment_size));
+    ei_check(cork_record_log_sync_fd(log->fd));
+    log->base = base;
+    log->offset = offset;
+    log->written = offset;
+    cork_buffer_done(&segment_path);
+    return 0;
+
+error:
+    if (map != MAP_FAILED) {
+        munmap(map, info.st_size);
+    }
+    if (log->fd != -1) {
+        close(log->fd);
+        log->fd = -1;
+    }
+    cork_buffer_done(&segment_path);
+    return -1;
+}
+
+struct cork_record_log *
+cork_record_log_open(const char *path, size_t segment_size)
+{
+    struct cork_record_log  *log;
+    struct cork_file  *dir;
+    cork_record_log_bases  bases;
+    int  rc;
+
+    dir = cork_file_new(path);
+    rc = cork_file_mkdir(dir, 0755, CORK_FILE_RECURSIVE | CORK_FILE_PERMISSIVE);
+    cork_file_free(dir);
+    rpi_check(rc);
+
+    log = cork_new(struct cork_record_log);
+    cork_buffer_init(&log->path);
+    cork_buffer_set_string(&log->path, path);
+    log->segment_size = segment_size;
+    log->fd = -1;
+    log->needs_sync = false;
+    cork_buffer_init(&log->pending);
+    cork_array_init(&bases);
+
+    ei_check(cork_record_log_list_segments(path, &bases));
+    if (cork_array_is_empty(&bases)) {
+        ei_check(cork_record_log_create_segment(log, 0));
+    } else {
+        ei_check(cork_record_log_recover_segment
+                 (log, cork_array_at(&bases, cork_array_size(&bases) - 1)));
+    }
+    cork_array_done(&bases);
+    return log;
+
+error:
+    cork_array_done(&bases);
+    cork_buffer_done(&log->path);
+    cork_buffer_done(&log->pending);
+    free(log);
+    return NULL;
+}
+
+uint64_t
+cork_record_log_end(const struct cork_record_log *log)
+{
+    return log->base + log->offset;
+}
+
+static int
+cork_record_log_flush(struct cork_record_log *log)
+{
+    if (log->pending.size > 0) {
+        rii_check(cork_record_log_pwrite
+                  (log->fd, log->pending.buf, log->pending.size,
+                   log->written));
+        log->written += log->pending.size;
+        log->needs_sync = true;
+        cork_buffer_clear(&log->pending);
+    }
+    return 0;
+}
+
+int
+cork_record_log_commit(struct cork_record_log *log)
+{
+    rii_check(cork_record_log_flush(log));
+    if (log->needs_sync) {
+        rii_check(cork_record_log_sync_fd(log->fd));
+        log->needs_sync = false;
+    }
+    return 0;
+}
+
+int
+cork_record_log_close(struct cork_record_log *log)
+{
+    int  rc = cork_record_log_commit(log);
+    close(log->fd);
+    cork_buffer_done(&log->path);
+    cork_buffer_done(&log->pending);
+    free(log);
+    return rc;
+}
+
+static int
+cork_record_log_next_segment(struct cork_record_log *log)
+{
+    rii_check(cork_record_log_commit(log));
+    /* Trim the preallocated space that we didn't use. */
+    rii_check_posix(ftruncate(log->fd, log->offset));
+    close(log->fd);
+    log->fd = -1;
+    return cork_record_log_create_segment(log, log->base + log->offset);
+}
+
+int
+cork_record_log_append(struct cork_record_log *log,
+                       const void *src, size_t size, uint64_t *position)
+{
+    static const uint8_t  padding[8] = { 0 };
+    size_t  record_size = cork_record_log_record_size(size);
+    uint32_t  header[2];
+
+    if (CORK_UNLIKELY((uint64_t) size > UINT32_MAX)) {
+        cork_error_set(CORK_RECORD_LOG_ERROR, CORK_RECORD_LOG_TOO_LARGE,
+                       "Record is too large (%zu bytes)", size);
+        return -1;
+    }
+
+    if (log->offset > CORK_RECORD_LOG_HEADER_SIZE &&
+        log->offset + record_size > log->segment_size) {
+        rii_check(cork_record_log_next_segment(log));
+    }
+
+    header[0] = CORK_UINT32_HOST_TO_LITTLE((uint32_t) size);
+    header[1] = CORK_UINT32_HOST_TO_LITTLE
+        (cork_record_log_checksum(header[0], src, size));
+
+    /* Don't move offset forward until the record is safely in the file or in
+     * pending, so that a failed write doesn't leave a hole in the segment.
+     * Whatever we managed to write will be overwritten by the next record. */
+    if (size >= CORK_RECORD_LOG_DIRECT_SIZE) {
+        size_t  offset;
+        rii_check(cork_record_log_flush(log));
+        offset = log->written + sizeof(header);
+        rii_check(cork_record_log_pwrite
+                  (log->fd, header, sizeof(header), log->written));
+        rii_check(cork_record_log_pwrite(log->fd, src, size, offset));
+        rii_check(cork_record_log_pwrite
+                  (log->fd, padding, record_size - sizeof(header) - size,
+                   offset + size));
+        log->written += record_size;
+        log->needs_sync = true;
+    } else {
+        cork_buffer_append_fast(&log->pending, header, sizeof(header));
+        cork_buffer_append_fast(&log->pending, src, size);
+        cork_buffer_append_fast
+            (&log->pending, padding, record_size - sizeof(header) - size);
+        if (log->pending.size >= CORK_RECORD_LOG_WRITE_SIZE &&
+            CORK_UNLIKELY(cork_record_log_flush(log) != 0)) {
+            /* The earlier records stay pending, but this one isn't part of
+             * the log. */
+            cork_buffer_truncate
+                (&log->pending, log->pending.size - record_size);
+            return -1;
+        }
+    }
+
+    if (position != NULL) {
+        *position = log->base + log->offset;
+    }
+    log->offset += record_size;
+    return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Reading
+ */
+
+struct cork_record_log_reader {
+    struct cork_buffer  path;
+    cork_record_log_bases  bases;
+    /* The index of the next segment to open */
+    size_t  next_segment;
+    /* The current segment, which is mapped into memory.  Each record that we
+     * hand out holds a reference to it. */
+    struct cork_managed_buffer  *segment;
+    uint64_t  base;
+    size_t  offset;
+};
+
+static void
+cork_record_log_unmap(void *buf, size_t size)
+{
+    munmap(buf, size);
+}
+
+static int
+cork_record_log_reader_open_segment(struct cork_record_log_reader *reader)
+{
+    struct cork_buffer  segment_path = CORK_BUFFER_INIT();
+    uint64_t  base = cork_array_at(&reader->bases, reader->next_segment);
+    bool  is_last = (reader->next_segment + 1 ==
+                     cork_array_size(&reader->bases));
+    struct stat  info;
+    int  fd = -1;
+    void  *map;
+
+    reader->next_segment++;
+    cork_record_log_segment_path(&segment_path, reader->path.buf, base);
+    DEBUG("Reading log segment %s\n", (char *) segment_path.buf);
+    ei_check_posix(fd = open(segment_path.buf, O_RDONLY));
+    ei_check_posix(fstat(fd, &info));
+    if (info.st_size < CORK_RECORD_LOG_HEADER_SIZE) {
+        if (is_last) {
+            /* The writer is still creating this segment. */
+            close(fd);
+            cork_buffer_done(&segment_path);
+            return 0;
+        }
+        cork_record_log_corrupt("Log segment is too short");
+        goto error;
+    }
+
+    ei_check(cork_record_log_map(fd, info.st_size, &map));
+    close(fd);
+    fd = -1;
+    reader->segment = cork_managed_buffer_new
+        (map, info.st_size, cork_record_log_unmap);
+    ei_check(cork_record_log_check_header(map, info.st_size, base));
+    reader->base = base;
+    reader->offset = CORK_RECORD_LOG_HEADER_SIZE;
+    cork_buffer_done(&segment_path);
+    return 0;
+
+error:
+    if (fd != -1) {
+        close(fd);
+    }
+    if (reader->segment != NULL) {
+        cork_managed_buffer_unref(reader->segment);
+        reader->segment = NULL;
+    }
+    cork_buffer_done(&segment_path);
+    return -1;
+}
+
+struct cork_record_log_reader *
+cork_record_log_reader_new(const char *path)
+{
+    struct cork_record_log_reader  *reader =
+        cork_new(struct cork_record_log_reader);
+    cork_buffer_init(&reader->path);
+    cork_buffer_set_string(&reader->path, path);
+    cork_array_init(&reader->bases);
+    reader->next_segment = 0;
+    reader->segment = NULL;
+    reader->base = 0;
+    reader->offset = 0;
+    ei_check(cork_record_log_list_segments(path, &reader->bases));
+    return reader;
+
+error:
+    cork_record_log_reader_free(reader);
+    return NULL;
+}
+
+void
+cork_record_log_reader_free(struct cork_record_log_reader *reader)
+{
+    if (reader->segment != NULL) {
+        cork_managed_buffer_unref(reader->segment);
+    }
+    cork_buffer_done(&reader->path);
+    cork_array_done(&reader->bases);
+    free(reader);
+}
+
+int
+cork_record_log_reader_next(struct cork_record_log_reader *reader,
+                            struct cork_slice *dest, uint64_t *position)
+{
+    while (true) {
+        const uint8_t  *buf;
+        size_t  size;
+        size_t  payload_size;
+
+        if (reader->segment == NULL) {
+            if (reader->next_segment == cork_array_size(&reader->bases)) {
+                cork_slice_clear(dest);
+                return 0;
+            }
+            rii_check(cork_record_log_reader_open_segment(reader));
+            continue;
+        }
+
+        buf = reader->segment->buf;
+        size = reader->segment->size;
+        if (cork_record_log_parse(buf, size, reader->offset, &payload_size)) {
+            if (position != NULL) {
+                *position = reader->base + reader->offset;
+            }
+            rii_check(cork_managed_buffer_slice
+                      (dest, reader->segment,
+                       reader->offset + CORK_RECORD_LOG_RECORD_HEADER_SIZE,
+                       payload_size));
+            reader->offset += cork_record_log_record_size(payload_size);
+            return 0;
+        }
+
+        /* A partial record is only expected at the end of the log. */
+        if (reader->next_segment < cork_array_size(&reader->bases) &&
+            !cork_record_log_is_clean_end(buf, size, reader->offset)) {
+            cork_record_log_corrupt
+                ("Corrupt record at position %" PRIu64,
+                 reader->base + reader->offset);
+            return -1;
+        }
+        cork_managed_buffer_unref(reader->segment);
+        reader->segment = NULL;
+    }
+}
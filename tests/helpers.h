@@ -11,7 +11,11 @@
 #ifndef TESTS_HELPERS_H
 #define TESTS_HELPERS_H
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "libcork/core/error.h"
+#include "libcork/ds/stream.h"
 
 #if !defined(PRINT_EXPECTED_FAILURES)
 #define PRINT_EXPECTED_FAILURES  1
@@ -60,4 +64,30 @@
                  (char *) (what), (char *) (expected), (char *) (actual)))
 
 
+/* Passes src to consumer in chunks of chunk_size bytes.  Each chunk is copied
+ * into its own allocation, which is freed as soon as the consumer is done
+ * with it, so that we'll notice if anything points into it for too long. */
+static inline int
+feed(struct cork_stream_consumer *consumer, const void *src, size_t size,
+     size_t chunk_size)
+{
+    size_t  offset = 0;
+    while (offset < size) {
+        size_t  this_size = (size - offset < chunk_size)?
+            size - offset: chunk_size;
+        char  *chunk = malloc(this_size);
+        int  rc;
+        memcpy(chunk, (const char *) src + offset, this_size);
+        rc = cork_stream_consumer_data
+            (consumer, chunk, this_size, offset == 0);
+        free(chunk);
+        if (rc != 0) {
+            return rc;
+        }
+        offset += this_size;
+    }
+    return cork_stream_consumer_eof(consumer);
+}
+
+
 #endif /* TESTS_HELPERS_H */
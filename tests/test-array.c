@@ -279,6 +279,50 @@ START_TEST(test_array_callbacks)
 }
 END_TEST
 
+START_TEST(test_array_pod)
+{
+    DESCRIBE_TEST;
+    cork_array(int64_t)  array;
+    cork_array(int64_t)  copy;
+    struct callback_counts  counts;
+    int64_t  values[100];
+    size_t  i;
+
+    cork_array_init(&array);
+    fail_unless(cork_array_is_pod(&array), "New arrays should be POD");
+    for (i = 0; i < 100; i++) {
+        values[i] = i;
+        cork_array_append(&array, i);
+    }
+    cork_array_append_n(&array, values, 100);
+    fail_unless_equal("Array size", "%zu", (size_t) 200,
+                      cork_array_size(&array));
+    test_sum(&array, 9900);
+
+    cork_array_init(&copy);
+    cork_array_append(&copy, 12);
+    fail_if_error(cork_array_copy(&copy, &array, NULL, NULL));
+    fail_unless_equal("Array size", "%zu", (size_t) 200,
+                      cork_array_size(&copy));
+    test_sum(&copy, 9900);
+    cork_array_clear(&copy);
+    fail_unless(cork_array_is_empty(&copy), "Array should be empty");
+    cork_array_done(&copy);
+
+    /* Providing a callback takes the array out of POD mode.  Every element
+     * that was appended in POD mode counts as initialized. */
+    memset(&counts, 0, sizeof(counts));
+    cork_array_set_callback_data(&array, &counts, NULL);
+    cork_array_set_done(&array, test_array__done);
+    fail_if(cork_array_is_pod(&array), "Array shouldn't be POD");
+    cork_array_clear(&array);
+    cork_array_append_n(&array, values, 100);
+    test_sum(&array, 4950);
+    cork_array_done(&array);
+    check_counts(&counts, 0, 200, 0, 0);
+}
+END_TEST
+
 
 /*-----------------------------------------------------------------------
  * Testing harness
@@ -296,6 +340,7 @@ test_suite()
     tcase_add_test(tc_ds, test_array_int64_t);
     tcase_add_test(tc_ds, test_array_string);
     tcase_add_test(tc_ds, test_array_callbacks);
+    tcase_add_test(tc_ds, test_array_pod);
     suite_add_tcase(s, tc_ds);
 
     return s;
@@ -0,0 +1,162 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/bloom-filter.h"
+#include "libcork/ds/buffer.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Bloom filters
+ */
+
+#define add(filter, i) \
+    do { \
+        uint64_t  __i = (i); \
+        cork_bloom_filter_add((filter), &__i, sizeof(__i)); \
+    } while (0)
+
+static bool
+contains(const struct cork_bloom_filter *filter, uint64_t i)
+{
+    return cork_bloom_filter_contains(filter, &i, sizeof(i));
+}
+
+static void
+test_false_positives(const struct cork_bloom_filter *filter,
+                     uint64_t first, uint64_t count, double max_rate)
+{
+    uint64_t  i;
+    size_t  false_positives = 0;
+    double  rate;
+    for (i = first; i < first + count; i++) {
+        if (contains(filter, i)) {
+            false_positives++;
+        }
+    }
+    rate = (double) false_positives / (double) count;
+    fail_unless(rate <= max_rate,
+                "False positive rate too high (%f > %f)", rate, max_rate);
+}
+
+static void
+test_rate(size_t count, double rate)
+{
+    struct cork_bloom_filter  *filter = cork_bloom_filter_new(count, rate);
+    uint64_t  i;
+    for (i = 0; i < count; i++) {
+        add(filter, i);
+    }
+    for (i = 0; i < count; i++) {
+        fail_unless(contains(filter, i), "Missing element %zu", (size_t) i);
+    }
+    test_false_positives(filter, 1000000, 100000, rate * 1.5);
+    cork_bloom_filter_free(filter);
+}
+
+START_TEST(test_bloom_filter)
+{
+    DESCRIBE_TEST;
+    struct cork_bloom_filter  *filter = cork_bloom_filter_new(100, 0.01);
+
+    fail_if(contains(filter, 1), "Empty filter shouldn't contain anything");
+    add(filter, 1);
+    fail_unless(contains(filter, 1), "Filter should contain 1");
+    cork_bloom_filter_clear(filter);
+    fail_if(contains(filter, 1), "Cleared filter shouldn't contain anything");
+    cork_bloom_filter_free(filter);
+
+    test_rate(10000, 0.1);
+    test_rate(10000, 0.01);
+    test_rate(10000, 0.001);
+    test_rate(100000, 0.01);
+}
+END_TEST
+
+START_TEST(test_bloom_filter_serialize)
+{
+    DESCRIBE_TEST;
+    struct cork_bloom_filter  *filter = cork_bloom_filter_new(1000, 0.01);
+    struct cork_bloom_filter  *copy;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    uint64_t  i;
+
+    for (i = 0; i < 1000; i++) {
+        add(filter, i);
+    }
+    cork_bloom_filter_save(filter, &buf);
+    fail_unless_equal("Serialized size", "%zu",
+                      cork_bloom_filter_byte_size(filter) + 64, buf.size);
+
+    fail_if_error(copy = cork_bloom_filter_new_from_bytes(buf.buf, buf.size));
+    fail_unless_equal("Hash count", "%u",
+                      cork_bloom_filter_hash_count(filter),
+                      cork_bloom_filter_hash_count(copy));
+    for (i = 0; i < 1000; i++) {
+        fail_unless(contains(copy, i), "Missing element %zu", (size_t) i);
+    }
+    for (i = 1000; i < 2000; i++) {
+        fail_unless(contains(filter, i) == contains(copy, i),
+                    "Copy differs for element %zu", (size_t) i);
+    }
+    cork_bloom_filter_free(copy);
+
+    fail_unless_error(cork_bloom_filter_new_from_bytes(buf.buf, buf.size - 1),
+                      "Shouldn't load truncated filter");
+    fail_unless_error(cork_bloom_filter_new_from_bytes(buf.buf, 10),
+                      "Shouldn't load truncated filter");
+    memset(buf.buf, 0, 4);
+    fail_unless_error(cork_bloom_filter_new_from_bytes(buf.buf, buf.size),
+                      "Shouldn't load filter with bad magic number");
+
+    cork_buffer_done(&buf);
+    cork_bloom_filter_free(filter);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("bloom_filter");
+
+    TCase  *tc_ds = tcase_create("bloom_filter");
+    tcase_add_test(tc_ds, test_bloom_filter);
+    tcase_add_test(tc_ds, test_bloom_filter_serialize);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
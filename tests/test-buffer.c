@@ -14,10 +14,13 @@
 
 #include <check.h>
 
+#include "libcork/core/allocator.h"
 #include "libcork/core/types.h"
 #include "libcork/ds/buffer.h"
+#include "libcork/ds/buffer-pool.h"
 #include "libcork/ds/managed-buffer.h"
 #include "libcork/ds/stream.h"
+#include "libcork/threads/basics.h"
 
 #include "helpers.h"
 
@@ -133,6 +136,74 @@ START_TEST(test_buffer_append)
 }
 END_TEST
 
+START_TEST(test_buffer_append_fast)
+{
+    struct cork_buffer  buffer1 = CORK_BUFFER_INIT();
+    struct cork_buffer  buffer2 = CORK_BUFFER_INIT();
+    size_t  i;
+
+    /* Start with an empty buffer so that we exercise the fallback, and
+     * append enough to grow the buffer a few times. */
+    for (i = 0; i < 1000; i++) {
+        fail_if_error(cork_buffer_append_fast(&buffer1, "abc", 3));
+        fail_if_error(cork_buffer_append(&buffer2, "abc", 3));
+        fail_unless_equal("NUL terminator", "%d", 0,
+                          cork_buffer_char(&buffer1, buffer1.size));
+    }
+
+    fail_unless(cork_buffer_equal(&buffer1, &buffer2),
+                "Buffers should be equal");
+    cork_buffer_done(&buffer1);
+    cork_buffer_done(&buffer2);
+}
+END_TEST
+
+
+START_TEST(test_buffer_large)
+{
+#define CHUNK_SIZE  (1024 * 1024)
+#define CHUNK_COUNT  40
+    struct cork_buffer  buffer = CORK_BUFFER_INIT();
+    char  *chunk = cork_malloc(CHUNK_SIZE);
+    size_t  i;
+
+    /* Grow well past CORK_BUFFER_LARGE_SIZE, so that the buffer moves into
+     * its own memory mapping and is then grown in place. */
+    for (i = 0; i < CHUNK_COUNT; i++) {
+        memset(chunk, 'a' + (int) i, CHUNK_SIZE);
+        cork_buffer_append(&buffer, chunk, CHUNK_SIZE);
+    }
+    fail_unless_equal("Buffer size", "%zu",
+                      (size_t) CHUNK_COUNT * CHUNK_SIZE, buffer.size);
+    for (i = 0; i < CHUNK_COUNT; i++) {
+        fail_unless_equal("Chunk content", "%c", (char) ('a' + i),
+                          cork_buffer_char(&buffer, i * CHUNK_SIZE));
+        fail_unless_equal("Chunk content", "%c", (char) ('a' + i),
+                          cork_buffer_char(&buffer, (i+1) * CHUNK_SIZE - 1));
+    }
+
+    /* Truncating releases the unused pages, but the remaining content and
+     * the NUL terminator must survive. */
+    cork_buffer_truncate(&buffer, CHUNK_SIZE + 10);
+    fail_unless_equal("Buffer size", "%zu",
+                      (size_t) CHUNK_SIZE + 10, buffer.size);
+    fail_unless_equal("Chunk content", "%c", 'b',
+                      cork_buffer_char(&buffer, CHUNK_SIZE + 9));
+    fail_unless_equal("NUL terminator", "%d", 0,
+                      cork_buffer_char(&buffer, CHUNK_SIZE + 10));
+
+    cork_buffer_append(&buffer, "xyz", 3);
+    fail_unless_equal("Appended content", "%c", 'z',
+                      cork_buffer_char(&buffer, CHUNK_SIZE + 12));
+    fail_unless_equal("NUL terminator", "%d", 0,
+                      cork_buffer_char(&buffer, CHUNK_SIZE + 13));
+
+    cork_buffer_done(&buffer);
+    free(chunk);
+#undef CHUNK_SIZE
+#undef CHUNK_COUNT
+}
+END_TEST
 
 START_TEST(test_buffer_slicing)
 {
@@ -223,6 +294,174 @@ START_TEST(test_buffer_stream)
 END_TEST
 
 
+/*-----------------------------------------------------------------------
+ * Buffer pools
+ */
+
+START_TEST(test_buffer_pool)
+{
+    struct cork_buffer_pool  *pool = cork_buffer_pool_new(1024 * 1024);
+    struct cork_buffer  *buffers[10];
+    struct cork_buffer  *buffer;
+    size_t  i;
+
+    for (i = 0; i < 10; i++) {
+        fail_if_error(buffers[i] = cork_buffer_pool_acquire(pool, 100));
+        fail_unless(buffers[i]->allocated_size > 100,
+                    "Pooled buffer is too small");
+        fail_unless_equal("Buffer size", "%zu", (size_t) 0, buffers[i]->size);
+        cork_buffer_append_printf(buffers[i], "buffer %zu", i);
+    }
+
+    /* The first few buffers go into this thread's cache; the rest go into
+     * the shared free lists. */
+    for (i = 0; i < 10; i++) {
+        cork_buffer_pool_release(pool, buffers[i]);
+    }
+    fail_unless(cork_buffer_pool_retained(pool) > 0,
+                "Pool should have retained some buffers");
+
+    /* Reacquired buffers should be reused, and cleared. */
+    for (i = 0; i < 10; i++) {
+        size_t  j;
+        bool  found = false;
+        fail_if_error(buffer = cork_buffer_pool_acquire(pool, 100));
+        fail_unless_equal("Buffer size", "%zu", (size_t) 0, buffer->size);
+        for (j = 0; j < 10; j++) {
+            found = found || (buffer == buffers[j]);
+        }
+        fail_unless(found, "Expected a reused buffer");
+    }
+    fail_unless_equal("Retained", "%zu", (size_t) 0,
+                      cork_buffer_pool_retained(pool));
+
+    /* Buffers that grew while in use go into a larger size class. */
+    cork_buffer_ensure_size(buffers[0], 10000);
+    cork_buffer_pool_release(pool, buffers[0]);
+    fail_if_error(buffer = cork_buffer_pool_acquire(pool, 8000));
+    fail_unless(buffer == buffers[0], "Expected the grown buffer");
+    cork_buffer_pool_release(pool, buffer);
+
+    /* Very large buffers aren't kept. */
+    fail_if_error(buffer = cork_buffer_pool_acquire
+                  (pool, CORK_BUFFER_POOL_MAX_SIZE * 2));
+    cork_buffer_pool_release(pool, buffer);
+
+    for (i = 1; i < 10; i++) {
+        cork_buffer_pool_release(pool, buffers[i]);
+    }
+    cork_buffer_pool_free(pool);
+}
+END_TEST
+
+START_TEST(test_buffer_pool_limit)
+{
+    struct cork_buffer_pool  *pool = cork_buffer_pool_new(1000);
+    struct cork_buffer  *buffers[10];
+    size_t  i;
+
+    for (i = 0; i < 10; i++) {
+        fail_if_error(buffers[i] = cork_buffer_pool_acquire(pool, 200));
+    }
+    for (i = 0; i < 10; i++) {
+        cork_buffer_pool_release(pool, buffers[i]);
+    }
+    fail_unless(cork_buffer_pool_retained(pool) <= 1000,
+                "Pool retained too much memory");
+    cork_buffer_pool_free(pool);
+}
+END_TEST
+
+START_TEST(test_buffer_pool_managed)
+{
+    struct cork_buffer_pool  *pool = cork_buffer_pool_new(1024 * 1024);
+    struct cork_buffer  *buffer;
+    struct cork_buffer  *reused;
+    struct cork_managed_buffer  *managed;
+    struct cork_slice  slice;
+
+    fail_if_error(buffer = cork_buffer_pool_acquire(pool, 100));
+    cork_buffer_set_string(buffer, "hello world");
+    fail_if_error(managed = cork_buffer_pool_to_managed_buffer(pool, buffer));
+    fail_unless_equal("Managed size", "%zu", (size_t) 11, managed->size);
+    fail_unless(managed->buf == buffer->buf, "Managed buffer was copied");
+
+    /* A slice keeps the buffer out of the pool until it's finished. */
+    fail_if_error(cork_managed_buffer_slice(&slice, managed, 6, 5));
+    cork_managed_buffer_unref(managed);
+    fail_unless(memcmp(slice.buf, "world", 5) == 0, "Unexpected slice");
+    fail_if_error(reused = cork_buffer_pool_acquire(pool, 100));
+    fail_if(reused == buffer, "Buffer was reused while still referenced");
+    cork_buffer_pool_release(pool, reused);
+    cork_slice_finish(&slice);
+
+    /* Now that the last reference is gone, the buffer is back in the pool. */
+    fail_if_error(reused = cork_buffer_pool_acquire(pool, 100));
+    fail_unless(reused == buffer, "Expected the released buffer");
+    cork_buffer_pool_release(pool, reused);
+    cork_buffer_pool_free(pool);
+}
+END_TEST
+
+
+#define POOL_THREAD_COUNT  4
+
+struct pool_body {
+    struct cork_thread_body  parent;
+    struct cork_buffer_pool  *pool;
+};
+
+static int
+pool_body__run(struct cork_thread_body *vself)
+{
+    struct pool_body  *self = cork_container_of(vself, struct pool_body, parent);
+    struct cork_buffer  *buffers[8];
+    size_t  i;
+    size_t  j;
+    for (i = 0; i < 2000; i++) {
+        for (j = 0; j < 8; j++) {
+            buffers[j] = cork_buffer_pool_acquire(self->pool, j * 100);
+            if (buffers[j]->size != 0) {
+                return -1;
+            }
+            cork_buffer_append(buffers[j], "data", 4);
+        }
+        for (j = 0; j < 8; j++) {
+            cork_buffer_pool_release(self->pool, buffers[j]);
+        }
+    }
+    return 0;
+}
+
+static void
+pool_body__free(struct cork_thread_body *vself)
+{
+    struct pool_body  *self = cork_container_of(vself, struct pool_body, parent);
+    free(self);
+}
+
+START_TEST(test_buffer_pool_threads)
+{
+    struct cork_buffer_pool  *pool = cork_buffer_pool_new(1024 * 1024);
+    struct cork_thread  *threads[POOL_THREAD_COUNT];
+    size_t  i;
+
+    for (i = 0; i < POOL_THREAD_COUNT; i++) {
+        struct pool_body  *body = cork_new(struct pool_body);
+        body->parent.run = pool_body__run;
+        body->parent.free = pool_body__free;
+        body->pool = pool;
+        fail_if_error(threads[i] = cork_thread_new("pool", &body->parent));
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+    for (i = 0; i < POOL_THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+    }
+    cork_buffer_pool_free(pool);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -235,6 +474,12 @@ test_suite()
     TCase  *tc_buffer = tcase_create("buffer");
     tcase_add_test(tc_buffer, test_buffer);
     tcase_add_test(tc_buffer, test_buffer_append);
+    tcase_add_test(tc_buffer, test_buffer_append_fast);
+    tcase_add_test(tc_buffer, test_buffer_large);
+    tcase_add_test(tc_buffer, test_buffer_pool);
+    tcase_add_test(tc_buffer, test_buffer_pool_limit);
+    tcase_add_test(tc_buffer, test_buffer_pool_managed);
+    tcase_add_test(tc_buffer, test_buffer_pool_threads);
     tcase_add_test(tc_buffer, test_buffer_slicing);
     tcase_add_test(tc_buffer, test_buffer_stream);
     suite_add_tcase(s, tc_buffer);
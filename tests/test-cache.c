@@ -0,0 +1,465 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <check.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/cache.h"
+#include "libcork/threads/basics.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helper functions
+ */
+
+/* Keys and values are small integers smuggled into pointers, so there's
+ * nothing to free. */
+
+#define K(i)  ((void *) (uintptr_t) (i))
+#define V(i)  ((void *) (uintptr_t) ((i) * 10))
+
+static cork_hash
+test_hasher(const void *key)
+{
+    uintptr_t  i = (uintptr_t) key;
+    return cork_hash_buffer(0, &i, sizeof(i));
+}
+
+static bool
+test_comparator(const void *key1, const void *key2)
+{
+    return key1 == key2;
+}
+
+static size_t  evict_count;
+static size_t  free_count;
+
+static void
+test_evict(void *user_data, void *key, void *value)
+{
+    size_t  *count = user_data;
+    (*count)++;
+}
+
+static void
+test_free_user_data(void *user_data)
+{
+    free_count++;
+}
+
+static struct cork_cache *
+test_cache_new(enum cork_cache_policy policy,
+               size_t max_count, size_t max_bytes)
+{
+    struct cork_cache  *cache = cork_cache_new
+        (policy, max_count, max_bytes, test_hasher, test_comparator);
+    evict_count = 0;
+    cork_cache_set_callbacks
+        (cache, &evict_count, test_free_user_data, test_evict);
+    return cache;
+}
+
+static void
+test_put(struct cork_cache *cache, uintptr_t i, size_t size)
+{
+    cork_cache_put(cache, K(i), V(i), size, NULL, NULL, NULL);
+}
+
+#define test_present(cache, i) \
+    fail_unless_equal("Cache value", "%p", V(i), cork_cache_get(cache, K(i)))
+
+static void
+test_visit_value(void *user_data, void *key, void *value)
+{
+    void  **dest = user_data;
+    *dest = value;
+}
+
+#define test_missing(cache, i) \
+    fail_unless(cork_cache_get(cache, K(i)) == NULL, \
+                "Key %zu should have been evicted", (size_t) (i))
+
+
+/*-----------------------------------------------------------------------
+ * Basic operations
+ */
+
+static void
+test_basic_ops(enum cork_cache_policy policy)
+{
+    struct cork_cache  *cache = test_cache_new(policy, 10, 0);
+    bool  is_new;
+    void  *old_key;
+    void  *old_value;
+    void  *deleted_key;
+    void  *deleted_value;
+
+    fail_unless(cork_cache_get(cache, K(1)) == NULL, "Unexpected entry");
+    fail_if(cork_cache_visit(cache, K(1), NULL, test_visit_value),
+            "Unexpected entry");
+
+    cork_cache_put(cache, K(1), V(1), 1, &is_new, &old_key, &old_value);
+    fail_unless(is_new, "Entry should be new");
+    fail_unless(old_key == NULL && old_value == NULL, "Unexpected old entry");
+    test_present(cache, 1);
+    fail_unless(cork_cache_visit(cache, K(1), &old_value, test_visit_value),
+                "Missing entry");
+    fail_unless_equal("Visited value", "%p", V(1), old_value);
+
+    cork_cache_put(cache, K(1), V(2), 5, &is_new, &old_key, &old_value);
+    fail_if(is_new, "Entry shouldn't be new");
+    fail_unless_equal("Old key", "%p", K(1), old_key);
+    fail_unless_equal("Old value", "%p", V(1), old_value);
+    fail_unless_equal("Value", "%p", V(2), cork_cache_get(cache, K(1)));
+    fail_unless_equal("Size", "%zu", 1, cork_cache_size(cache));
+    fail_unless_equal("Bytes", "%zu", 5, cork_cache_bytes(cache));
+
+    fail_unless(cork_cache_delete(cache, K(1), &deleted_key, &deleted_value),
+                "Cannot delete entry");
+    fail_unless_equal("Deleted key", "%p", K(1), deleted_key);
+    fail_unless_equal("Deleted value", "%p", V(2), deleted_value);
+    fail_if(cork_cache_delete(cache, K(1), NULL, NULL),
+            "Shouldn't be able to delete entry twice");
+    fail_unless_equal("Size", "%zu", 0, cork_cache_size(cache));
+    fail_unless_equal("Bytes", "%zu", 0, cork_cache_bytes(cache));
+
+    /* Explicit deletes and overwrites don't count as evictions. */
+    fail_unless_equal("Eviction count", "%zu", 0, evict_count);
+
+    test_put(cache, 1, 1);
+    test_put(cache, 2, 1);
+    test_put(cache, 3, 1);
+    cork_cache_clear(cache);
+    fail_unless_equal("Size", "%zu", 0, cork_cache_size(cache));
+    fail_unless_equal("Eviction count", "%zu", 3, evict_count);
+    test_missing(cache, 1);
+
+    test_put(cache, 4, 1);
+    free_count = 0;
+    cork_cache_free(cache);
+    fail_unless_equal("Eviction count", "%zu", 4, evict_count);
+    fail_unless_equal("Free count", "%zu", 1, free_count);
+}
+
+START_TEST(test_cache_basic_lru)
+{
+    DESCRIBE_TEST;
+    test_basic_ops(CORK_CACHE_LRU);
+}
+END_TEST
+
+START_TEST(test_cache_basic_clock)
+{
+    DESCRIBE_TEST;
+    test_basic_ops(CORK_CACHE_CLOCK);
+}
+END_TEST
+
+START_TEST(test_cache_basic_s3fifo)
+{
+    DESCRIBE_TEST;
+    test_basic_ops(CORK_CACHE_S3FIFO);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Eviction policies
+ */
+
+START_TEST(test_cache_lru)
+{
+    DESCRIBE_TEST;
+    struct cork_cache  *cache = test_cache_new(CORK_CACHE_LRU, 3, 0);
+
+    test_put(cache, 1, 1);
+    test_put(cache, 2, 1);
+    test_put(cache, 3, 1);
+    test_present(cache, 1);
+    test_put(cache, 4, 1);
+    test_missing(cache, 2);
+    test_present(cache, 3);
+    test_put(cache, 5, 1);
+    test_missing(cache, 1);
+    test_present(cache, 3);
+    test_present(cache, 4);
+    test_present(cache, 5);
+    fail_unless_equal("Size", "%zu", 3, cork_cache_size(cache));
+    fail_unless_equal("Eviction count", "%zu", 2, evict_count);
+
+    cork_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_cache_clock)
+{
+    DESCRIBE_TEST;
+    struct cork_cache  *cache = test_cache_new(CORK_CACHE_CLOCK, 3, 0);
+
+    test_put(cache, 1, 1);
+    test_put(cache, 2, 1);
+    test_put(cache, 3, 1);
+    /* 1 gets a second chance, so 2 is evicted instead. */
+    test_present(cache, 1);
+    test_put(cache, 4, 1);
+    test_missing(cache, 2);
+    /* 1's reference bit was cleared above, but 3's was never set. */
+    test_put(cache, 5, 1);
+    test_missing(cache, 3);
+    test_present(cache, 1);
+    test_present(cache, 4);
+    test_present(cache, 5);
+    fail_unless_equal("Eviction count", "%zu", 2, evict_count);
+
+    cork_cache_free(cache);
+}
+END_TEST
+
+static void
+test_scan_resistance(enum cork_cache_policy policy, bool should_survive)
+{
+    struct cork_cache  *cache = test_cache_new(policy, 20, 0);
+    size_t  i;
+    size_t  hot_count = 0;
+
+    /* A small working set that is accessed repeatedly... */
+    for (i = 1; i <= 10; i++) {
+        test_put(cache, i, 1);
+    }
+    for (i = 1; i <= 10; i++) {
+        test_present(cache, i);
+        test_present(cache, i);
+    }
+
+    /* ...followed by a long scan of keys that are only seen once. */
+    for (i = 1000; i < 2000; i++) {
+        test_put(cache, i, 1);
+    }
+
+    for (i = 1; i <= 10; i++) {
+        if (cork_cache_get(cache, K(i)) != NULL) {
+            hot_count++;
+        }
+    }
+
+    if (should_survive) {
+        fail_unless_equal("Surviving hot entries", "%zu", 10, hot_count);
+    } else {
+        fail_unless_equal("Surviving hot entries", "%zu", 0, hot_count);
+    }
+    fail_unless_equal("Size", "%zu", 20, cork_cache_size(cache));
+    cork_cache_free(cache);
+}
+
+START_TEST(test_cache_s3fifo)
+{
+    DESCRIBE_TEST;
+    test_scan_resistance(CORK_CACHE_LRU, false);
+    test_scan_resistance(CORK_CACHE_S3FIFO, true);
+}
+END_TEST
+
+START_TEST(test_cache_s3fifo_ghost)
+{
+    DESCRIBE_TEST;
+    struct cork_cache  *cache = test_cache_new(CORK_CACHE_S3FIFO, 20, 0);
+    size_t  i;
+
+    for (i = 1; i <= 30; i++) {
+        test_put(cache, i, 1);
+    }
+    test_missing(cache, 1);
+
+    /* 1 is still in the ghost queue, so it goes straight into the main queue
+     * and survives another scan that only touches the small queue. */
+    test_put(cache, 1, 1);
+    for (i = 100; i < 200; i++) {
+        test_put(cache, i, 1);
+    }
+    test_present(cache, 1);
+
+    cork_cache_free(cache);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Byte limits
+ */
+
+START_TEST(test_cache_bytes)
+{
+    DESCRIBE_TEST;
+    struct cork_cache  *cache = test_cache_new(CORK_CACHE_LRU, 0, 100);
+
+    test_put(cache, 1, 40);
+    test_put(cache, 2, 40);
+    fail_unless_equal("Bytes", "%zu", 80, cork_cache_bytes(cache));
+    test_put(cache, 3, 40);
+    test_missing(cache, 1);
+    fail_unless_equal("Bytes", "%zu", 80, cork_cache_bytes(cache));
+
+    /* Growing an existing entry can evict others. */
+    test_put(cache, 3, 90);
+    test_missing(cache, 2);
+    test_present(cache, 3);
+    fail_unless_equal("Bytes", "%zu", 90, cork_cache_bytes(cache));
+
+    /* An entry that's larger than the entire cache isn't kept. */
+    test_put(cache, 4, 200);
+    test_missing(cache, 4);
+    fail_unless_equal("Size", "%zu", 0, cork_cache_size(cache));
+    fail_unless_equal("Eviction count", "%zu", 4, evict_count);
+
+    cork_cache_free(cache);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Sharded caches
+ */
+
+#define THREAD_COUNT  4
+#define KEYS_PER_THREAD  10000
+
+struct test_cache_thread_body {
+    struct cork_thread_body  parent;
+    struct cork_cache  *cache;
+    uintptr_t  first_key;
+};
+
+static int
+test_cache_thread_body__run(struct cork_thread_body *vself)
+{
+    struct test_cache_thread_body  *self =
+        cork_container_of(vself, struct test_cache_thread_body, parent);
+    uintptr_t  i;
+    for (i = self->first_key; i < self->first_key + KEYS_PER_THREAD; i++) {
+        void  *value;
+        cork_cache_put(self->cache, K(i), V(i), 1, NULL, NULL, NULL);
+        value = cork_cache_get(self->cache, K(i - (i % 7)));
+        if (value != NULL && value != V(i - (i % 7))) {
+            return -1;
+        }
+        value = NULL;
+        if (cork_cache_visit(self->cache, K(i - (i % 5)),
+                             &value, test_visit_value) &&
+            value != V(i - (i % 5))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+test_cache_thread_body__free(struct cork_thread_body *vself)
+{
+    struct test_cache_thread_body  *self =
+        cork_container_of(vself, struct test_cache_thread_body, parent);
+    free(self);
+}
+
+static struct cork_thread_body *
+test_cache_thread_body_new(struct cork_cache *cache, uintptr_t first_key)
+{
+    struct test_cache_thread_body  *self =
+        cork_new(struct test_cache_thread_body);
+    self->parent.run = test_cache_thread_body__run;
+    self->parent.free = test_cache_thread_body__free;
+    self->cache = cache;
+    self->first_key = first_key;
+    return &self->parent;
+}
+
+static void
+test_sharded(enum cork_cache_policy policy)
+{
+    struct cork_cache  *cache;
+    struct cork_thread  *threads[THREAD_COUNT];
+    size_t  i;
+
+    cache = cork_cache_new_sharded
+        (8, policy, 1000, 0, test_hasher, test_comparator);
+    evict_count = 0;
+    cork_cache_set_callbacks(cache, &evict_count, NULL, NULL);
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(threads[i] = cork_thread_new
+                      ("test", test_cache_thread_body_new
+                       (cache, 1 + i * KEYS_PER_THREAD)));
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+    }
+
+    fail_unless(cork_cache_size(cache) <= 1000,
+                "Sharded cache is too large (%zu)", cork_cache_size(cache));
+    fail_unless(cork_cache_size(cache) > 0, "Sharded cache is empty");
+    cork_cache_free(cache);
+}
+
+START_TEST(test_cache_sharded)
+{
+    DESCRIBE_TEST;
+    test_sharded(CORK_CACHE_LRU);
+    test_sharded(CORK_CACHE_CLOCK);
+    test_sharded(CORK_CACHE_S3FIFO);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("cache");
+
+    TCase  *tc_ds = tcase_create("cache");
+    tcase_add_test(tc_ds, test_cache_basic_lru);
+    tcase_add_test(tc_ds, test_cache_basic_clock);
+    tcase_add_test(tc_ds, test_cache_basic_s3fifo);
+    tcase_add_test(tc_ds, test_cache_lru);
+    tcase_add_test(tc_ds, test_cache_clock);
+    tcase_add_test(tc_ds, test_cache_s3fifo);
+    tcase_add_test(tc_ds, test_cache_s3fifo_ghost);
+    tcase_add_test(tc_ds, test_cache_bytes);
+    tcase_add_test(tc_ds, test_cache_sharded);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,371 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/compression.h"
+#include "libcork/ds/stream.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+enum test_data_kind {
+    TEST_DATA_TEXT,
+    TEST_DATA_RANDOM,
+    TEST_DATA_ZEROES,
+    TEST_DATA_MIXED
+};
+
+#define TEST_DATA_KIND_COUNT  4
+
+static void
+make_test_data(struct cork_buffer *dest, enum test_data_kind kind,
+               size_t size)
+{
+    static const char  *words[] = {
+        "stream ", "consumer ", "buffer ", "block ", "frame ", "\n"
+    };
+    unsigned int  state = 42;
+    size_t  i;
+#define next_random()  (state = state * 1103515245U + 12345U, state >> 16)
+
+    cork_buffer_clear(dest);
+    for (i = 0; dest->size < size; i++) {
+        switch (kind) {
+            case TEST_DATA_TEXT:
+                cork_buffer_append_string(dest, words[next_random() % 6]);
+                break;
+            case TEST_DATA_RANDOM:
+            {
+                uint8_t  byte = next_random();
+                cork_buffer_append(dest, &byte, 1);
+                break;
+            }
+            case TEST_DATA_ZEROES:
+                cork_buffer_append(dest, "\0", 1);
+                break;
+            default:
+                if ((i / 1000) % 2 == 0) {
+                    cork_buffer_append_string(dest, words[next_random() % 6]);
+                } else {
+                    uint8_t  byte = next_random();
+                    cork_buffer_append(dest, &byte, 1);
+                }
+                break;
+        }
+    }
+    cork_buffer_truncate(dest, size);
+#undef next_random
+}
+
+static void
+compress(struct cork_buffer *dest, const void *buf, size_t size,
+         bool checksum, size_t chunk_size)
+{
+    struct cork_stream_consumer  *compressor =
+        cork_lz_compressor_new(cork_buffer_to_stream_consumer(dest), checksum);
+    cork_buffer_clear(dest);
+    fail_if_error(feed(compressor, buf, size, chunk_size));
+    cork_stream_consumer_free(compressor);
+}
+
+static int
+decompress(struct cork_buffer *dest, const void *buf, size_t size,
+           size_t chunk_size)
+{
+    int  rc;
+    struct cork_stream_consumer  *decompressor =
+        cork_lz_decompressor_new(cork_buffer_to_stream_consumer(dest));
+    cork_buffer_clear(dest);
+    rc = feed(decompressor, buf, size, chunk_size);
+    cork_stream_consumer_free(decompressor);
+    return rc;
+}
+
+static void
+test_decompress_error(const void *buf, size_t size, const char *expected)
+{
+    struct cork_buffer  output = CORK_BUFFER_INIT();
+    fail_unless(decompress(&output, buf, size, size) == -1,
+                "Expected a decompression error");
+    fail_unless_equal("Error class", "%" PRIu32,
+                      CORK_COMPRESSION_ERROR, cork_error_get_class());
+    fail_unless_streq("Error message", expected, cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    cork_buffer_done(&output);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Blocks
+ */
+
+START_TEST(test_lz_blocks)
+{
+    static const size_t  sizes[] = {
+        0, 1, 4, 12, 13, 14, 20, 100, 1000, 65535, 65536, 200000
+    };
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    size_t  i;
+    unsigned int  kind;
+    DESCRIBE_TEST;
+
+    for (kind = 0; kind < TEST_DATA_KIND_COUNT; kind++) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            size_t  size = sizes[i];
+            size_t  bound = cork_lz_compress_bound(size);
+            uint8_t  *compressed = cork_malloc(bound);
+            uint8_t  *decompressed = cork_malloc(size + 1);
+            size_t  compressed_size;
+
+            make_test_data(&data, kind, size);
+            compressed_size =
+                cork_lz_compress_block(data.buf, size, compressed);
+            fail_unless(compressed_size <= bound,
+                        "Compressed block is larger than its bound");
+            if (kind != TEST_DATA_RANDOM && size >= 1000) {
+                fail_unless(compressed_size < size / 2,
+                            "Didn't compress %zu bytes of kind %u (%zu)",
+                            size, kind, compressed_size);
+            }
+
+            fail_unless_equal("Decompressed size", "%zd", (ssize_t) size,
+                              cork_lz_decompress_block
+                              (compressed, compressed_size,
+                               decompressed, size + 1));
+            fail_unless(size == 0 ||
+                        memcmp(data.buf, decompressed, size) == 0,
+                        "Decompressed data doesn't match");
+
+            /* A destination that's too small, or a truncated block */
+            if (size > 0) {
+                fail_unless_equal("Too small", "%zd", (ssize_t) -1,
+                                  cork_lz_decompress_block
+                                  (compressed, compressed_size,
+                                   decompressed, size - 1));
+                fail_unless_equal("Truncated", "%zd", (ssize_t) -1,
+                                  cork_lz_decompress_block
+                                  (compressed, compressed_size - 1,
+                                   decompressed, size + 1));
+            }
+
+            free(compressed);
+            free(decompressed);
+        }
+    }
+
+    cork_buffer_done(&data);
+}
+END_TEST
+
+START_TEST(test_lz_garbage)
+{
+    /* Decompressing garbage should fail cleanly (or produce garbage), but
+     * must never read or write outside of the buffers. */
+    unsigned int  state = 1;
+    uint8_t  src[64];
+    uint8_t  dest[256];
+    size_t  i;
+    size_t  j;
+    DESCRIBE_TEST;
+#define next_random()  (state = state * 1103515245U + 12345U, state >> 16)
+    for (i = 0; i < 10000; i++) {
+        size_t  size = 1 + next_random() % sizeof(src);
+        ssize_t  result;
+        for (j = 0; j < size; j++) {
+            src[j] = next_random();
+        }
+        result = cork_lz_decompress_block(src, size, dest, sizeof(dest));
+        fail_unless(result <= (ssize_t) sizeof(dest),
+                    "Decompressed too much");
+    }
+#undef next_random
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Streams
+ */
+
+START_TEST(test_lz_streams)
+{
+    static const size_t  sizes[] = {
+        0, 1, 100, 65535, 65536, 65537, 300000
+    };
+    static const size_t  chunk_sizes[] = { 1, 13, 4096, 100000, SIZE_MAX };
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct cork_buffer  compressed = CORK_BUFFER_INIT();
+    struct cork_buffer  decompressed = CORK_BUFFER_INIT();
+    size_t  i;
+    size_t  j;
+    unsigned int  kind;
+    DESCRIBE_TEST;
+
+    for (kind = 0; kind < TEST_DATA_KIND_COUNT; kind++) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            size_t  size = sizes[i];
+            make_test_data(&data, kind, size);
+            for (j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+                 j++) {
+                size_t  chunk_size = chunk_sizes[j];
+                bool  checksum = (j % 2 == 0);
+                /* Feeding large streams a byte at a time is slow. */
+                if (chunk_size == 1 && size > 1000) {
+                    continue;
+                }
+                compress(&compressed, data.buf, size, checksum, chunk_size);
+                if (kind == TEST_DATA_RANDOM) {
+                    fail_unless(compressed.size <= size + 64 +
+                                8 * (size / CORK_LZ_MAX_BLOCK_SIZE),
+                                "Random data expanded too much");
+                } else if (size >= 1000) {
+                    fail_unless(compressed.size < size / 2,
+                                "Didn't compress stream");
+                }
+                fail_if_error(decompress
+                              (&decompressed, compressed.buf, compressed.size,
+                               chunk_size));
+                fail_unless_equal("Decompressed size", "%zu",
+                                  size, decompressed.size);
+                fail_unless(size == 0 ||
+                            memcmp(data.buf, decompressed.buf, size) == 0,
+                            "Decompressed data doesn't match");
+            }
+        }
+    }
+
+    cork_buffer_done(&data);
+    cork_buffer_done(&compressed);
+    cork_buffer_done(&decompressed);
+}
+END_TEST
+
+START_TEST(test_lz_concatenated)
+{
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct cork_buffer  compressed = CORK_BUFFER_INIT();
+    struct cork_buffer  frames = CORK_BUFFER_INIT();
+    struct cork_buffer  decompressed = CORK_BUFFER_INIT();
+    DESCRIBE_TEST;
+
+    make_test_data(&data, TEST_DATA_TEXT, 100000);
+    compress(&compressed, data.buf, 70000, true, SIZE_MAX);
+    cork_buffer_append_copy(&frames, &compressed);
+    compress(&compressed, (char *) data.buf + 70000, 30000, false, SIZE_MAX);
+    cork_buffer_append_copy(&frames, &compressed);
+
+    fail_if_error(decompress
+                  (&decompressed, frames.buf, frames.size, 1000));
+    fail_unless(cork_buffer_equal(&data, &decompressed),
+                "Decompressed data doesn't match");
+
+    cork_buffer_done(&data);
+    cork_buffer_done(&compressed);
+    cork_buffer_done(&frames);
+    cork_buffer_done(&decompressed);
+}
+END_TEST
+
+START_TEST(test_lz_errors)
+{
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct cork_buffer  compressed = CORK_BUFFER_INIT();
+    uint8_t  *buf;
+    DESCRIBE_TEST;
+
+    test_decompress_error
+        ("", 0, "Truncated compressed stream at offset 0");
+    test_decompress_error
+        ("abcdefgh", 8, "Invalid compressed frame header at offset 0");
+    test_decompress_error
+        ("\x89" "CLZ\x02", 5,
+         "Unsupported compressed frame flags (0x02) at offset 0");
+    test_decompress_error
+        ("\x89" "CLZ\x00" "\x00\x00\x02\x00", 9,
+         "Invalid compressed block size (131072 bytes) at offset 5");
+    test_decompress_error
+        ("\x89" "CLZ\x00" "\x01\x00\x01\x80", 9,
+         "Invalid compressed block size (65537 bytes) at offset 5");
+    /* A match that refers back before the start of the block */
+    test_decompress_error
+        ("\x89" "CLZ\x00" "\x03\x00\x00\x00" "\x00\x05\x00", 12,
+         "Corrupt compressed block at offset 5");
+
+    /* Random data is stored without compression, so flipping one of its
+     * bytes only breaks the checksum. */
+    make_test_data(&data, TEST_DATA_RANDOM, 1000);
+    compress(&compressed, data.buf, data.size, true, SIZE_MAX);
+    buf = compressed.buf;
+    buf[500] ^= 0x01;
+    test_decompress_error
+        (compressed.buf, compressed.size,
+         "Checksum mismatch in compressed block at offset 5");
+    buf[500] ^= 0x01;
+
+    test_decompress_error
+        (compressed.buf, compressed.size - 1,
+         "Truncated compressed stream at offset 1016");
+
+    cork_buffer_done(&data);
+    cork_buffer_done(&compressed);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("compression");
+
+    TCase  *tc_blocks = tcase_create("blocks");
+    tcase_add_test(tc_blocks, test_lz_blocks);
+    tcase_add_test(tc_blocks, test_lz_garbage);
+    suite_add_tcase(s, tc_blocks);
+
+    TCase  *tc_streams = tcase_create("streams");
+    tcase_add_test(tc_streams, test_lz_streams);
+    tcase_add_test(tc_streams, test_lz_concatenated);
+    tcase_add_test(tc_streams, test_lz_errors);
+    suite_add_tcase(s, tc_streams);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,313 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/csv.h"
+#include "libcork/ds/stream.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+/* Renders each row that it sees as [field][field]...\n */
+struct collector {
+    struct cork_buffer  rendered;
+    size_t  batch_count;
+    size_t  row_count;
+    size_t  fail_after;
+};
+
+static int
+collect_rows(void *user_data, const struct cork_csv_row *rows,
+             size_t row_count)
+{
+    struct collector  *collector = user_data;
+    size_t  i;
+    size_t  j;
+    fail_unless(row_count > 0, "Empty batch");
+    fail_unless(row_count <= CORK_CSV_BATCH_SIZE, "Batch too large");
+    collector->batch_count++;
+    for (i = 0; i < row_count; i++) {
+        for (j = 0; j < rows[i].field_count; j++) {
+            cork_buffer_append(&collector->rendered, "[", 1);
+            cork_buffer_append
+                (&collector->rendered,
+                 rows[i].fields[j].buf, rows[i].fields[j].size);
+            cork_buffer_append(&collector->rendered, "]", 1);
+        }
+        cork_buffer_append(&collector->rendered, "\n", 1);
+        if (++collector->row_count == collector->fail_after) {
+            cork_error_set(CORK_CSV_ERROR, CORK_CSV_INVALID, "Stop!");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+collector_init(struct collector *collector)
+{
+    cork_buffer_init(&collector->rendered);
+    cork_buffer_set_string(&collector->rendered, "");
+    collector->batch_count = 0;
+    collector->row_count = 0;
+    collector->fail_after = 0;
+}
+
+static void
+test_csv(char delimiter, char quote, const char *src, size_t size,
+         const char *expected, size_t chunk_size)
+{
+    struct collector  collector;
+    struct cork_stream_consumer  *consumer;
+    collector_init(&collector);
+    consumer = cork_csv_consumer_new
+        (delimiter, quote, &collector, NULL, collect_rows);
+    fail_if_error(feed(consumer, src, size, chunk_size));
+    fail_unless_streq("Rows", expected, collector.rendered.buf);
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+}
+
+/* Tries every chunk size up to the length of src. */
+static void
+test_csv_all_chunks(char delimiter, char quote, const char *src,
+                    const char *expected)
+{
+    size_t  size = strlen(src);
+    size_t  chunk_size;
+    test_csv(delimiter, quote, src, size, expected, size + 1);
+    for (chunk_size = 1; chunk_size <= size; chunk_size++) {
+        test_csv(delimiter, quote, src, size, expected, chunk_size);
+    }
+}
+
+static void
+test_csv_error(const char *src, size_t chunk_size, const char *message)
+{
+    struct collector  collector;
+    struct cork_stream_consumer  *consumer;
+    collector_init(&collector);
+    consumer = cork_csv_consumer_new(',', '"', &collector, NULL, collect_rows);
+    fail_unless(feed(consumer, src, strlen(src), chunk_size) == -1,
+                "Expected an error parsing \"%s\"", src);
+    fail_unless_streq("Error message", message, cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+}
+
+
+/*-----------------------------------------------------------------------
+ * CSV
+ */
+
+START_TEST(test_csv_simple)
+{
+    DESCRIBE_TEST;
+    test_csv_all_chunks(',', '"', "", "");
+    test_csv_all_chunks(',', '"', "\n\n", "");
+    test_csv_all_chunks(',', '"', "a", "[a]\n");
+    test_csv_all_chunks(',', '"', "a,b,c\n1,2,3\n", "[a][b][c]\n[1][2][3]\n");
+    test_csv_all_chunks(',', '"', "a,b,c\n1,2,3", "[a][b][c]\n[1][2][3]\n");
+    test_csv_all_chunks(',', '"', ",,\n,\n", "[][][]\n[][]\n");
+    test_csv_all_chunks(',', '"', "a,b\r\n\r\nc,d\r\n", "[a][b]\n[c][d]\n");
+    test_csv_all_chunks
+        (',', '"',
+         "first field that is longer than a single block of 64 bytes,"
+         "second field that is also quite a bit longer than that\n"
+         "short,row\n",
+         "[first field that is longer than a single block of 64 bytes]"
+         "[second field that is also quite a bit longer than that]\n"
+         "[short][row]\n");
+}
+END_TEST
+
+START_TEST(test_csv_quoted)
+{
+    DESCRIBE_TEST;
+    test_csv_all_chunks(',', '"', "\"\"\n", "[]\n");
+    test_csv_all_chunks(',', '"', "\"a,b\",c\n", "[a,b][c]\n");
+    test_csv_all_chunks(',', '"', "\"a\nb\",c\n", "[a\nb][c]\n");
+    test_csv_all_chunks(',', '"', "\"a\"\"b\",\"\"\"\"\n", "[a\"b][\"]\n");
+    test_csv_all_chunks(',', '"', "x,\"y\"\r\n", "[x][y]\n");
+    test_csv_all_chunks(',', '"', "x,\"y\r\n\"\r\n", "[x][y\r\n]\n");
+    test_csv_all_chunks
+        (',', '"',
+         "\"a quoted field with \"\"escaped\"\" quotes, commas, and\n"
+         "newlines, which is long enough to span several 64-byte blocks "
+         "of input\",z\n",
+         "[a quoted field with \"escaped\" quotes, commas, and\n"
+         "newlines, which is long enough to span several 64-byte blocks "
+         "of input][z]\n");
+}
+END_TEST
+
+START_TEST(test_tsv)
+{
+    DESCRIBE_TEST;
+    /* Quotes have no special meaning in TSV. */
+    test_csv_all_chunks('\t', '\0', "a\t\"b\n\"c\t\t\n",
+                        "[a][\"b]\n[\"c][][]\n");
+}
+END_TEST
+
+START_TEST(test_csv_invalid)
+{
+    size_t  chunk_size;
+    DESCRIBE_TEST;
+    for (chunk_size = 1; chunk_size <= 16; chunk_size++) {
+        test_csv_error("a\"b\"c,d\n", chunk_size,
+                       "Unexpected quote at offset 1");
+        test_csv_error("x,y\n\"ab\"c,d\n", chunk_size,
+                       "Unexpected character after closing quote "
+                       "at offset 8");
+        test_csv_error("x,y\n\"abc\n", chunk_size,
+                       "Unterminated quoted field at offset 4");
+    }
+}
+END_TEST
+
+START_TEST(test_csv_random)
+{
+    struct cork_buffer  src = CORK_BUFFER_INIT();
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    static const char  alphabet[] = "abc,\"\n";
+    uint32_t  state = 12345;
+    size_t  row;
+    size_t  chunk_size;
+    DESCRIBE_TEST;
+
+#define next_random()  (state = state * 1103515245U + 12345U, state >> 16)
+
+    for (row = 0; row < 1000; row++) {
+        size_t  field_count = next_random() % 5 + 1;
+        size_t  i;
+        for (i = 0; i < field_count; i++) {
+            size_t  size = next_random() % ((row % 10 == 0)? 200: 8);
+            bool  quoted = (next_random() % 4 == 0) ||
+                (field_count == 1 && size == 0);
+            size_t  j;
+            if (i > 0) {
+                cork_buffer_append(&src, ",", 1);
+            }
+            cork_buffer_append(&expected, "[", 1);
+            if (quoted) {
+                cork_buffer_append(&src, "\"", 1);
+            }
+            for (j = 0; j < size; j++) {
+                char  ch = quoted?
+                    alphabet[next_random() % 6]: alphabet[next_random() % 3];
+                if (ch == '"') {
+                    cork_buffer_append(&src, "\"", 1);
+                }
+                cork_buffer_append(&src, &ch, 1);
+                cork_buffer_append(&expected, &ch, 1);
+            }
+            if (quoted) {
+                cork_buffer_append(&src, "\"", 1);
+            }
+            cork_buffer_append(&expected, "]", 1);
+        }
+        cork_buffer_append(&src, (row % 3 == 0)? "\r\n": "\n",
+                           (row % 3 == 0)? 2: 1);
+        cork_buffer_append(&expected, "\n", 1);
+    }
+
+    for (chunk_size = 1; chunk_size < 300; chunk_size += 7) {
+        test_csv(',', '"', src.buf, src.size, expected.buf, chunk_size);
+    }
+    test_csv(',', '"', src.buf, src.size, expected.buf, src.size);
+
+    cork_buffer_done(&src);
+    cork_buffer_done(&expected);
+}
+END_TEST
+
+START_TEST(test_csv_batches)
+{
+    struct cork_buffer  src = CORK_BUFFER_INIT();
+    struct collector  collector;
+    struct cork_stream_consumer  *consumer;
+    size_t  i;
+    DESCRIBE_TEST;
+
+    for (i = 0; i < 1000; i++) {
+        cork_buffer_append_printf(&src, "%zu,x\n", i);
+    }
+
+    /* All in one chunk, so the batches should be as large as possible. */
+    collector_init(&collector);
+    consumer = cork_csv_consumer_new(',', '"', &collector, NULL, collect_rows);
+    fail_if_error(feed(consumer, src.buf, src.size, src.size));
+    fail_unless_equal("Row count", "%zu", (size_t) 1000, collector.row_count);
+    fail_unless_equal("Batch count", "%zu", (size_t) 4, collector.batch_count);
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+
+    /* An error from the callback should be passed back to the producer. */
+    collector_init(&collector);
+    collector.fail_after = 10;
+    consumer = cork_csv_consumer_new(',', '"', &collector, NULL, collect_rows);
+    fail_unless_error(feed(consumer, src.buf, src.size, 100));
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+
+    cork_buffer_done(&src);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("csv");
+
+    TCase  *tc_ds = tcase_create("csv");
+    tcase_add_test(tc_ds, test_csv_simple);
+    tcase_add_test(tc_ds, test_csv_quoted);
+    tcase_add_test(tc_ds, test_tsv);
+    tcase_add_test(tc_ds, test_csv_invalid);
+    tcase_add_test(tc_ds, test_csv_random);
+    tcase_add_test(tc_ds, test_csv_batches);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
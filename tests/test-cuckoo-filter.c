@@ -0,0 +1,176 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/cuckoo-filter.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Cuckoo filters
+ */
+
+static int
+add(struct cork_cuckoo_filter *filter, uint64_t i)
+{
+    return cork_cuckoo_filter_add(filter, &i, sizeof(i));
+}
+
+static bool
+contains(const struct cork_cuckoo_filter *filter, uint64_t i)
+{
+    return cork_cuckoo_filter_contains(filter, &i, sizeof(i));
+}
+
+static bool
+delete(struct cork_cuckoo_filter *filter, uint64_t i)
+{
+    return cork_cuckoo_filter_delete(filter, &i, sizeof(i));
+}
+
+START_TEST(test_cuckoo_filter)
+{
+    DESCRIBE_TEST;
+    struct cork_cuckoo_filter  *filter = cork_cuckoo_filter_new(10000);
+    uint64_t  i;
+    size_t  false_positives = 0;
+
+    fail_if(contains(filter, 1), "Empty filter shouldn't contain anything");
+    for (i = 0; i < 10000; i++) {
+        fail_if_error(add(filter, i));
+    }
+    fail_unless_equal("Count", "%zu", 10000, cork_cuckoo_filter_count(filter));
+    for (i = 0; i < 10000; i++) {
+        fail_unless(contains(filter, i), "Missing element %zu", (size_t) i);
+    }
+    for (i = 1000000; i < 1100000; i++) {
+        if (contains(filter, i)) {
+            false_positives++;
+        }
+    }
+    fail_unless(false_positives < 100,
+                "Too many false positives (%zu)", false_positives);
+
+    /* Delete the even elements; the odd ones must still be there. */
+    for (i = 0; i < 10000; i += 2) {
+        fail_unless(delete(filter, i), "Cannot delete element %zu", (size_t) i);
+    }
+    fail_unless_equal("Count", "%zu", 5000, cork_cuckoo_filter_count(filter));
+    for (i = 1; i < 10000; i += 2) {
+        fail_unless(contains(filter, i), "Missing element %zu", (size_t) i);
+    }
+    fail_if(delete(filter, 2000000), "Shouldn't delete missing element");
+
+    cork_cuckoo_filter_clear(filter);
+    fail_unless_equal("Count", "%zu", 0, cork_cuckoo_filter_count(filter));
+    fail_if(contains(filter, 1), "Cleared filter shouldn't contain anything");
+    cork_cuckoo_filter_free(filter);
+}
+END_TEST
+
+START_TEST(test_cuckoo_filter_full)
+{
+    DESCRIBE_TEST;
+    struct cork_cuckoo_filter  *filter = cork_cuckoo_filter_new(100);
+    size_t  size = cork_cuckoo_filter_byte_size(filter) / 2;
+    uint64_t  i;
+    int  rc = 0;
+
+    /* A filter can't hold more elements than it has slots. */
+    for (i = 0; rc == 0 && i <= size; i++) {
+        rc = add(filter, i);
+    }
+    fail_unless(rc == -1, "Filter should have filled up");
+    print_expected_failure();
+    cork_error_clear();
+
+    /* Everything that was successfully added must still be found. */
+    for (i = 0; i < cork_cuckoo_filter_count(filter); i++) {
+        fail_unless(contains(filter, i), "Missing element %zu", (size_t) i);
+    }
+
+    /* Deleting an element makes room again. */
+    fail_unless(delete(filter, 0), "Cannot delete element");
+    fail_unless(delete(filter, 1), "Cannot delete element");
+    fail_if_error(add(filter, 0));
+    cork_cuckoo_filter_free(filter);
+}
+END_TEST
+
+START_TEST(test_cuckoo_filter_serialize)
+{
+    DESCRIBE_TEST;
+    struct cork_cuckoo_filter  *filter = cork_cuckoo_filter_new(1000);
+    struct cork_cuckoo_filter  *copy;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    uint64_t  i;
+
+    for (i = 0; i < 1000; i++) {
+        fail_if_error(add(filter, i));
+    }
+    cork_cuckoo_filter_save(filter, &buf);
+    fail_if_error(copy = cork_cuckoo_filter_new_from_bytes(buf.buf, buf.size));
+    fail_unless_equal("Count", "%zu", 1000, cork_cuckoo_filter_count(copy));
+    for (i = 0; i < 1000; i++) {
+        fail_unless(contains(copy, i), "Missing element %zu", (size_t) i);
+    }
+    cork_cuckoo_filter_free(copy);
+
+    fail_unless_error(cork_cuckoo_filter_new_from_bytes(buf.buf, buf.size - 8),
+                      "Shouldn't load truncated filter");
+    memset(buf.buf, 0, 4);
+    fail_unless_error(cork_cuckoo_filter_new_from_bytes(buf.buf, buf.size),
+                      "Shouldn't load filter with bad magic number");
+
+    cork_buffer_done(&buf);
+    cork_cuckoo_filter_free(filter);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("cuckoo_filter");
+
+    TCase  *tc_ds = tcase_create("cuckoo_filter");
+    tcase_add_test(tc_ds, test_cuckoo_filter);
+    tcase_add_test(tc_ds, test_cuckoo_filter_full);
+    tcase_add_test(tc_ds, test_cuckoo_filter_serialize);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
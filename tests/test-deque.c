@@ -0,0 +1,205 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/deque.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Double-ended queues
+ */
+
+START_TEST(test_deque_back)
+{
+    DESCRIBE_TEST;
+    cork_deque(int64_t)  deque;
+    int64_t  i;
+
+    cork_deque_init(&deque);
+    fail_unless(cork_deque_is_empty(&deque), "Deque should be empty");
+
+    for (i = 0; i < 10000; i++) {
+        cork_deque_push_back(&deque, i);
+    }
+    fail_unless_equal("Size", "%zu", 10000, cork_deque_size(&deque));
+    for (i = 0; i < 10000; i++) {
+        fail_unless_equal("Element", "%" PRId64, i, cork_deque_at(&deque, i));
+    }
+    fail_unless_equal("Front", "%" PRId64, 0, cork_deque_front(&deque));
+    fail_unless_equal("Back", "%" PRId64, 9999, cork_deque_back(&deque));
+
+    /* Elements are lvalues */
+    cork_deque_at(&deque, 5000) = -1;
+    fail_unless_equal("Element", "%" PRId64, -1, cork_deque_at(&deque, 5000));
+
+    for (i = 9999; i >= 5001; i--) {
+        fail_unless_equal("Back", "%" PRId64, i, cork_deque_back(&deque));
+        cork_deque_pop_back(&deque);
+    }
+    fail_unless_equal("Size", "%zu", 5001, cork_deque_size(&deque));
+
+    cork_deque_clear(&deque);
+    fail_unless(cork_deque_is_empty(&deque), "Deque should be empty");
+    cork_deque_done(&deque);
+}
+END_TEST
+
+START_TEST(test_deque_front)
+{
+    DESCRIBE_TEST;
+    cork_deque(int64_t)  deque;
+    int64_t  i;
+
+    cork_deque_init(&deque);
+    for (i = 0; i < 10000; i++) {
+        cork_deque_push_front(&deque, i);
+    }
+    for (i = 0; i < 10000; i++) {
+        fail_unless_equal("Element", "%" PRId64,
+                          9999 - i, cork_deque_at(&deque, i));
+    }
+    for (i = 9999; i >= 0; i--) {
+        fail_unless_equal("Front", "%" PRId64, i, cork_deque_front(&deque));
+        cork_deque_pop_front(&deque);
+    }
+    fail_unless(cork_deque_is_empty(&deque), "Deque should be empty");
+    cork_deque_done(&deque);
+}
+END_TEST
+
+START_TEST(test_deque_queue)
+{
+    DESCRIBE_TEST;
+    cork_deque(int64_t)  deque;
+    int64_t  next_in = 0;
+    int64_t  next_out = 0;
+    size_t  round;
+
+    /* Use the deque as a FIFO whose size keeps changing, so that the
+     * elements wrap around the block map while it grows. */
+    cork_deque_init(&deque);
+    for (round = 1; round <= 20; round++) {
+        size_t  i;
+        for (i = 0; i < round * 300; i++) {
+            cork_deque_push_back(&deque, next_in++);
+        }
+        for (i = 0; i < round * 200; i++) {
+            fail_unless_equal("Front", "%" PRId64,
+                              next_out, cork_deque_front(&deque));
+            cork_deque_pop_front(&deque);
+            next_out++;
+        }
+        for (i = 0; i < cork_deque_size(&deque); i++) {
+            fail_unless_equal("Element", "%" PRId64,
+                              next_out + (int64_t) i,
+                              cork_deque_at(&deque, i));
+        }
+    }
+    cork_deque_done(&deque);
+}
+END_TEST
+
+START_TEST(test_deque_wrap)
+{
+    DESCRIBE_TEST;
+    struct big { char  data[3000]; int  value; };
+    cork_deque(struct big)  deque;
+    struct big  element;
+    int  i;
+
+    /* Elements that are so big that each block can only hold one of them,
+     * with pushes at both ends so that the first element ends up in the
+     * middle of the block map when it grows. */
+    cork_deque_init(&deque);
+    for (i = 0; i < 100; i++) {
+        element.value = i;
+        cork_deque_push_back(&deque, element);
+        element.value = -i - 1;
+        cork_deque_push_front(&deque, element);
+    }
+    for (i = 0; i < 200; i++) {
+        fail_unless_equal("Element", "%d",
+                          i - 100, cork_deque_at(&deque, i).value);
+    }
+    cork_deque_done(&deque);
+}
+END_TEST
+
+START_TEST(test_deque_split_block)
+{
+    DESCRIBE_TEST;
+    cork_deque(int64_t)  deque;
+    int64_t  i;
+    size_t  capacity;
+
+    /* Fill the deque exactly to capacity with the first element partway
+     * through a block, so that growing has to split that block. */
+    cork_deque_init(&deque);
+    cork_deque_push_back(&deque, 0);
+    capacity = deque.mask + 1;
+    cork_deque_pop_front(&deque);
+    for (i = 0; i < 10; i++) {
+        cork_deque_push_back(&deque, -1);
+        cork_deque_pop_front(&deque);
+    }
+    for (i = 0; (size_t) i < capacity; i++) {
+        cork_deque_push_back(&deque, i);
+    }
+    fail_unless_equal("Capacity", "%zu", capacity, deque.mask + 1);
+    cork_deque_push_back(&deque, i);
+    fail_unless_equal("Capacity", "%zu", capacity * 2, deque.mask + 1);
+    for (i = 0; (size_t) i <= capacity; i++) {
+        fail_unless_equal("Element", "%" PRId64, i, cork_deque_at(&deque, i));
+    }
+    cork_deque_done(&deque);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("deque");
+
+    TCase  *tc_ds = tcase_create("deque");
+    tcase_add_test(tc_ds, test_deque_back);
+    tcase_add_test(tc_ds, test_deque_front);
+    tcase_add_test(tc_ds, test_deque_queue);
+    tcase_add_test(tc_ds, test_deque_wrap);
+    tcase_add_test(tc_ds, test_deque_split_block);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
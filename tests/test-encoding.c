@@ -0,0 +1,685 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/encoding.h"
+#include "libcork/ds/slice.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+/* Long enough to exercise the SIMD code paths, along with a tail that's
+ * handled by the portable code. */
+#define MAX_SIZE  200
+
+static void
+fill_random(uint8_t *dest, size_t size, unsigned int seed)
+{
+    size_t  i;
+    uint32_t  state = seed * 2654435761U + 1;
+    for (i = 0; i < size; i++) {
+        state = state * 1103515245U + 12345U;
+        dest[i] = state >> 24;
+    }
+}
+
+static bool
+is_hex_digit(int ch)
+{
+    return (ch >= '0' && ch <= '9') ||
+        (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+static bool
+is_base64_char(int ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') ||
+        (ch >= '0' && ch <= '9') || ch == '+' || ch == '/';
+}
+
+#define test_decode_error(func, dest, src, src_size) \
+    do { \
+        size_t  __old_size = (dest)->size; \
+        fail_unless_error(func((dest), (src), (src_size)), \
+                          "Shouldn't be able to decode \"%.*s\"", \
+                          (int) (src_size), (char *) (src)); \
+        fail_unless((dest)->size == __old_size, \
+                    "Failed decode shouldn't change buffer"); \
+    } while (0)
+
+typedef int
+(*decoder)(struct cork_buffer *dest, const void *src, size_t size);
+
+/* Tries every possible byte at every position of encoded, and makes sure that
+ * decode accepts exactly the ones that is_valid says it should.  (We don't
+ * try a '=' in the last position, since that might be valid padding.) */
+static void
+test_every_byte(decoder decode, bool (*is_valid)(int),
+                struct cork_buffer *encoded)
+{
+    struct cork_buffer  decoded = CORK_BUFFER_INIT();
+    char  *chars = encoded->buf;
+    size_t  i;
+    int  ch;
+
+    cork_buffer_set_string(&decoded, "x");
+    for (i = 0; i < encoded->size; i++) {
+        char  old = chars[i];
+        for (ch = 0; ch < 256; ch++) {
+            int  rc;
+            if (ch == '=' && i == encoded->size - 1) {
+                continue;
+            }
+            chars[i] = ch;
+            rc = decode(&decoded, encoded->buf, encoded->size);
+            if (is_valid(ch)) {
+                fail_unless(rc == 0, "Should decode byte %d at %zu", ch, i);
+                cork_buffer_set_string(&decoded, "x");
+            } else {
+                fail_unless(rc == -1 && cork_error_occurred(),
+                            "Shouldn't decode byte %d at %zu", ch, i);
+                fail_unless_streq("Decoded", "x", decoded.buf);
+                cork_error_clear();
+            }
+        }
+        chars[i] = old;
+    }
+    cork_buffer_done(&decoded);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Hex
+ */
+
+static void
+reference_hex(struct cork_buffer *dest, const uint8_t *src, size_t size)
+{
+    size_t  i;
+    for (i = 0; i < size; i++) {
+        cork_buffer_append_printf(dest, "%02x", src[i]);
+    }
+}
+
+START_TEST(test_hex)
+{
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    struct cork_buffer  encoded = CORK_BUFFER_INIT();
+    struct cork_buffer  decoded = CORK_BUFFER_INIT();
+    struct cork_slice  slice;
+    uint8_t  src[MAX_SIZE];
+    size_t  size;
+
+    for (size = 0; size <= MAX_SIZE; size++) {
+        fill_random(src, size, size);
+        cork_buffer_set_string(&expected, "");
+        reference_hex(&expected, src, size);
+
+        cork_buffer_set_string(&encoded, "x");
+        cork_hex_encode(&encoded, src, size);
+        fail_unless_equal("Encoded size", "%zu",
+                          cork_hex_encoded_size(size) + 1, encoded.size);
+        fail_unless_streq("Hex encoding", expected.buf,
+                          (char *) encoded.buf + 1);
+
+        cork_buffer_set_string(&decoded, "x");
+        fail_if_error(cork_hex_decode
+                      (&decoded, (char *) encoded.buf + 1, encoded.size - 1));
+        fail_unless_equal("Decoded size", "%zu", size + 1, decoded.size);
+        fail_unless(memcmp((char *) decoded.buf + 1, src, size) == 0,
+                    "Hex round trip failed for %zu bytes", size);
+    }
+
+    /* Uppercase digits and slices */
+    cork_buffer_set_string
+        (&encoded, "0123456789ABCDEFabcdef0123456789ABCDEFabcdef");
+    cork_buffer_clear(&decoded);
+    fail_if_error(cork_slice_init_static(&slice, encoded.buf, encoded.size));
+    fail_if_error(cork_hex_decode_slice(&decoded, &slice));
+    cork_slice_finish(&slice);
+    cork_buffer_clear(&expected);
+    cork_hex_encode(&expected, decoded.buf, decoded.size);
+    fail_unless_streq("Hex encoding",
+                      "0123456789abcdefabcdef0123456789abcdefabcdef",
+                      expected.buf);
+
+    cork_buffer_done(&expected);
+    cork_buffer_done(&encoded);
+    cork_buffer_done(&decoded);
+}
+END_TEST
+
+START_TEST(test_hex_invalid)
+{
+    struct cork_buffer  encoded = CORK_BUFFER_INIT();
+    struct cork_buffer  decoded = CORK_BUFFER_INIT();
+    uint8_t  src[48];
+
+    fill_random(src, sizeof(src), 0);
+    cork_hex_encode(&encoded, src, sizeof(src));
+    cork_buffer_set_string(&decoded, "x");
+
+    test_decode_error(cork_hex_decode, &decoded, "0", 1);
+    test_decode_error(cork_hex_decode, &decoded, encoded.buf, 33);
+
+    /* Every possible byte at every possible position */
+    test_every_byte(cork_hex_decode, is_hex_digit, &encoded);
+
+    fail_unless_streq("Decoded", "x", decoded.buf);
+    cork_buffer_done(&encoded);
+    cork_buffer_done(&decoded);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Base64
+ */
+
+static void
+reference_base64(struct cork_buffer *dest, const uint8_t *src, size_t size)
+{
+    static const char  digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t  i;
+    for (i = 0; i < size; i += 3) {
+        uint32_t  group = src[i] << 16;
+        char  out[4];
+        if (i + 1 < size) {
+            group |= src[i + 1] << 8;
+        }
+        if (i + 2 < size) {
+            group |= src[i + 2];
+        }
+        out[0] = digits[group >> 18];
+        out[1] = digits[(group >> 12) & 0x3f];
+        out[2] = (i + 1 < size)? digits[(group >> 6) & 0x3f]: '=';
+        out[3] = (i + 2 < size)? digits[group & 0x3f]: '=';
+        cork_buffer_append(dest, out, 4);
+    }
+}
+
+static void
+test_base64_vector(const char *src, const char *expected)
+{
+    struct cork_buffer  encoded = CORK_BUFFER_INIT();
+    struct cork_buffer  decoded = CORK_BUFFER_INIT();
+    cork_base64_encode(&encoded, src, strlen(src));
+    fail_unless_streq("Base64 encoding", expected, encoded.buf);
+    fail_if_error(cork_base64_decode(&decoded, encoded.buf, encoded.size));
+    fail_unless_streq("Base64 decoding", src, decoded.buf);
+    cork_buffer_done(&encoded);
+    cork_buffer_done(&decoded);
+}
+
+START_TEST(test_base64)
+{
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    struct cork_buffer  encoded = CORK_BUFFER_INIT();
+    struct cork_buffer  decoded = CORK_BUFFER_INIT();
+    struct cork_slice  slice;
+    uint8_t  src[MAX_SIZE];
+    size_t  size;
+
+    /* From RFC 4648 */
+    test_base64_vector("", "");
+    test_base64_vector("f", "Zg==");
+    test_base64_vector("fo", "Zm8=");
+    test_base64_vector("foo", "Zm9v");
+    test_base64_vector("foob", "Zm9vYg==");
+    test_base64_vector("fooba", "Zm9vYmE=");
+    test_base64_vector("foobar", "Zm9vYmFy");
+
+    for (size = 0; size <= MAX_SIZE; size++) {
+        fill_random(src, size, size);
+        cork_buffer_set_string(&expected, "");
+        reference_base64(&expected, src, size);
+
+        cork_buffer_set_string(&encoded, "x");
+        cork_base64_encode(&encoded, src, size);
+        fail_unless_equal("Encoded size", "%zu",
+                          cork_base64_encoded_size(size) + 1, encoded.size);
+        fail_unless_streq("Base64 encoding", expected.buf,
+                          (char *) encoded.buf + 1);
+
+        cork_buffer_set_string(&decoded, "x");
+        fail_if_error(cork_base64_decode
+                      (&decoded, (char *) encoded.buf + 1, encoded.size - 1));
+        fail_unless_equal("Decoded size", "%zu", size + 1, decoded.size);
+        fail_unless(memcmp((char *) decoded.buf + 1, src, size) == 0,
+                    "Base64 round trip failed for %zu bytes", size);
+    }
+
+    /* Slices */
+    cork_buffer_set_string(&encoded, "Zm9vYmFy");
+    cork_buffer_clear(&decoded);
+    fail_if_error(cork_slice_init_static(&slice, encoded.buf, encoded.size));
+    fail_if_error(cork_base64_decode_slice(&decoded, &slice));
+    cork_slice_finish(&slice);
+    fail_unless_streq("Base64 decoding", "foobar", decoded.buf);
+
+    cork_buffer_done(&expected);
+    cork_buffer_done(&encoded);
+    cork_buffer_done(&decoded);
+}
+END_TEST
+
+START_TEST(test_base64_invalid)
+{
+    struct cork_buffer  encoded = CORK_BUFFER_INIT();
+    struct cork_buffer  decoded = CORK_BUFFER_INIT();
+    uint8_t  src[48];
+
+    cork_buffer_set_string(&decoded, "x");
+    test_decode_error(cork_base64_decode, &decoded, "Zm9", 3);
+    test_decode_error(cork_base64_decode, &decoded, "Zm9vY", 5);
+    test_decode_error(cork_base64_decode, &decoded, "Zm=v", 4);
+    test_decode_error(cork_base64_decode, &decoded, "Z===", 4);
+    test_decode_error(cork_base64_decode, &decoded, "====", 4);
+    test_decode_error(cork_base64_decode, &decoded, "Zg==Zm9v", 8);
+    test_decode_error(cork_base64_decode, &decoded, "Zm9v\nYmFy", 9);
+    /* Unused trailing bits */
+    test_decode_error(cork_base64_decode, &decoded, "Zh==", 4);
+    test_decode_error(cork_base64_decode, &decoded, "Zm9=", 4);
+
+    /* Every possible byte at every possible position */
+    fill_random(src, sizeof(src), 0);
+    cork_base64_encode(&encoded, src, sizeof(src));
+    test_every_byte(cork_base64_decode, is_base64_char, &encoded);
+
+    fail_unless_streq("Decoded", "x", decoded.buf);
+    cork_buffer_done(&encoded);
+    cork_buffer_done(&decoded);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * UTF-8
+ */
+
+/* A straightforward decoder that we can compare against. */
+static bool
+reference_utf8_valid(const uint8_t *src, size_t size)
+{
+    size_t  i = 0;
+    while (i < size) {
+        uint32_t  cp;
+        size_t  length;
+        size_t  j;
+        if (src[i] < 0x80) {
+            i++;
+            continue;
+        } else if ((src[i] & 0xe0) == 0xc0) {
+            cp = src[i] & 0x1f;
+            length = 2;
+        } else if ((src[i] & 0xf0) == 0xe0) {
+            cp = src[i] & 0x0f;
+            length = 3;
+        } else if ((src[i] & 0xf8) == 0xf0) {
+            cp = src[i] & 0x07;
+            length = 4;
+        } else {
+            return false;
+        }
+        if (i + length > size) {
+            return false;
+        }
+        for (j = 1; j < length; j++) {
+            if ((src[i + j] & 0xc0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (src[i + j] & 0x3f);
+        }
+        if ((length == 2 && cp < 0x80) ||
+            (length == 3 && cp < 0x800) ||
+            (length == 4 && cp < 0x10000) ||
+            (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+static const char  *valid_utf8[] = {
+    "",
+    "hello",
+    "\xc2\x80",
+    "\xdf\xbf",
+    "\xe0\xa0\x80",
+    "\xe2\x82\xac",
+    "\xed\x9f\xbf",
+    "\xee\x80\x80",
+    "\xef\xbf\xbf",
+    "\xf0\x90\x80\x80",
+    "\xf3\xbf\xbf\xbf",
+    "\xf4\x8f\xbf\xbf",
+    NULL
+};
+
+static const char  *invalid_utf8[] = {
+    "\x80",
+    "\xbf",
+    "\xc0\x80",
+    "\xc1\xbf",
+    "\xc2",
+    "\xc2\x41",
+    "\xc2\xc2\x80",
+    "\xe0\x80\x80",
+    "\xe0\x9f\xbf",
+    "\xe2\x82",
+    "\xe2\x28\xa1",
+    "\xed\xa0\x80",
+    "\xed\xbf\xbf",
+    "\xf0\x80\x80\x80",
+    "\xf0\x8f\xbf\xbf",
+    "\xf0\x90\x80",
+    "\xf4\x90\x80\x80",
+    "\xf5\x80\x80\x80",
+    "\xf8\x88\x80\x80\x80",
+    "\xff",
+    "\xc2\x80\x80",
+    NULL
+};
+
+/* Puts str at every possible offset within a string of ASCII, so that it
+ * straddles every possible block boundary. */
+static void
+test_utf8_offsets(const char *str, bool valid)
+{
+    size_t  length = strlen(str);
+    size_t  offset;
+    for (offset = 0; offset < 40; offset++) {
+        uint8_t  buf[100];
+        size_t  size = offset + length + 20;
+        memset(buf, 'a', sizeof(buf));
+        memcpy(buf + offset, str, length);
+        if (valid) {
+            fail_if_error(cork_utf8_validate(buf, size));
+            fail_if_error(cork_utf8_validate(buf, offset + length));
+        } else {
+            char  expected[100];
+            /* Errors are reported at the start of the invalid character;
+             * only one of our test cases starts with a valid one. */
+            size_t  error_offset = offset;
+            if (strcmp(str, "\xc2\x80\x80") == 0) {
+                error_offset += 2;
+            }
+            snprintf(expected, sizeof(expected),
+                     "Invalid UTF-8 sequence at offset %zu", error_offset);
+            fail_unless(cork_utf8_validate(buf, size) == -1,
+                        "Shouldn't validate \"%s\" at offset %zu",
+                        str, offset);
+            fail_unless_streq("Error", expected, cork_error_message());
+            cork_error_clear();
+            fail_unless(cork_utf8_validate(buf, offset + length) == -1,
+                        "Shouldn't validate \"%s\" at offset %zu",
+                        str, offset);
+            cork_error_clear();
+        }
+    }
+}
+
+START_TEST(test_utf8)
+{
+    struct cork_slice  slice;
+    size_t  i;
+
+    for (i = 0; valid_utf8[i] != NULL; i++) {
+        fail_unless(reference_utf8_valid
+                    ((const uint8_t *) valid_utf8[i], strlen(valid_utf8[i])),
+                    "Bad test case");
+        test_utf8_offsets(valid_utf8[i], true);
+    }
+
+    for (i = 0; invalid_utf8[i] != NULL; i++) {
+        fail_if(reference_utf8_valid
+                ((const uint8_t *) invalid_utf8[i], strlen(invalid_utf8[i])),
+                "Bad test case");
+        test_utf8_offsets(invalid_utf8[i], false);
+    }
+
+    fail_if_error(cork_slice_init_static(&slice, "\xe2\x82\xac", 3));
+    fail_if_error(cork_utf8_validate_slice(&slice));
+    cork_slice_finish(&slice);
+}
+END_TEST
+
+START_TEST(test_utf8_random)
+{
+    /* Random strings built out of a mix of valid characters and random
+     * bytes, so that there's a good chance of both valid and invalid
+     * results. */
+    static const char  *pieces[] = {
+        "a", "bc", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+        "\xed\x9f\xbf", "\xf4\x8f\xbf\xbf"
+    };
+    uint8_t  buf[MAX_SIZE];
+    uint8_t  random_bytes[4];
+    unsigned int  round;
+    size_t  valid_count = 0;
+
+    for (round = 0; round < 20000; round++) {
+        size_t  size = 0;
+        fill_random(random_bytes, sizeof(random_bytes), round);
+        while (size < MAX_SIZE - 4) {
+            const char  *piece;
+            size_t  piece_size;
+            fill_random(buf + size, 1, round * MAX_SIZE + size);
+            piece = pieces[buf[size] % 7];
+            piece_size = strlen(piece);
+            memcpy(buf + size, piece, piece_size);
+            size += piece_size;
+        }
+        /* Corrupt a random byte in most rounds */
+        if (random_bytes[0] % 4 != 0) {
+            buf[random_bytes[1] % size] = random_bytes[2];
+        }
+        size -= random_bytes[3] % 4;
+
+        if (reference_utf8_valid(buf, size)) {
+            valid_count++;
+            fail_if_error(cork_utf8_validate(buf, size));
+        } else {
+            fail_unless(cork_utf8_validate(buf, size) == -1,
+                        "Round %u should be invalid", round);
+            cork_error_clear();
+        }
+    }
+
+    fail_if(valid_count == 0 || valid_count == 20000,
+            "Expected a mix of valid and invalid strings");
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Escaping
+ */
+
+static void
+reference_json_escape(struct cork_buffer *dest, const uint8_t *src,
+                      size_t size)
+{
+    size_t  i;
+    for (i = 0; i < size; i++) {
+        switch (src[i]) {
+            case '"':  cork_buffer_append_string(dest, "\\\""); break;
+            case '\\': cork_buffer_append_string(dest, "\\\\"); break;
+            case '\b': cork_buffer_append_string(dest, "\\b"); break;
+            case '\f': cork_buffer_append_string(dest, "\\f"); break;
+            case '\n': cork_buffer_append_string(dest, "\\n"); break;
+            case '\r': cork_buffer_append_string(dest, "\\r"); break;
+            case '\t': cork_buffer_append_string(dest, "\\t"); break;
+            default:
+                if (src[i] < 0x20) {
+                    cork_buffer_append_printf(dest, "\\u%04x", src[i]);
+                } else {
+                    cork_buffer_append(dest, &src[i], 1);
+                }
+                break;
+        }
+    }
+}
+
+static void
+reference_c_escape(struct cork_buffer *dest, const uint8_t *src, size_t size)
+{
+    size_t  i;
+    for (i = 0; i < size; i++) {
+        switch (src[i]) {
+            case '"':  cork_buffer_append_string(dest, "\\\""); break;
+            case '\\': cork_buffer_append_string(dest, "\\\\"); break;
+            case '\a': cork_buffer_append_string(dest, "\\a"); break;
+            case '\b': cork_buffer_append_string(dest, "\\b"); break;
+            case '\f': cork_buffer_append_string(dest, "\\f"); break;
+            case '\n': cork_buffer_append_string(dest, "\\n"); break;
+            case '\r': cork_buffer_append_string(dest, "\\r"); break;
+            case '\t': cork_buffer_append_string(dest, "\\t"); break;
+            case '\v': cork_buffer_append_string(dest, "\\v"); break;
+            default:
+                if (src[i] < 0x20 || src[i] >= 0x7f) {
+                    cork_buffer_append_printf(dest, "\\%03o", src[i]);
+                } else {
+                    cork_buffer_append(dest, &src[i], 1);
+                }
+                break;
+        }
+    }
+}
+
+typedef void
+(*escaper)(struct cork_buffer *dest, const void *src, size_t size);
+
+typedef void
+(*reference_escaper)(struct cork_buffer *dest, const uint8_t *src,
+                     size_t size);
+
+/* Tries every possible byte at several positions within a long string. */
+static void
+test_escape_every_byte(escaper escape, reference_escaper reference)
+{
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    struct cork_buffer  actual = CORK_BUFFER_INIT();
+    uint8_t  buf[MAX_SIZE];
+    size_t  offset;
+    int  ch;
+
+    memset(buf, 'a', sizeof(buf));
+    for (offset = 0; offset < 70; offset++) {
+        for (ch = 0; ch < 256; ch++) {
+            buf[offset] = ch;
+            buf[offset + 33] = ch;
+            cork_buffer_set_string(&expected, "x");
+            reference(&expected, buf, sizeof(buf));
+            cork_buffer_set_string(&actual, "x");
+            escape(&actual, buf, sizeof(buf));
+            fail_unless(expected.size == actual.size &&
+                        memcmp(expected.buf, actual.buf, actual.size) == 0,
+                        "Bad escape of byte %d at %zu:\n%s\n%s",
+                        ch, offset, expected.buf, actual.buf);
+        }
+        buf[offset] = 'a';
+        buf[offset + 33] = 'a';
+    }
+
+    cork_buffer_done(&expected);
+    cork_buffer_done(&actual);
+}
+
+START_TEST(test_json_escape)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_slice  slice;
+
+    cork_buffer_set_string(&buf, "");
+    cork_json_escape(&buf, "a\"b\\c\n\x01\xc3\xa9", 9);
+    fail_unless_streq("JSON", "a\\\"b\\\\c\\n\\u0001\xc3\xa9", buf.buf);
+
+    cork_buffer_set_string(&buf, "");
+    fail_if_error(cork_slice_init_static(&slice, "tab\there", 8));
+    cork_json_escape_slice(&buf, &slice);
+    cork_slice_finish(&slice);
+    fail_unless_streq("JSON", "tab\\there", buf.buf);
+
+    test_escape_every_byte(cork_json_escape, reference_json_escape);
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+START_TEST(test_c_escape)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_slice  slice;
+
+    cork_buffer_set_string(&buf, "");
+    cork_c_escape(&buf, "a\"b\\c\n\x01\x7f\xff" "1", 10);
+    fail_unless_streq("C", "a\\\"b\\\\c\\n\\001\\177\\3771", buf.buf);
+
+    cork_buffer_set_string(&buf, "");
+    fail_if_error(cork_slice_init_static(&slice, "bell\a", 5));
+    cork_c_escape_slice(&buf, &slice);
+    cork_slice_finish(&slice);
+    fail_unless_streq("C", "bell\\a", buf.buf);
+
+    test_escape_every_byte(cork_c_escape, reference_c_escape);
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("encoding");
+
+    TCase  *tc_ds = tcase_create("encoding");
+    tcase_add_test(tc_ds, test_hex);
+    tcase_add_test(tc_ds, test_hex_invalid);
+    tcase_add_test(tc_ds, test_base64);
+    tcase_add_test(tc_ds, test_base64_invalid);
+    tcase_add_test(tc_ds, test_utf8);
+    tcase_add_test(tc_ds, test_utf8_random);
+    tcase_add_test(tc_ds, test_json_escape);
+    tcase_add_test(tc_ds, test_c_escape);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,369 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/framing.h"
+#include "libcork/ds/stream.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+/* Renders each record that it sees as [record] */
+struct collector {
+    struct cork_buffer  rendered;
+    size_t  batch_count;
+    size_t  record_count;
+    size_t  fail_after;
+};
+
+static int
+collect_records(void *user_data, const struct cork_slice *records,
+                size_t record_count)
+{
+    struct collector  *collector = user_data;
+    size_t  i;
+    fail_unless(record_count > 0, "Empty batch");
+    fail_unless(record_count <= CORK_FRAMING_BATCH_SIZE, "Batch too large");
+    collector->batch_count++;
+    for (i = 0; i < record_count; i++) {
+        cork_buffer_append(&collector->rendered, "[", 1);
+        cork_buffer_append
+            (&collector->rendered, records[i].buf, records[i].size);
+        cork_buffer_append(&collector->rendered, "]", 1);
+        if (++collector->record_count == collector->fail_after) {
+            cork_error_set(CORK_FRAMING_ERROR, CORK_FRAMING_INVALID, "Stop!");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+collector_init(struct collector *collector)
+{
+    cork_buffer_init(&collector->rendered);
+    cork_buffer_set_string(&collector->rendered, "");
+    collector->batch_count = 0;
+    collector->record_count = 0;
+    collector->fail_after = 0;
+}
+
+enum framing {
+    DELIMITED,
+    FIXED_SIZE,
+    VARINT_PREFIX,
+    U32_PREFIX
+};
+
+static struct cork_stream_consumer *
+framer_new(enum framing framing, size_t param, struct collector *collector)
+{
+    switch (framing) {
+        case DELIMITED:
+            return cork_delimited_consumer_new
+                ((char) param, collector, NULL, collect_records);
+        case FIXED_SIZE:
+            return cork_fixed_size_consumer_new
+                (param, collector, NULL, collect_records);
+        case VARINT_PREFIX:
+            return cork_varint_prefix_consumer_new
+                (param, collector, NULL, collect_records);
+        case U32_PREFIX:
+            return cork_u32_prefix_consumer_new
+                (param, collector, NULL, collect_records);
+        default:
+            fail("Unknown framing");
+            return NULL;
+    }
+}
+
+static void
+test_framing(enum framing framing, size_t param,
+             const char *src, size_t size, const char *expected,
+             size_t chunk_size)
+{
+    struct collector  collector;
+    struct cork_stream_consumer  *consumer;
+    collector_init(&collector);
+    consumer = framer_new(framing, param, &collector);
+    fail_if_error(feed(consumer, src, size, chunk_size));
+    fail_unless_streq("Records", expected, collector.rendered.buf);
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+}
+
+/* Tries every chunk size up to the length of src. */
+static void
+test_framing_all_chunks(enum framing framing, size_t param,
+                        const char *src, size_t size, const char *expected)
+{
+    size_t  chunk_size;
+    test_framing(framing, param, src, size, expected, size + 1);
+    for (chunk_size = 1; chunk_size <= size; chunk_size++) {
+        test_framing(framing, param, src, size, expected, chunk_size);
+    }
+}
+
+static void
+test_framing_error(enum framing framing, size_t param,
+                   const char *src, size_t size, size_t chunk_size,
+                   const char *message)
+{
+    struct collector  collector;
+    struct cork_stream_consumer  *consumer;
+    collector_init(&collector);
+    consumer = framer_new(framing, param, &collector);
+    fail_unless(feed(consumer, src, size, chunk_size) == -1,
+                "Expected an error");
+    fail_unless_streq("Error message", message, cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+}
+
+#define STR(s)  s, sizeof(s) - 1
+
+
+/*-----------------------------------------------------------------------
+ * Framing
+ */
+
+START_TEST(test_delimited)
+{
+    DESCRIBE_TEST;
+    test_framing_all_chunks(DELIMITED, '\n', STR(""), "");
+    test_framing_all_chunks(DELIMITED, '\n', STR("a"), "[a]");
+    test_framing_all_chunks(DELIMITED, '\n', STR("a\n"), "[a]");
+    test_framing_all_chunks(DELIMITED, '\n', STR("\n\n"), "[][]");
+    test_framing_all_chunks(DELIMITED, '\n', STR("ab\ncd\nef"),
+                            "[ab][cd][ef]");
+    test_framing_all_chunks(DELIMITED, '\0', STR("abc\0\0de\0"),
+                            "[abc][][de]");
+}
+END_TEST
+
+START_TEST(test_fixed_size)
+{
+    DESCRIBE_TEST;
+    test_framing_all_chunks(FIXED_SIZE, 1, STR(""), "");
+    test_framing_all_chunks(FIXED_SIZE, 1, STR("abc"), "[a][b][c]");
+    test_framing_all_chunks(FIXED_SIZE, 3, STR("abcdefghi"),
+                            "[abc][def][ghi]");
+}
+END_TEST
+
+START_TEST(test_varint_prefix)
+{
+    DESCRIBE_TEST;
+    test_framing_all_chunks(VARINT_PREFIX, 100, STR(""), "");
+    test_framing_all_chunks(VARINT_PREFIX, 100, STR("\x00"), "[]");
+    test_framing_all_chunks(VARINT_PREFIX, 100, STR("\x01" "a\x00\x02" "bc"),
+                            "[a][][bc]");
+    /* A two-byte length prefix, and one that isn't in its shortest form. */
+    test_framing_all_chunks
+        (VARINT_PREFIX, 200,
+         STR("\x81\x01" "0123456789012345678901234567890123456789"
+             "0123456789012345678901234567890123456789"
+             "0123456789012345678901234567890123456789"
+             "012345678" "\x82\x80\x00" "xy"),
+         "[0123456789012345678901234567890123456789"
+         "0123456789012345678901234567890123456789"
+         "0123456789012345678901234567890123456789"
+         "012345678][xy]");
+}
+END_TEST
+
+START_TEST(test_u32_prefix)
+{
+    DESCRIBE_TEST;
+    test_framing_all_chunks(U32_PREFIX, 100, STR(""), "");
+    test_framing_all_chunks(U32_PREFIX, 100, STR("\x00\x00\x00\x00"), "[]");
+    test_framing_all_chunks
+        (U32_PREFIX, 100,
+         STR("\x00\x00\x00\x01" "a" "\x00\x00\x00\x03" "bcd"),
+         "[a][bcd]");
+}
+END_TEST
+
+START_TEST(test_framing_invalid)
+{
+    size_t  chunk_size;
+    DESCRIBE_TEST;
+    for (chunk_size = 1; chunk_size <= 16; chunk_size++) {
+        test_framing_error
+            (FIXED_SIZE, 3, STR("abcdefgh"), chunk_size,
+             "Truncated record at offset 6");
+        test_framing_error
+            (VARINT_PREFIX, 100, STR("\x01" "a\x03" "bc"), chunk_size,
+             "Truncated record at offset 2");
+        test_framing_error
+            (VARINT_PREFIX, 100, STR("\x01" "a\x81"), chunk_size,
+             "Truncated record at offset 2");
+        test_framing_error
+            (VARINT_PREFIX, 100,
+             STR("\x00\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x00"),
+             chunk_size, "Invalid length prefix at offset 1");
+        test_framing_error
+            (VARINT_PREFIX, 100, STR("\x01" "a\x65"), chunk_size,
+             "Record at offset 2 is too large (101 bytes)");
+        test_framing_error
+            (U32_PREFIX, 100, STR("\x00\x00\x00\x00" "\x00\x00\x01\x00"),
+             chunk_size, "Record at offset 4 is too large (256 bytes)");
+        test_framing_error
+            (U32_PREFIX, 100, STR("\x00\x00\x00"), chunk_size,
+             "Truncated record at offset 0");
+    }
+}
+END_TEST
+
+START_TEST(test_framing_random)
+{
+    struct cork_buffer  delimited = CORK_BUFFER_INIT();
+    struct cork_buffer  varint = CORK_BUFFER_INIT();
+    struct cork_buffer  u32 = CORK_BUFFER_INIT();
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    uint32_t  state = 12345;
+    size_t  i;
+    size_t  chunk_size;
+    DESCRIBE_TEST;
+
+#define next_random()  (state = state * 1103515245U + 12345U, state >> 16)
+
+    cork_buffer_set_string(&expected, "");
+    for (i = 0; i < 1000; i++) {
+        size_t  size = next_random() % ((i % 10 == 0)? 400: 8);
+        size_t  remaining = size;
+        uint8_t  prefix[4];
+        size_t  j;
+
+        do {
+            uint8_t  byte = remaining & 0x7f;
+            remaining >>= 7;
+            if (remaining > 0) {
+                byte |= 0x80;
+            }
+            cork_buffer_append(&varint, &byte, 1);
+        } while (remaining > 0);
+        prefix[0] = prefix[1] = 0;
+        prefix[2] = size >> 8;
+        prefix[3] = size & 0xff;
+        cork_buffer_append(&u32, prefix, 4);
+
+        cork_buffer_append(&expected, "[", 1);
+        for (j = 0; j < size; j++) {
+            char  ch = 'a' + next_random() % 26;
+            cork_buffer_append(&delimited, &ch, 1);
+            cork_buffer_append(&varint, &ch, 1);
+            cork_buffer_append(&u32, &ch, 1);
+            cork_buffer_append(&expected, &ch, 1);
+        }
+        cork_buffer_append(&delimited, "\n", 1);
+        cork_buffer_append(&expected, "]", 1);
+    }
+
+    for (chunk_size = 1; chunk_size < 600; chunk_size += 7) {
+        test_framing(DELIMITED, '\n', delimited.buf, delimited.size,
+                     expected.buf, chunk_size);
+        test_framing(VARINT_PREFIX, 400, varint.buf, varint.size,
+                     expected.buf, chunk_size);
+        test_framing(U32_PREFIX, 400, u32.buf, u32.size,
+                     expected.buf, chunk_size);
+    }
+
+    cork_buffer_done(&delimited);
+    cork_buffer_done(&varint);
+    cork_buffer_done(&u32);
+    cork_buffer_done(&expected);
+}
+END_TEST
+
+START_TEST(test_framing_batches)
+{
+    struct cork_buffer  src = CORK_BUFFER_INIT();
+    struct collector  collector;
+    struct cork_stream_consumer  *consumer;
+    size_t  i;
+    DESCRIBE_TEST;
+
+    for (i = 0; i < 1000; i++) {
+        cork_buffer_append_printf(&src, "%zu\n", i);
+    }
+
+    /* All in one chunk, so the batches should be as large as possible. */
+    collector_init(&collector);
+    consumer = framer_new(DELIMITED, '\n', &collector);
+    fail_if_error(feed(consumer, src.buf, src.size, src.size));
+    fail_unless_equal("Record count", "%zu",
+                      (size_t) 1000, collector.record_count);
+    fail_unless_equal("Batch count", "%zu", (size_t) 4, collector.batch_count);
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+
+    /* An error from the callback should be passed back to the producer. */
+    collector_init(&collector);
+    collector.fail_after = 10;
+    consumer = framer_new(DELIMITED, '\n', &collector);
+    fail_unless_error(feed(consumer, src.buf, src.size, 100));
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&collector.rendered);
+
+    cork_buffer_done(&src);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("framing");
+
+    TCase  *tc_ds = tcase_create("framing");
+    tcase_add_test(tc_ds, test_delimited);
+    tcase_add_test(tc_ds, test_fixed_size);
+    tcase_add_test(tc_ds, test_varint_prefix);
+    tcase_add_test(tc_ds, test_u32_prefix);
+    tcase_add_test(tc_ds, test_framing_invalid);
+    tcase_add_test(tc_ds, test_framing_random);
+    tcase_add_test(tc_ds, test_framing_batches);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
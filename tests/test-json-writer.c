@@ -0,0 +1,386 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/json-writer.h"
+#include "libcork/ds/stream.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+#define test_writer(buf, writer, call, expected) \
+    do { \
+        cork_buffer_clear(&(buf)); \
+        cork_json_writer_init(&(writer), &(buf)); \
+        fail_if_error(call); \
+        fail_if_error(cork_json_writer_finish(&(writer))); \
+        cork_json_writer_done(&(writer)); \
+        fail_unless_streq("JSON", (expected), (char *) (buf).buf); \
+    } while (0)
+
+
+/*-----------------------------------------------------------------------
+ * Containers
+ */
+
+START_TEST(test_json_writer)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_json_writer  writer;
+
+    cork_json_writer_init(&writer, &buf);
+    fail_if_error(cork_json_writer_start_object(&writer));
+    fail_if_error(cork_json_writer_key(&writer, "name"));
+    fail_if_error(cork_json_writer_string(&writer, "say \"hi\"\n"));
+    fail_if_error(cork_json_writer_key(&writer, "list"));
+    fail_if_error(cork_json_writer_start_array(&writer));
+    fail_if_error(cork_json_writer_int(&writer, 1));
+    fail_if_error(cork_json_writer_bool(&writer, true));
+    fail_if_error(cork_json_writer_null(&writer));
+    fail_if_error(cork_json_writer_start_object(&writer));
+    fail_if_error(cork_json_writer_end_object(&writer));
+    fail_if_error(cork_json_writer_start_array(&writer));
+    fail_if_error(cork_json_writer_end_array(&writer));
+    fail_if_error(cork_json_writer_end_array(&writer));
+    fail_if_error(cork_json_writer_key_n(&writer, "k\0ey", 4));
+    fail_if_error(cork_json_writer_string_n(&writer, "a\0b", 3));
+    fail_if_error(cork_json_writer_key(&writer, "raw"));
+    fail_if_error(cork_json_writer_raw(&writer, "[1,2]", 5));
+    fail_if_error(cork_json_writer_end_object(&writer));
+    fail_if_error(cork_json_writer_finish(&writer));
+    cork_json_writer_done(&writer);
+
+    fail_unless_streq
+        ("JSON",
+         "{\"name\":\"say \\\"hi\\\"\\n\",\"list\":[1,true,null,{},[]],"
+         "\"k\\u0000ey\":\"a\\u0000b\",\"raw\":[1,2]}",
+         buf.buf);
+
+    /* Top-level scalars are fine, too */
+    test_writer(buf, writer, cork_json_writer_string(&writer, "x"), "\"x\"");
+    test_writer(buf, writer, cork_json_writer_uint(&writer, 7), "7");
+
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+START_TEST(test_json_writer_invalid)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_json_writer  writer;
+    unsigned int  i;
+
+    cork_json_writer_init(&writer, &buf);
+    fail_unless_error(cork_json_writer_finish(&writer),
+                      "Shouldn't finish an empty writer");
+    fail_unless_error(cork_json_writer_key(&writer, "a"),
+                      "Shouldn't write a key outside of an object");
+    fail_unless_error(cork_json_writer_end_object(&writer),
+                      "Shouldn't end an object that wasn't started");
+    fail_if_error(cork_json_writer_start_object(&writer));
+    fail_unless_error(cork_json_writer_int(&writer, 1),
+                      "Shouldn't write a value without a key");
+    fail_unless_error(cork_json_writer_end_array(&writer),
+                      "Shouldn't end an array inside an object");
+    fail_if_error(cork_json_writer_key(&writer, "a"));
+    fail_unless_error(cork_json_writer_key(&writer, "b"),
+                      "Shouldn't write two keys in a row");
+    fail_unless_error(cork_json_writer_end_object(&writer),
+                      "Shouldn't end an object after a key");
+    fail_if_error(cork_json_writer_start_array(&writer));
+    fail_unless_error(cork_json_writer_key(&writer, "a"),
+                      "Shouldn't write a key in an array");
+    fail_unless_error(cork_json_writer_finish(&writer),
+                      "Shouldn't finish with open containers");
+    fail_if_error(cork_json_writer_end_array(&writer));
+    fail_if_error(cork_json_writer_end_object(&writer));
+    fail_unless_error(cork_json_writer_int(&writer, 1),
+                      "Shouldn't write two top-level values");
+    fail_if_error(cork_json_writer_finish(&writer));
+    cork_json_writer_done(&writer);
+    fail_unless_streq("JSON", "{\"a\":[]}", buf.buf);
+
+    cork_buffer_clear(&buf);
+    cork_json_writer_init(&writer, &buf);
+    for (i = 0; i < CORK_JSON_WRITER_MAX_DEPTH; i++) {
+        fail_if_error(cork_json_writer_start_array(&writer));
+    }
+    fail_unless_error(cork_json_writer_start_array(&writer),
+                      "Shouldn't nest too deeply");
+    cork_json_writer_done(&writer);
+
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Numbers
+ */
+
+START_TEST(test_json_writer_integers)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_json_writer  writer;
+    char  expected[32];
+    uint64_t  value;
+
+#define test_int(value, expected) \
+    test_writer(buf, writer, cork_json_writer_int(&writer, (value)), \
+                (expected))
+#define test_uint(value, expected) \
+    test_writer(buf, writer, cork_json_writer_uint(&writer, (value)), \
+                (expected))
+
+    test_int(0, "0");
+    test_int(9, "9");
+    test_int(10, "10");
+    test_int(-1, "-1");
+    test_int(-100, "-100");
+    test_int(INT64_MAX, "9223372036854775807");
+    test_int(INT64_MIN, "-9223372036854775808");
+    test_uint(0, "0");
+    test_uint(UINT64_MAX, "18446744073709551615");
+
+    /* Every number of digits, and every two-digit suffix */
+    for (value = 1; value < UINT64_MAX / 10; value = value * 10 + 3) {
+        snprintf(expected, sizeof(expected), "%" PRIu64, value);
+        test_uint(value, expected);
+    }
+    for (value = 0; value < 1000; value++) {
+        snprintf(expected, sizeof(expected), "%" PRIu64, value);
+        test_uint(value, expected);
+    }
+
+#undef test_int
+#undef test_uint
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+START_TEST(test_json_writer_doubles)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_json_writer  writer;
+
+#define test_double(value, expected) \
+    test_writer(buf, writer, cork_json_writer_double(&writer, (value)), \
+                (expected))
+
+    test_double(0.0, "0");
+    test_double(-0.0, "-0");
+    test_double(1.0, "1");
+    test_double(-1.5, "-1.5");
+    test_double(0.1, "0.1");
+    test_double(0.3, "0.3");
+    test_double(123.456, "123.456");
+    test_double(1e20, "100000000000000000000");
+    test_double(1e21, "1e+21");
+    test_double(1.5e300, "1.5e+300");
+    test_double(0.000001, "0.000001");
+    test_double(1e-7, "1e-7");
+    test_double(1.25e-10, "1.25e-10");
+    test_double(5e-324, "5e-324");
+    test_double(2.2250738585072014e-308, "2.2250738585072014e-308");
+    test_double(1.7976931348623157e308, "1.7976931348623157e+308");
+    test_double(9007199254740993.0, "9007199254740992");
+    test_double(NAN, "null");
+    test_double(INFINITY, "null");
+    test_double(-INFINITY, "null");
+
+#undef test_double
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+START_TEST(test_json_writer_doubles_round_trip)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_json_writer  writer;
+    uint64_t  state = 1;
+    unsigned int  i;
+
+    for (i = 0; i < 100000; i++) {
+        uint64_t  bits;
+        uint64_t  parsed_bits;
+        double  value;
+        double  parsed;
+
+        state = state * UINT64_C(6364136223846793005) +
+            UINT64_C(1442695040888963407);
+        /* Alternate between random bit patterns, which are mostly very large
+         * or very small, and values with a moderate exponent. */
+        bits = (i % 2 == 0)? state:
+            (state & UINT64_C(0x800fffffffffffff)) |
+            ((UINT64_C(0x3ff) - 40 + (state >> 52) % 80) << 52);
+        memcpy(&value, &bits, sizeof(value));
+        if (isnan(value) || isinf(value)) {
+            continue;
+        }
+
+        cork_buffer_clear(&buf);
+        cork_json_writer_init(&writer, &buf);
+        fail_if_error(cork_json_writer_double(&writer, value));
+        cork_json_writer_done(&writer);
+
+        parsed = strtod(buf.buf, NULL);
+        memcpy(&parsed_bits, &parsed, sizeof(parsed));
+        fail_unless(bits == parsed_bits,
+                    "%s doesn't round-trip (expected %.17g)",
+                    (char *) buf.buf, value);
+    }
+
+    cork_buffer_done(&buf);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Stream consumers
+ */
+
+struct collector {
+    struct cork_stream_consumer  parent;
+    struct cork_buffer  buf;
+    size_t  chunk_count;
+    bool  saw_first;
+    bool  eof;
+};
+
+static int
+collector__data(struct cork_stream_consumer *vself,
+                const void *buf, size_t size, bool is_first_chunk)
+{
+    struct collector  *self =
+        cork_container_of(vself, struct collector, parent);
+    fail_unless(is_first_chunk == !self->saw_first,
+                "Unexpected is_first_chunk");
+    self->saw_first = true;
+    self->chunk_count++;
+    cork_buffer_append(&self->buf, buf, size);
+    return 0;
+}
+
+static int
+collector__eof(struct cork_stream_consumer *vself)
+{
+    struct collector  *self =
+        cork_container_of(vself, struct collector, parent);
+    self->eof = true;
+    return 0;
+}
+
+START_TEST(test_json_writer_stream)
+{
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    struct collector  collector;
+    struct cork_json_writer  direct;
+    struct cork_json_writer  streamed;
+    unsigned int  i;
+
+    collector.parent.data = collector__data;
+    collector.parent.eof = collector__eof;
+    collector.parent.free = NULL;
+    cork_buffer_init(&collector.buf);
+    collector.chunk_count = 0;
+    collector.saw_first = false;
+    collector.eof = false;
+
+    cork_json_writer_init(&direct, &expected);
+    cork_json_writer_init_stream(&streamed, &collector.parent, 64);
+
+#define both(call) \
+    do { \
+        fail_if_error(call(&direct)); \
+        fail_if_error(call(&streamed)); \
+    } while (0)
+#define both1(call, arg) \
+    do { \
+        fail_if_error(call(&direct, (arg))); \
+        fail_if_error(call(&streamed, (arg))); \
+    } while (0)
+
+    both(cork_json_writer_start_array);
+    for (i = 0; i < 1000; i++) {
+        both(cork_json_writer_start_object);
+        both1(cork_json_writer_key, "index");
+        both1(cork_json_writer_uint, i);
+        both1(cork_json_writer_key, "value");
+        both1(cork_json_writer_double, i / 8.0);
+        both(cork_json_writer_end_object);
+    }
+    both(cork_json_writer_end_array);
+    fail_unless(!collector.eof, "Shouldn't see EOF before finishing");
+    both(cork_json_writer_finish);
+    cork_json_writer_done(&direct);
+    cork_json_writer_done(&streamed);
+
+#undef both
+#undef both1
+
+    fail_unless(collector.eof, "Should see EOF");
+    fail_unless(collector.chunk_count > 100,
+                "Should have flushed more often (%zu chunks)",
+                collector.chunk_count);
+    fail_unless_equal("Size", "%zu", expected.size, collector.buf.size);
+    fail_unless_streq("JSON", expected.buf, collector.buf.buf);
+
+    cork_buffer_done(&expected);
+    cork_buffer_done(&collector.buf);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("json_writer");
+
+    TCase  *tc_ds = tcase_create("json_writer");
+    tcase_add_test(tc_ds, test_json_writer);
+    tcase_add_test(tc_ds, test_json_writer_invalid);
+    tcase_add_test(tc_ds, test_json_writer_integers);
+    tcase_add_test(tc_ds, test_json_writer_doubles);
+    tcase_add_test(tc_ds, test_json_writer_doubles_round_trip);
+    tcase_add_test(tc_ds, test_json_writer_stream);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -12,6 +12,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <check.h>
 
@@ -59,6 +60,43 @@ START_TEST(test_mempool_01)
 }
 END_TEST
 
+START_TEST(test_mempool_fast_01)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    mp = cork_mempool_new_ex(int64_t, 64);
+
+    size_t  i;
+    int64_t  *objects[OBJECT_COUNT];
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        /* Mix the inline and out-of-line versions. */
+        if (i % 2 == 0) {
+            objects[i] = cork_mempool_new_object_fast(mp);
+        } else {
+            objects[i] = cork_mempool_new_object(mp);
+        }
+        fail_if(objects[i] == NULL, "Cannot allocate object #%zu", i);
+        *objects[i] = i;
+    }
+
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        fail_unless(*objects[i] == (int64_t) i,
+                    "Unexpected value %" PRId64, *objects[i]);
+        if (i % 3 == 0) {
+            cork_mempool_free_object(mp, objects[i]);
+        } else {
+            cork_mempool_free_object_fast(mp, objects[i]);
+        }
+    }
+
+    /* Since pools are LIFO, we should get back the last object we freed. */
+    fail_unless(cork_mempool_new_object_fast(mp) == objects[OBJECT_COUNT - 1],
+                "Expected to reuse the most recently freed object");
+    cork_mempool_free_object_fast(mp, objects[OBJECT_COUNT - 1]);
+    cork_mempool_free(mp);
+}
+END_TEST
+
 START_TEST(test_mempool_fail_01)
 {
     DESCRIBE_TEST;
@@ -132,6 +170,125 @@ START_TEST(test_mempool_reuse_01)
 END_TEST
 
 
+START_TEST(test_mempool_compact_01)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    mp = cork_mempool_new_compact_ex(int64_t, 64);
+
+    size_t  i;
+    int64_t  *objects[OBJECT_COUNT];
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        fail_if((objects[i] = cork_mempool_new_object(mp)) == NULL,
+                "Cannot allocate object #%zu", i);
+        *objects[i] = i;
+    }
+
+    /* Objects don't have headers, so the first two objects from a block are
+     * right next to each other. */
+    fail_unless(objects[0] - objects[1] == 1,
+                "Compact objects should be adjacent");
+
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        fail_unless(*objects[i] == (int64_t) i,
+                    "Unexpected value %" PRId64, *objects[i]);
+        cork_mempool_free_object(mp, objects[i]);
+    }
+
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        fail_if((objects[i] = cork_mempool_new_object(mp)) == NULL,
+                "Cannot reallocate object #%zu", i);
+    }
+
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        cork_mempool_free_object(mp, objects[i]);
+    }
+
+    cork_mempool_free(mp);
+}
+END_TEST
+
+START_TEST(test_mempool_compact_02)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    /* Objects smaller than a pointer are padded so that they can hold the
+     * free list link. */
+    mp = cork_mempool_new_compact(char);
+
+    char  *obj1;
+    char  *obj2;
+    fail_if((obj1 = cork_mempool_new_object(mp)) == NULL,
+            "Cannot allocate object");
+    fail_if((obj2 = cork_mempool_new_object(mp)) == NULL,
+            "Cannot allocate object");
+    fail_unless(obj1 - obj2 == CORK_SIZEOF_POINTER,
+                "Unexpected object spacing %td", obj1 - obj2);
+    cork_mempool_free_object(mp, obj1);
+    cork_mempool_free_object(mp, obj2);
+    cork_mempool_free(mp);
+}
+END_TEST
+
+static void
+test_aligned_pool(struct cork_mempool *mp, size_t alignment)
+{
+    size_t  i;
+    char  *objects[OBJECT_COUNT];
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        fail_if((objects[i] = cork_mempool_new_object(mp)) == NULL,
+                "Cannot allocate object #%zu", i);
+        fail_unless(((uintptr_t) objects[i] & (alignment - 1)) == 0,
+                    "Object #%zu (%p) isn't %zu-byte aligned",
+                    i, objects[i], alignment);
+        memset(objects[i], (int) i, 24);
+    }
+
+    for (i = 0; i < OBJECT_COUNT; i++) {
+        fail_unless(objects[i][23] == (char) i,
+                    "Object #%zu was overwritten", i);
+        cork_mempool_free_object(mp, objects[i]);
+    }
+
+    cork_mempool_free(mp);
+}
+
+START_TEST(test_mempool_aligned_01)
+{
+    DESCRIBE_TEST;
+    struct {
+        char  data[24];
+    }  *obj;
+    size_t  alignment;
+    for (alignment = 8; alignment <= 64; alignment *= 2) {
+        test_aligned_pool
+            (cork_mempool_new_aligned_size_ex(sizeof(*obj), 256, alignment),
+             alignment);
+        test_aligned_pool
+            (cork_mempool_new_compact_aligned_size_ex
+             (sizeof(*obj), 256, alignment), alignment);
+    }
+}
+END_TEST
+
+START_TEST(test_mempool_aligned_02)
+{
+    DESCRIBE_TEST;
+    /* The block size is too small to hold even one object once it's
+     * aligned, so the pool has to use larger blocks. */
+    struct {
+        char  data[64];
+    }  *obj;
+    test_aligned_pool
+        (cork_mempool_new_compact_aligned(*obj, 4096), 4096);
+    test_aligned_pool
+        (cork_mempool_new_aligned(*obj, 4096), 4096);
+    test_aligned_pool
+        (cork_mempool_new_aligned_size_ex(sizeof(*obj), 64, 64), 64);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -143,6 +300,7 @@ test_suite()
 
     TCase  *tc_mempool = tcase_create("mempool");
     tcase_add_test(tc_mempool, test_mempool_01);
+    tcase_add_test(tc_mempool, test_mempool_fast_01);
 #if NDEBUG
     /* If we're not compiling assertions then this test won't abort */
     tcase_add_test(tc_mempool, test_mempool_fail_01);
@@ -150,6 +308,10 @@ test_suite()
     tcase_add_test_raise_signal(tc_mempool, test_mempool_fail_01, SIGABRT);
 #endif
     tcase_add_test(tc_mempool, test_mempool_reuse_01);
+    tcase_add_test(tc_mempool, test_mempool_compact_01);
+    tcase_add_test(tc_mempool, test_mempool_compact_02);
+    tcase_add_test(tc_mempool, test_mempool_aligned_01);
+    tcase_add_test(tc_mempool, test_mempool_aligned_02);
     suite_add_tcase(s, tc_mempool);
 
     return s;
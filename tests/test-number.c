@@ -0,0 +1,505 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/number.h"
+#include "libcork/ds/slice.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+#define test_parse(func, type, fmt, str, expected) \
+    do { \
+        type  __value; \
+        fail_if_error(func((str), strlen(str), &__value)); \
+        fail_unless_equal((str), fmt, (type) (expected), __value); \
+    } while (0)
+
+/* Makes sure that we get the right error, and that dest isn't changed. */
+#define test_parse_error(func, type, str, code, message) \
+    do { \
+        type  __value = 42; \
+        fail_unless(func((str), strlen(str), &__value) == -1, \
+                    "Expected an error parsing \"%s\"", (str)); \
+        fail_unless(cork_error_occurred(), \
+                    "Expected an error parsing \"%s\"", (str)); \
+        fail_unless_equal("Error code", "%u", (unsigned int) (code), \
+                          cork_error_get_code()); \
+        fail_unless_streq("Error message", (message), cork_error_message()); \
+        fail_unless(__value == 42, "dest changed after parsing \"%s\"", \
+                    (str)); \
+        print_expected_failure(); \
+        cork_error_clear(); \
+    } while (0)
+
+/* Makes sure that an _ex function reports the right error offset.  Use
+ * SIZE_MAX for errors that shouldn't touch the offset. */
+#define test_parse_error_offset(func, type, str, code, expected) \
+    do { \
+        type  __value = 42; \
+        size_t  __offset = SIZE_MAX; \
+        fail_unless(func((str), strlen(str), &__value, &__offset) == -1, \
+                    "Expected an error parsing \"%s\"", (str)); \
+        fail_unless_equal("Error code", "%u", (unsigned int) (code), \
+                          cork_error_get_code()); \
+        fail_unless_equal("Error offset", "%zu", \
+                          (size_t) (expected), __offset); \
+        fail_unless(__value == 42, "dest changed after parsing \"%s\"", \
+                    (str)); \
+        cork_error_clear(); \
+    } while (0)
+
+static uint64_t
+double_bits(double value)
+{
+    uint64_t  bits;
+    memcpy(&bits, &value, sizeof(double));
+    return bits;
+}
+
+/* Checks that we parse str to exactly the same double as strtod, or that we
+ * report an overflow when strtod does. */
+static void
+test_double(const char *str)
+{
+    double  expected = strtod(str, NULL);
+    double  actual;
+    if (isinf(expected)) {
+        fail_unless_error(cork_parse_double(str, strlen(str), &actual),
+                          "Expected an overflow parsing \"%s\"", str);
+        return;
+    }
+    fail_if_error(cork_parse_double(str, strlen(str), &actual));
+    fail_unless(double_bits(expected) == double_bits(actual),
+                "Parsing \"%s\": expected %.17g, got %.17g",
+                str, expected, actual);
+}
+
+static uint64_t
+next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Integers
+ */
+
+START_TEST(test_parse_integers)
+{
+    DESCRIBE_TEST;
+    test_parse(cork_parse_int8, int8_t, "%d", "0", 0);
+    test_parse(cork_parse_int8, int8_t, "%d", "-0", 0);
+    test_parse(cork_parse_int8, int8_t, "%d", "127", 127);
+    test_parse(cork_parse_int8, int8_t, "%d", "-128", -128);
+    test_parse(cork_parse_int8, int8_t, "%d", "0000000000000000000000042", 42);
+    test_parse(cork_parse_int16, int16_t, "%d", "32767", 32767);
+    test_parse(cork_parse_int16, int16_t, "%d", "-32768", -32768);
+    test_parse(cork_parse_int32, int32_t, "%" PRId32,
+               "2147483647", INT32_MAX);
+    test_parse(cork_parse_int32, int32_t, "%" PRId32,
+               "-2147483648", INT32_MIN);
+    test_parse(cork_parse_int64, int64_t, "%" PRId64,
+               "9223372036854775807", INT64_MAX);
+    test_parse(cork_parse_int64, int64_t, "%" PRId64,
+               "-9223372036854775808", INT64_MIN);
+    test_parse(cork_parse_int64, int64_t, "%" PRId64,
+               "-12345678", -12345678);
+    test_parse(cork_parse_uint8, uint8_t, "%u", "255", 255);
+    test_parse(cork_parse_uint16, uint16_t, "%u", "65535", 65535);
+    test_parse(cork_parse_uint32, uint32_t, "%" PRIu32,
+               "4294967295", UINT32_MAX);
+    test_parse(cork_parse_uint64, uint64_t, "%" PRIu64,
+               "18446744073709551615", UINT64_MAX);
+    test_parse(cork_parse_uint64, uint64_t, "%" PRIu64,
+               "1234567890123456", UINT64_C(1234567890123456));
+    test_parse(cork_parse_uint64, uint64_t, "%" PRIu64,
+               "00000000000000000000018446744073709551615", UINT64_MAX);
+}
+END_TEST
+
+START_TEST(test_parse_integers_random)
+{
+    uint64_t  state = UINT64_C(0x9e3779b97f4a7c15);
+    size_t  i;
+    DESCRIBE_TEST;
+    /* Every length from 1 to 20 digits, to exercise both the eight-digit
+     * and single-digit code paths. */
+    for (i = 0; i < 10000; i++) {
+        char  str[32];
+        uint64_t  expected = next_random(&state) >> (i % 64);
+        uint64_t  actual;
+        int64_t  signed_actual;
+        snprintf(str, sizeof(str), "%" PRIu64, expected);
+        fail_if_error(cork_parse_uint64(str, strlen(str), &actual));
+        fail_unless_equal(str, "%" PRIu64, expected, actual);
+        snprintf(str, sizeof(str), "%" PRId64, (int64_t) expected);
+        fail_if_error(cork_parse_int64(str, strlen(str), &signed_actual));
+        fail_unless_equal(str, "%" PRId64, (int64_t) expected, signed_actual);
+        snprintf(str, sizeof(str), "%" PRIx64, expected);
+        fail_if_error(cork_parse_uint64_hex(str, strlen(str), &actual));
+        fail_unless_equal(str, "%" PRIu64, expected, actual);
+    }
+}
+END_TEST
+
+START_TEST(test_parse_integers_invalid)
+{
+    DESCRIBE_TEST;
+    test_parse_error(cork_parse_int32, int32_t, "",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 0");
+    test_parse_error(cork_parse_int32, int32_t, "-",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 1");
+    test_parse_error(cork_parse_int32, int32_t, "+1",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 0");
+    test_parse_error(cork_parse_int32, int32_t, " 1",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 0");
+    test_parse_error(cork_parse_int32, int32_t, "1 ",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 1");
+    test_parse_error(cork_parse_int32, int32_t, "--1",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 1");
+    test_parse_error(cork_parse_uint32, uint32_t, "-1",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 0");
+    /* The invalid character is in the middle of what would otherwise be an
+     * eight-digit block. */
+    test_parse_error(cork_parse_uint64, uint64_t, "1234567812345x78",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 13");
+    test_parse_error(cork_parse_uint64, uint64_t, "12:45678",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 2");
+
+    test_parse_error(cork_parse_int8, int8_t, "128",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for int8_t");
+    test_parse_error(cork_parse_int8, int8_t, "-129",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for int8_t");
+    test_parse_error(cork_parse_uint16, uint16_t, "65536",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for uint16_t");
+    test_parse_error(cork_parse_int64, int64_t, "9223372036854775808",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for int64_t");
+    test_parse_error(cork_parse_int64, int64_t, "-9223372036854775809",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for int64_t");
+    test_parse_error(cork_parse_uint64, uint64_t, "18446744073709551616",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for uint64_t");
+    test_parse_error(cork_parse_uint64, uint64_t, "99999999999999999999",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for uint64_t");
+}
+END_TEST
+
+START_TEST(test_parse_hex)
+{
+    DESCRIBE_TEST;
+    test_parse(cork_parse_uint8_hex, uint8_t, "%u", "ff", 255);
+    test_parse(cork_parse_uint8_hex, uint8_t, "%u", "0x0F", 15);
+    test_parse(cork_parse_uint16_hex, uint16_t, "%u", "0XBeeF", 0xbeef);
+    test_parse(cork_parse_uint32_hex, uint32_t, "%" PRIu32,
+               "000000000000deadbeef", 0xdeadbeef);
+    test_parse(cork_parse_uint64_hex, uint64_t, "%" PRIu64,
+               "0xffffffffffffffff", UINT64_MAX);
+
+    test_parse_error(cork_parse_uint8_hex, uint8_t, "0x",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 2");
+    test_parse_error(cork_parse_uint8_hex, uint8_t, "0xg",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 2");
+    test_parse_error(cork_parse_uint8_hex, uint8_t, "x1",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 0");
+    test_parse_error(cork_parse_uint8_hex, uint8_t, "100",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for uint8_t");
+    test_parse_error(cork_parse_uint64_hex, uint64_t, "10000000000000000",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for uint64_t");
+}
+END_TEST
+
+START_TEST(test_parse_slices)
+{
+    struct cork_slice  slice;
+    int32_t  value;
+    uint16_t  hex_value;
+    double  double_value;
+    DESCRIBE_TEST;
+    /* None of these are NUL-terminated. */
+    fail_if_error(cork_slice_init_static(&slice, "-1234,abcd", 5));
+    fail_if_error(cork_parse_int32_slice(&slice, &value));
+    fail_unless_equal("Parsed value", "%" PRId32, -1234, value);
+    fail_if_error(cork_slice_init_static(&slice, "abcd,1", 4));
+    fail_if_error(cork_parse_uint16_hex_slice(&slice, &hex_value));
+    fail_unless_equal("Parsed value", "%u", 0xabcd, hex_value);
+    fail_if_error(cork_slice_init_static(&slice, "2.5e10", 3));
+    fail_if_error(cork_parse_double_slice(&slice, &double_value));
+    fail_unless(double_value == 2.5, "Parsed value not equal");
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Doubles
+ */
+
+START_TEST(test_parse_doubles)
+{
+    double  value;
+    DESCRIBE_TEST;
+
+    test_double("0");
+    test_double("-0");
+    test_double("0.0");
+    test_double("-0.0e10");
+    test_double("1");
+    test_double("+1");
+    test_double("1.5");
+    test_double(".5");
+    test_double("5.");
+    test_double("0.1");
+    test_double("3.14159265358979323846");
+    test_double("1e22");
+    test_double("1e23");
+    test_double("9007199254740993");
+    test_double("12345678.12345678");
+    test_double("0.000000000000000000000000000012345");
+    test_double("1.7976931348623157e308");
+    test_double("2.2250738585072014e-308");
+    test_double("2.2250738585072011e-308");
+    test_double("4.9406564584124654e-324");
+    test_double("2.4703282292062328e-324");
+    test_double("2.4703282292062327e-324");
+    test_double("1e-400");
+    test_double("1E+5");
+    test_double("1e-00000000000000000000000005");
+    test_double("1e-99999999999999999999999999");
+    test_double("0e99999999999999999999999999");
+    /* Exactly halfway between two doubles, which forces the slow path. */
+    test_double("9007199254740993.0");
+    test_double("9007199254740995");
+    test_double("2.00000000000000011102230246251565404236316680908203125");
+    test_double("2.00000000000000011102230246251565404236316680908203124");
+    test_double("2.00000000000000011102230246251565404236316680908203126");
+    /* More digits than we can keep in a uint64_t */
+    test_double("123456789012345678901234567890");
+    test_double("0.123456789012345678901234567890");
+    test_double("7.2057594037927933e16");
+    test_double
+        ("179769313486231580793728971405303415079934132710037826936173778"
+         "980444968292764750946649017977587207096330286416692887910946555"
+         "547851940402630657488671505820681908902000708383676273854845817"
+         "711531764475730270069855571366959622842914819860834936475292719"
+         "074168444365510704342711559699508093042880177904174497791.9999999"
+         "999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999"
+         "9999999999999999999999999999999999999999999999999999999999999999");
+
+    fail_if_error(cork_parse_double("inf", 3, &value));
+    fail_unless(isinf(value) && value > 0, "Expected infinity");
+    fail_if_error(cork_parse_double("-Infinity", 9, &value));
+    fail_unless(isinf(value) && value < 0, "Expected -infinity");
+    fail_if_error(cork_parse_double("NaN", 3, &value));
+    fail_unless(isnan(value), "Expected NaN");
+}
+END_TEST
+
+START_TEST(test_parse_doubles_random)
+{
+    uint64_t  state = UINT64_C(0x2545f4914f6cdd1d);
+    size_t  i;
+    DESCRIBE_TEST;
+
+    /* Random bit patterns, printed with varying precision */
+    for (i = 0; i < 20000; i++) {
+        char  str[64];
+        uint64_t  bits = next_random(&state);
+        double  value;
+        memcpy(&value, &bits, sizeof(double));
+        if (isnan(value) || isinf(value)) {
+            continue;
+        }
+        snprintf(str, sizeof(str), "%.*g", (int) (i % 19) + 1, value);
+        test_double(str);
+        snprintf(str, sizeof(str), "%.17g", value);
+        test_double(str);
+    }
+
+    /* Random digit strings, including ones with more digits than fit in a
+     * uint64_t.  None of them are large enough to overflow. */
+    for (i = 0; i < 20000; i++) {
+        char  str[128];
+        size_t  len = 0;
+        size_t  digit_count = next_random(&state) % 40 + 1;
+        size_t  point = next_random(&state) % (digit_count + 1);
+        int  exponent = (int) (next_random(&state) % 618) - 350;
+        size_t  j;
+        for (j = 0; j < digit_count; j++) {
+            if (j == point) {
+                str[len++] = '.';
+            }
+            str[len++] = '0' + next_random(&state) % 10;
+        }
+        snprintf(str + len, sizeof(str) - len, "e%d", exponent);
+        test_double(str);
+    }
+}
+END_TEST
+
+START_TEST(test_parse_doubles_invalid)
+{
+    DESCRIBE_TEST;
+    test_parse_error(cork_parse_double, double, "",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 0");
+    test_parse_error(cork_parse_double, double, "-",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 1");
+    test_parse_error(cork_parse_double, double, ".",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 1");
+    test_parse_error(cork_parse_double, double, "-.e1",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 2");
+    test_parse_error(cork_parse_double, double, "1e",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 2");
+    test_parse_error(cork_parse_double, double, "1e+",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 3");
+    test_parse_error(cork_parse_double, double, "1.5.",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 3");
+    test_parse_error(cork_parse_double, double, "12345678.1234x678",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 13");
+    test_parse_error(cork_parse_double, double, "1e5 ",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 3");
+    test_parse_error(cork_parse_double, double, "0x10",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 1");
+    test_parse_error(cork_parse_double, double, "infinit",
+                     CORK_NUMBER_INVALID,
+                     "Unexpected end of number at offset 7");
+    test_parse_error(cork_parse_double, double, "-info",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 4");
+    test_parse_error(cork_parse_double, double, "nana",
+                     CORK_NUMBER_INVALID, "Invalid character at offset 3");
+    test_parse_error(cork_parse_double, double, "1e309",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for double");
+    test_parse_error(cork_parse_double, double, "-1.8e308",
+                     CORK_NUMBER_OUT_OF_RANGE,
+                     "Value out of range for double");
+}
+END_TEST
+
+START_TEST(test_parse_error_offsets)
+{
+    DESCRIBE_TEST;
+    int32_t  value;
+    size_t  offset = SIZE_MAX;
+
+    /* Invalid characters */
+    test_parse_error_offset(cork_parse_int32_ex, int32_t, "--1",
+                            CORK_NUMBER_INVALID, 1);
+    test_parse_error_offset(cork_parse_uint64_ex, uint64_t,
+                            "1234567812345x78", CORK_NUMBER_INVALID, 13);
+    test_parse_error_offset(cork_parse_uint16_hex_ex, uint16_t, "0xbeeg",
+                            CORK_NUMBER_INVALID, 5);
+    test_parse_error_offset(cork_parse_double_ex, double, "12345678.1234x678",
+                            CORK_NUMBER_INVALID, 13);
+    test_parse_error_offset(cork_parse_double_ex, double, "-info",
+                            CORK_NUMBER_INVALID, 4);
+
+    /* Inputs that end too early */
+    test_parse_error_offset(cork_parse_int8_ex, int8_t, "",
+                            CORK_NUMBER_INVALID, 0);
+    test_parse_error_offset(cork_parse_int64_ex, int64_t, "-",
+                            CORK_NUMBER_INVALID, 1);
+    test_parse_error_offset(cork_parse_uint8_hex_ex, uint8_t, "0x",
+                            CORK_NUMBER_INVALID, 2);
+    test_parse_error_offset(cork_parse_double_ex, double, "1e+",
+                            CORK_NUMBER_INVALID, 3);
+
+    /* Other errors don't have an offset */
+    test_parse_error_offset(cork_parse_uint8_ex, uint8_t, "256",
+                            CORK_NUMBER_OUT_OF_RANGE, SIZE_MAX);
+    test_parse_error_offset(cork_parse_double_ex, double, "1e309",
+                            CORK_NUMBER_OUT_OF_RANGE, SIZE_MAX);
+
+    /* A successful parse doesn't touch the offset, and it's fine not to ask
+     * for it. */
+    fail_if_error(cork_parse_int32_ex("-17", 3, &value, &offset));
+    fail_unless_equal("Value", "%" PRId32, -17, value);
+    fail_unless_equal("Error offset", "%zu", (size_t) SIZE_MAX, offset);
+    fail_unless_error(cork_parse_int32_ex("1x", 2, &value, NULL));
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("number");
+
+    TCase  *tc_ds = tcase_create("number");
+    tcase_add_test(tc_ds, test_parse_integers);
+    tcase_add_test(tc_ds, test_parse_integers_random);
+    tcase_add_test(tc_ds, test_parse_integers_invalid);
+    tcase_add_test(tc_ds, test_parse_hex);
+    tcase_add_test(tc_ds, test_parse_slices);
+    tcase_add_test(tc_ds, test_parse_doubles);
+    tcase_add_test(tc_ds, test_parse_doubles_random);
+    tcase_add_test(tc_ds, test_parse_doubles_invalid);
+    tcase_add_test(tc_ds, test_parse_error_offsets);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,335 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <check.h>
+
+#include "libcork/core.h"
+#include "libcork/ds.h"
+#include "libcork/os.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+static char  log_path[64];
+
+static void
+make_log_dir(void)
+{
+    strcpy(log_path, "/tmp/cork-record-log-XXXXXX");
+    fail_if(mkdtemp(log_path) == NULL, "Cannot create temporary directory");
+}
+
+static void
+remove_log_dir(void)
+{
+    struct cork_file  *dir = cork_file_new(log_path);
+    fail_if_error(cork_file_remove(dir, CORK_FILE_RECURSIVE));
+    cork_file_free(dir);
+}
+
+/* Record i is i bytes long, and every byte has the value i. */
+static void
+fill_record(struct cork_buffer *dest, size_t i)
+{
+    cork_buffer_ensure_size(dest, i + 1);
+    memset(dest->buf, (int) (i & 0xff), i);
+    dest->size = i;
+}
+
+static void
+append_records(struct cork_record_log *log, size_t start, size_t end,
+               uint64_t *positions)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    size_t  i;
+    for (i = start; i < end; i++) {
+        fill_record(&buf, i);
+        fail_if_error(cork_record_log_append
+                      (log, buf.buf, buf.size, &positions[i]));
+    }
+    cork_buffer_done(&buf);
+}
+
+static void
+verify_records(size_t count, const uint64_t *positions)
+{
+    struct cork_record_log_reader  *reader;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    struct cork_slice  record;
+    uint64_t  position;
+    size_t  i;
+
+    fail_if_error(reader = cork_record_log_reader_new(log_path));
+    for (i = 0; i < count; i++) {
+        fail_if_error(cork_record_log_reader_next(reader, &record, &position));
+        fail_if(cork_slice_is_empty(&record), "Missing record %zu", i);
+        fill_record(&buf, i);
+        fail_unless_equal("Record size", "%zu", buf.size, record.size);
+        fail_unless(memcmp(buf.buf, record.buf, buf.size) == 0,
+                    "Record %zu has the wrong content", i);
+        fail_unless_equal("Record position", "%" PRIu64,
+                          positions[i], position);
+        cork_slice_finish(&record);
+    }
+    fail_if_error(cork_record_log_reader_next(reader, &record, &position));
+    fail_unless(cork_slice_is_empty(&record), "Unexpected extra record");
+    cork_record_log_reader_free(reader);
+    cork_buffer_done(&buf);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Record logs
+ */
+
+START_TEST(test_record_log_basic)
+{
+    DESCRIBE_TEST;
+    struct cork_record_log  *log;
+    uint64_t  positions[200];
+    uint64_t  big_position;
+    uint64_t  end;
+    struct cork_buffer  big = CORK_BUFFER_INIT();
+    struct cork_record_log_reader  *reader;
+    struct cork_slice  record;
+    uint64_t  position;
+    size_t  i;
+
+    make_log_dir();
+    fail_if_error(log = cork_record_log_open
+                  (log_path, CORK_RECORD_LOG_DEFAULT_SEGMENT_SIZE));
+    append_records(log, 0, 200, positions);
+    fail_if_error(cork_record_log_commit(log));
+    fail_if_error(end = cork_record_log_end(log));
+    fail_if_error(cork_record_log_close(log));
+    verify_records(200, positions);
+
+    /* Reopening the log should pick up where we left off.  Large records are
+     * written directly to the file. */
+    fail_if_error(log = cork_record_log_open
+                  (log_path, CORK_RECORD_LOG_DEFAULT_SEGMENT_SIZE));
+    fail_unless_equal("Log end", "%" PRIu64, end, cork_record_log_end(log));
+    cork_buffer_ensure_size(&big, 100000);
+    for (i = 0; i < 100000; i++) {
+        ((uint8_t *) big.buf)[i] = (uint8_t) (i * 7);
+    }
+    big.size = 100000;
+    fail_if_error(cork_record_log_append
+                  (log, big.buf, big.size, &big_position));
+    fail_unless_equal("Record position", "%" PRIu64, end, big_position);
+    fail_if_error(cork_record_log_append(log, "abc", 3, NULL));
+    fail_if_error(cork_record_log_close(log));
+
+    /* Records should outlive the reader. */
+    fail_if_error(reader = cork_record_log_reader_new(log_path));
+    for (i = 0; i < 200; i++) {
+        fail_if_error(cork_record_log_reader_next(reader, &record, NULL));
+        cork_slice_finish(&record);
+    }
+    fail_if_error(cork_record_log_reader_next(reader, &record, &position));
+    fail_unless_equal("Record position", "%" PRIu64, big_position, position);
+    cork_record_log_reader_free(reader);
+    fail_unless_equal("Record size", "%zu", big.size, record.size);
+    fail_unless(memcmp(big.buf, record.buf, big.size) == 0,
+                "Large record has the wrong content");
+    cork_slice_finish(&record);
+
+    cork_buffer_done(&big);
+    remove_log_dir();
+}
+END_TEST
+
+START_TEST(test_record_log_segments)
+{
+    DESCRIBE_TEST;
+    struct cork_record_log  *log;
+    uint64_t  positions[400];
+
+    make_log_dir();
+    fail_if_error(log = cork_record_log_open(log_path, 4096));
+    append_records(log, 0, 300, positions);
+    fail_if_error(cork_record_log_close(log));
+
+    fail_if_error(log = cork_record_log_open(log_path, 4096));
+    append_records(log, 300, 400, positions);
+    fail_if_error(cork_record_log_close(log));
+
+    verify_records(400, positions);
+    remove_log_dir();
+}
+END_TEST
+
+START_TEST(test_record_log_recovery)
+{
+    DESCRIBE_TEST;
+    struct cork_record_log  *log;
+    struct cork_buffer  segment_path = CORK_BUFFER_INIT();
+    uint64_t  positions[21];
+    uint64_t  end;
+    int  fd;
+
+    make_log_dir();
+    fail_if_error(log = cork_record_log_open
+                  (log_path, CORK_RECORD_LOG_DEFAULT_SEGMENT_SIZE));
+    append_records(log, 0, 20, positions);
+    end = cork_record_log_end(log);
+    fail_if_error(cork_record_log_close(log));
+
+    /* Simulate a partially written record at the end of the log. */
+    cork_buffer_printf(&segment_path, "%s/%020d.log", log_path, 0);
+    fd = open(segment_path.buf, O_WRONLY);
+    fail_if(fd == -1, "Cannot open log segment");
+    fail_unless(pwrite(fd, "\x40\x00\x00\x00garbage!", 12, end) == 12,
+                "Cannot corrupt log segment");
+    close(fd);
+
+    /* Readers should stop at the partial record. */
+    verify_records(20, positions);
+
+    /* Writers should discard it. */
+    fail_if_error(log = cork_record_log_open
+                  (log_path, CORK_RECORD_LOG_DEFAULT_SEGMENT_SIZE));
+    fail_unless_equal("Log end", "%" PRIu64, end, cork_record_log_end(log));
+    append_records(log, 20, 21, positions);
+    fail_if_error(cork_record_log_close(log));
+    verify_records(21, positions);
+
+    cork_buffer_done(&segment_path);
+    remove_log_dir();
+}
+END_TEST
+
+START_TEST(test_record_log_corrupt)
+{
+    DESCRIBE_TEST;
+    struct cork_record_log  *log;
+    struct cork_record_log_reader  *reader;
+    struct cork_buffer  segment_path = CORK_BUFFER_INIT();
+    struct cork_slice  record;
+    uint64_t  positions[300];
+    size_t  i;
+    int  fd;
+
+    make_log_dir();
+    fail_if_error(log = cork_record_log_open(log_path, 4096));
+    append_records(log, 0, 300, positions);
+    fail_if_error(cork_record_log_close(log));
+
+    /* Corrupt the payload of record 10, which isn't in the last segment. */
+    cork_buffer_printf(&segment_path, "%s/%020d.log", log_path, 0);
+    fd = open(segment_path.buf, O_WRONLY);
+    fail_if(fd == -1, "Cannot open log segment");
+    fail_unless(pwrite(fd, "X", 1, positions[10] + 8) == 1,
+                "Cannot corrupt log segment");
+    close(fd);
+
+    fail_if_error(reader = cork_record_log_reader_new(log_path));
+    for (i = 0; i < 10; i++) {
+        fail_if_error(cork_record_log_reader_next(reader, &record, NULL));
+        cork_slice_finish(&record);
+    }
+    fail_unless_error(cork_record_log_reader_next(reader, &record, NULL));
+    cork_record_log_reader_free(reader);
+
+    cork_buffer_done(&segment_path);
+    remove_log_dir();
+}
+END_TEST
+
+START_TEST(test_record_log_write_error)
+{
+    DESCRIBE_TEST;
+    struct cork_record_log  *log;
+    struct cork_buffer  big = CORK_BUFFER_INIT();
+    struct rlimit  old_limit;
+    struct rlimit  limit;
+    uint64_t  positions[20];
+    uint64_t  end;
+
+    make_log_dir();
+    fail_if_error(log = cork_record_log_open
+                  (log_path, CORK_RECORD_LOG_DEFAULT_SEGMENT_SIZE));
+    append_records(log, 0, 10, positions);
+    end = cork_record_log_end(log);
+
+    /* Make the large record's write fail partway through. */
+    signal(SIGXFSZ, SIG_IGN);
+    fail_unless(getrlimit(RLIMIT_FSIZE, &old_limit) == 0,
+                "Cannot get file size limit");
+    limit = old_limit;
+    limit.rlim_cur = end + 4096;
+    fail_unless(setrlimit(RLIMIT_FSIZE, &limit) == 0,
+                "Cannot set file size limit");
+    cork_buffer_ensure_size(&big, 100000);
+    memset(big.buf, 'x', 100000);
+    big.size = 100000;
+    fail_unless_error(cork_record_log_append(log, big.buf, big.size, NULL));
+    fail_unless(setrlimit(RLIMIT_FSIZE, &old_limit) == 0,
+                "Cannot restore file size limit");
+    fail_unless_equal("Log end", "%" PRIu64, end, cork_record_log_end(log));
+
+    /* The failed record shouldn't leave a hole in the log. */
+    append_records(log, 10, 20, positions);
+    fail_unless_equal("Record position", "%" PRIu64, end, positions[10]);
+    fail_if_error(cork_record_log_close(log));
+    verify_records(20, positions);
+
+    cork_buffer_done(&big);
+    remove_log_dir();
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("record-log");
+
+    TCase  *tc_log = tcase_create("record-log");
+    tcase_add_test(tc_log, test_record_log_basic);
+    tcase_add_test(tc_log, test_record_log_segments);
+    tcase_add_test(tc_log, test_record_log_recovery);
+    tcase_add_test(tc_log, test_record_log_corrupt);
+    tcase_add_test(tc_log, test_record_log_write_error);
+    suite_add_tcase(s, tc_log);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,298 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/bitset.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/hash-table.h"
+#include "libcork/ds/serializer.h"
+#include "libcork/ds/slice.h"
+#include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+static int
+write_entry(struct cork_serializer *ser,
+            const struct cork_hash_table_entry *entry, void *user_data)
+{
+    rii_check(cork_serializer_write_varint(ser, (uintptr_t) entry->key));
+    return cork_serializer_write_varint(ser, (uintptr_t) entry->value);
+}
+
+static int
+read_entry(struct cork_deserializer *des, struct cork_hash_table *table,
+           void *user_data)
+{
+    uint64_t  key;
+    uint64_t  value;
+    rii_check(cork_deserializer_read_varint(des, &key));
+    rii_check(cork_deserializer_read_varint(des, &value));
+    cork_hash_table_put(table, (void *) (uintptr_t) key,
+                        (void *) (uintptr_t) value, NULL, NULL, NULL);
+    return 0;
+}
+
+static void
+write_everything(struct cork_buffer *dest)
+{
+    struct cork_stream_consumer  *consumer =
+        cork_buffer_to_stream_consumer(dest);
+    struct cork_serializer  *ser = cork_serializer_new(consumer);
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    cork_array(int32_t)  array;
+    struct cork_bitset  *set = cork_bitset_new(100);
+    struct cork_hash_table  *table = cork_pointer_hash_table_new(0);
+    int32_t  i;
+
+    cork_array_init(&array);
+    /* Big enough to be passed directly to the consumer. */
+    for (i = 0; i < 10000; i++) {
+        cork_array_append(&array, i * 3);
+    }
+    for (i = 0; i < 100; i += 7) {
+        cork_bitset_set(set, i, true);
+    }
+    for (i = 1; i <= 100; i++) {
+        cork_hash_table_put(table, (void *) (uintptr_t) i,
+                            (void *) (uintptr_t) (i * i), NULL, NULL, NULL);
+    }
+    cork_buffer_set_string(&buf, "buffer contents");
+
+    fail_if_error(cork_serializer_start(ser, 42));
+    fail_if_error(cork_serializer_write_varint(ser, 0));
+    fail_if_error(cork_serializer_write_varint(ser, 127));
+    fail_if_error(cork_serializer_write_varint(ser, 128));
+    fail_if_error(cork_serializer_write_varint(ser, UINT64_MAX));
+    fail_if_error(cork_serializer_write_svarint(ser, -1));
+    fail_if_error(cork_serializer_write_svarint(ser, INT64_MIN));
+    fail_if_error(cork_serializer_write_string(ser, "hello"));
+    fail_if_error(cork_serializer_write_buffer(ser, &buf));
+    fail_if_error(cork_serializer_write_array(ser, &array));
+    fail_if_error(cork_serializer_write_bitset(ser, set));
+    fail_if_error(cork_serializer_write_hash_table
+                  (ser, table, write_entry, NULL));
+    fail_if_error(cork_serializer_finish(ser));
+    fail_unless_equal("Byte count", "%zu",
+                      dest->size, (size_t) cork_serializer_byte_count(ser));
+
+    cork_serializer_free(ser);
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&buf);
+    cork_array_done(&array);
+    cork_bitset_free(set);
+    cork_hash_table_free(table);
+}
+
+static void
+read_everything(struct cork_deserializer *des)
+{
+    uint32_t  version;
+    uint64_t  u;
+    int64_t  s;
+    const void  *bytes;
+    size_t  size;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    cork_array(int32_t)  array;
+    cork_array(int64_t)  wrong_array;
+    struct cork_bitset  *set;
+    struct cork_hash_table  *table = cork_pointer_hash_table_new(0);
+    struct cork_deserializer  saved;
+    size_t  i;
+
+    fail_if_error(cork_deserializer_start(des, &version));
+    fail_unless_equal("Version", "%" PRIu32, 42, version);
+
+#define check_varint(expected) \
+    do { \
+        fail_if_error(cork_deserializer_read_varint(des, &u)); \
+        fail_unless_equal("Varint", "%" PRIu64, (uint64_t) (expected), u); \
+    } while (0)
+    check_varint(0);
+    check_varint(127);
+    check_varint(128);
+    check_varint(UINT64_MAX);
+#undef check_varint
+
+    fail_if_error(cork_deserializer_read_svarint(des, &s));
+    fail_unless_equal("Svarint", "%" PRId64, (int64_t) -1, s);
+    fail_if_error(cork_deserializer_read_svarint(des, &s));
+    fail_unless_equal("Svarint", "%" PRId64, INT64_MIN, s);
+
+    fail_if_error(cork_deserializer_read_bytes(des, &bytes, &size));
+    fail_unless(size == 5 && memcmp(bytes, "hello", 5) == 0,
+                "Unexpected string");
+    fail_if_error(cork_deserializer_read_buffer(des, &buf));
+    fail_unless(buf.size == 15 && memcmp(buf.buf, "buffer contents", 15) == 0,
+                "Unexpected buffer");
+
+    /* Element sizes must match. */
+    saved = *des;
+    cork_array_init(&wrong_array);
+    fail_unless_error(cork_deserializer_read_array(des, &wrong_array));
+    cork_array_done(&wrong_array);
+    *des = saved;
+
+    cork_array_init(&array);
+    fail_if_error(cork_deserializer_read_array(des, &array));
+    fail_unless_equal("Array size", "%zu", 10000, cork_array_size(&array));
+    for (i = 0; i < 10000; i++) {
+        fail_unless_equal("Element", "%" PRId32,
+                          (int32_t) i * 3, cork_array_at(&array, i));
+    }
+
+    fail_if_error(set = cork_deserializer_read_bitset(des));
+    fail_unless_equal("Bit count", "%zu", 100, set->bit_count);
+    for (i = 0; i < 100; i++) {
+        fail_unless(cork_bitset_get(set, i) == (i % 7 == 0),
+                    "Unexpected bit %zu", i);
+    }
+
+    fail_if_error(cork_deserializer_read_hash_table
+                  (des, table, read_entry, NULL));
+    fail_unless_equal("Table size", "%zu", 100, cork_hash_table_size(table));
+    for (i = 1; i <= 100; i++) {
+        fail_unless_equal("Value", "%zu", i * i,
+                          (size_t) (uintptr_t) cork_hash_table_get
+                          (table, (void *) (uintptr_t) i));
+    }
+
+    fail_unless(cork_deserializer_is_empty(des), "Leftover data");
+    fail_unless_error(cork_deserializer_read_varint(des, &u));
+
+    cork_buffer_done(&buf);
+    cork_array_done(&array);
+    cork_bitset_free(set);
+    cork_hash_table_free(table);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Serialization
+ */
+
+START_TEST(test_serializer_round_trip)
+{
+    DESCRIBE_TEST;
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct cork_deserializer  des;
+    write_everything(&data);
+    cork_deserializer_init(&des, data.buf, data.size);
+    read_everything(&des);
+    cork_buffer_done(&data);
+}
+END_TEST
+
+START_TEST(test_serializer_slice)
+{
+    DESCRIBE_TEST;
+    struct cork_buffer  *data = cork_buffer_new();
+    struct cork_slice  slice;
+    struct cork_slice  field;
+    struct cork_deserializer  des;
+    uint32_t  version;
+    uint64_t  u;
+    size_t  i;
+
+    write_everything(data);
+    fail_if_error(cork_buffer_to_slice(data, &slice));
+    cork_deserializer_init_slice(&des, &slice);
+    read_everything(&des);
+
+    /* Bytes fields can be extracted as slices without copying them. */
+    cork_deserializer_init_slice(&des, &slice);
+    fail_if_error(cork_deserializer_start(&des, &version));
+    /* Skip over the integers. */
+    for (i = 0; i < 6; i++) {
+        fail_if_error(cork_deserializer_read_varint(&des, &u));
+    }
+    fail_if_error(cork_deserializer_read_slice(&des, &field));
+    fail_unless(field.size == 5 && memcmp(field.buf, "hello", 5) == 0,
+                "Unexpected slice");
+    fail_unless((const uint8_t *) field.buf > (const uint8_t *) slice.buf &&
+                (const uint8_t *) field.buf <
+                (const uint8_t *) slice.buf + slice.size,
+                "Slice should refer to the original data");
+    cork_slice_finish(&field);
+    /* The slice owns data now. */
+    cork_slice_finish(&slice);
+}
+END_TEST
+
+START_TEST(test_serializer_invalid)
+{
+    DESCRIBE_TEST;
+    struct cork_deserializer  des;
+    uint64_t  u;
+    const void  *bytes;
+    size_t  size;
+
+    cork_deserializer_init(&des, "CkSr", 4);
+    fail_unless_error(cork_deserializer_start(&des, NULL));
+    cork_deserializer_init(&des, "XXXX\x01\x00\x00", 7);
+    fail_unless_error(cork_deserializer_start(&des, NULL));
+
+    /* A varint that never ends */
+    cork_deserializer_init(&des, "\xff\xff\xff", 3);
+    fail_unless_error(cork_deserializer_read_varint(&des, &u));
+    cork_deserializer_init
+        (&des, "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff", 11);
+    fail_unless_error(cork_deserializer_read_varint(&des, &u));
+
+    /* A length that's longer than the data */
+    cork_deserializer_init(&des, "\x05" "abc", 4);
+    fail_unless_error(cork_deserializer_read_bytes(&des, &bytes, &size));
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("serializer");
+
+    TCase  *tc_ds = tcase_create("serializer");
+    tcase_add_test(tc_ds, test_serializer_round_trip);
+    tcase_add_test(tc_ds, test_serializer_slice);
+    tcase_add_test(tc_ds, test_serializer_invalid);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
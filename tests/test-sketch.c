@@ -0,0 +1,351 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/sketch.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helper functions
+ */
+
+static cork_big_hash
+hash_of(uint64_t i)
+{
+    cork_big_hash  seed = {cork_u128_from_64(0, 0)};
+    return cork_big_hash_variable(seed, i);
+}
+
+#define fail_unless_close(what, expected, actual, tolerance) \
+    do { \
+        double  __expected = (expected); \
+        double  __actual = (actual); \
+        double  __diff = (__actual > __expected)? \
+            __actual - __expected: __expected - __actual; \
+        fail_unless(__diff <= __expected * (tolerance), \
+                    "%s too far off (expected %.0f, got %.0f)", \
+                    (what), __expected, __actual); \
+    } while (0)
+
+
+/*-----------------------------------------------------------------------
+ * HyperLogLog
+ */
+
+static void
+test_hll_accuracy(unsigned int precision, uint64_t count, double tolerance)
+{
+    struct cork_hll  *hll = cork_hll_new(precision);
+    uint64_t  i;
+    for (i = 0; i < count; i++) {
+        cork_hll_add(hll, &i, sizeof(i));
+        /* Duplicates shouldn't affect the estimate */
+        cork_hll_add(hll, &i, sizeof(i));
+    }
+    fail_unless_close("HLL estimate", count, cork_hll_estimate(hll),
+                      tolerance);
+    cork_hll_free(hll);
+}
+
+START_TEST(test_hll)
+{
+    DESCRIBE_TEST;
+    struct cork_hll  *hll = cork_hll_new(12);
+    fail_unless_equal("Empty estimate", "%" PRIu64, 0, cork_hll_estimate(hll));
+    cork_hll_free(hll);
+
+    test_hll_accuracy(12, 10, 0.01);
+    test_hll_accuracy(12, 100, 0.05);
+    test_hll_accuracy(12, 1000, 0.05);
+    test_hll_accuracy(12, 100000, 0.05);
+    test_hll_accuracy(14, 1000000, 0.03);
+    test_hll_accuracy(4, 10000, 0.5);
+}
+END_TEST
+
+START_TEST(test_hll_merge)
+{
+    DESCRIBE_TEST;
+    struct cork_hll  *hll1 = cork_hll_new(12);
+    struct cork_hll  *hll2 = cork_hll_new(12);
+    struct cork_hll  *hll3 = cork_hll_new(12);
+    struct cork_hll  *other = cork_hll_new(10);
+    cork_big_hash  hashes[1000];
+    uint64_t  i;
+
+    /* hll1 stays sparse, while hll2 becomes dense. */
+    for (i = 0; i < 100; i++) {
+        cork_hll_add_hash(hll1, hash_of(i));
+    }
+    for (i = 0; i < 20000; i += 1000) {
+        size_t  j;
+        for (j = 0; j < 1000; j++) {
+            hashes[j] = hash_of(50 + i + j);
+        }
+        cork_hll_add_hashes(hll2, hashes, 1000);
+    }
+
+    fail_if_error(cork_hll_merge(hll3, hll1));
+    fail_unless_equal("Merged estimate", "%" PRIu64,
+                      cork_hll_estimate(hll1), cork_hll_estimate(hll3));
+    fail_if_error(cork_hll_merge(hll3, hll2));
+    fail_if_error(cork_hll_merge(hll1, hll2));
+    fail_unless_equal("Merged estimates", "%" PRIu64,
+                      cork_hll_estimate(hll1), cork_hll_estimate(hll3));
+    fail_unless_close("Merged estimate", 20050, cork_hll_estimate(hll3), 0.05);
+
+    fail_unless_error(cork_hll_merge(hll1, other),
+                      "Shouldn't merge HLLs with different precisions");
+
+    cork_hll_clear(hll1);
+    fail_unless_equal("Cleared estimate", "%" PRIu64,
+                      0, cork_hll_estimate(hll1));
+
+    cork_hll_free(hll1);
+    cork_hll_free(hll2);
+    cork_hll_free(hll3);
+    cork_hll_free(other);
+}
+END_TEST
+
+static void
+test_hll_roundtrip(uint64_t count)
+{
+    struct cork_hll  *hll = cork_hll_new(12);
+    struct cork_hll  *copy;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    uint64_t  i;
+
+    for (i = 0; i < count; i++) {
+        cork_hll_add_hash(hll, hash_of(i));
+    }
+    cork_hll_save(hll, &buf);
+    fail_if_error(copy = cork_hll_new_from_bytes(buf.buf, buf.size));
+    fail_unless_equal("Estimate", "%" PRIu64,
+                      cork_hll_estimate(hll), cork_hll_estimate(copy));
+    cork_hll_free(copy);
+
+    fail_unless_error(cork_hll_new_from_bytes(buf.buf, buf.size - 1),
+                      "Shouldn't load truncated HLL");
+    cork_buffer_done(&buf);
+    cork_hll_free(hll);
+}
+
+START_TEST(test_hll_serialize)
+{
+    DESCRIBE_TEST;
+    test_hll_roundtrip(0);
+    test_hll_roundtrip(100);
+    test_hll_roundtrip(100000);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Count-Min sketches
+ */
+
+START_TEST(test_count_min)
+{
+    DESCRIBE_TEST;
+    struct cork_count_min  *cm1 = cork_count_min_new(2000, 5);
+    struct cork_count_min  *cm2 = cork_count_min_new(2000, 5);
+    struct cork_count_min  *copy;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    cork_big_hash  hashes[100];
+    uint64_t  i;
+
+    /* Element i appears i times. */
+    for (i = 1; i <= 100; i++) {
+        cork_count_min_add(cm1, &i, sizeof(i), i);
+    }
+    for (i = 0; i < 100; i++) {
+        hashes[i] = hash_of(1000);
+    }
+    cork_count_min_add_hashes(cm2, hashes, 100);
+
+    /* Count-Min never underestimates, and with these parameters, the
+     * overestimate should be tiny. */
+    for (i = 1; i <= 100; i++) {
+        uint64_t  estimate = cork_count_min_estimate(cm1, &i, sizeof(i));
+        fail_unless(estimate >= i && estimate <= i + 20,
+                    "Bad estimate for %" PRIu64 " (%" PRIu64 ")", i, estimate);
+    }
+    fail_unless_equal("Total", "%" PRIu64, 5050, cork_count_min_total(cm1));
+    fail_unless_equal("Estimate", "%" PRIu64, 100,
+                      cork_count_min_estimate_hash(cm2, hash_of(1000)));
+
+    fail_if_error(cork_count_min_merge(cm1, cm2));
+    fail_unless_equal("Total", "%" PRIu64, 5150, cork_count_min_total(cm1));
+    fail_unless(cork_count_min_estimate_hash(cm1, hash_of(1000)) >= 100,
+                "Merged estimate too small");
+
+    cork_count_min_save(cm1, &buf);
+    fail_if_error(copy = cork_count_min_new_from_bytes(buf.buf, buf.size));
+    for (i = 1; i <= 100; i++) {
+        fail_unless_equal("Estimate", "%" PRIu64,
+                          cork_count_min_estimate(cm1, &i, sizeof(i)),
+                          cork_count_min_estimate(copy, &i, sizeof(i)));
+    }
+    cork_count_min_free(copy);
+    fail_unless_error(cork_count_min_new_from_bytes(buf.buf, buf.size - 8),
+                      "Shouldn't load truncated sketch");
+    cork_buffer_done(&buf);
+
+    /* Dimensions whose product overflows */
+    {
+        static const uint8_t  huge[] = {
+            'C', 'C', 'M', 'S', 1,
+            0, 0, 0, 0, 0x80, 0, 0, 0,
+            0, 0, 0, 0, 0x40, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0
+        };
+        fail_unless_error(cork_count_min_new_from_bytes(huge, sizeof(huge)),
+                          "Shouldn't load oversized sketch");
+    }
+
+    cork_count_min_free(cm2);
+    cm2 = cork_count_min_new(100, 5);
+    fail_unless_error(cork_count_min_merge(cm1, cm2),
+                      "Shouldn't merge sketches with different widths");
+
+    cork_count_min_clear(cm1);
+    fail_unless_equal("Total", "%" PRIu64, 0, cork_count_min_total(cm1));
+    cork_count_min_free(cm1);
+    cork_count_min_free(cm2);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Space-Saving top-k
+ */
+
+static void
+add_stream(struct cork_top_k *top_k, uint64_t first)
+{
+    uint64_t  i;
+    /* Ten heavy hitters... */
+    for (i = 0; i < 10; i++) {
+        uint64_t  key = first + i;
+        cork_top_k_add(top_k, &key, sizeof(key), 1000 - i * 10);
+    }
+    /* ...buried in lots of noise. */
+    for (i = 0; i < 10000; i++) {
+        uint64_t  key = 1000000 + i;
+        cork_top_k_add(top_k, &key, sizeof(key), 1);
+    }
+}
+
+static void
+check_top(struct cork_top_k *top_k, uint64_t first, uint64_t scale)
+{
+    struct cork_top_k_entry  entries[10];
+    size_t  i;
+    fail_unless_equal("Entry count", "%zu",
+                      10, cork_top_k_get(top_k, entries, 10));
+    for (i = 0; i < 10; i++) {
+        uint64_t  key;
+        fail_unless_equal("Key size", "%zu", sizeof(key), entries[i].key_size);
+        memcpy(&key, entries[i].key, sizeof(key));
+        fail_unless_equal("Key", "%" PRIu64, first + i, key);
+        fail_unless(entries[i].count - entries[i].error <=
+                    (1000 - i * 10) * scale &&
+                    entries[i].count >= (1000 - i * 10) * scale,
+                    "Bad count for key %" PRIu64, key);
+    }
+}
+
+START_TEST(test_top_k)
+{
+    DESCRIBE_TEST;
+    struct cork_top_k  *top_k1 = cork_top_k_new(50);
+    struct cork_top_k  *top_k2 = cork_top_k_new(50);
+    struct cork_top_k  *copy;
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+
+    add_stream(top_k1, 1);
+    fail_unless_equal("Size", "%zu", 50, cork_top_k_size(top_k1));
+    check_top(top_k1, 1, 1);
+
+    cork_top_k_save(top_k1, &buf);
+    fail_if_error(copy = cork_top_k_new_from_bytes(buf.buf, buf.size));
+    check_top(copy, 1, 1);
+    cork_top_k_free(copy);
+    fail_unless_error(cork_top_k_new_from_bytes(buf.buf, buf.size - 1),
+                      "Shouldn't load truncated sketch");
+    cork_buffer_done(&buf);
+
+    /* An empty sketch that claims to have 2^60 counters */
+    {
+        static const uint8_t  huge[] = {
+            'C', 'T', 'O', 'P', 1,
+            0x10, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0
+        };
+        fail_unless_error(cork_top_k_new_from_bytes(huge, sizeof(huge)),
+                          "Shouldn't load oversized sketch");
+    }
+
+    add_stream(top_k2, 1);
+    cork_top_k_merge(top_k1, top_k2);
+    check_top(top_k1, 1, 2);
+
+    cork_top_k_clear(top_k1);
+    fail_unless_equal("Size", "%zu", 0, cork_top_k_size(top_k1));
+    cork_top_k_free(top_k1);
+    cork_top_k_free(top_k2);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("sketch");
+
+    TCase  *tc_ds = tcase_create("sketch");
+    tcase_add_test(tc_ds, test_hll);
+    tcase_add_test(tc_ds, test_hll_merge);
+    tcase_add_test(tc_ds, test_hll_serialize);
+    tcase_add_test(tc_ds, test_count_min);
+    tcase_add_test(tc_ds, test_top_k);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
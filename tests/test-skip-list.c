@@ -0,0 +1,267 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <check.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/skip-list.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+/* Keys are integers stored directly in the key pointer. */
+#define int_key(i)  ((void *) (uintptr_t) (i))
+#define key_int(k)  ((uintptr_t) (k))
+
+static int
+int_comparator(const void *key1, const void *key2)
+{
+    uintptr_t  i1 = key_int(key1);
+    uintptr_t  i2 = key_int(key2);
+    return (i1 < i2)? -1: (i1 > i2)? 1: 0;
+}
+
+static size_t  freed_values = 0;
+
+static void
+count_freed_value(void *value)
+{
+    cork_uint_atomic_add(&freed_values, 1);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Skip lists
+ */
+
+START_TEST(test_skip_list_basic)
+{
+    DESCRIBE_TEST;
+    struct cork_skip_list  *list = cork_skip_list_new(int_comparator);
+    struct cork_skip_list_iterator  iter;
+    struct cork_skip_list_entry  *entry;
+    void  *old_value;
+    bool  is_new;
+    uintptr_t  i;
+    uintptr_t  expected;
+
+    freed_values = 0;
+    cork_skip_list_set_free_value(list, count_freed_value);
+
+    /* Add keys in a scrambled order. */
+    for (i = 0; i < 1000; i++) {
+        uintptr_t  key = (i * 7919) % 1000;
+        cork_skip_list_put(list, int_key(key), int_key(key + 1),
+                           &is_new, NULL);
+        fail_unless(is_new, "Key %zu should be new", (size_t) key);
+    }
+    fail_unless_equal("Size", "%zu", 1000, cork_skip_list_size(list));
+
+    cork_skip_list_put(list, int_key(10), int_key(100), &is_new, &old_value);
+    fail_if(is_new, "Key 10 shouldn't be new");
+    fail_unless_equal("Old value", "%zu", 11, (size_t) key_int(old_value));
+    fail_unless_equal("Value", "%zu",
+                      100, (size_t) key_int(cork_skip_list_get(list, int_key(10))));
+    fail_unless(cork_skip_list_get_entry(list, int_key(1000)) == NULL,
+                "Key 1000 shouldn't exist");
+
+    /* Iterating should return keys in order. */
+    expected = 0;
+    cork_skip_list_iterator_init(list, &iter);
+    while ((entry = cork_skip_list_iterator_next(&iter)) != NULL) {
+        fail_unless_equal("Key", "%zu",
+                          (size_t) expected, (size_t) key_int(entry->key));
+        expected++;
+    }
+    fail_unless_equal("Count", "%zu", 1000, (size_t) expected);
+
+    /* Delete the odd keys. */
+    for (i = 1; i < 1000; i += 2) {
+        fail_unless(cork_skip_list_delete(list, int_key(i)),
+                    "Cannot delete %zu", (size_t) i);
+        fail_if(cork_skip_list_delete(list, int_key(i)),
+                "Deleted %zu twice", (size_t) i);
+    }
+    fail_unless_equal("Size", "%zu", 500, cork_skip_list_size(list));
+    fail_unless(cork_skip_list_get(list, int_key(501)) == NULL,
+                "Key 501 should be deleted");
+    fail_unless_equal("Freed values", "%zu", 0, freed_values);
+    cork_skip_list_reclaim(list);
+    fail_unless_equal("Freed values", "%zu", 500, freed_values);
+
+    /* A range scan over [101, 120) */
+    expected = 102;
+    cork_skip_list_iterator_init_at(list, &iter, int_key(101));
+    while ((entry = cork_skip_list_iterator_next(&iter)) != NULL &&
+           key_int(entry->key) < 120) {
+        fail_unless_equal("Key", "%zu",
+                          (size_t) expected, (size_t) key_int(entry->key));
+        expected += 2;
+    }
+    fail_unless_equal("Last key", "%zu", 120, (size_t) expected);
+
+    /* Deleted keys can be added again. */
+    cork_skip_list_put(list, int_key(1), int_key(2), &is_new, NULL);
+    fail_unless(is_new, "Key 1 should be new");
+    fail_unless_equal("Value", "%zu",
+                      2, (size_t) key_int(cork_skip_list_get(list, int_key(1))));
+
+    cork_skip_list_free(list);
+    fail_unless_equal("Freed values", "%zu", 1001, freed_values);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Concurrent access
+ */
+
+#define WRITER_COUNT  4
+#define KEYS_PER_WRITER  5000
+
+struct writer_body {
+    struct cork_thread_body  parent;
+    struct cork_skip_list  *list;
+    uintptr_t  index;
+};
+
+/* Each writer adds its own keys, interleaved with every other writer's, and
+ * then deletes the odd ones. */
+static int
+writer_body__run(struct cork_thread_body *vself)
+{
+    struct writer_body  *self =
+        cork_container_of(vself, struct writer_body, parent);
+    uintptr_t  i;
+    for (i = 0; i < KEYS_PER_WRITER; i++) {
+        uintptr_t  key = i * WRITER_COUNT + self->index;
+        cork_skip_list_put(self->list, int_key(key), int_key(key), NULL, NULL);
+    }
+    for (i = 1; i < KEYS_PER_WRITER; i += 2) {
+        uintptr_t  key = i * WRITER_COUNT + self->index;
+        if (!cork_skip_list_delete(self->list, int_key(key))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+writer_body__free(struct cork_thread_body *vself)
+{
+    struct writer_body  *self =
+        cork_container_of(vself, struct writer_body, parent);
+    free(self);
+}
+
+static struct cork_thread_body *
+writer_body_new(struct cork_skip_list *list, uintptr_t index)
+{
+    struct writer_body  *self = cork_new(struct writer_body);
+    self->parent.run = writer_body__run;
+    self->parent.free = writer_body__free;
+    self->list = list;
+    self->index = index;
+    return &self->parent;
+}
+
+START_TEST(test_skip_list_threads)
+{
+    DESCRIBE_TEST;
+    struct cork_skip_list  *list = cork_skip_list_new(int_comparator);
+    struct cork_thread  *threads[WRITER_COUNT];
+    struct cork_skip_list_iterator  iter;
+    struct cork_skip_list_entry  *entry;
+    size_t  count;
+    size_t  round;
+    uintptr_t  i;
+
+    for (i = 0; i < WRITER_COUNT; i++) {
+        fail_if_error(threads[i] = cork_thread_new
+                      ("writer", writer_body_new(list, i)));
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+
+    /* Read while the writers are running; keys must always be in order. */
+    for (round = 0; round < 20; round++) {
+        uintptr_t  last = 0;
+        bool  first = true;
+        cork_skip_list_iterator_init(list, &iter);
+        while ((entry = cork_skip_list_iterator_next(&iter)) != NULL) {
+            fail_unless(first || key_int(entry->key) > last,
+                        "Keys out of order");
+            fail_unless(entry->value == entry->key, "Wrong value");
+            last = key_int(entry->key);
+            first = false;
+        }
+    }
+
+    for (i = 0; i < WRITER_COUNT; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+    }
+
+    fail_unless_equal("Size", "%zu", WRITER_COUNT * KEYS_PER_WRITER / 2,
+                      cork_skip_list_size(list));
+    count = 0;
+    cork_skip_list_iterator_init(list, &iter);
+    while ((entry = cork_skip_list_iterator_next(&iter)) != NULL) {
+        uintptr_t  key = key_int(entry->key);
+        fail_unless((key / WRITER_COUNT) % 2 == 0,
+                    "Key %zu should be deleted", (size_t) key);
+        count++;
+    }
+    fail_unless_equal("Count", "%zu", WRITER_COUNT * KEYS_PER_WRITER / 2, count);
+
+    cork_skip_list_reclaim(list);
+    cork_skip_list_free(list);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("skip_list");
+
+    TCase  *tc_ds = tcase_create("skip_list");
+    tcase_add_test(tc_ds, test_skip_list_basic);
+    tcase_add_test(tc_ds, test_skip_list_threads);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,151 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/slist.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Singly-linked lists
+ */
+
+struct int64_item {
+    int64_t  value;
+    struct cork_slist_item  element;
+};
+
+#define int64_item_value(item) \
+    (cork_container_of((item), struct int64_item, element)->value)
+
+static void
+int64_sum(struct cork_slist_item *element, void *user_data)
+{
+    int64_t  *sum = user_data;
+    *sum += int64_item_value(element);
+}
+
+START_TEST(test_slist)
+{
+    DESCRIBE_TEST;
+    struct cork_slist  list = CORK_SLIST_INIT;
+    struct int64_item  items[4];
+    int64_t  sum = 0;
+    size_t  i;
+
+    fail_unless(cork_slist_is_empty(&list), "Expected empty list");
+    fail_unless(cork_slist_pop(&list) == NULL, "Expected empty list");
+
+    for (i = 0; i < 3; i++) {
+        items[i].value = i + 1;
+        cork_slist_push(&list, &items[i].element);
+    }
+    fail_unless_equal("Size", "%zu", 3, cork_slist_size(&list));
+    cork_slist_map(&list, int64_sum, &sum);
+    fail_unless_equal("Sum", "%" PRId64, 6, sum);
+
+    /* 3, 2, 1 => 3, 4, 2, 1 => 3, 4, 1 */
+    items[3].value = 4;
+    cork_slist_add_after(cork_slist_head(&list), &items[3].element);
+    cork_slist_remove_after(&items[3].element);
+    fail_unless_equal("Size", "%zu", 3, cork_slist_size(&list));
+
+    fail_unless_equal("Value", "%" PRId64,
+                      3, int64_item_value(cork_slist_pop(&list)));
+    fail_unless_equal("Value", "%" PRId64,
+                      4, int64_item_value(cork_slist_pop(&list)));
+    fail_unless_equal("Value", "%" PRId64,
+                      1, int64_item_value(cork_slist_pop(&list)));
+    fail_unless(cork_slist_is_empty(&list), "Expected empty list");
+}
+END_TEST
+
+START_TEST(test_stailq)
+{
+    DESCRIBE_TEST;
+    struct cork_stailq  queue;
+    struct cork_stailq  other;
+    struct int64_item  items[5];
+    int64_t  sum = 0;
+    int64_t  expected;
+    size_t  i;
+
+    cork_stailq_init(&queue);
+    cork_stailq_init(&other);
+    fail_unless(cork_stailq_is_empty(&queue), "Expected empty queue");
+    fail_unless(cork_stailq_pop(&queue) == NULL, "Expected empty queue");
+
+    for (i = 0; i < 5; i++) {
+        items[i].value = i;
+    }
+
+    /* Pushing onto an empty queue must update its tail. */
+    cork_stailq_push(&queue, &items[1].element);
+    cork_stailq_add(&queue, &items[2].element);
+    cork_stailq_push(&queue, &items[0].element);
+    cork_stailq_add(&other, &items[3].element);
+    cork_stailq_add(&other, &items[4].element);
+    cork_stailq_concat(&queue, &other);
+    fail_unless(cork_stailq_is_empty(&other), "Expected empty queue");
+    fail_unless_equal("Size", "%zu", 5, cork_stailq_size(&queue));
+    cork_stailq_map(&queue, int64_sum, &sum);
+    fail_unless_equal("Sum", "%" PRId64, 10, sum);
+
+    for (expected = 0; expected < 5; expected++) {
+        fail_unless_equal("Value", "%" PRId64,
+                          expected, int64_item_value(cork_stailq_pop(&queue)));
+    }
+    fail_unless(cork_stailq_is_empty(&queue), "Expected empty queue");
+
+    /* Popping the last element must reset the tail. */
+    cork_stailq_add(&queue, &items[0].element);
+    fail_unless_equal("Value", "%" PRId64,
+                      0, int64_item_value(cork_stailq_head(&queue)));
+    fail_unless_equal("Size", "%zu", 1, cork_stailq_size(&queue));
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("slist");
+
+    TCase  *tc_ds = tcase_create("slist");
+    tcase_add_test(tc_ds, test_slist);
+    tcase_add_test(tc_ds, test_stailq);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
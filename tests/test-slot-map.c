@@ -0,0 +1,195 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <check.h>
+
+#include "libcork/core/types.h"
+#include "libcork/ds/slot-map.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Slot maps
+ */
+
+START_TEST(test_slot_map_basic)
+{
+    DESCRIBE_TEST;
+    cork_slot_map(int64_t)  map;
+    cork_slot_handle  handles[100];
+    int64_t  i;
+    int64_t  *value;
+
+    cork_slot_map_init(&map);
+    fail_unless(cork_slot_map_is_empty(&map), "Slot map should be empty");
+    fail_unless(cork_slot_map_get(&map, CORK_SLOT_HANDLE_NONE) == NULL,
+                "Null handle shouldn't be valid");
+
+    for (i = 0; i < 100; i++) {
+        cork_slot_map_insert(&map, i, &handles[i]);
+    }
+    fail_unless_equal("Size", "%zu", 100, cork_slot_map_size(&map));
+    for (i = 0; i < 100; i++) {
+        value = cork_slot_map_get(&map, handles[i]);
+        fail_if(value == NULL, "Missing handle %" PRId64, i);
+        fail_unless_equal("Value", "%" PRId64, i, *value);
+    }
+
+    /* Remove the even values. */
+    for (i = 0; i < 100; i += 2) {
+        fail_unless(cork_slot_map_remove(&map, handles[i]),
+                    "Cannot remove handle %" PRId64, i);
+        fail_if(cork_slot_map_remove(&map, handles[i]),
+                "Removed handle %" PRId64 " twice", i);
+    }
+    fail_unless_equal("Size", "%zu", 50, cork_slot_map_size(&map));
+    for (i = 0; i < 100; i++) {
+        value = cork_slot_map_get(&map, handles[i]);
+        if (i % 2 == 0) {
+            fail_unless(value == NULL, "Stale handle %" PRId64, i);
+        } else {
+            fail_if(value == NULL, "Missing handle %" PRId64, i);
+            fail_unless_equal("Value", "%" PRId64, i, *value);
+        }
+    }
+
+    /* Dense iteration should only see the odd values, and each position's
+     * handle should lead back to that position. */
+    for (i = 0; i < (int64_t) cork_slot_map_size(&map); i++) {
+        cork_slot_handle  handle = cork_slot_map_handle_at(&map, i);
+        fail_unless(cork_slot_map_at(&map, i) % 2 == 1,
+                    "Unexpected value %" PRId64, cork_slot_map_at(&map, i));
+        fail_unless(cork_slot_map_get(&map, handle) ==
+                    &cork_slot_map_at(&map, i),
+                    "Handle doesn't match position %" PRId64, i);
+    }
+
+    cork_slot_map_done(&map);
+}
+END_TEST
+
+START_TEST(test_slot_map_reuse)
+{
+    DESCRIBE_TEST;
+    cork_slot_map(int64_t)  map;
+    cork_slot_handle  old_handle;
+    cork_slot_handle  new_handle;
+    int64_t  *value;
+
+    cork_slot_map_init(&map);
+
+    /* Slots are reused, but the old handle must not see the new value. */
+    value = cork_slot_map_insert_get(&map, &old_handle);
+    *value = 1;
+    fail_unless(cork_slot_map_remove(&map, old_handle), "Cannot remove");
+    cork_slot_map_insert(&map, 2, &new_handle);
+    fail_if(old_handle == new_handle, "Handles should differ");
+    fail_unless((uint32_t) old_handle == (uint32_t) new_handle,
+                "Slot should be reused");
+    fail_unless(cork_slot_map_get(&map, old_handle) == NULL,
+                "Stale handle should be invalid");
+    fail_unless_equal("Value", "%" PRId64,
+                      2, *(int64_t *) cork_slot_map_get(&map, new_handle));
+
+    /* Clearing invalidates every handle. */
+    cork_slot_map_clear(&map);
+    fail_unless(cork_slot_map_is_empty(&map), "Slot map should be empty");
+    fail_unless(cork_slot_map_get(&map, new_handle) == NULL,
+                "Handle should be invalid after clear");
+    cork_slot_map_insert(&map, 3, &new_handle);
+    fail_unless_equal("Value", "%" PRId64,
+                      3, *(int64_t *) cork_slot_map_get(&map, new_handle));
+
+    cork_slot_map_done(&map);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Sparse sets
+ */
+
+START_TEST(test_sparse_set)
+{
+    DESCRIBE_TEST;
+    struct cork_sparse_set  *set = cork_sparse_set_new(1000);
+    uint32_t  i;
+    uint64_t  sum;
+
+    fail_unless_equal("Size", "%zu", 0, cork_sparse_set_size(set));
+    for (i = 0; i < 1000; i += 3) {
+        fail_unless(cork_sparse_set_add(set, i), "Cannot add %u", i);
+        fail_if(cork_sparse_set_add(set, i), "Added %u twice", i);
+    }
+    fail_unless_equal("Size", "%zu", 334, cork_sparse_set_size(set));
+
+    for (i = 0; i < 1000; i += 6) {
+        fail_unless(cork_sparse_set_remove(set, i), "Cannot remove %u", i);
+        fail_if(cork_sparse_set_remove(set, i), "Removed %u twice", i);
+    }
+    for (i = 0; i < 1000; i++) {
+        bool  expected = (i % 3 == 0) && (i % 6 != 0);
+        fail_unless(cork_sparse_set_contains(set, i) == expected,
+                    "Unexpected membership for %u", i);
+    }
+
+    sum = 0;
+    for (i = 0; i < cork_sparse_set_size(set); i++) {
+        sum += cork_sparse_set_at(set, i);
+    }
+    /* 3 + 9 + 15 + ... + 999 */
+    fail_unless_equal("Sum", "%" PRIu64, 83667, sum);
+
+    cork_sparse_set_clear(set);
+    fail_unless_equal("Size", "%zu", 0, cork_sparse_set_size(set));
+    fail_if(cork_sparse_set_contains(set, 3), "Set should be empty");
+    fail_unless(cork_sparse_set_add(set, 3), "Cannot add after clear");
+    fail_unless(cork_sparse_set_contains(set, 3), "Missing value");
+
+    cork_sparse_set_free(set);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("slot_map");
+
+    TCase  *tc_ds = tcase_create("slot_map");
+    tcase_add_test(tc_ds, test_slot_map_basic);
+    tcase_add_test(tc_ds, test_slot_map_reuse);
+    tcase_add_test(tc_ds, test_sparse_set);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
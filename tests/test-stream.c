@@ -0,0 +1,701 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2013, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/array.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/managed-buffer.h"
+#include "libcork/ds/stream.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+/* Appends everything it sees into a buffer. */
+struct collector {
+    struct cork_stream_consumer  parent;
+    struct cork_buffer  data;
+    size_t  chunk_count;
+    size_t  largest_chunk;
+    size_t  fail_after;
+    bool  seen_eof;
+    /* Microseconds to sleep for each chunk, to simulate a slow consumer */
+    unsigned int  delay;
+};
+
+static int
+collector__data(struct cork_stream_consumer *consumer,
+                const void *buf, size_t size, bool is_first_chunk)
+{
+    struct collector  *self =
+        cork_container_of(consumer, struct collector, parent);
+    fail_unless(is_first_chunk == (self->chunk_count == 0),
+                "Unexpected is_first_chunk");
+    fail_if(self->seen_eof, "Data after EOF");
+    fail_unless(size > 0, "Empty chunk");
+    if (self->delay > 0) {
+        usleep(self->delay);
+    }
+    cork_buffer_append(&self->data, buf, size);
+    if (size > self->largest_chunk) {
+        self->largest_chunk = size;
+    }
+    if (++self->chunk_count == self->fail_after) {
+        cork_error_set(CORK_BUILTIN_ERROR, CORK_UNKNOWN_ERROR, "Stop!");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+collector__eof(struct cork_stream_consumer *consumer)
+{
+    struct collector  *self =
+        cork_container_of(consumer, struct collector, parent);
+    self->seen_eof = true;
+    return 0;
+}
+
+static void
+collector__free(struct cork_stream_consumer *consumer)
+{
+}
+
+static void
+collector_init(struct collector *self)
+{
+    self->parent.data = collector__data;
+    self->parent.eof = collector__eof;
+    self->parent.free = collector__free;
+    cork_buffer_init(&self->data);
+    self->chunk_count = 0;
+    self->largest_chunk = 0;
+    self->fail_after = 0;
+    self->seen_eof = false;
+    self->delay = 0;
+}
+
+static void
+collector_done(struct collector *self)
+{
+    cork_buffer_done(&self->data);
+}
+
+static void
+verify_collected(struct collector *self, const void *expected, size_t size,
+                 size_t chunk_size)
+{
+    fail_unless(self->seen_eof, "Didn't see EOF");
+    fail_unless_equal("Stream size", "%zu", size, self->data.size);
+    fail_unless(size == 0 || memcmp(expected, self->data.buf, size) == 0,
+                "Stream contents don't match");
+    fail_unless(self->largest_chunk <= chunk_size, "Chunk too large");
+}
+
+/* Holds on to every chunk that it sees, and only looks at their contents
+ * once the stream is finished. */
+struct retainer {
+    struct cork_chunk_consumer  parent;
+    cork_array(struct cork_managed_buffer *)  chunks;
+    struct cork_buffer  data;
+};
+
+static int
+retainer__chunk(struct cork_chunk_consumer *consumer,
+                struct cork_managed_buffer *chunk, bool is_first_chunk)
+{
+    struct retainer  *self =
+        cork_container_of(consumer, struct retainer, parent);
+    fail_unless(is_first_chunk == cork_array_is_empty(&self->chunks),
+                "Unexpected is_first_chunk");
+    cork_array_append(&self->chunks, cork_managed_buffer_ref(chunk));
+    return 0;
+}
+
+static int
+retainer__eof(struct cork_chunk_consumer *consumer)
+{
+    struct retainer  *self =
+        cork_container_of(consumer, struct retainer, parent);
+    size_t  i;
+    for (i = 0; i < cork_array_size(&self->chunks); i++) {
+        struct cork_managed_buffer  *chunk = cork_array_at(&self->chunks, i);
+        cork_buffer_append(&self->data, chunk->buf, chunk->size);
+    }
+    return 0;
+}
+
+static void
+retainer_init(struct retainer *self)
+{
+    self->parent.chunk = retainer__chunk;
+    self->parent.eof = retainer__eof;
+    self->parent.free = NULL;
+    cork_array_init(&self->chunks);
+    cork_buffer_init(&self->data);
+}
+
+static void
+retainer_done(struct retainer *self)
+{
+    size_t  i;
+    for (i = 0; i < cork_array_size(&self->chunks); i++) {
+        cork_managed_buffer_unref(cork_array_at(&self->chunks, i));
+    }
+    cork_array_done(&self->chunks);
+    cork_buffer_done(&self->data);
+}
+
+static void
+verify_retained(struct retainer *self, const void *expected, size_t size)
+{
+    fail_unless_equal("Stream size", "%zu", size, self->data.size);
+    fail_unless(size == 0 || memcmp(expected, self->data.buf, size) == 0,
+                "Stream contents don't match");
+}
+
+/* A producer that fails after a certain number of bytes */
+struct failing_producer {
+    struct cork_stream_producer  parent;
+    size_t  remaining;
+};
+
+static ssize_t
+failing_producer__read(struct cork_stream_producer *producer,
+                       void *buf, size_t size)
+{
+    struct failing_producer  *self =
+        cork_container_of(producer, struct failing_producer, parent);
+    if (self->remaining == 0) {
+        cork_error_set(CORK_BUILTIN_ERROR, CORK_UNKNOWN_ERROR, "Broken");
+        return -1;
+    }
+    if (size > self->remaining) {
+        size = self->remaining;
+    }
+    memset(buf, 'x', size);
+    self->remaining -= size;
+    return size;
+}
+
+static void
+failing_producer_init(struct failing_producer *self, size_t remaining)
+{
+    self->parent.read = failing_producer__read;
+    self->parent.borrow = NULL;
+    self->parent.free = NULL;
+    self->remaining = remaining;
+}
+
+static char  temp_path[64];
+
+static void
+make_temp_file(const void *buf, size_t size)
+{
+    int  fd;
+    strcpy(temp_path, "/tmp/cork-stream-XXXXXX");
+    fail_if((fd = mkstemp(temp_path)) == -1, "Cannot create temporary file");
+    fail_unless(write(fd, buf, size) == (ssize_t) size, "Cannot write file");
+    close(fd);
+}
+
+static void
+make_test_data(struct cork_buffer *dest, size_t size)
+{
+    size_t  i;
+    cork_buffer_ensure_size(dest, size + 1);
+    for (i = 0; i < size; i++) {
+        ((char *) dest->buf)[i] = (char) (i * 7 + i / 251);
+    }
+    dest->size = size;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Producers
+ */
+
+START_TEST(test_buffer_producer)
+{
+    struct cork_stream_producer  *producer;
+    const void  *chunk;
+    char  buf[4];
+    DESCRIBE_TEST;
+
+    producer = cork_buffer_producer_new("abcdefghij", 10);
+    fail_unless(cork_stream_producer_can_borrow(producer), "Can't borrow");
+    fail_unless_equal("Read", "%zd",
+                      (ssize_t) 4, cork_stream_producer_read(producer, buf, 4));
+    fail_unless(memcmp(buf, "abcd", 4) == 0, "Wrong data");
+    fail_unless_equal("Borrow", "%zd", (ssize_t) 3,
+                      cork_stream_producer_borrow(producer, &chunk, 3));
+    fail_unless(memcmp(chunk, "efg", 3) == 0, "Wrong data");
+    fail_unless_equal("Read", "%zd",
+                      (ssize_t) 3, cork_stream_producer_read(producer, buf, 4));
+    fail_unless(memcmp(buf, "hij", 3) == 0, "Wrong data");
+    fail_unless_equal("Read", "%zd",
+                      (ssize_t) 0, cork_stream_producer_read(producer, buf, 4));
+    fail_unless_equal("Borrow", "%zd", (ssize_t) 0,
+                      cork_stream_producer_borrow(producer, &chunk, 3));
+    cork_stream_producer_free(producer);
+}
+END_TEST
+
+static void
+test_pump(struct cork_stream_producer *producer,
+          const void *expected, size_t size, size_t chunk_size)
+{
+    struct collector  collector;
+    collector_init(&collector);
+    fail_if_error(cork_stream_pump(producer, &collector.parent, chunk_size));
+    verify_collected(&collector, expected, size,
+                     (chunk_size == 0)? CORK_STREAM_PUMP_CHUNK_SIZE:
+                     chunk_size);
+    cork_stream_producer_free(producer);
+    collector_done(&collector);
+}
+
+START_TEST(test_file_producers)
+{
+    static const size_t  sizes[] = { 0, 1, 1000, 200000 };
+    static const size_t  chunk_sizes[] = { 0, 1, 4096, 65537 };
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    size_t  i;
+    size_t  j;
+    DESCRIBE_TEST;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        make_test_data(&data, sizes[i]);
+        make_temp_file(data.buf, data.size);
+        for (j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++) {
+            int  fd;
+            FILE  *fp;
+            struct cork_stream_producer  *producer;
+
+            if (sizes[i] > 1000 && chunk_sizes[j] == 1) {
+                continue;
+            }
+
+            fail_if((fd = open(temp_path, O_RDONLY)) == -1, "Cannot open");
+            test_pump(cork_fd_producer_new(fd),
+                      data.buf, data.size, chunk_sizes[j]);
+            close(fd);
+
+            fail_if((fp = fopen(temp_path, "rb")) == NULL, "Cannot open");
+            test_pump(cork_file_producer_new(fp),
+                      data.buf, data.size, chunk_sizes[j]);
+            fclose(fp);
+
+            fail_if_error(producer = cork_mmap_producer_new(temp_path));
+            test_pump(producer, data.buf, data.size, chunk_sizes[j]);
+
+            test_pump(cork_buffer_producer_new(data.buf, data.size),
+                      data.buf, data.size, chunk_sizes[j]);
+        }
+        unlink(temp_path);
+    }
+
+    fail_unless_error(cork_mmap_producer_new("/nonexistent/cork-stream"));
+    cork_buffer_done(&data);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Managed chunks
+ */
+
+START_TEST(test_managed_chunks)
+{
+    static const size_t  sizes[] = { 0, 1, 200000 };
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct retainer  retainer;
+    size_t  i;
+    DESCRIBE_TEST;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int  fd;
+        FILE  *fp;
+
+        make_test_data(&data, sizes[i]);
+        make_temp_file(data.buf, data.size);
+
+        retainer_init(&retainer);
+        fail_if((fd = open(temp_path, O_RDONLY)) == -1, "Cannot open");
+        fail_if_error(cork_consume_fd_chunks(&retainer.parent, fd));
+        close(fd);
+        verify_retained(&retainer, data.buf, data.size);
+        retainer_done(&retainer);
+
+        retainer_init(&retainer);
+        fail_if((fp = fopen(temp_path, "rb")) == NULL, "Cannot open");
+        fail_if_error(cork_consume_file_chunks(&retainer.parent, fp));
+        fclose(fp);
+        verify_retained(&retainer, data.buf, data.size);
+        retainer_done(&retainer);
+
+        unlink(temp_path);
+    }
+
+    cork_buffer_done(&data);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Pumps
+ */
+
+START_TEST(test_pump_errors)
+{
+    struct collector  collector;
+    struct failing_producer  failing;
+    struct cork_stream_producer  *producer;
+    DESCRIBE_TEST;
+
+    /* An error from the consumer */
+    collector_init(&collector);
+    collector.fail_after = 3;
+    producer = cork_buffer_producer_new("abcdefghij", 10);
+    fail_unless_error(cork_stream_pump(producer, &collector.parent, 2));
+    fail_if(collector.seen_eof, "Shouldn't see EOF");
+    cork_stream_producer_free(producer);
+    collector_done(&collector);
+
+    /* An error from the producer */
+    collector_init(&collector);
+    failing_producer_init(&failing, 10);
+    fail_unless(cork_stream_pump(&failing.parent, &collector.parent, 4) == -1,
+                "Expected an error");
+    fail_unless_streq("Error message", "Broken", cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    fail_if(collector.seen_eof, "Shouldn't see EOF");
+    fail_unless_equal("Stream size", "%zu", (size_t) 10, collector.data.size);
+    collector_done(&collector);
+}
+END_TEST
+
+START_TEST(test_pump_threaded)
+{
+    static const size_t  max_chunks[] = { 1, 2, 8 };
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct collector  collector;
+    struct failing_producer  failing;
+    struct cork_stream_producer  *producer;
+    size_t  i;
+    DESCRIBE_TEST;
+
+    make_test_data(&data, 100000);
+    for (i = 0; i < sizeof(max_chunks) / sizeof(max_chunks[0]); i++) {
+        collector_init(&collector);
+        producer = cork_buffer_producer_new(data.buf, data.size);
+        fail_if_error(cork_stream_pump_threaded
+                      (producer, &collector.parent, 1000, max_chunks[i]));
+        verify_collected(&collector, data.buf, data.size, 1000);
+        cork_stream_producer_free(producer);
+        collector_done(&collector);
+
+        /* A slow consumer shouldn't lose or reorder anything. */
+        collector_init(&collector);
+        collector.delay = 100;
+        producer = cork_buffer_producer_new(data.buf, data.size);
+        fail_if_error(cork_stream_pump_threaded
+                      (producer, &collector.parent, 4096, max_chunks[i]));
+        verify_collected(&collector, data.buf, data.size, 4096);
+        cork_stream_producer_free(producer);
+        collector_done(&collector);
+    }
+
+    /* An empty stream */
+    collector_init(&collector);
+    producer = cork_buffer_producer_new("", 0);
+    fail_if_error(cork_stream_pump_threaded
+                  (producer, &collector.parent, 0, 4));
+    verify_collected(&collector, "", 0, CORK_STREAM_PUMP_CHUNK_SIZE);
+    cork_stream_producer_free(producer);
+    collector_done(&collector);
+
+    /* An error from the consumer should be the one that's reported. */
+    collector_init(&collector);
+    collector.fail_after = 5;
+    producer = cork_buffer_producer_new(data.buf, data.size);
+    fail_unless(cork_stream_pump_threaded
+                (producer, &collector.parent, 100, 4) == -1,
+                "Expected an error");
+    fail_unless_streq("Error message", "Stop!", cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    fail_if(collector.seen_eof, "Shouldn't see EOF");
+    cork_stream_producer_free(producer);
+    collector_done(&collector);
+
+    /* An error from the producer */
+    collector_init(&collector);
+    failing_producer_init(&failing, 1000);
+    fail_unless_error(cork_stream_pump_threaded
+                      (&failing.parent, &collector.parent, 100, 4));
+    fail_if(collector.seen_eof, "Shouldn't see EOF");
+    fail_unless_equal("Stream size", "%zu", (size_t) 1000, collector.data.size);
+    collector_done(&collector);
+
+    cork_buffer_done(&data);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Parallel file processing
+ */
+
+struct parallel_state {
+    struct collector  *collectors;
+    size_t  range_count;
+    size_t  fail_range;
+    size_t  fail_merge;
+    struct cork_buffer  merged;
+    size_t  merge_count;
+    bool  ordered;
+};
+
+static struct cork_stream_consumer *
+parallel_new_consumer(void *user_data, size_t range_index)
+{
+    struct parallel_state  *state = user_data;
+    struct collector  *collector = &state->collectors[range_index];
+    collector_init(collector);
+    if (range_index == state->fail_range) {
+        collector->fail_after = 1;
+    }
+    return &collector->parent;
+}
+
+static int
+parallel_merge(void *user_data, size_t range_index,
+               struct cork_stream_consumer *consumer)
+{
+    struct parallel_state  *state = user_data;
+    struct collector  *collector =
+        cork_container_of(consumer, struct collector, parent);
+    fail_unless(collector == &state->collectors[range_index],
+                "Wrong consumer for range");
+    fail_unless(collector->seen_eof, "Didn't see EOF");
+    if (state->ordered) {
+        fail_unless_equal("Merge order", "%zu",
+                          state->merge_count, range_index);
+    }
+    /* Every range must start and end on a record boundary. */
+    if (collector->data.size > 0) {
+        fail_unless(((char *) collector->data.buf)[0] == 'r',
+                    "Range %zu doesn't start at a record", range_index);
+    }
+    if (++state->merge_count == state->fail_merge) {
+        cork_error_set(CORK_BUILTIN_ERROR, CORK_UNKNOWN_ERROR, "No merge");
+        return -1;
+    }
+    /* An empty range never allocates its buffer, so there's nothing to copy
+     * out of it. */
+    if (collector->data.size > 0) {
+        cork_buffer_append_copy(&state->merged, &collector->data);
+    }
+    return 0;
+}
+
+static void
+parallel_state_init(struct parallel_state *state, size_t range_count,
+                    bool ordered)
+{
+    state->collectors = cork_calloc(range_count, sizeof(struct collector));
+    state->range_count = range_count;
+    state->fail_range = SIZE_MAX;
+    state->fail_merge = 0;
+    cork_buffer_init(&state->merged);
+    state->merge_count = 0;
+    state->ordered = ordered;
+}
+
+static void
+parallel_state_done(struct parallel_state *state)
+{
+    size_t  i;
+    for (i = 0; i < state->range_count; i++) {
+        collector_done(&state->collectors[i]);
+    }
+    free(state->collectors);
+    cork_buffer_done(&state->merged);
+}
+
+static void
+test_parallel(const char *path, const struct cork_buffer *data,
+              size_t range_count, size_t thread_count, bool ordered)
+{
+    struct parallel_state  state;
+    parallel_state_init(&state, range_count, ordered);
+    fail_if_error(cork_consume_file_in_parallel
+                  (path, '\n', range_count, thread_count, ordered,
+                   &state, parallel_new_consumer, parallel_merge));
+    fail_unless_equal("Merge count", "%zu", range_count, state.merge_count);
+    fail_unless_equal("Merged size", "%zu", data->size, state.merged.size);
+    if (ordered) {
+        fail_unless(data->size == 0 ||
+                    memcmp(data->buf, state.merged.buf, data->size) == 0,
+                    "Merged contents don't match");
+    }
+    parallel_state_done(&state);
+}
+
+START_TEST(test_consume_file_in_parallel)
+{
+    static const size_t  range_counts[] = { 1, 2, 3, 16, 100 };
+    static const size_t  thread_counts[] = { 1, 4 };
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    size_t  i;
+    size_t  j;
+    DESCRIBE_TEST;
+
+    for (i = 0; i < 50000; i++) {
+        cork_buffer_append_printf(&data, "record %zu\n", i);
+    }
+    /* One record that's long enough to span several ranges */
+    cork_buffer_append(&data, "r", 1);
+    for (i = 0; i < 200000; i++) {
+        cork_buffer_append(&data, "x", 1);
+    }
+    cork_buffer_append_printf(&data, "\nrecord without a newline");
+    make_temp_file(data.buf, data.size);
+
+    for (i = 0; i < sizeof(range_counts) / sizeof(range_counts[0]); i++) {
+        for (j = 0; j < sizeof(thread_counts) / sizeof(thread_counts[0]);
+             j++) {
+            test_parallel(temp_path, &data,
+                          range_counts[i], thread_counts[j], true);
+            test_parallel(temp_path, &data,
+                          range_counts[i], thread_counts[j], false);
+        }
+    }
+    unlink(temp_path);
+
+    /* An empty file */
+    cork_buffer_clear(&data);
+    make_temp_file("", 0);
+    test_parallel(temp_path, &data, 4, 2, true);
+    unlink(temp_path);
+
+    cork_buffer_done(&data);
+}
+END_TEST
+
+START_TEST(test_consume_file_in_parallel_errors)
+{
+    struct cork_buffer  data = CORK_BUFFER_INIT();
+    struct parallel_state  state;
+    size_t  i;
+    DESCRIBE_TEST;
+
+    for (i = 0; i < 10000; i++) {
+        cork_buffer_append_printf(&data, "record %zu\n", i);
+    }
+    make_temp_file(data.buf, data.size);
+
+    /* An error from one of the range consumers */
+    parallel_state_init(&state, 8, true);
+    state.fail_range = 5;
+    fail_unless(cork_consume_file_in_parallel
+                (temp_path, '\n', 8, 4, true,
+                 &state, parallel_new_consumer, parallel_merge) == -1,
+                "Expected an error");
+    fail_unless_streq("Error message", "Stop!", cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    parallel_state_done(&state);
+
+    /* An error from the merge function */
+    parallel_state_init(&state, 8, false);
+    state.fail_merge = 3;
+    fail_unless(cork_consume_file_in_parallel
+                (temp_path, '\n', 8, 4, false,
+                 &state, parallel_new_consumer, parallel_merge) == -1,
+                "Expected an error");
+    fail_unless_streq("Error message", "No merge", cork_error_message());
+    print_expected_failure();
+    cork_error_clear();
+    parallel_state_done(&state);
+
+    unlink(temp_path);
+    cork_buffer_done(&data);
+
+    /* A missing file */
+    parallel_state_init(&state, 2, true);
+    fail_unless_error(cork_consume_file_in_parallel
+                      ("/nonexistent/cork-stream", '\n', 2, 2, true,
+                       &state, parallel_new_consumer, parallel_merge));
+    free(state.collectors);
+    cork_buffer_done(&state.merged);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("stream");
+
+    TCase  *tc_producers = tcase_create("producers");
+    tcase_add_test(tc_producers, test_buffer_producer);
+    tcase_add_test(tc_producers, test_file_producers);
+    suite_add_tcase(s, tc_producers);
+
+    TCase  *tc_chunks = tcase_create("chunks");
+    tcase_add_test(tc_chunks, test_managed_chunks);
+    suite_add_tcase(s, tc_chunks);
+
+    TCase  *tc_pumps = tcase_create("pumps");
+    tcase_add_test(tc_pumps, test_pump_errors);
+    tcase_add_test(tc_pumps, test_pump_threaded);
+    suite_add_tcase(s, tc_pumps);
+
+    TCase  *tc_parallel = tcase_create("parallel");
+    tcase_add_test(tc_parallel, test_consume_file_in_parallel);
+    tcase_add_test(tc_parallel, test_consume_file_in_parallel_errors);
+    suite_add_tcase(s, tc_parallel);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
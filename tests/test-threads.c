@@ -17,6 +17,7 @@
 
 #include "libcork/core/allocator.h"
 #include "libcork/core/types.h"
+#include "libcork/threads/atomic-stack.h"
 #include "libcork/threads/atomics.h"
 #include "libcork/threads/basics.h"
 
@@ -299,6 +300,135 @@ START_TEST(test_threads_error_01)
 END_TEST
 
 
+/*-----------------------------------------------------------------------
+ * Lock-free stacks
+ */
+
+#define ATOMIC_STACK_ITEM_COUNT  64
+#define ATOMIC_STACK_THREAD_COUNT  4
+#define ATOMIC_STACK_ITERATIONS  100000
+
+struct cork_test_stack_item {
+    struct cork_slist_item  item;
+    int  value;
+};
+
+START_TEST(test_atomic_stack_01)
+{
+    DESCRIBE_TEST;
+    struct cork_atomic_stack  stack = CORK_ATOMIC_STACK_INIT;
+    struct cork_test_stack_item  items[3];
+    struct cork_slist_item  *curr;
+    int  i;
+
+    fail_unless(cork_atomic_stack_is_empty(&stack), "Stack should be empty");
+    fail_unless(cork_atomic_stack_pop(&stack) == NULL, "Stack should be empty");
+    for (i = 0; i < 3; i++) {
+        items[i].value = i;
+        cork_atomic_stack_push(&stack, &items[i].item);
+    }
+    fail_unless(cork_atomic_stack_pop(&stack) == &items[2].item, "Wrong top");
+
+    curr = cork_atomic_stack_pop_all(&stack);
+    fail_unless(cork_atomic_stack_is_empty(&stack), "Stack should be empty");
+    for (i = 1; i >= 0; i--) {
+        fail_unless(curr == &items[i].item, "Wrong element in chain");
+        curr = curr->next;
+    }
+    fail_unless(curr == NULL, "Chain should be NULL-terminated");
+
+    /* Push the chain back in one step. */
+    items[0].item.next = &items[1].item;
+    cork_atomic_stack_push_chain(&stack, &items[0].item, &items[1].item);
+    fail_unless(cork_atomic_stack_pop(&stack) == &items[0].item, "Wrong top");
+    fail_unless(cork_atomic_stack_pop(&stack) == &items[1].item, "Wrong top");
+    fail_unless(cork_atomic_stack_pop(&stack) == NULL, "Stack should be empty");
+}
+END_TEST
+
+struct cork_test_stack_body {
+    struct cork_thread_body  parent;
+    struct cork_atomic_stack  *stack;
+};
+
+static int
+cork_test_stack_body__run(struct cork_thread_body *vself)
+{
+    struct cork_test_stack_body  *self =
+        cork_container_of(vself, struct cork_test_stack_body, parent);
+    size_t  i;
+    for (i = 0; i < ATOMIC_STACK_ITERATIONS; i++) {
+        struct cork_slist_item  *a = cork_atomic_stack_pop(self->stack);
+        struct cork_slist_item  *b = cork_atomic_stack_pop(self->stack);
+        if (a != NULL) {
+            cork_atomic_stack_push(self->stack, a);
+        }
+        if (b != NULL) {
+            cork_atomic_stack_push(self->stack, b);
+        }
+    }
+    return 0;
+}
+
+static void
+cork_test_stack_body__free(struct cork_thread_body *vself)
+{
+    struct cork_test_stack_body  *self =
+        cork_container_of(vself, struct cork_test_stack_body, parent);
+    free(self);
+}
+
+static struct cork_thread_body *
+cork_test_stack_body_new(struct cork_atomic_stack *stack)
+{
+    struct cork_test_stack_body  *self = cork_new(struct cork_test_stack_body);
+    self->parent.run = cork_test_stack_body__run;
+    self->parent.free = cork_test_stack_body__free;
+    self->stack = stack;
+    return &self->parent;
+}
+
+START_TEST(test_atomic_stack_threads)
+{
+    DESCRIBE_TEST;
+    struct cork_atomic_stack  stack;
+    struct cork_test_stack_item  items[ATOMIC_STACK_ITEM_COUNT];
+    bool  seen[ATOMIC_STACK_ITEM_COUNT];
+    struct cork_thread  *threads[ATOMIC_STACK_THREAD_COUNT];
+    struct cork_slist_item  *curr;
+    size_t  count = 0;
+    size_t  i;
+
+    cork_atomic_stack_init(&stack);
+    for (i = 0; i < ATOMIC_STACK_ITEM_COUNT; i++) {
+        items[i].value = i;
+        seen[i] = false;
+        cork_atomic_stack_push(&stack, &items[i].item);
+    }
+
+    for (i = 0; i < ATOMIC_STACK_THREAD_COUNT; i++) {
+        fail_if_error(threads[i] = cork_thread_new
+                      ("stack", cork_test_stack_body_new(&stack)));
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+    for (i = 0; i < ATOMIC_STACK_THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+    }
+
+    /* Every element should still be on the stack exactly once. */
+    for (curr = cork_atomic_stack_pop_all(&stack); curr != NULL;
+         curr = curr->next) {
+        struct cork_test_stack_item  *item =
+            cork_container_of(curr, struct cork_test_stack_item, item);
+        fail_if(seen[item->value], "Element %d appears twice", item->value);
+        seen[item->value] = true;
+        count++;
+    }
+    fail_unless_equal("Count", "%zu", ATOMIC_STACK_ITEM_COUNT, count);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -328,6 +458,11 @@ test_suite()
     tcase_add_test(tc_threads, test_threads_error_01);
     suite_add_tcase(s, tc_threads);
 
+    TCase  *tc_stack = tcase_create("atomic-stack");
+    tcase_add_test(tc_stack, test_atomic_stack_01);
+    tcase_add_test(tc_stack, test_atomic_stack_threads);
+    suite_add_tcase(s, tc_stack);
+
     return s;
 }
 